@@ -5,9 +5,9 @@
 #include "alignment_computation.hh"
 #include "hmm_forward_backward.hh"
 
-void compute_ibm1_viterbi_alignment(const Storage1D<uint>& source_sentence,
+void compute_ibm1_viterbi_alignment(const SentenceView& source_sentence,
                                     const SingleLookupTable& slookup,
-                                    const Storage1D<uint>& target_sentence,
+                                    const SentenceView& target_sentence,
                                     const SingleWordDictionary& dict,
                                     Storage1D<AlignBaseType>& viterbi_alignment) {
 
@@ -36,9 +36,9 @@ void compute_ibm1_viterbi_alignment(const Storage1D<uint>& source_sentence,
 }
 
 //posterior decoding for IBM-1
-void compute_ibm1_postdec_alignment(const Storage1D<uint>& source_sentence,
+void compute_ibm1_postdec_alignment(const SentenceView& source_sentence,
 				    const SingleLookupTable& slookup,
-				    const Storage1D<uint>& target_sentence,
+				    const SentenceView& target_sentence,
 				    const SingleWordDictionary& dict,
 				    std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
 				    double threshold) {
@@ -72,9 +72,9 @@ void compute_ibm1_postdec_alignment(const Storage1D<uint>& source_sentence,
 }
 
 
-void compute_ibm2_viterbi_alignment(const Storage1D<uint>& source_sentence,
+void compute_ibm2_viterbi_alignment(const SentenceView& source_sentence,
                                     const SingleLookupTable& slookup,
-                                    const Storage1D<uint>& target_sentence,
+                                    const SentenceView& target_sentence,
                                     const SingleWordDictionary& dict,
                                     const Math2D::Matrix<double>& align_prob,
                                     Storage1D<AlignBaseType>& viterbi_alignment) {
@@ -103,9 +103,9 @@ void compute_ibm2_viterbi_alignment(const Storage1D<uint>& source_sentence,
 
 }
 
-void compute_ibm2_postdec_alignment(const Storage1D<uint>& source_sentence,
+void compute_ibm2_postdec_alignment(const SentenceView& source_sentence,
                                     const SingleLookupTable& slookup,
-                                    const Storage1D<uint>& target_sentence,
+                                    const SentenceView& target_sentence,
                                     const SingleWordDictionary& dict,
                                     const Math2D::Matrix<double>& align_prob,
 				    std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
@@ -138,9 +138,9 @@ void compute_ibm2_postdec_alignment(const Storage1D<uint>& source_sentence,
   }
 }
 
-void compute_fullhmm_viterbi_alignment(const Storage1D<uint>& source_sentence,
+void compute_fullhmm_viterbi_alignment(const SentenceView& source_sentence,
                                        const SingleLookupTable& slookup,
-                                       const Storage1D<uint>& target_sentence,
+                                       const SentenceView& target_sentence,
                                        const SingleWordDictionary& dict,
                                        const Math2D::Matrix<double>& align_prob,
                                        Storage1D<AlignBaseType>& viterbi_alignment) {
@@ -154,9 +154,9 @@ void compute_fullhmm_viterbi_alignment(const Storage1D<uint>& source_sentence,
 }
 
 
-long double compute_ehmm_viterbi_alignment(const Storage1D<uint>& source_sentence,
+long double compute_ehmm_viterbi_alignment(const SentenceView& source_sentence,
 					   const SingleLookupTable& slookup,
-					   const Storage1D<uint>& target_sentence,
+					   const SentenceView& target_sentence,
 					   const SingleWordDictionary& dict,
 					   const Math2D::Matrix<double>& align_prob,
 					   const Math1D::Vector<double>& initial_prob,
@@ -174,9 +174,9 @@ long double compute_ehmm_viterbi_alignment(const Storage1D<uint>& source_sentenc
 }
 
 
-long double compute_ehmm_viterbi_alignment(const Storage1D<uint>& source_sentence,
+long double compute_ehmm_viterbi_alignment(const SentenceView& source_sentence,
 					   const SingleLookupTable& slookup,
-					   const Storage1D<uint>& target_sentence,
+					   const SentenceView& target_sentence,
 					   const SingleWordDictionary& dict,
 					   const Math2D::Matrix<double>& align_prob,
 					   const Math1D::Vector<double>& initial_prob,
@@ -227,27 +227,21 @@ long double compute_ehmm_viterbi_alignment(const Storage1D<uint>& source_sentenc
 
     const double null_dict_entry = std::max(min_dict_entry,dict[0][source_sentence[j]-1]);
 
+    //the transition loops run over the contiguous columns of the model.
+    // The empty words only win if they are strictly better
     for (uint i=0; i < I; i++) {
-    
-      double max_score = 0.0;
-      uint arg_max = MAX_UINT;
-      
-      for (uint i_prev = 0; i_prev < I; i_prev++) {
-        double hyp_score = prev_score[i_prev] * align_prob(i,i_prev);
-
-        if (hyp_score > max_score) {
-          max_score = hyp_score;
-          arg_max = i_prev;
-        }
-      }
-      for (uint i_prev = I; i_prev < 2*I; i_prev++) {
-        double hyp_score = prev_score[i_prev] * align_prob(i,i_prev-I);
+      cur_score[i] = 0.0;
+      traceback(i,j) = MAX_UINT;
+    }
+    hmm_max_product_columns(align_prob.direct_access(), align_prob.xDim(), prev_score.direct_access(), I,
+                            cur_score.direct_access(), &traceback(0,j), 0);
+    hmm_max_product_columns(align_prob.direct_access(), align_prob.xDim(), prev_score.direct_access() + I, I,
+                            cur_score.direct_access(), &traceback(0,j), I);
 
-        if (hyp_score > max_score) {
-          max_score = hyp_score;
-          arg_max = i_prev;
-        }
-      }
+    for (uint i=0; i < I; i++) {
+    
+      double max_score = cur_score[i];
+      uint arg_max = traceback(i,j);
 
       //       if (arg_max == MAX_UINT) {
       // 	std::cerr << "ERROR: j=" << j << ", J=" << J << ", I=" << I << std::endl;
@@ -340,9 +334,9 @@ long double compute_ehmm_viterbi_alignment(const Storage1D<uint>& source_sentenc
   return prob;
 }
 
-long double compute_sehmm_viterbi_alignment(const Storage1D<uint>& source_sentence,
+long double compute_sehmm_viterbi_alignment(const SentenceView& source_sentence,
                                             const SingleLookupTable& slookup,
-                                            const Storage1D<uint>& target_sentence,
+                                            const SentenceView& target_sentence,
                                             const SingleWordDictionary& dict,
                                             const Math2D::Matrix<double>& align_prob,
                                             const Math1D::Vector<double>& initial_prob,
@@ -390,27 +384,21 @@ long double compute_sehmm_viterbi_alignment(const Storage1D<uint>& source_senten
 
     const double null_dict_entry = std::max(min_dict_entry,dict[0][source_sentence[j]-1]);
 
+    //the transition loops run over the contiguous columns of the model.
+    // The empty words only win if they are strictly better
     for (uint i=0; i < I; i++) {
-    
-      double max_score = 0.0;
-      uint arg_max = MAX_UINT;
-      
-      for (uint i_prev = 0; i_prev < I; i_prev++) {
-        double hyp_score = prev_score[i_prev] * align_prob(i,i_prev);
-
-        if (hyp_score > max_score) {
-          max_score = hyp_score;
-          arg_max = i_prev;
-        }
-      }
-      for (uint i_prev = I; i_prev < 2*I; i_prev++) {
-        double hyp_score = prev_score[i_prev] * align_prob(i,i_prev-I);
+      cur_score[i] = 0.0;
+      traceback(i,j) = MAX_UINT;
+    }
+    hmm_max_product_columns(align_prob.direct_access(), align_prob.xDim(), prev_score.direct_access(), I,
+                            cur_score.direct_access(), &traceback(0,j), 0);
+    hmm_max_product_columns(align_prob.direct_access(), align_prob.xDim(), prev_score.direct_access() + I, I,
+                            cur_score.direct_access(), &traceback(0,j), I);
 
-        if (hyp_score > max_score) {
-          max_score = hyp_score;
-          arg_max = i_prev;
-        }
-      }
+    for (uint i=0; i < I; i++) {
+    
+      double max_score = cur_score[i];
+      uint arg_max = traceback(i,j);
       //initial empty word
       {
         double hyp_score = prev_score[2*I] * initial_prob[i];
@@ -520,9 +508,9 @@ long double compute_sehmm_viterbi_alignment(const Storage1D<uint>& source_senten
 }
 
 
-long double compute_ehmm_viterbi_alignment_with_tricks(const Storage1D<uint>& source_sentence,
+long double compute_ehmm_viterbi_alignment_with_tricks(const SentenceView& source_sentence,
 						       const SingleLookupTable& slookup,
-						       const Storage1D<uint>& target_sentence,
+						       const SentenceView& target_sentence,
 						       const SingleWordDictionary& dict,
 						       const Math2D::Matrix<double>& align_prob,
 						       const Math1D::Vector<double>& initial_prob,
@@ -721,9 +709,9 @@ long double compute_ehmm_viterbi_alignment_with_tricks(const Storage1D<uint>& so
 }
 
 
-void compute_ehmm_optmarginal_alignment(const Storage1D<uint>& source_sentence,
+void compute_ehmm_optmarginal_alignment(const SentenceView& source_sentence,
                                         const SingleLookupTable& slookup,
-                                        const Storage1D<uint>& target_sentence,
+                                        const SentenceView& target_sentence,
                                         const SingleWordDictionary& dict,
                                         const Math2D::Matrix<double>& align_prob,
                                         const Math1D::Vector<double>& initial_prob,
@@ -793,9 +781,9 @@ void compute_ehmm_optmarginal_alignment(const Storage1D<uint>& source_sentence,
 }
 
 
-void compute_ehmm_postdec_alignment(const Storage1D<uint>& source_sentence,
+void compute_ehmm_postdec_alignment(const SentenceView& source_sentence,
 				    const SingleLookupTable& slookup,
-				    const Storage1D<uint>& target_sentence,
+				    const SentenceView& target_sentence,
 				    const SingleWordDictionary& dict,
 				    const Math2D::Matrix<double>& align_prob,
 				    const Math1D::Vector<double>& initial_prob,
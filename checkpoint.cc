@@ -0,0 +1,202 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#include "checkpoint.hh"
+
+#include <cstring>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+static const char checkpoint_magic[9] = "REGALC01";
+static const size_t checkpoint_header_size = 8 + 2*sizeof(size_t);
+static const size_t checkpoint_name_length = 48;
+static const size_t checkpoint_entry_header_size = checkpoint_name_length + 2*sizeof(size_t);
+
+CheckpointWriter::CheckpointWriter(std::string filename, TrainingStage stage) : filename_(filename), nEntries_(0) {
+
+  fptr_ = fopen((filename_ + ".tmp").c_str(),"wb");
+  if (fptr_ == 0) {
+    IO_ERROR << "could not open \"" << filename_ << ".tmp\" for writing. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  //the number of entries is filled in by close()
+  const size_t counts[2] = {size_t(stage),0};
+  fwrite(checkpoint_magic,1,8,fptr_);
+  fwrite(counts,sizeof(size_t),2,fptr_);
+}
+
+CheckpointWriter::~CheckpointWriter() {
+  close();
+}
+
+void CheckpointWriter::add_array(std::string name, const void* data, size_t element_size, size_t nElements) {
+
+  assert(fptr_ != 0);
+
+  if (name.size() >= checkpoint_name_length) {
+    INTERNAL_ERROR << "checkpoint entry name \"" << name << "\" is too long. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  char padded_name[checkpoint_name_length];
+  memset(padded_name,0,checkpoint_name_length);
+  memcpy(padded_name,name.c_str(),name.size());
+
+  const size_t sizes[2] = {element_size,nElements};
+  fwrite(padded_name,1,checkpoint_name_length,fptr_);
+  fwrite(sizes,sizeof(size_t),2,fptr_);
+
+  const size_t nBytes = element_size*nElements;
+  if (nBytes > 0)
+    fwrite(data,1,nBytes,fptr_);
+
+  const char padding[8] = {0,0,0,0,0,0,0,0};
+  fwrite(padding,1,(8 - (nBytes % 8)) % 8,fptr_);
+
+  nEntries_++;
+}
+
+void CheckpointWriter::add_scalar(std::string name, double value) {
+  add_array(name,&value,sizeof(double),1);
+}
+
+void CheckpointWriter::close() {
+
+  if (fptr_ == 0)
+    return;
+
+  fseek(fptr_,8+sizeof(size_t),SEEK_SET);
+  fwrite(&nEntries_,sizeof(size_t),1,fptr_);
+
+  const bool failed = (ferror(fptr_) != 0);
+  fclose(fptr_);
+  fptr_ = 0;
+
+  if (failed || rename((filename_ + ".tmp").c_str(),filename_.c_str()) != 0) {
+    IO_ERROR << "writing the checkpoint \"" << filename_ << "\" failed. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  std::cerr << "wrote checkpoint \"" << filename_ << "\"" << std::endl;
+}
+
+Checkpoint::Checkpoint(std::string filename) : filename_(filename) {
+
+  int fd = open(filename.c_str(),O_RDONLY);
+  if (fd < 0) {
+    IO_ERROR << "could not open \"" << filename << "\". Exiting..." << std::endl;
+    exit(1);
+  }
+
+  struct stat file_stat;
+  if (fstat(fd,&file_stat) != 0 || size_t(file_stat.st_size) < checkpoint_header_size) {
+    IO_ERROR << "\"" << filename << "\" is not a checkpoint. Exiting..." << std::endl;
+    exit(1);
+  }
+  file_size_ = file_stat.st_size;
+
+  data_ = mmap(0,file_size_,PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);
+
+  if (data_ == MAP_FAILED) {
+    IO_ERROR << "could not map \"" << filename << "\" into memory. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const char* bytes = static_cast<const char*>(data_);
+
+  if (strncmp(bytes,checkpoint_magic,8) != 0) {
+    IO_ERROR << "\"" << filename << "\" is not a checkpoint. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const size_t* counts = reinterpret_cast<const size_t*>(bytes + 8);
+  if (counts[0] > size_t(StageIBM4)) {
+    IO_ERROR << "checkpoint \"" << filename << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+  stage_ = TrainingStage(counts[0]);
+  const size_t nEntries = counts[1];
+
+  size_t pos = checkpoint_header_size;
+  for (size_t k=0; k < nEntries; k++) {
+
+    if (pos + checkpoint_entry_header_size > file_size_) {
+      IO_ERROR << "checkpoint \"" << filename << "\" is truncated. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    const std::string name(bytes + pos,strnlen(bytes + pos,checkpoint_name_length));
+    const size_t* sizes = reinterpret_cast<const size_t*>(bytes + pos + checkpoint_name_length);
+
+    Entry entry;
+    entry.element_size_ = sizes[0];
+    entry.nElements_ = sizes[1];
+    entry.data_ = bytes + pos + checkpoint_entry_header_size;
+
+    if (entry.element_size_ != 0 && entry.nElements_ > std::numeric_limits<size_t>::max() / entry.element_size_) {
+      IO_ERROR << "checkpoint \"" << filename << "\" is corrupt. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    const size_t nBytes = entry.element_size_ * entry.nElements_;
+    if (nBytes > file_size_ - pos - checkpoint_entry_header_size) {
+      IO_ERROR << "checkpoint \"" << filename << "\" is truncated. Exiting..." << std::endl;
+      exit(1);
+    }
+    pos += checkpoint_entry_header_size + nBytes + (8 - (nBytes % 8)) % 8;
+
+    if (pos > file_size_) {
+      IO_ERROR << "checkpoint \"" << filename << "\" is truncated. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    entry_[name] = entry;
+  }
+}
+
+Checkpoint::~Checkpoint() {
+  munmap(data_,file_size_);
+}
+
+TrainingStage Checkpoint::stage() const {
+  return stage_;
+}
+
+bool Checkpoint::has(std::string name) const {
+  return (entry_.find(name) != entry_.end());
+}
+
+const void* Checkpoint::get_array(std::string name, size_t element_size, size_t& nElements) const {
+
+  std::map<std::string,Entry>::const_iterator it = entry_.find(name);
+
+  if (it == entry_.end()) {
+    IO_ERROR << "checkpoint \"" << filename_ << "\" has no entry \"" << name << "\". Exiting..." << std::endl;
+    exit(1);
+  }
+  if (it->second.element_size_ != element_size) {
+    IO_ERROR << "entry \"" << name << "\" of checkpoint \"" << filename_ << "\" has the wrong type. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  nElements = it->second.nElements_;
+  return it->second.data_;
+}
+
+double Checkpoint::get_scalar(std::string name) const {
+
+  size_t size;
+  const double* value = static_cast<const double*>(get_array(name,sizeof(double),size));
+
+  if (size != 1) {
+    IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  return *value;
+}
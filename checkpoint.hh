@@ -0,0 +1,282 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#ifndef CHECKPOINT_HH
+#define CHECKPOINT_HH
+
+#include "vector.hh"
+#include "matrix.hh"
+#include "tensor.hh"
+
+#include <cstdio>
+#include <map>
+
+/**** binary checkpoint format ****/
+// layout (native byte order, 64-bit sizes):
+//  - the 8 characters "REGALC01"
+//  - the completed training stage and the number of entries (size_t each)
+//  - the entries, each consisting of
+//    - the name, zero-padded to 48 characters
+//    - the size of one element and the number of elements (size_t each)
+//    - the elements, padded to a multiple of 8 bytes
+// Nested and multi-dimensional structures are stored as several entries (sizes and data).
+// All arrays are 8-byte aligned, so the file is read via a memory mapping.
+
+//the stages of the training pipeline, in the order they are run
+enum TrainingStage {StageNone, StageIBM1, StageIBM2, StageHMM, StageIBM3, StageIBM4};
+
+class CheckpointWriter {
+public:
+
+  //the file is first written under a temporary name and only renamed when complete
+  CheckpointWriter(std::string filename, TrainingStage stage);
+
+  ~CheckpointWriter();
+
+  void add_array(std::string name, const void* data, size_t element_size, size_t nElements);
+
+  void add_scalar(std::string name, double value);
+
+  template<typename T, typename ST>
+  void add_vector(std::string name, const Storage1D<T,ST>& vec);
+
+  template<typename T>
+  void add_nested(std::string name, const Storage1D<Math1D::Vector<T> >& vec);
+
+  template<typename T>
+  void add_matrix(std::string name, const Math2D::Matrix<T>& matrix);
+
+  template<typename T>
+  void add_matrix_list(std::string name, const Storage1D<Math2D::Matrix<T> >& list);
+
+  template<typename T>
+  void add_tensor(std::string name, const Math3D::Tensor<T>& tensor);
+
+  //writes the number of entries and renames the file
+  void close();
+
+protected:
+
+  std::string filename_;
+  FILE* fptr_;
+  size_t nEntries_;
+};
+
+//read-only memory mapping of a checkpoint
+class Checkpoint {
+public:
+
+  Checkpoint(std::string filename);
+
+  ~Checkpoint();
+
+  TrainingStage stage() const;
+
+  bool has(std::string name) const;
+
+  //exits if the entry does not exist or has a different element size
+  const void* get_array(std::string name, size_t element_size, size_t& nElements) const;
+
+  double get_scalar(std::string name) const;
+
+  template<typename T, typename ST>
+  void get_vector(std::string name, Storage1D<T,ST>& vec) const;
+
+  template<typename T>
+  void get_nested(std::string name, Storage1D<Math1D::Vector<T> >& vec) const;
+
+  template<typename T>
+  void get_matrix(std::string name, Math2D::Matrix<T>& matrix) const;
+
+  template<typename T>
+  void get_matrix_list(std::string name, Storage1D<Math2D::Matrix<T> >& list) const;
+
+  template<typename T>
+  void get_tensor(std::string name, Math3D::Tensor<T>& tensor) const;
+
+protected:
+
+  //not copyable
+  Checkpoint(const Checkpoint&);
+  void operator=(const Checkpoint&);
+
+  struct Entry {
+    const char* data_;
+    size_t element_size_;
+    size_t nElements_;
+  };
+
+  std::string filename_;
+
+  void* data_;
+  size_t file_size_;
+
+  TrainingStage stage_;
+  std::map<std::string,Entry> entry_;
+};
+
+/************************ implementation **************************/
+
+template<typename T, typename ST>
+void CheckpointWriter::add_vector(std::string name, const Storage1D<T,ST>& vec) {
+  add_array(name,vec.direct_access(),sizeof(T),vec.size());
+}
+
+template<typename T>
+void CheckpointWriter::add_nested(std::string name, const Storage1D<Math1D::Vector<T> >& vec) {
+
+  Math1D::Vector<size_t> size(vec.size());
+  size_t total_size = 0;
+  for (size_t k=0; k < vec.size(); k++) {
+    size[k] = vec[k].size();
+    total_size += vec[k].size();
+  }
+
+  Math1D::Vector<T> data(total_size);
+  size_t pos = 0;
+  for (size_t k=0; k < vec.size(); k++) {
+    for (size_t l=0; l < vec[k].size(); l++)
+      data[pos++] = vec[k][l];
+  }
+
+  add_vector(name + ".size",size);
+  add_vector(name + ".data",data);
+}
+
+template<typename T>
+void CheckpointWriter::add_matrix(std::string name, const Math2D::Matrix<T>& matrix) {
+
+  Math1D::Vector<size_t> dim(2);
+  dim[0] = matrix.xDim();
+  dim[1] = matrix.yDim();
+
+  add_vector(name + ".dim",dim);
+  add_array(name + ".data",matrix.direct_access(),sizeof(T),matrix.size());
+}
+
+template<typename T>
+void CheckpointWriter::add_matrix_list(std::string name, const Storage1D<Math2D::Matrix<T> >& list) {
+
+  Math1D::Vector<size_t> dim(2*list.size());
+  size_t total_size = 0;
+  for (size_t k=0; k < list.size(); k++) {
+    dim[2*k] = list[k].xDim();
+    dim[2*k+1] = list[k].yDim();
+    total_size += list[k].size();
+  }
+
+  Math1D::Vector<T> data(total_size);
+  size_t pos = 0;
+  for (size_t k=0; k < list.size(); k++) {
+    std::copy(list[k].direct_access(),list[k].direct_access()+list[k].size(),data.direct_access()+pos);
+    pos += list[k].size();
+  }
+
+  add_vector(name + ".dim",dim);
+  add_vector(name + ".data",data);
+}
+
+template<typename T>
+void CheckpointWriter::add_tensor(std::string name, const Math3D::Tensor<T>& tensor) {
+
+  Math1D::Vector<size_t> dim(3);
+  dim[0] = tensor.xDim();
+  dim[1] = tensor.yDim();
+  dim[2] = tensor.zDim();
+
+  add_vector(name + ".dim",dim);
+  add_array(name + ".data",tensor.direct_access(),sizeof(T),tensor.size());
+}
+
+template<typename T, typename ST>
+void Checkpoint::get_vector(std::string name, Storage1D<T,ST>& vec) const {
+
+  size_t size;
+  const T* data = static_cast<const T*>(get_array(name,sizeof(T),size));
+
+  vec.resize_dirty(size);
+  std::copy(data,data+size,vec.direct_access());
+}
+
+template<typename T>
+void Checkpoint::get_nested(std::string name, Storage1D<Math1D::Vector<T> >& vec) const {
+
+  size_t nEntries;
+  const size_t* size = static_cast<const size_t*>(get_array(name + ".size",sizeof(size_t),nEntries));
+  size_t total_size;
+  const T* data = static_cast<const T*>(get_array(name + ".data",sizeof(T),total_size));
+
+  vec.resize_dirty(nEntries);
+  size_t pos = 0;
+  for (size_t k=0; k < nEntries; k++) {
+    if (pos + size[k] > total_size) {
+      IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+      exit(1);
+    }
+    vec[k].resize_dirty(size[k]);
+    std::copy(data+pos,data+pos+size[k],vec[k].direct_access());
+    pos += size[k];
+  }
+}
+
+template<typename T>
+void Checkpoint::get_matrix(std::string name, Math2D::Matrix<T>& matrix) const {
+
+  size_t nDims;
+  const size_t* dim = static_cast<const size_t*>(get_array(name + ".dim",sizeof(size_t),nDims));
+  size_t size;
+  const T* data = static_cast<const T*>(get_array(name + ".data",sizeof(T),size));
+
+  if (nDims != 2 || size != dim[0]*dim[1]) {
+    IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  matrix.resize_dirty(dim[0],dim[1]);
+  std::copy(data,data+size,matrix.direct_access());
+}
+
+template<typename T>
+void Checkpoint::get_matrix_list(std::string name, Storage1D<Math2D::Matrix<T> >& list) const {
+
+  size_t nDims;
+  const size_t* dim = static_cast<const size_t*>(get_array(name + ".dim",sizeof(size_t),nDims));
+  size_t total_size;
+  const T* data = static_cast<const T*>(get_array(name + ".data",sizeof(T),total_size));
+
+  if ((nDims % 2) != 0) {
+    IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  list.resize_dirty(nDims / 2);
+  size_t pos = 0;
+  for (size_t k=0; k < list.size(); k++) {
+    const size_t size = dim[2*k]*dim[2*k+1];
+    if (pos + size > total_size) {
+      IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+      exit(1);
+    }
+    list[k].resize_dirty(dim[2*k],dim[2*k+1]);
+    std::copy(data+pos,data+pos+size,list[k].direct_access());
+    pos += size;
+  }
+}
+
+template<typename T>
+void Checkpoint::get_tensor(std::string name, Math3D::Tensor<T>& tensor) const {
+
+  size_t nDims;
+  const size_t* dim = static_cast<const size_t*>(get_array(name + ".dim",sizeof(size_t),nDims));
+  size_t size;
+  const T* data = static_cast<const T*>(get_array(name + ".data",sizeof(T),size));
+
+  if (nDims != 3 || size != dim[0]*dim[1]*dim[2]) {
+    IO_ERROR << "checkpoint \"" << filename_ << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  tensor.resize_dirty(dim[0],dim[1],dim[2]);
+  std::copy(data,data+size,tensor.direct_access());
+}
+
+#endif
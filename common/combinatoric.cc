@@ -54,3 +54,23 @@ long double ldchoose(uint n, uint k) {
 
   return r;
 }
+
+CombinatoricTable::CombinatoricTable(uint max_n) {
+  resize(max_n);
+}
+
+void CombinatoricTable::resize(uint max_n) {
+
+  fac_.resize_dirty(max_n+1);
+  log_fac_.resize_dirty(max_n+1);
+
+  //the products are formed as in ldfac, the logarithms are summed up so that they stay finite for large n
+  fac_[0] = 1.0;
+  log_fac_[0] = 0.0;
+  long double log_sum = 0.0;
+  for (uint n=1; n <= max_n; n++) {
+    fac_[n] = fac_[n-1] * n;
+    log_sum += logl((long double) n);
+    log_fac_[n] = log_sum;
+  }
+}
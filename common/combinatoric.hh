@@ -4,6 +4,7 @@
 #define COMBINATORIC_HH
 
 #include "makros.hh"
+#include "vector.hh"
 
 uint fac(uint n);
 
@@ -13,4 +14,57 @@ uint choose(uint n, uint k);
 
 long double ldchoose(uint n, uint k);
 
+/**** precomputed factorials and binomial coefficients ****/
+// The tables are filled for all n <= max_n, then all accessors take constant time.
+// Larger n are computed directly (as by ldfac and ldchoose).
+class CombinatoricTable {
+public:
+
+  CombinatoricTable(uint max_n = 0);
+
+  void resize(uint max_n);
+
+  uint max_n() const;
+
+  long double fac(uint n) const;
+
+  long double choose(uint n, uint k) const;
+
+  double log_fac(uint n) const;
+
+  double log_choose(uint n, uint k) const;
+
+protected:
+
+  Math1D::Vector<long double> fac_;
+  Math1D::Vector<double> log_fac_;
+};
+
+/************ implementation **********/
+
+inline uint CombinatoricTable::max_n() const {
+  return fac_.size() - 1;
+}
+
+inline long double CombinatoricTable::fac(uint n) const {
+  return (n < fac_.size()) ? fac_.direct_access(n) : ldfac(n);
+}
+
+inline long double CombinatoricTable::choose(uint n, uint k) const {
+
+  assert(k <= n);
+  return (n < fac_.size()) ? fac_.direct_access(n) / (fac_.direct_access(k) * fac_.direct_access(n-k)) : ldchoose(n,k);
+}
+
+inline double CombinatoricTable::log_fac(uint n) const {
+  return (n < log_fac_.size()) ? log_fac_.direct_access(n) : logl(ldfac(n));
+}
+
+inline double CombinatoricTable::log_choose(uint n, uint k) const {
+
+  assert(k <= n);
+  return (n < log_fac_.size()) ? log_fac_.direct_access(n) - log_fac_.direct_access(k) - log_fac_.direct_access(n-k)
+    : logl(ldchoose(n,k));
+}
+
 #endif
@@ -15,6 +15,7 @@ void Storage1D<uint>::operator=(const Storage1D<uint>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new uint[size_];
   }
 
@@ -31,6 +32,7 @@ void Storage1D<int>::operator=(const Storage1D<int>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new int[size_];
   }
 
@@ -46,6 +48,7 @@ void Storage1D<float>::operator=(const Storage1D<float>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new float[size_];
   }
 
@@ -61,6 +64,7 @@ void Storage1D<double>::operator=(const Storage1D<double>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new double[size_];
   }
 
@@ -76,6 +80,7 @@ void Storage1D<long double>::operator=(const Storage1D<long double>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new long double[size_];
   }
 
@@ -91,6 +96,7 @@ void Storage1D<ushort>::operator=(const Storage1D<ushort>& toCopy) {
       delete[] data_;
     
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new ushort[size_];
   }
 
@@ -103,6 +109,7 @@ template<>
 Storage1D<int>::Storage1D(const Storage1D<int>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new int[size_];
 
   memcpy(data_,toCopy.direct_access(),size_*sizeof(int));
@@ -112,6 +119,7 @@ template<>
 Storage1D<uint>::Storage1D(const Storage1D<uint>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new uint[size_];
 
   memcpy(data_,toCopy.direct_access(),size_*sizeof(uint));
@@ -121,6 +129,7 @@ template<>
 Storage1D<ushort>::Storage1D(const Storage1D<ushort>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new ushort[size_];
 
   memcpy(data_,toCopy.direct_access(),size_*sizeof(ushort));
@@ -130,6 +139,7 @@ template<>
 Storage1D<float>::Storage1D(const Storage1D<float>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new float[size_];
 
   memcpy(data_,toCopy.direct_access(),size_*sizeof(float));
@@ -139,6 +149,7 @@ template<>
 Storage1D<double>::Storage1D(const Storage1D<double>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new double[size_];
 
   memcpy(data_,toCopy.direct_access(),size_*sizeof(double));
@@ -162,6 +173,7 @@ void Storage1D<float>::resize(size_t new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -180,6 +192,7 @@ void Storage1D<double>::resize(size_t new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -198,6 +211,7 @@ void Storage1D<long double>::resize(size_t new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -216,6 +230,7 @@ void Storage1D<int>::resize(size_t new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -234,6 +249,7 @@ void Storage1D<uint>::resize(size_t new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 
@@ -261,6 +277,7 @@ void Storage1D<float>::resize(size_t new_size, float fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -286,6 +303,7 @@ void Storage1D<double>::resize(size_t new_size, double fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -310,6 +328,7 @@ void Storage1D<long double>::resize(size_t new_size, long double fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -334,6 +353,7 @@ void Storage1D<int>::resize(size_t new_size, int fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -358,6 +378,7 @@ void Storage1D<uint>::resize(size_t new_size, uint fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 
@@ -40,7 +40,7 @@ public:
   //maintains the values of exisitng positions, new ones are filled with <code> fill_value </code>
   void resize(ST new_size, T fill_value);
 
-  //all elements are undefined after this operation
+  //all elements are undefined after this operation. The memory is kept if it suffices
   void resize_dirty(ST new_size);
   
   inline ST size() const;
@@ -59,6 +59,7 @@ protected:
   
   T* data_;
   ST size_;
+  ST reserved_size_; //number of allocated elements, at least size_
   static const std::string stor1D_name_;
 };
 
@@ -184,15 +185,15 @@ template<typename T,typename ST>
 /*static*/ const std::string Storage1D<T,ST>::stor1D_name_ = "unnamed 1Dstorage";
 
 template<typename T,typename ST>
-Storage1D<T,ST>::Storage1D(): data_(0), size_(0) {}
+Storage1D<T,ST>::Storage1D(): data_(0), size_(0), reserved_size_(0) {}
 
 template<typename T,typename ST>
-Storage1D<T,ST>::Storage1D(ST size): size_(size) {
+Storage1D<T,ST>::Storage1D(ST size): size_(size), reserved_size_(size) {
   data_ = new T[size];    
 }
 
 template<typename T,typename ST>
-Storage1D<T,ST>::Storage1D(ST size, T default_value): size_(size) {
+Storage1D<T,ST>::Storage1D(ST size, T default_value): size_(size), reserved_size_(size) {
   data_ = new T[size_];    
 
   std::fill(data_, data_+size, default_value); //fill and fill_n are of equal speed
@@ -203,6 +204,7 @@ template<typename T,typename ST>
 Storage1D<T,ST>::Storage1D(const Storage1D<T,ST>& toCopy) {
 
   size_ = toCopy.size();
+  reserved_size_ = size_;
   data_ = new T[size_];
  
   const ST size = size_;
@@ -296,6 +298,7 @@ void Storage1D<T,ST>::operator=(const Storage1D<T,ST>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new T[size_];
   }
     
@@ -347,6 +350,7 @@ void Storage1D<T,ST>::resize(ST new_size) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -391,6 +395,7 @@ void Storage1D<T,ST>::resize(ST new_size, T fill_value) {
   }
 
   size_ = new_size;
+  reserved_size_ = size_;
 }
 
 template<>
@@ -414,11 +419,12 @@ void Storage1D<uint>::resize(size_t new_size, uint fill_value);
 template<typename T,typename ST>
 void Storage1D<T,ST>::resize_dirty(ST new_size) {
 
-  if (size_ != new_size) {
+  if (new_size > reserved_size_) {
     if (data_ != 0)
       delete[] data_;
 
     data_ = new T[new_size];
+    reserved_size_ = new_size;
   }
   size_ = new_size;
 }
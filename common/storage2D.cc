@@ -11,6 +11,7 @@ void Storage2D<int>::operator=(const Storage2D<int>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new int[size_];
   }
 
@@ -29,6 +30,7 @@ void Storage2D<uint>::operator=(const Storage2D<uint>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new uint[size_];
   }
 
@@ -47,6 +49,7 @@ void Storage2D<float>::operator=(const Storage2D<float>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new float[size_];
   }
 
@@ -65,6 +68,7 @@ void Storage2D<double>::operator=(const Storage2D<double>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new double[size_];
   }
 
@@ -83,6 +87,7 @@ void Storage2D<long double>::operator=(const Storage2D<long double>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new long double[size_];
   }
 
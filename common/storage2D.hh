@@ -36,7 +36,8 @@ public:
   //saves all existing entries, new positions are filled with <code> fill_value </code>
   void resize(ST newxDim, ST newyDim, T fill_value);
 
-  //all elements are uninitialized after this operation
+  //all elements are uninitialized after this operation.
+  // The memory is kept if it suffices, so buffers that are resized for every sentence are not reallocated each time
   void resize_dirty(ST newxDim, ST newyDim);
 
   void set_constant(T new_constant);
@@ -68,6 +69,7 @@ protected:
   ST xDim_;
   ST yDim_;
   ST size_;
+  size_t reserved_size_; //number of allocated elements, at least size_
   static const std::string stor2D_name_;
 };
 
@@ -109,12 +111,13 @@ template<typename T, typename ST>
 
 //constructors
 template<typename T, typename ST>
-Storage2D<T,ST>::Storage2D() : data_(0), xDim_(0), yDim_(0), size_(0) {}
+Storage2D<T,ST>::Storage2D() : data_(0), xDim_(0), yDim_(0), size_(0), reserved_size_(0) {}
 
 template<typename T, typename ST>
 Storage2D<T,ST>::Storage2D(ST xDim, ST yDim) : xDim_(xDim), yDim_(yDim) {
 
   size_ = xDim_*yDim_;
+  reserved_size_ = size_;
   data_ = new T[size_];
 }
 
@@ -122,6 +125,7 @@ template<typename T, typename ST>
 Storage2D<T,ST>::Storage2D(ST xDim, ST yDim, T default_value) : xDim_(xDim), yDim_(yDim) {
 
   size_ = xDim_*yDim_;
+  reserved_size_ = size_;
   data_ = new T[size_];
   for (ST i=0; i < size_; i++)
     data_[i] = default_value;
@@ -134,6 +138,7 @@ Storage2D<T,ST>::Storage2D(const Storage2D<T,ST>& toCopy) {
   xDim_ = toCopy.xDim();
   yDim_ = toCopy.yDim();
   size_ = toCopy.size();
+  reserved_size_ = size_;
 
   assert(size_ == xDim_*yDim_);
 
@@ -216,6 +221,7 @@ void Storage2D<T,ST>::operator=(const Storage2D<T,ST>& toCopy) {
       delete[] data_;
 
     size_ = toCopy.size();
+    reserved_size_ = size_;
     data_ = new T[size_];
   }
 
@@ -270,6 +276,7 @@ void Storage2D<T,ST>::resize(ST newxDim, ST newyDim) {
   xDim_ = newxDim;
   yDim_ = newyDim;
   size_ = xDim_*yDim_;
+  reserved_size_ = size_;
 }
 
 template <typename T, typename ST>
@@ -301,22 +308,28 @@ void Storage2D<T,ST>::resize(ST newxDim, ST newyDim, T fill_value) {
   xDim_ = newxDim;
   yDim_ = newyDim;
   size_ = xDim_*yDim_;
+  reserved_size_ = size_;
 }
 
 template<typename T, typename ST>
 void Storage2D<T,ST>::resize_dirty(ST newxDim, ST newyDim) {
 
-  if (newxDim != xDim_ || newyDim != yDim_) {
+  //the product is formed in size_t so that it cannot wrap for small types ST
+  const size_t new_size = size_t(newxDim) * size_t(newyDim);
+  assert(new_size == size_t(ST(new_size)));
+
+  if (new_size > reserved_size_) {
     if (data_ != 0) {
       delete[] data_;
     }
-  
-    xDim_ = newxDim;
-    yDim_ = newyDim;
-    size_ = xDim_*yDim_;
-    
-    data_ = new T[size_];
+
+    reserved_size_ = new_size;
+    data_ = new T[reserved_size_];
   }
+
+  xDim_ = newxDim;
+  yDim_ = newyDim;
+  size_ = xDim_*yDim_;
 }
 
 /***** implementation of NamedStorage2D ********/
@@ -0,0 +1,69 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#include "corpus.hh"
+#include "corpusio.hh"
+
+Corpus::Corpus() : mapping_(0), word_(0), nSentences_(0) {
+  offset_buffer_.push_back(0);
+  offset_ = &(offset_buffer_[0]);
+}
+
+Corpus::~Corpus() {
+  delete mapping_;
+}
+
+void Corpus::add_sentence(const std::vector<uint>& sentence) {
+
+  if (mapping_ != 0) {
+    INTERNAL_ERROR << "cannot add sentences to a mapped corpus. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  word_buffer_.insert(word_buffer_.end(),sentence.begin(),sentence.end());
+  offset_buffer_.push_back(word_buffer_.size());
+  nSentences_++;
+
+  word_ = (word_buffer_.empty()) ? 0 : &(word_buffer_[0]);
+  offset_ = &(offset_buffer_[0]);
+}
+
+void Corpus::prefetch(size_t first_s, size_t end_s) const {
+
+  if (mapping_ != 0)
+    mapping_->prefetch(first_s,end_s);
+}
+
+void Corpus::compact() {
+
+  std::vector<uint>(word_buffer_).swap(word_buffer_);
+  std::vector<size_t>(offset_buffer_).swap(offset_buffer_);
+
+  if (mapping_ == 0) {
+    word_ = (word_buffer_.empty()) ? 0 : &(word_buffer_[0]);
+    offset_ = &(offset_buffer_[0]);
+  }
+}
+
+void Corpus::set_mapping(MappedCorpus* mapping) {
+
+  clear();
+  std::vector<size_t>().swap(offset_buffer_);
+
+  mapping_ = mapping;
+  word_ = mapping_->words();
+  offset_ = mapping_->offsets();
+  nSentences_ = mapping_->nSentences();
+}
+
+void Corpus::clear() {
+
+  delete mapping_;
+  mapping_ = 0;
+
+  std::vector<uint>().swap(word_buffer_);
+  offset_buffer_.assign(1,0);
+
+  word_ = 0;
+  offset_ = &(offset_buffer_[0]);
+  nSentences_ = 0;
+}
@@ -0,0 +1,131 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#ifndef CORPUS_HH
+#define CORPUS_HH
+
+#include "storage1D.hh"
+#include <vector>
+
+class MappedCorpus;
+
+//read-only view of a single sentence, does not own the words
+class SentenceView {
+public:
+
+  SentenceView();
+
+  SentenceView(const uint* word, size_t size);
+
+  //allows to pass sentences that are not part of a Corpus
+  SentenceView(const Storage1D<uint>& sentence);
+
+  size_t size() const;
+
+  const uint& operator[](size_t k) const;
+
+  const uint* direct_access() const;
+
+protected:
+
+  const uint* word_;
+  size_t size_;
+};
+
+//all sentences of one side of a corpus in compressed sparse row layout:
+// a single array with the words of all sentences and an array of start offsets.
+//The words are either held in memory or taken directly from a mapped binary corpus file
+class Corpus {
+public:
+
+  Corpus();
+
+  ~Corpus();
+
+  //number of sentences
+  size_t size() const;
+
+  size_t nWords() const;
+
+  SentenceView operator[](size_t s) const;
+
+  void add_sentence(const std::vector<uint>& sentence);
+
+  //for a mapped corpus the reading of the sentences [first_s,end_s) is started in the background,
+  // otherwise nothing happens
+  void prefetch(size_t first_s, size_t end_s) const;
+
+  //releases unused capacity after the last call to add_sentence
+  void compact();
+
+  //takes ownership of the mapping, all previous sentences are discarded
+  void set_mapping(MappedCorpus* mapping);
+
+  void clear();
+
+protected:
+
+  //not copyable
+  Corpus(const Corpus&);
+  void operator=(const Corpus&);
+
+  std::vector<uint> word_buffer_;
+  std::vector<size_t> offset_buffer_;
+
+  MappedCorpus* mapping_;
+
+  //point either into the buffers or into the mapping
+  const uint* word_;
+  const size_t* offset_;
+  size_t nSentences_;
+};
+
+/************************ implementation **************************/
+
+inline SentenceView::SentenceView() : word_(0), size_(0) {}
+
+inline SentenceView::SentenceView(const uint* word, size_t size) : word_(word), size_(size) {}
+
+inline SentenceView::SentenceView(const Storage1D<uint>& sentence)
+  : word_(sentence.direct_access()), size_(sentence.size()) {}
+
+inline size_t SentenceView::size() const {
+  return size_;
+}
+
+inline const uint& SentenceView::operator[](size_t k) const {
+#ifdef SAFE_MODE
+  if (k >= size_) {
+    INTERNAL_ERROR << "    invalid const access on element " << k
+                   << " of sentence view:" << std::endl
+                   << "     sentence has only " << size_ << " words." << std::endl;
+    exit(1);
+  }
+#endif
+  return word_[k];
+}
+
+inline const uint* SentenceView::direct_access() const {
+  return word_;
+}
+
+inline size_t Corpus::size() const {
+  return nSentences_;
+}
+
+inline size_t Corpus::nWords() const {
+  return offset_[nSentences_];
+}
+
+inline SentenceView Corpus::operator[](size_t s) const {
+#ifdef SAFE_MODE
+  if (s >= nSentences_) {
+    INTERNAL_ERROR << "    invalid const access on sentence " << s
+                   << " of corpus:" << std::endl
+                   << "     corpus has only " << nSentences_ << " sentences." << std::endl;
+    exit(1);
+  }
+#endif
+  return SentenceView(word_ + offset_[s], offset_[s+1] - offset_[s]);
+}
+
+#endif
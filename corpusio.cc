@@ -5,6 +5,13 @@
 #include "corpusio.hh"
 #include "stringprocessing.hh"
 #include <fstream>
+#include <cstring>
+#include <limits>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #ifdef HAS_GZSTREAM
 #include "gzstream.h"
@@ -41,6 +48,19 @@ void read_vocabulary(std::string filename, std::vector<std::string>& voc_list) {
 
 void read_monolingual_corpus(std::string filename, Storage1D<Storage1D<uint> > & sentence_list) {
 
+  if (is_binary_corpus_file(filename)) {
+
+    MappedCorpus corpus(filename);
+
+    sentence_list.resize_dirty(corpus.nSentences());
+    for (size_t s=0; s < corpus.nSentences(); s++) {
+      const size_t curJ = corpus.sentence_length(s);
+      sentence_list[s].resize_dirty(curJ);
+      memcpy(sentence_list[s].direct_access(),corpus.sentence(s),curJ*sizeof(uint));
+    }
+    return;
+  }
+
   bool zipped = is_gzip_file(filename);
 
 #ifdef HAS_GZSTREAM
@@ -100,6 +120,67 @@ void read_monolingual_corpus(std::string filename, Storage1D<Storage1D<uint> > &
   }
 }
 
+void read_monolingual_corpus(std::string filename, Corpus& corpus) {
+
+  if (is_binary_corpus_file(filename)) {
+    corpus.set_mapping(new MappedCorpus(filename));
+    return;
+  }
+
+  bool zipped = is_gzip_file(filename);
+
+#ifdef HAS_GZSTREAM
+  std::ifstream infile;
+  igzstream gzin;
+
+  if (zipped)
+    gzin.open(filename.c_str());
+  else {
+    infile.open(filename.c_str());
+  }
+
+  std::istream* instream = (zipped) ? static_cast<std::istream*>(&gzin) : &infile;
+#else
+
+  if (zipped) {
+    INTERNAL_ERROR << "zipped file input, but support for gz is not enabled" << std::endl;
+    exit(1);
+  }
+
+  std::ifstream infile(filename.c_str());
+
+  std::istream* instream = &infile;
+#endif
+
+  corpus.clear();
+
+  char cline[65536];
+  std::string line;
+
+  std::vector<std::string> tokens;
+  std::vector<uint> cur_line;
+
+  while(instream->getline(cline,65536)) {
+
+    line = cline;
+    tokenize(line,tokens,' ');
+
+    cur_line.clear();
+    for (uint k=0; k < tokens.size(); k++) {
+      if (tokens[k].size() > 3 && tokens[k].substr(0,3) == "OOV") {
+        TODO("handling of OOVs");
+      }
+      else {
+        cur_line.push_back(convert<uint>(tokens[k]));
+      }
+    }
+
+    corpus.add_sentence(cur_line);
+  }
+
+  corpus.compact();
+}
+
 void read_monolingual_corpus(std::string filename, Storage1D<Storage1D<std::string> > & sentence_list) {
 
 
@@ -337,3 +418,192 @@ void read_word_classes(std::string filename, Storage1D<WordClassType>& word_clas
   }
 
 }
+
+
+/**** binary corpus format ****/
+
+static const char binary_corpus_magic[9] = "REGALB01";
+static const size_t binary_corpus_header_size = 8 + 2*sizeof(size_t);
+
+bool is_binary_corpus_file(std::string filename) {
+
+  FILE* fptr = fopen(filename.c_str(),"rb");
+  if (fptr == 0)
+    return false;
+
+  char start[8];
+  const size_t nRead = fread(start,1,8,fptr);
+  fclose(fptr);
+
+  return (nRead == 8 && strncmp(start,binary_corpus_magic,8) == 0);
+}
+
+BinaryCorpusWriter::BinaryCorpusWriter(std::string filename) {
+
+  fptr_ = fopen(filename.c_str(),"wb");
+  if (fptr_ == 0) {
+    IO_ERROR << "could not open \"" << filename << "\" for writing. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  //the counts are filled in by close()
+  const size_t zero[2] = {0,0};
+  fwrite(binary_corpus_magic,1,8,fptr_);
+  fwrite(zero,sizeof(size_t),2,fptr_);
+
+  offset_.push_back(0);
+}
+
+BinaryCorpusWriter::~BinaryCorpusWriter() {
+  close();
+}
+
+void BinaryCorpusWriter::add_sentence(const std::vector<uint>& sentence) {
+
+  assert(fptr_ != 0);
+
+  if (!sentence.empty())
+    fwrite(&(sentence[0]),sizeof(uint),sentence.size(),fptr_);
+  offset_.push_back(offset_.back() + sentence.size());
+}
+
+void BinaryCorpusWriter::close() {
+
+  if (fptr_ == 0)
+    return;
+
+  const size_t counts[2] = {offset_.size()-1, offset_.back()};
+
+  //align the offsets
+  const size_t word_bytes = counts[1] * sizeof(uint);
+  const size_t nPadding = (8 - (word_bytes % 8)) % 8;
+  const char padding[8] = {0,0,0,0,0,0,0,0};
+  fwrite(padding,1,nPadding,fptr_);
+
+  fwrite(&(offset_[0]),sizeof(size_t),offset_.size(),fptr_);
+
+  fseek(fptr_,8,SEEK_SET);
+  fwrite(counts,sizeof(size_t),2,fptr_);
+
+  if (ferror(fptr_)) {
+    IO_ERROR << "writing the binary corpus failed. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  fclose(fptr_);
+  fptr_ = 0;
+}
+
+MappedCorpus::MappedCorpus(std::string filename) {
+
+  int fd = open(filename.c_str(),O_RDONLY);
+  if (fd < 0) {
+    IO_ERROR << "could not open \"" << filename << "\". Exiting..." << std::endl;
+    exit(1);
+  }
+
+  struct stat file_stat;
+  if (fstat(fd,&file_stat) != 0 || size_t(file_stat.st_size) < binary_corpus_header_size) {
+    IO_ERROR << "\"" << filename << "\" is not a binary corpus. Exiting..." << std::endl;
+    exit(1);
+  }
+  file_size_ = file_stat.st_size;
+
+  data_ = mmap(0,file_size_,PROT_READ,MAP_SHARED,fd,0);
+  ::close(fd);
+
+  if (data_ == MAP_FAILED) {
+    IO_ERROR << "could not map \"" << filename << "\" into memory. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const char* bytes = static_cast<const char*>(data_);
+
+  if (strncmp(bytes,binary_corpus_magic,8) != 0) {
+    IO_ERROR << "\"" << filename << "\" is not a binary corpus. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const size_t* counts = reinterpret_cast<const size_t*>(bytes + 8);
+  nSentences_ = counts[0];
+  nWords_ = counts[1];
+
+  //the counts are checked before they are multiplied, so that a corrupt header cannot wrap the sizes
+  if (nWords_ > (file_size_ - binary_corpus_header_size) / sizeof(uint)
+      || nSentences_ >= std::numeric_limits<size_t>::max() / sizeof(size_t)) {
+    IO_ERROR << "binary corpus \"" << filename << "\" is truncated or corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const size_t word_bytes = nWords_ * sizeof(uint);
+  const size_t offset_pos = binary_corpus_header_size + word_bytes + (8 - (word_bytes % 8)) % 8;
+
+  if (file_size_ < offset_pos || file_size_ - offset_pos != (nSentences_+1)*sizeof(size_t)) {
+    IO_ERROR << "binary corpus \"" << filename << "\" is truncated or corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  word_ = reinterpret_cast<const uint*>(bytes + binary_corpus_header_size);
+  offset_ = reinterpret_cast<const size_t*>(bytes + offset_pos);
+
+  //the offsets have to run monotonically from 0 to the number of words, otherwise the sentences leave the mapping
+  bool valid = (offset_[0] == 0 && offset_[nSentences_] == nWords_);
+  for (size_t s=0; valid && s < nSentences_; s++)
+    valid = (offset_[s] <= offset_[s+1]);
+
+  if (!valid) {
+    IO_ERROR << "binary corpus \"" << filename << "\" is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+}
+
+MappedCorpus::~MappedCorpus() {
+  munmap(data_,file_size_);
+}
+
+size_t MappedCorpus::nSentences() const {
+  return nSentences_;
+}
+
+size_t MappedCorpus::nWords() const {
+  return nWords_;
+}
+
+size_t MappedCorpus::sentence_length(size_t s) const {
+  assert(s < nSentences_);
+  return offset_[s+1] - offset_[s];
+}
+
+const uint* MappedCorpus::sentence(size_t s) const {
+  assert(s < nSentences_);
+  return word_ + offset_[s];
+}
+
+const uint* MappedCorpus::words() const {
+  return word_;
+}
+
+const size_t* MappedCorpus::offsets() const {
+  return offset_;
+}
+
+//madvise needs a page-aligned start address
+static void advise_willneed(const void* begin, const void* end) {
+
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+
+  const size_t first = reinterpret_cast<size_t>(begin) & ~(page_size-1);
+  const size_t last = reinterpret_cast<size_t>(end);
+  if (last > first)
+    madvise(reinterpret_cast<void*>(first),last-first,MADV_WILLNEED);
+}
+
+void MappedCorpus::prefetch(size_t first_s, size_t end_s) const {
+
+  end_s = std::min(end_s,nSentences_);
+  if (first_s >= end_s)
+    return;
+
+  advise_willneed(offset_ + first_s, offset_ + end_s + 1);
+  advise_willneed(word_ + offset_[first_s], word_ + offset_[end_s]);
+}
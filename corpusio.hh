@@ -8,12 +8,18 @@
 #include <vector>
 #include <set>
 #include "mttypes.hh"
+#include "corpus.hh"
 #include <iostream>
+#include <cstdio>
 
 void read_vocabulary(std::string filename, std::vector<std::string>& voc_list);
 
+//reads text files with word indices as well as binary corpus files (see below)
 void read_monolingual_corpus(std::string filename, Storage1D<Storage1D<uint> > & sentence_list);
 
+//binary corpus files are mapped into memory, not copied
+void read_monolingual_corpus(std::string filename, Corpus& corpus);
+
 void read_monolingual_corpus(std::string filename, Storage1D<Storage1D<std::string> > & sentence_list);
 
 //returns true if the file contained another line
@@ -25,4 +31,77 @@ void read_prior_dict(std::string filename, std::set<std::pair<uint, uint> >& kno
 
 void read_word_classes(std::string filename, Storage1D<WordClassType>& word_class);
 
+
+/**** binary corpus format ****/
+// layout (native byte order, 64-bit offsets):
+//  - the 8 characters "REGALB01"
+//  - number of sentences S and total number of words N (size_t each)
+//  - the word indices of all sentences, N entries of type uint
+//  - padding to a multiple of 8 bytes
+//  - S+1 start offsets into the word array (size_t), the last one equals N
+// Such files are mapped into memory instead of being parsed.
+
+bool is_binary_corpus_file(std::string filename);
+
+//writes a binary corpus sentence by sentence
+class BinaryCorpusWriter {
+public:
+
+  BinaryCorpusWriter(std::string filename);
+
+  ~BinaryCorpusWriter();
+
+  void add_sentence(const std::vector<uint>& sentence);
+
+  //writes the offsets and completes the header
+  void close();
+
+protected:
+
+  FILE* fptr_;
+  std::vector<size_t> offset_;
+};
+
+//read-only memory mapping of a binary corpus file
+class MappedCorpus {
+public:
+
+  MappedCorpus(std::string filename);
+
+  ~MappedCorpus();
+
+  size_t nSentences() const;
+
+  size_t nWords() const;
+
+  size_t sentence_length(size_t s) const;
+
+  //pointer to the first word of sentence s
+  const uint* sentence(size_t s) const;
+
+  //the word array of all sentences
+  const uint* words() const;
+
+  //the nSentences()+1 start offsets into words()
+  const size_t* offsets() const;
+
+  //asks the kernel to start reading the pages of the sentences [first_s,end_s), returns immediately
+  void prefetch(size_t first_s, size_t end_s) const;
+
+protected:
+
+  //not copyable
+  MappedCorpus(const MappedCorpus&);
+  void operator=(const MappedCorpus&);
+
+  void* data_;
+  size_t file_size_;
+
+  size_t nSentences_;
+  size_t nWords_;
+
+  const uint* word_;
+  const size_t* offset_;
+};
+
 #endif
@@ -6,125 +6,156 @@
 
 #include "mttypes.hh"
 #include "matrix.hh"
+#include "hmm_kernels.hh"
 
+//prev_sum_buffer can be passed to reuse a buffer over the sentences, otherwise a local one is allocated
 template<typename T>
-void calculate_hmm_forward(const Storage1D<uint>& source_sentence,
-                           const Storage1D<uint>& target_sentence,
+void calculate_hmm_forward(const SentenceView& source_sentence,
+                           const SentenceView& target_sentence,
                            const SingleLookupTable& slookup,
                            const SingleWordDictionary& dict,
                            const Math2D::Matrix<double>& align_model,
                            const Math1D::Vector<double>& start_prob,
                            const HmmAlignProbType align_type,
-                           Math2D::Matrix<T>& forward);
+                           Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale = 0,
+                           Math1D::Vector<T>* prev_sum_buffer = 0);
 
 
 template<typename T>
-void calculate_hmm_forward(const Storage1D<uint>& source_sentence,
-                           const Storage1D<uint>& target_sentence,
+void calculate_hmm_forward(const SentenceView& source_sentence,
+                           const SentenceView& target_sentence,
                            const SingleLookupTable& slookup,
                            const SingleWordDictionary& dict,
                            const Math2D::Matrix<double>& align_model,
                            const Math1D::Vector<double>& start_prob,
-                           Math2D::Matrix<T>& forward);
+                           Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale = 0,
+                           Math1D::Vector<T>* prev_sum_buffer = 0);
 
 
 /** this exploits the special structure of reduced parametric models. 
     Make sure that you are using such a model **/
 template<typename T>
-void calculate_hmm_forward_with_tricks(const Storage1D<uint>& source_sentence,
-				       const Storage1D<uint>& target_sentence,
+void calculate_hmm_forward_with_tricks(const SentenceView& source_sentence,
+				       const SentenceView& target_sentence,
 				       const SingleLookupTable& slookup,
 				       const SingleWordDictionary& dict,
 				       const Math2D::Matrix<double>& align_model,
 				       const Math1D::Vector<double>& start_prob,
-				       Math2D::Matrix<T>& forward);
+				       Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale = 0);
 
 
 template<typename T>
-void calculate_sehmm_forward(const Storage1D<uint>& source_sentence,
-                             const Storage1D<uint>& target_sentence,
+void calculate_sehmm_forward(const SentenceView& source_sentence,
+                             const SentenceView& target_sentence,
                              const SingleLookupTable& slookup,
                              const SingleWordDictionary& dict,
                              const Math2D::Matrix<double>& align_model,
                              const Math1D::Vector<double>& start_prob,
-                             Math2D::Matrix<T>& forward);
+                             Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale = 0,
+                             Math1D::Vector<T>* prev_sum_buffer = 0);
 
 
 template<typename T>
-void calculate_hmm_backward(const Storage1D<uint>& source_sentence,
-                            const Storage1D<uint>& target_sentence,
+void calculate_hmm_backward(const SentenceView& source_sentence,
+                            const SentenceView& target_sentence,
                             const SingleLookupTable& slookup,
                             const SingleWordDictionary& dict,
                             const Math2D::Matrix<double>& align_model,
                             const Math1D::Vector<double>& start_prob,
                             const HmmAlignProbType align_type,
                             Math2D::Matrix<T>& backward,
-                            bool include_start_alignment = true);
+                            bool include_start_alignment = true,
+                            Math1D::Vector<double>* log_scale = 0);
 
 
 
 template<typename T>
-void calculate_hmm_backward(const Storage1D<uint>& source_sentence,
-                            const Storage1D<uint>& target_sentence,
+void calculate_hmm_backward(const SentenceView& source_sentence,
+                            const SentenceView& target_sentence,
                             const SingleLookupTable& slookup,
                             const SingleWordDictionary& dict,
                             const Math2D::Matrix<double>& align_model,
                             const Math1D::Vector<double>& start_prob,
                             Math2D::Matrix<T>& backward,
-                            bool include_start_alignment = true);
+                            bool include_start_alignment = true,
+                            Math1D::Vector<double>* log_scale = 0);
 
 
 template<typename T>
-void calculate_sehmm_backward(const Storage1D<uint>& source_sentence,
-                              const Storage1D<uint>& target_sentence,
+void calculate_sehmm_backward(const SentenceView& source_sentence,
+                              const SentenceView& target_sentence,
                               const SingleLookupTable& slookup,
                               const SingleWordDictionary& dict,
                               const Math2D::Matrix<double>& align_model,
                               const Math1D::Vector<double>& start_prob,
                               Math2D::Matrix<T>& backward,
-                              bool include_start_alignment = true);
+                              bool include_start_alignment = true,
+                              Math1D::Vector<double>* log_scale = 0);
 
 
 template<typename T>
-void calculate_hmm_backward_with_tricks(const Storage1D<uint>& source_sentence,
-					const Storage1D<uint>& target_sentence,
+void calculate_hmm_backward_with_tricks(const SentenceView& source_sentence,
+					const SentenceView& target_sentence,
 					const SingleLookupTable& slookup,
 					const SingleWordDictionary& dict,
 					const Math2D::Matrix<double>& align_model,
 					const Math1D::Vector<double>& start_prob,
 					Math2D::Matrix<T>& backward,
-					bool include_start_alignment = true);
+					bool include_start_alignment = true,
+					Math1D::Vector<double>* log_scale = 0);
 
 
 /************ implementation **********/
 
+//divides the first nRows entries of column j by their maximum and returns the logarithm of the maximum.
+// This is used to keep the tables in the range of doubles
 template<typename T>
-void calculate_hmm_forward(const Storage1D<uint>& source_sentence,
-                           const Storage1D<uint>& target_sentence,
+inline double rescale_hmm_column(Math2D::Matrix<T>& table, uint j, uint nRows) {
+
+  T max_entry = 0.0;
+  for (uint i=0; i < nRows; i++)
+    max_entry = std::max(max_entry,table(i,j));
+
+  if (!(max_entry > 0.0))
+    return 0.0;
+
+  const T inv_max = 1.0 / max_entry;
+  for (uint i=0; i < nRows; i++)
+    table(i,j) *= inv_max;
+
+  return std::log(max_entry);
+}
+
+template<typename T>
+void calculate_hmm_forward(const SentenceView& source_sentence,
+                           const SentenceView& target_sentence,
                            const SingleLookupTable& slookup,
                            const SingleWordDictionary& dict,
                            const Math2D::Matrix<double>& align_model,
                            const Math1D::Vector<double>& start_prob,
                            const HmmAlignProbType align_type,
-                           Math2D::Matrix<T>& forward) {
+                           Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale,
+                           Math1D::Vector<T>* prev_sum_buffer) {
 
 
   if (align_type == HmmAlignProbReducedpar)
     calculate_hmm_forward_with_tricks(source_sentence, target_sentence, slookup, dict, align_model,
-                                      start_prob, forward);
+                                      start_prob, forward, log_scale);
   else
-    calculate_hmm_forward(source_sentence, target_sentence, slookup, dict, align_model, start_prob, forward);
+    calculate_hmm_forward(source_sentence, target_sentence, slookup, dict, align_model, start_prob, forward, log_scale,
+                          prev_sum_buffer);
 }
 
 
 template<typename T>
-void calculate_hmm_forward(const Storage1D<uint>& source,
-                           const Storage1D<uint>& target,
+void calculate_hmm_forward(const SentenceView& source,
+                           const SentenceView& target,
                            const SingleLookupTable& slookup,
                            const SingleWordDictionary& dict,
                            const Math2D::Matrix<double>& align_model,
                            const Math1D::Vector<double>& start_prob,
-                           Math2D::Matrix<T>& forward) {
+                           Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale,
+                           Math1D::Vector<T>* prev_sum_buffer) {
 
   const uint I = target.size();
   const uint J = source.size();
@@ -143,19 +174,28 @@ void calculate_hmm_forward(const Storage1D<uint>& source,
     forward(i,0) = start_align_prob * dict[0][start_s_idx-1];
   }
   
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[0] = rescale_hmm_column(forward,0,2*I);
+  }
+
+  Math1D::Vector<T> local_prev_sum;
+  Math1D::Vector<T>& prev_sum = (prev_sum_buffer != 0) ? *prev_sum_buffer : local_prev_sum;
+  prev_sum.resize_dirty(I);
+
   for (uint j=1; j < J; j++) {
     const uint j_prev = j-1;
     const uint s_idx = source[j];
-    
-    for (uint i=0; i < I; i++) {
-      
-      T sum = 0.0;
 
-      for (uint i_prev=0; i_prev < I; i_prev++)
-        sum += align_model(i,i_prev) * (forward(i_prev,j_prev) + forward(i_prev+I,j_prev));
+    for (uint i_prev=0; i_prev < I; i_prev++)
+      prev_sum[i_prev] = forward(i_prev,j_prev) + forward(i_prev+I,j_prev);
+    
+    //the transition loop runs over the contiguous columns of the model
+    T* cur_forward = forward.direct_access() + j*forward.xDim();
+    hmm_sum_product_columns(align_model.direct_access(), align_model.xDim(), prev_sum.direct_access(), I, cur_forward);
 
-      forward(i,j) = sum * dict[target[i]][slookup(j,i)];
-    }
+    for (uint i=0; i < I; i++)
+      cur_forward[i] *= dict[target[i]][slookup(j,i)];
     
     T cur_emptyword_prob = dict[0][s_idx-1];
     
@@ -165,22 +205,26 @@ void calculate_hmm_forward(const Storage1D<uint>& source,
 
       forward(i,j) = sum * cur_emptyword_prob;
     }
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j-1] + rescale_hmm_column(forward,j,2*I);
   }
 }
 
 template<typename T>
-void calculate_sehmm_forward(const Storage1D<uint>& source,
-                             const Storage1D<uint>& target,
+void calculate_sehmm_forward(const SentenceView& source,
+                             const SentenceView& target,
                              const SingleLookupTable& slookup,
                              const SingleWordDictionary& dict,
                              const Math2D::Matrix<double>& align_model,
                              const Math1D::Vector<double>& start_prob,
-                             Math2D::Matrix<T>& forward) {
+                             Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale,
+                             Math1D::Vector<T>* prev_sum_buffer) {
 
   const uint I = target.size();
   const uint J = source.size();
 
-  forward.resize(2*I+1,J);
+  forward.resize_dirty(2*I+1,J);
 
   const uint start_s_idx = source[0];
   for (uint i=0; i < I; i++) {
@@ -194,20 +238,29 @@ void calculate_sehmm_forward(const Storage1D<uint>& source,
   //initial empty word
   forward(2*I,0) = start_prob[I] * dict[0][start_s_idx-1];
   
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[0] = rescale_hmm_column(forward,0,2*I+1);
+  }
+
+  Math1D::Vector<T> local_prev_sum;
+  Math1D::Vector<T>& prev_sum = (prev_sum_buffer != 0) ? *prev_sum_buffer : local_prev_sum;
+  prev_sum.resize_dirty(I);
+
   for (uint j=1; j < J; j++) {
     const uint j_prev = j-1;
     const uint s_idx = source[j];
 
-    for (uint i=0; i < I; i++) {
-      
-      T sum = 0.0;
+    for (uint i_prev=0; i_prev < I; i_prev++)
+      prev_sum[i_prev] = forward(i_prev,j_prev) + forward(i_prev+I,j_prev);
 
-      for (uint i_prev=0; i_prev < I; i_prev++)
-        sum += align_model(i,i_prev) * (forward(i_prev,j_prev) + forward(i_prev+I,j_prev));
+    //the transition loop runs over the contiguous columns of the model
+    T* cur_forward = forward.direct_access() + j*forward.xDim();
+    hmm_sum_product_columns(align_model.direct_access(), align_model.xDim(), prev_sum.direct_access(), I, cur_forward);
 
-      sum += forward(2*I,j_prev) * start_prob[i];
+    for (uint i=0; i < I; i++) {
 
-      forward(i,j) = sum * dict[target[i]][slookup(j,i)];
+      cur_forward[i] = (cur_forward[i] + forward(2*I,j_prev) * start_prob[i]) * dict[target[i]][slookup(j,i)];
 
       assert(!isnan(forward(i,j)));
     }
@@ -223,19 +276,22 @@ void calculate_sehmm_forward(const Storage1D<uint>& source,
 
     //initial empty word
     forward(2*I,j) = forward(2*I,j_prev) * start_prob[I] * cur_emptyword_prob;
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j-1] + rescale_hmm_column(forward,j,2*I+1);
   }  
 
 }
 
 
 template<typename T>
-void calculate_hmm_forward_with_tricks(const Storage1D<uint>& source,
-				       const Storage1D<uint>& target,
+void calculate_hmm_forward_with_tricks(const SentenceView& source,
+				       const SentenceView& target,
 				       const SingleLookupTable& slookup,
 				       const SingleWordDictionary& dict,
 				       const Math2D::Matrix<double>& align_model,
 				       const Math1D::Vector<double>& start_prob,
-				       Math2D::Matrix<T>& forward) {
+				       Math2D::Matrix<T>& forward, Math1D::Vector<double>* log_scale) {
 
   const int I = target.size();
   const int J = source.size();
@@ -254,6 +310,11 @@ void calculate_hmm_forward_with_tricks(const Storage1D<uint>& source,
     forward(i,0) = start_align_prob * dict[0][start_s_idx-1];
   }
   
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[0] = rescale_hmm_column(forward,0,2*I);
+  }
+
   Math1D::Vector<double> long_dist_align_prob(I,0.0);
   for (int i=0; i < I; i++) {
 
@@ -344,40 +405,45 @@ void calculate_hmm_forward_with_tricks(const Storage1D<uint>& source,
 
       forward(i,j) = sum * cur_emptyword_prob;
     }
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j-1] + rescale_hmm_column(forward,j,2*I);
   }
 }
 
 
 
 template<typename T>
-void calculate_hmm_backward(const Storage1D<uint>& source_sentence,
-                            const Storage1D<uint>& target_sentence,
+void calculate_hmm_backward(const SentenceView& source_sentence,
+                            const SentenceView& target_sentence,
                             const SingleLookupTable& slookup,
                             const SingleWordDictionary& dict,
                             const Math2D::Matrix<double>& align_model,
                             const Math1D::Vector<double>& start_prob,
                             const HmmAlignProbType align_type,
                             Math2D::Matrix<T>& backward,
-                            bool include_start_alignment) {
+                            bool include_start_alignment,
+                            Math1D::Vector<double>* log_scale) {
 
   if (align_type == HmmAlignProbReducedpar)
     calculate_hmm_backward_with_tricks(source_sentence, target_sentence, slookup, dict, align_model,
-                                       start_prob, backward, include_start_alignment);
+                                       start_prob, backward, include_start_alignment, log_scale);
   else
     calculate_hmm_backward(source_sentence, target_sentence, slookup, dict, align_model,
-                           start_prob, backward, include_start_alignment);      
+                           start_prob, backward, include_start_alignment, log_scale);
 }
 
 
 template<typename T>
-void calculate_hmm_backward(const Storage1D<uint>& source,
-                            const Storage1D<uint>& target,
+void calculate_hmm_backward(const SentenceView& source,
+                            const SentenceView& target,
                             const SingleLookupTable& slookup,
                             const SingleWordDictionary& dict,
                             const Math2D::Matrix<double>& align_model,
                             const Math1D::Vector<double>& start_prob,
                             Math2D::Matrix<T>& backward,
-                            bool include_start_alignment) {
+                            bool include_start_alignment,
+                            Math1D::Vector<double>* log_scale) {
 
   const uint I = target.size();
   const uint J = source.size();
@@ -392,23 +458,33 @@ void calculate_hmm_backward(const Storage1D<uint>& source,
   for (uint i=I; i < 2*I; i++)
     backward(i,J-1) = dict[0][end_s_idx-1];
       
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[J-1] = rescale_hmm_column(backward,J-1,2*I);
+  }
+
   for (int j=J-2; j >= 0; j--) {
     const uint s_idx = source[j];
     const uint j_next = j+1;
     
     const T cur_emptyword_prob = dict[0][s_idx-1];
 
+    //the rows of align_model and the column of backward are both contiguous
+    T* cur_backward = backward.direct_access() + j*backward.xDim();
+    hmm_sum_product_rows(align_model.direct_access(), align_model.xDim(),
+                         backward.direct_access() + j_next*backward.xDim(), I, cur_backward);
+
     for (uint i=0; i < I; i++) {
 
-      T sum = 0.0;
-      for (uint i_next = 0; i_next < I; i_next++)
-        sum += backward(i_next,j_next) * align_model(i_next,i);
-      sum += backward(i+I,j_next) * align_model(I,i);
+      T sum = cur_backward[i] + backward(i+I,j_next) * align_model(I,i);
 
       backward(i,j) = sum * dict[target[i]][slookup(j,i)];
 
       backward(i+I,j) = sum * cur_emptyword_prob;
     }
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j+1] + rescale_hmm_column(backward,j,2*I);
   }
 
   if (include_start_alignment) {
@@ -422,20 +498,21 @@ void calculate_hmm_backward(const Storage1D<uint>& source,
 
 
 template<typename T>
-void calculate_sehmm_backward(const Storage1D<uint>& source,
-                              const Storage1D<uint>& target,
+void calculate_sehmm_backward(const SentenceView& source,
+                              const SentenceView& target,
                               const SingleLookupTable& slookup,
                               const SingleWordDictionary& dict,
                               const Math2D::Matrix<double>& align_model,
                               const Math1D::Vector<double>& start_prob,
                               Math2D::Matrix<T>& backward,
-                              bool include_start_alignment) {
+                              bool include_start_alignment,
+                              Math1D::Vector<double>* log_scale) {
 
 
   const uint I = target.size();
   const uint J = source.size();
 
-  backward.resize(2*I+1,J);
+  backward.resize_dirty(2*I+1,J);
 
   const uint end_s_idx = source[J-1];
   
@@ -444,18 +521,25 @@ void calculate_sehmm_backward(const Storage1D<uint>& source,
   for (uint i=I; i <= 2*I; i++)
     backward(i,J-1) = dict[0][end_s_idx-1];
       
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[J-1] = rescale_hmm_column(backward,J-1,2*I+1);
+  }
+
   for (int j=J-2; j >= 0; j--) {
     const uint s_idx = source[j];
     const uint j_next = j+1;
     
     const T cur_emptyword_prob = dict[0][s_idx-1];
 
+    //the rows of align_model and the column of backward are both contiguous
+    T* cur_backward = backward.direct_access() + j*backward.xDim();
+    hmm_sum_product_rows(align_model.direct_access(), align_model.xDim(),
+                         backward.direct_access() + j_next*backward.xDim(), I, cur_backward);
+
     for (uint i=0; i < I; i++) {
 
-      T sum = 0.0;
-      for (uint i_next = 0; i_next < I; i_next++)
-        sum += backward(i_next,j_next) * align_model(i_next,i);
-      sum += backward(i+I,j_next) * align_model(I,i);
+      T sum = cur_backward[i] + backward(i+I,j_next) * align_model(I,i);
 
       backward(i,j) = sum * dict[target[i]][slookup(j,i)];
 
@@ -471,6 +555,9 @@ void calculate_sehmm_backward(const Storage1D<uint>& source,
 
       backward(2*I,j) = sum * cur_emptyword_prob;
     }
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j+1] + rescale_hmm_column(backward,j,2*I+1);
   }
 
   if (include_start_alignment) {
@@ -487,14 +574,15 @@ void calculate_sehmm_backward(const Storage1D<uint>& source,
 }
 
 template<typename T>
-void calculate_hmm_backward_with_tricks(const Storage1D<uint>& source,
-					const Storage1D<uint>& target,
+void calculate_hmm_backward_with_tricks(const SentenceView& source,
+					const SentenceView& target,
 					const SingleLookupTable& slookup,
 					const SingleWordDictionary& dict,
 					const Math2D::Matrix<double>& align_model,
 					const Math1D::Vector<double>& start_prob,
 					Math2D::Matrix<T>& backward,
-					bool include_start_alignment) {
+					bool include_start_alignment,
+					Math1D::Vector<double>* log_scale) {
 
   
   const int I = target.size();
@@ -519,6 +607,11 @@ void calculate_hmm_backward_with_tricks(const Storage1D<uint>& source,
   for (int i=I; i < 2*I; i++)
     backward(i,J-1) = dict[0][end_s_idx-1];
   
+  if (log_scale != 0) {
+    log_scale->resize_dirty(J);
+    (*log_scale)[J-1] = rescale_hmm_column(backward,J-1,2*I);
+  }
+
   for (int j=J-2; j >= 0; j--) {
     const uint s_idx = source[j];
     const uint j_next = j+1;
@@ -596,6 +689,9 @@ void calculate_hmm_backward_with_tricks(const Storage1D<uint>& source,
       backward(i+I,j) = sum * cur_emptyword_prob;
     }
 #endif
+
+    if (log_scale != 0)
+      (*log_scale)[j] = (*log_scale)[j+1] + rescale_hmm_column(backward,j,2*I);
   }
 
   if (include_start_alignment) {
@@ -0,0 +1,294 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#include "hmm_kernels.hh"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HMM_KERNELS_X86
+#include <immintrin.h>
+#endif
+
+/**** scalar versions ****/
+
+static void scalar_sum_product_rows(const double* model, uint stride, const double* vec, uint n, double* result) {
+
+  for (uint i=0; i < n; i++) {
+    const double* row = model + i*stride;
+    double sum = 0.0;
+    for (uint k=0; k < n; k++)
+      sum += row[k] * vec[k];
+    result[i] = sum;
+  }
+}
+
+static void scalar_sum_product_columns(const double* model, uint stride, const double* weight, uint n, double* result) {
+
+  for (uint i=0; i < n; i++)
+    result[i] = 0.0;
+
+  for (uint k=0; k < n; k++) {
+    const double* column = model + k*stride;
+    const double w = weight[k];
+    for (uint i=0; i < n; i++)
+      result[i] += column[i] * w;
+  }
+}
+
+static void scalar_max_product_columns(const double* model, uint stride, const double* weight, uint n,
+                                       double* max_score, uint* arg_max, uint arg_offset) {
+
+  for (uint k=0; k < n; k++) {
+    const double* column = model + k*stride;
+    const double w = weight[k];
+    for (uint i=0; i < n; i++) {
+      const double hyp_score = column[i] * w;
+      if (hyp_score > max_score[i]) {
+        max_score[i] = hyp_score;
+        arg_max[i] = k + arg_offset;
+      }
+    }
+  }
+}
+
+#ifdef HMM_KERNELS_X86
+
+/**** AVX2 versions ****/
+
+//four rows are handled at once. Blocks of 4x4 entries are transposed in registers, so that each lane adds
+// the products of its row in the order of k as in the scalar version
+__attribute__((target("avx2")))
+static void avx2_sum_product_rows(const double* model, uint stride, const double* vec, uint n, double* result) {
+
+  uint i=0;
+  for (; i+4 <= n; i += 4) {
+    const double* row0 = model + i*stride;
+    const double* row1 = row0 + stride;
+    const double* row2 = row1 + stride;
+    const double* row3 = row2 + stride;
+
+    __m256d sum = _mm256_setzero_pd();
+
+    uint k=0;
+    for (; k+4 <= n; k += 4) {
+      const __m256d t0 = _mm256_unpacklo_pd(_mm256_loadu_pd(row0+k),_mm256_loadu_pd(row1+k));
+      const __m256d t1 = _mm256_unpackhi_pd(_mm256_loadu_pd(row0+k),_mm256_loadu_pd(row1+k));
+      const __m256d t2 = _mm256_unpacklo_pd(_mm256_loadu_pd(row2+k),_mm256_loadu_pd(row3+k));
+      const __m256d t3 = _mm256_unpackhi_pd(_mm256_loadu_pd(row2+k),_mm256_loadu_pd(row3+k));
+
+      sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_permute2f128_pd(t0,t2,0x20),_mm256_set1_pd(vec[k])));
+      sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_permute2f128_pd(t1,t3,0x20),_mm256_set1_pd(vec[k+1])));
+      sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_permute2f128_pd(t0,t2,0x31),_mm256_set1_pd(vec[k+2])));
+      sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_permute2f128_pd(t1,t3,0x31),_mm256_set1_pd(vec[k+3])));
+    }
+    for (; k < n; k++)
+      sum = _mm256_add_pd(sum,_mm256_mul_pd(_mm256_setr_pd(row0[k],row1[k],row2[k],row3[k]),_mm256_set1_pd(vec[k])));
+
+    _mm256_storeu_pd(result+i,sum);
+  }
+
+  for (; i < n; i++) {
+    const double* row = model + i*stride;
+    double sum = 0.0;
+    for (uint k=0; k < n; k++)
+      sum += row[k] * vec[k];
+    result[i] = sum;
+  }
+}
+
+//the rows are handled in blocks of four, for each row the products are added in the order of k as in the scalar version
+__attribute__((target("avx2")))
+static void avx2_sum_product_columns(const double* model, uint stride, const double* weight, uint n, double* result) {
+
+  uint i=0;
+  for (; i+8 <= n; i += 8) {
+    __m256d sum0 = _mm256_setzero_pd();
+    __m256d sum1 = _mm256_setzero_pd();
+    for (uint k=0; k < n; k++) {
+      const double* column = model + k*stride + i;
+      const __m256d w = _mm256_set1_pd(weight[k]);
+      sum0 = _mm256_add_pd(sum0,_mm256_mul_pd(_mm256_loadu_pd(column),w));
+      sum1 = _mm256_add_pd(sum1,_mm256_mul_pd(_mm256_loadu_pd(column+4),w));
+    }
+    _mm256_storeu_pd(result+i,sum0);
+    _mm256_storeu_pd(result+i+4,sum1);
+  }
+  if (i+4 <= n) {
+    __m256d sum0 = _mm256_setzero_pd();
+    for (uint k=0; k < n; k++)
+      sum0 = _mm256_add_pd(sum0,_mm256_mul_pd(_mm256_loadu_pd(model + k*stride + i),_mm256_set1_pd(weight[k])));
+    _mm256_storeu_pd(result+i,sum0);
+    i += 4;
+  }
+
+  for (; i < n; i++) {
+    double sum = 0.0;
+    for (uint k=0; k < n; k++)
+      sum += model[k*stride+i] * weight[k];
+    result[i] = sum;
+  }
+}
+
+__attribute__((target("avx2")))
+static void avx2_max_product_columns(const double* model, uint stride, const double* weight, uint n,
+                                     double* max_score, uint* arg_max, uint arg_offset) {
+
+  uint i=0;
+  for (; i+4 <= n; i += 4) {
+
+    //the winning k are kept as doubles, -1 marks rows without improvement.
+    // The comparison is false for NaNs, so these are skipped as in the scalar code
+    __m256d best = _mm256_loadu_pd(max_score+i);
+    __m256d best_k = _mm256_set1_pd(-1.0);
+
+    for (uint k=0; k < n; k++) {
+      const __m256d hyp_score = _mm256_mul_pd(_mm256_loadu_pd(model + k*stride + i),_mm256_set1_pd(weight[k]));
+      const __m256d better = _mm256_cmp_pd(hyp_score,best,_CMP_GT_OQ);
+      best = _mm256_blendv_pd(best,hyp_score,better);
+      best_k = _mm256_blendv_pd(best_k,_mm256_set1_pd(k),better);
+    }
+
+    _mm256_storeu_pd(max_score+i,best);
+
+    double part[4];
+    _mm256_storeu_pd(part,best_k);
+    for (uint l=0; l < 4; l++) {
+      if (part[l] >= 0.0)
+        arg_max[i+l] = uint(part[l]) + arg_offset;
+    }
+  }
+
+  for (; i < n; i++) {
+    for (uint k=0; k < n; k++) {
+      const double hyp_score = model[k*stride+i] * weight[k];
+      if (hyp_score > max_score[i]) {
+        max_score[i] = hyp_score;
+        arg_max[i] = k + arg_offset;
+      }
+    }
+  }
+}
+
+/**** AVX-512 versions ****/
+
+__attribute__((target("avx512f")))
+static void avx512_sum_product_columns(const double* model, uint stride, const double* weight, uint n, double* result) {
+
+  uint i=0;
+  for (; i+8 <= n; i += 8) {
+    __m512d sum0 = _mm512_setzero_pd();
+    for (uint k=0; k < n; k++)
+      sum0 = _mm512_add_pd(sum0,_mm512_mul_pd(_mm512_loadu_pd(model + k*stride + i),_mm512_set1_pd(weight[k])));
+    _mm512_storeu_pd(result+i,sum0);
+  }
+
+  for (; i < n; i++) {
+    double sum = 0.0;
+    for (uint k=0; k < n; k++)
+      sum += model[k*stride+i] * weight[k];
+    result[i] = sum;
+  }
+}
+
+__attribute__((target("avx512f")))
+static void avx512_max_product_columns(const double* model, uint stride, const double* weight, uint n,
+                                       double* max_score, uint* arg_max, uint arg_offset) {
+
+  uint i=0;
+  for (; i+8 <= n; i += 8) {
+
+    __m512d best = _mm512_loadu_pd(max_score+i);
+    __m512d best_k = _mm512_set1_pd(-1.0);
+
+    for (uint k=0; k < n; k++) {
+      const __m512d hyp_score = _mm512_mul_pd(_mm512_loadu_pd(model + k*stride + i),_mm512_set1_pd(weight[k]));
+      const __mmask8 better = _mm512_cmp_pd_mask(hyp_score,best,_CMP_GT_OQ);
+      best = _mm512_mask_blend_pd(better,best,hyp_score);
+      best_k = _mm512_mask_blend_pd(better,best_k,_mm512_set1_pd(k));
+    }
+
+    _mm512_storeu_pd(max_score+i,best);
+
+    double part[8];
+    _mm512_storeu_pd(part,best_k);
+    for (uint l=0; l < 8; l++) {
+      if (part[l] >= 0.0)
+        arg_max[i+l] = uint(part[l]) + arg_offset;
+    }
+  }
+
+  for (; i < n; i++) {
+    for (uint k=0; k < n; k++) {
+      const double hyp_score = model[k*stride+i] * weight[k];
+      if (hyp_score > max_score[i]) {
+        max_score[i] = hyp_score;
+        arg_max[i] = k + arg_offset;
+      }
+    }
+  }
+}
+
+#endif
+
+/**** dispatch ****/
+
+typedef void (*SumProductRowsKernel)(const double*, uint, const double*, uint, double*);
+typedef void (*SumProductColumnsKernel)(const double*, uint, const double*, uint, double*);
+typedef void (*MaxProductColumnsKernel)(const double*, uint, const double*, uint, double*, uint*, uint);
+
+enum HmmKernelType {HmmKernelScalar, HmmKernelAVX2, HmmKernelAVX512};
+
+static HmmKernelType select_hmm_kernel() {
+
+#ifdef HMM_KERNELS_X86
+  //needed since this runs before main()
+  __builtin_cpu_init();
+
+  //the AVX-512 path also uses the AVX2 row kernel
+  if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2"))
+    return HmmKernelAVX512;
+  if (__builtin_cpu_supports("avx2"))
+    return HmmKernelAVX2;
+#endif
+
+  return HmmKernelScalar;
+}
+
+static const HmmKernelType hmm_kernel_type = select_hmm_kernel();
+
+#ifdef HMM_KERNELS_X86
+//there is no AVX-512 version of the row kernel, the AVX2 version is used on these CPUs as well
+static const SumProductRowsKernel sum_product_rows_kernel = (hmm_kernel_type != HmmKernelScalar) ?
+  avx2_sum_product_rows : scalar_sum_product_rows;
+static const SumProductColumnsKernel sum_product_columns_kernel = (hmm_kernel_type == HmmKernelAVX512) ?
+  avx512_sum_product_columns : ((hmm_kernel_type == HmmKernelAVX2) ? avx2_sum_product_columns : scalar_sum_product_columns);
+static const MaxProductColumnsKernel max_product_columns_kernel = (hmm_kernel_type == HmmKernelAVX512) ?
+  avx512_max_product_columns : ((hmm_kernel_type == HmmKernelAVX2) ? avx2_max_product_columns : scalar_max_product_columns);
+#else
+static const SumProductRowsKernel sum_product_rows_kernel = scalar_sum_product_rows;
+static const SumProductColumnsKernel sum_product_columns_kernel = scalar_sum_product_columns;
+static const MaxProductColumnsKernel max_product_columns_kernel = scalar_max_product_columns;
+#endif
+
+void hmm_sum_product_rows(const double* model, uint stride, const double* vec, uint n, double* result) {
+  sum_product_rows_kernel(model,stride,vec,n,result);
+}
+
+void hmm_sum_product_columns(const double* model, uint stride, const double* weight, uint n, double* result) {
+  sum_product_columns_kernel(model,stride,weight,n,result);
+}
+
+void hmm_max_product_columns(const double* model, uint stride, const double* weight, uint n,
+                             double* max_score, uint* arg_max, uint arg_offset) {
+  max_product_columns_kernel(model,stride,weight,n,max_score,arg_max,arg_offset);
+}
+
+const char* hmm_kernel_name() {
+
+  switch (hmm_kernel_type) {
+  case HmmKernelAVX512 :
+    return "avx512";
+  case HmmKernelAVX2 :
+    return "avx2";
+  default :
+    return "scalar";
+  }
+}
@@ -0,0 +1,66 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#ifndef HMM_KERNELS_HH
+#define HMM_KERNELS_HH
+
+#include "makros.hh"
+
+/**** vectorized inner loops of the HMM (transition step of forward, backward and Viterbi) ****/
+// The double versions are dispatched at run-time to AVX-512, AVX2 or scalar code, depending on the CPU.
+// The alignment model of length I is stored with align_model(i,i_prev) at i_prev*(I+1)+i, so the backward step
+// works on rows of contiguous entries and the forward and Viterbi steps on the contiguous columns of the model.
+// All kernels add or compare in the order of the predecessor, so the results are the same for all instruction sets.
+
+//result[i] = sum_k model[i*stride+k] * vec[k] for i,k < n. For each i the summation is in the order of k
+void hmm_sum_product_rows(const double* model, uint stride, const double* vec, uint n, double* result);
+
+//generic version, used for long double tables
+template<typename T>
+inline void hmm_sum_product_rows(const double* model, uint stride, const T* vec, uint n, T* result);
+
+//result[i] = sum_k model[k*stride+i] * weight[k] for i,k < n. For each i the summation is in the order of k,
+// so the result is the same for all instruction sets
+void hmm_sum_product_columns(const double* model, uint stride, const double* weight, uint n, double* result);
+
+//generic version, used for long double tables
+template<typename T>
+inline void hmm_sum_product_columns(const double* model, uint stride, const T* weight, uint n, T* result);
+
+//for k < n (in this order) and i < n: if model[k*stride+i] * weight[k] > max_score[i], the product becomes
+// max_score[i] and arg_max[i] is set to k + arg_offset. So arg_max[i] receives the first k attaining the maximum
+// and is left unchanged if no product exceeds the given max_score[i]. The result is the same for all instruction sets
+void hmm_max_product_columns(const double* model, uint stride, const double* weight, uint n,
+                             double* max_score, uint* arg_max, uint arg_offset);
+
+//name of the instruction set selected for the kernels ("avx512", "avx2" or "scalar")
+const char* hmm_kernel_name();
+
+/************ implementation **********/
+
+template<typename T>
+inline void hmm_sum_product_rows(const double* model, uint stride, const T* vec, uint n, T* result) {
+
+  for (uint i=0; i < n; i++) {
+    const double* row = model + i*stride;
+    T sum = 0.0;
+    for (uint k=0; k < n; k++)
+      sum += row[k] * vec[k];
+    result[i] = sum;
+  }
+}
+
+template<typename T>
+inline void hmm_sum_product_columns(const double* model, uint stride, const T* weight, uint n, T* result) {
+
+  for (uint i=0; i < n; i++)
+    result[i] = 0.0;
+
+  for (uint k=0; k < n; k++) {
+    const double* column = model + k*stride;
+    const T w = weight[k];
+    for (uint i=0; i < n; i++)
+      result[i] += column[i] * w;
+  }
+}
+
+#endif
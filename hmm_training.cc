@@ -23,14 +23,15 @@ HmmOptions::HmmOptions(uint nSourceWords,uint nTargetWords,
                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments) :
   nIterations_(5), init_type_(HmmInitPar), align_type_(HmmAlignProbReducedpar), start_empty_word_(false), smoothed_l0_(false),
-  l0_beta_(1.0), print_energy_(true), nSourceWords_(nSourceWords), nTargetWords_(nTargetWords), 
-  init_m_step_iter_(1000), align_m_step_iter_(1000), dict_m_step_iter_(45), transfer_mode_(IBM1TransferNo),
+  l0_beta_(1.0), print_energy_(true), scaled_forward_backward_(false), sort_by_length_(true), stream_chunk_size_(0),
+  nSourceWords_(nSourceWords), nTargetWords_(nTargetWords), 
+  init_m_step_iter_(1000), align_m_step_iter_(1000), dict_m_step_iter_(45), nThreads_(1), transfer_mode_(IBM1TransferNo),
   sure_ref_alignments_(sure_ref_alignments), possible_ref_alignments_(possible_ref_alignments){}
 
 
-long double hmm_alignment_prob(const Storage1D<uint>& source, 
+long double hmm_alignment_prob(const SentenceView& source, 
                                const SingleLookupTable& slookup,
-                               const Storage1D<uint>& target,
+                               const SentenceView& target,
                                const SingleWordDictionary& dict,
                                const FullHMMAlignmentModel& align_model,
                                const InitialAlignmentProbability& initial_prob,
@@ -68,167 +69,325 @@ long double hmm_alignment_prob(const Storage1D<uint>& source,
   return prob;
 }
 
-double extended_hmm_perplexity(const Storage1D<Storage1D<uint> >& source, 
+double extended_hmm_perplexity(const Corpus& source, 
                                const LookupTable& slookup,
-                               const Storage1D<Storage1D<uint> >& target,
+                               const Corpus& target,
                                const FullHMMAlignmentModel& align_model,
                                const InitialAlignmentProbability& initial_prob,
                                const SingleWordDictionary& dict,
                                const CooccuringWordsType& wcooc, uint nSourceWords,
-			       HmmAlignProbType align_type, bool start_empty_word) {
-
-  double sum = 0.0;
+			       HmmAlignProbType align_type, bool start_empty_word, uint nThreads = 1,
+                               bool scaled_forward_backward = false) {
 
   const size_t nSentences = target.size();
 
-  SingleLookupTable aux_lookup;
+  nThreads = std::max<uint>(1,nThreads);
+
+  //partial sums of the sentence blocks are added in a fixed order
+  Math1D::Vector<double> block_sum(nThreads,0.0);
+
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+  for (int t=0; t < (int) nThreads; t++) {
+
+    WordLookupBuffers aux_lookup;
+
+    //kept over the sentences of the thread
+    Math2D::NamedMatrix<double> forward(MAKENAME(forward));
+    Math1D::Vector<double> prev_sum;
+
+    //only used with scaling
+    Math1D::Vector<double> log_scale;
+    Math1D::Vector<double>* log_scale_ptr = (scaled_forward_backward) ? &log_scale : 0;
+
+    const size_t start_s = (nSentences * t) / nThreads;
+    const size_t end_s = (nSentences * (t+1)) / nThreads;
+
+    double sum = 0.0;
   
-  for (size_t s=0; s < nSentences; s++) {
+    for (size_t s=start_s; s < end_s; s++) {
     
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
-    const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
+      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
 
-    const uint curJ = cur_source.size();
-    const uint curI = cur_target.size();
+      const uint curJ = cur_source.size();
+      const uint curI = cur_target.size();
     
-    const Math2D::Matrix<double>& cur_align_model = align_model[curI-1];
+      const Math2D::Matrix<double>& cur_align_model = align_model[curI-1];
     
-    /**** calculate forward ********/
+      /**** calculate forward ********/
 
-    Math2D::NamedMatrix<double> forward(2*curI,curJ,MAKENAME(forward));
+      forward.resize_dirty(2*curI,curJ);
 
-    if (start_empty_word) {
+      if (start_empty_word) {
 
-      calculate_sehmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                              initial_prob[curI-1], forward);
-    }
-    else {
-      calculate_hmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                            initial_prob[curI-1], align_type, forward);
-    }
+        calculate_sehmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                initial_prob[curI-1], forward, log_scale_ptr, &prev_sum);
+      }
+      else {
+        calculate_hmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                              initial_prob[curI-1], align_type, forward, log_scale_ptr, &prev_sum);
+      }
 
-    double sentence_prob = 0.0;
-    for (uint i=0; i < forward.xDim(); i++) {
+      double sentence_prob = 0.0;
+      for (uint i=0; i < forward.xDim(); i++) {
       
-      assert(forward(i,curJ-1) >= 0.0);
-      sentence_prob += forward(i,curJ-1);
+        assert(forward(i,curJ-1) >= 0.0);
+        sentence_prob += forward(i,curJ-1);
+      }
+
+      if (scaled_forward_backward)
+        sum -= log_scale[curJ-1] + std::log(sentence_prob);
+      else if (sentence_prob > 1e-300)
+        sum -= std::log(sentence_prob);
+      else
+        sum -= std::log(1e-300);
     }
 
-    if (sentence_prob > 1e-300)
-      sum -= std::log(sentence_prob);
-    else
-      sum -= std::log(1e-300);
+    block_sum[t] = sum;
   }
 
+  double sum = 0.0;
+  for (uint t=0; t < nThreads; t++)
+    sum += block_sum[t];
+
   return sum / nSentences;
 }
 
 
-double extended_hmm_energy(const Storage1D<Storage1D<uint> >& source, 
+double extended_hmm_energy(const Corpus& source, 
                            const LookupTable& slookup,
-                           const Storage1D<Storage1D<uint> >& target,
+                           const Corpus& target,
                            const FullHMMAlignmentModel& align_model,
                            const InitialAlignmentProbability& initial_prob,
                            const SingleWordDictionary& dict,
                            const CooccuringWordsType& wcooc, uint nSourceWords,
                            const floatSingleWordDictionary& prior_weight,
 			   HmmAlignProbType align_type, bool start_empty_word,
-			   bool smoothed_l0, double l0_beta) {
+			   bool smoothed_l0, double l0_beta, uint nThreads = 1,
+                           bool scaled_forward_backward = false) {
   
-  double energy = 0.0;
-
-  for (uint i=0; i < dict.size(); i++)
-    for (uint k=0; k < dict[i].size(); k++) {
-      if (smoothed_l0)
-	energy += prior_weight[i][k] * prob_penalty(dict[i][k],l0_beta);
-      else
-	energy += prior_weight[i][k] * dict[i][k];
-    }
+  double energy = dict_regularity_term(dict, prior_weight, smoothed_l0, l0_beta);
 
   energy /= source.size();
 
-  energy += extended_hmm_perplexity(source,slookup,target,align_model,initial_prob,dict,wcooc,nSourceWords,align_type,start_empty_word);
+  energy += extended_hmm_perplexity(source,slookup,target,align_model,initial_prob,dict,wcooc,nSourceWords,align_type,start_empty_word,
+                                    nThreads,scaled_forward_backward);
 
   return energy;
 }
 
-double ehmm_m_step_energy(const FullHMMAlignmentModel& facount, const Math1D::Vector<double>& dist_params, 
-                          uint zero_offset, double grouping_param = -1.0) {
+void compute_hmm_distortion_statistics(const FullHMMAlignmentModel& facount, uint zero_offset,
+                                       HmmDistortionStatistics& stats, uint nThreads) {
 
-  double energy = 0.0;
+  const int maxI = facount.size();
+  assert(zero_offset + 1 >= uint(maxI));
 
-  for (uint I=1; I <= facount.size(); I++) {
+  stats.zero_offset_ = zero_offset;
+  stats.displacement_count_.resize(zero_offset + maxI);
+  stats.far_count_.resize(maxI);
+  stats.far_count_.set_constant(0.0);
+  stats.position_count_.resize(maxI,maxI);
+  stats.position_count_.set_constant(0.0);
 
-    if (facount[I-1].size() > 0) {
-      
-      for (int i=0; i < (int) I; i++) {
+  Math2D::Matrix<double> far_position_count(maxI,maxI,0.0);
 
-        double non_zero_sum = 0.0;
+  //the lengths are independent
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+  for (int I=maxI; I >= 1; I--) {
 
-        if (grouping_param < 0.0) {
-	
-          for (uint ii=0; ii < I; ii++)
-            non_zero_sum += std::max(1e-15,dist_params[zero_offset + ii - i]);
-	  
-          for (int ii=0; ii < (int) I; ii++) {
-	    
-            const double cur_count = facount[I-1](ii,i);
-	    
-            energy -= cur_count * std::log( std::max(1e-15,dist_params[zero_offset + ii - i]) / non_zero_sum);
-          }
-        }
-        else {
+    if (facount[I-1].size() == 0)
+      continue;
 
-          double grouping_norm = std::max(0,i-5);
-          grouping_norm += std::max(0,int(I)-1-(i+5));
+    for (int i=0; i < I; i++) {
 
-          for (int ii=0; ii < (int) I; ii++) {
-            if (abs(ii-i) <= 5) 
-              non_zero_sum += std::max(1e-15,dist_params[zero_offset + ii - i]);
-            else {
-              non_zero_sum += grouping_param / grouping_norm;
-            }
-          }
+      double count_sum = 0.0;
+      double far_sum = 0.0;
+      for (int ii=0; ii < I; ii++) {
+        const double cur_count = facount[I-1](ii,i);
+        count_sum += cur_count;
+        if (abs(ii-i) > 5)
+          far_sum += cur_count;
+      }
 
-          for (int ii=0; ii < (int) I; ii++) {
-	    
-            double cur_count = facount[I-1](ii,i);
-            double cur_param = std::max(1e-15,dist_params[zero_offset + ii - i]);
+      stats.position_count_(I-1,i) = count_sum;
+      far_position_count(I-1,i) = far_sum;
+    }
+  }
 
-            if (abs(ii-i) > 5) {
-              cur_param = std::max(1e-15,grouping_param / grouping_norm);
-            }
+  //the displacements are independent
+#pragma omp parallel for schedule(dynamic,8) num_threads(nThreads)
+  for (int d = 1-maxI; d < maxI; d++) {
 
-            energy -= cur_count * std::log( cur_param / non_zero_sum);
-          }
-        }
+    double sum = 0.0;
+    for (int I=std::max(1,abs(d)+1); I <= maxI; I++) {
+
+      if (facount[I-1].size() == 0)
+        continue;
+
+      for (int i=std::max(0,-d); i < std::min(I,I-d); i++)
+        sum += facount[I-1](i+d,i);
+    }
+
+    stats.displacement_count_[zero_offset + d] = sum;
+  }
+
+  for (int I=1; I <= maxI; I++) {
+    for (int i=0; i < I; i++) {
+
+      if (far_position_count(I-1,i) != 0.0) {
+        const int grouping_norm = std::max(0,i-5) + std::max(0,I-1-(i+5));
+        stats.far_count_[grouping_norm] += far_position_count(I-1,i);
       }
     }
   }
+}
+
+//normalization of the jump probabilities from position i for target length I, where near_sum is the sum of the
+// (non-grouped) parameters of the positions < I
+static inline double ehmm_normalizer(double near_sum, int I, int i, double grouping_param) {
+
+  if (grouping_param < 0.0)
+    return near_sum;
+
+  const int grouping_norm = std::max(0,i-5) + std::max(0,I-1-(i+5));
+  if (grouping_norm == 0)
+    return near_sum;
+
+  return near_sum + grouping_norm * std::max(1e-15,grouping_param / grouping_norm);
+}
+
+double ehmm_m_step_energy(const HmmDistortionStatistics& stats, const Math1D::Vector<double>& dist_params, 
+                          double grouping_param) {
+
+  const int zero_offset = stats.zero_offset_;
+  const int maxI = stats.position_count_.xDim();
+
+  assert(dist_params.size() >= stats.displacement_count_.size());
+
+  double energy = 0.0;
+
+  //numerators
+  for (uint k=0; k < stats.displacement_count_.size(); k++) {
+
+    const double cur_count = stats.displacement_count_[k];
+    if (cur_count != 0.0 && (grouping_param < 0.0 || abs(int(k) - zero_offset) <= 5))
+      energy -= cur_count * std::log(std::max(1e-15,dist_params[k]));
+  }
+
+  if (grouping_param >= 0.0) {
+    for (uint n=1; n < stats.far_count_.size(); n++) {
+      if (stats.far_count_[n] != 0.0)
+        energy -= stats.far_count_[n] * std::log(std::max(1e-15,grouping_param / n));
+    }
+  }
+
+  //normalizers: for fixed i the sum grows with the length
+  for (int i=0; i < maxI; i++) {
+
+    double near_sum = 0.0;
+
+    for (int ii=0; ii < maxI; ii++) {
+
+      if (grouping_param < 0.0 || abs(ii-i) <= 5)
+        near_sum += std::max(1e-15,dist_params[zero_offset + ii - i]);
+
+      const int I = ii+1;
+      if (I <= i)
+        continue;
+
+      const double count_sum = stats.position_count_(I-1,i);
+      if (count_sum != 0.0)
+        energy += count_sum * std::log(ehmm_normalizer(near_sum,I,i,grouping_param));
+    }
+  }
+
+  assert(!isnan(energy));
 
   return energy;
 }
 
-void ehmm_m_step(const FullHMMAlignmentModel& facount, Math1D::Vector<double>& dist_params, uint zero_offset,
+//weight is a buffer of size maxI
+static void ehmm_m_step_gradient(const HmmDistortionStatistics& stats, const Math1D::Vector<double>& dist_params, 
+                                 double grouping_param, Math1D::Vector<double>& dist_grad, double& grouping_grad,
+                                 Math1D::Vector<double>& weight) {
+
+  const int zero_offset = stats.zero_offset_;
+  const int maxI = stats.position_count_.xDim();
+
+  dist_grad.set_constant(0.0);
+  grouping_grad = 0.0;
+
+  for (uint k=0; k < stats.displacement_count_.size(); k++) {
+
+    const double cur_count = stats.displacement_count_[k];
+    if (cur_count != 0.0 && (grouping_param < 0.0 || abs(int(k) - zero_offset) <= 5))
+      dist_grad[k] -= cur_count / std::max(1e-15,dist_params[k]);
+  }
+
+  if (grouping_param >= 0.0) {
+    //NOTE: -std::log( param / norm) = -std::log(param) + std::log(norm)
+    // => grouping_norm does NOT enter here
+    grouping_grad -= stats.far_count_.sum() / grouping_param;
+  }
+
+  for (int i=0; i < maxI; i++) {
+
+    //1. the weights count_sum / normalizer of all lengths
+    double near_sum = 0.0;
+
+    for (int ii=0; ii < maxI; ii++) {
+
+      if (grouping_param < 0.0 || abs(ii-i) <= 5)
+        near_sum += std::max(1e-15,dist_params[zero_offset + ii - i]);
+
+      const int I = ii+1;
+      const double count_sum = (I > i) ? stats.position_count_(I-1,i) : 0.0;
+
+      if (count_sum != 0.0) {
+        weight[ii] = count_sum / ehmm_normalizer(near_sum,I,i,grouping_param);
+
+        if (grouping_param >= 0.0 && std::max(0,i-5) + std::max(0,I-1-(i+5)) > 0)
+          grouping_grad += weight[ii];
+      }
+      else
+        weight[ii] = 0.0;
+    }
+
+    //2. the weight of length I enters the gradient of all positions ii < I
+    double weight_sum = 0.0;
+    for (int ii=maxI-1; ii >= 0; ii--) {
+
+      weight_sum += weight[ii];
+      if (grouping_param < 0.0 || abs(ii-i) <= 5)
+        dist_grad[zero_offset + ii - i] += weight_sum;
+    }
+  }
+}
+
+void ehmm_m_step(const HmmDistortionStatistics& stats, Math1D::Vector<double>& dist_params,
                  uint nIter, double& grouping_param) {
 
+  std::vector<double> proj_aux;
+
+  const uint zero_offset = stats.zero_offset_;
 
   if (grouping_param < 0.0)
-    projection_on_simplex(dist_params.direct_access(),dist_params.size());
+    projection_on_simplex(dist_params.direct_access(),dist_params.size(), proj_aux);
   else {
-    projection_on_simplex_with_slack(dist_params.direct_access() + zero_offset - 5, grouping_param, 11); 
+    projection_on_simplex_with_slack(dist_params.direct_access() + zero_offset - 5, grouping_param, 11, proj_aux);
   }
 
   Math1D::Vector<double> m_dist_grad = dist_params;
   Math1D::Vector<double> new_dist_params = dist_params;
   Math1D::Vector<double> hyp_dist_params = dist_params;
+  Math1D::Vector<double> weight(stats.position_count_.xDim());
 
   double m_grouping_grad = 0.0;
   double new_grouping_param = grouping_param;
   double hyp_grouping_param = grouping_param;
 
-  double energy = ehmm_m_step_energy(facount, dist_params, zero_offset, grouping_param);
+  double energy = ehmm_m_step_energy(stats, dist_params, grouping_param);
 
   assert(grouping_param < 0.0 || grouping_param >= 1e-15);
 
@@ -237,63 +396,8 @@ void ehmm_m_step(const FullHMMAlignmentModel& facount, Math1D::Vector<double>& d
     if ((iter % 5) == 0)
       std::cerr << "m-step gd-iter #" << iter << ", cur energy: " << energy << std::endl;
 
-    m_dist_grad.set_constant(0.0);
-    m_grouping_grad = 0.0;
-
     //calculate gradient
-    for (uint I=1; I <= facount.size(); I++) {
-
-      if (facount[I-1].size() > 0) {
-
-        for (int i=0; i < (int) I; i++) {
-
-          double grouping_norm = std::max(0,i-5);
-          grouping_norm += std::max(0,int(I)-1-(i+5));
-	    
-          double non_zero_sum = 0.0;
-          for (int ii=0; ii < (int) I; ii++) {
-            if (grouping_param < 0.0 || abs(i-ii) <= 5)
-              non_zero_sum +=  std::max(1e-15,dist_params[zero_offset + ii - i]);
-            else
-              non_zero_sum += std::max(1e-15,grouping_param / grouping_norm);
-          }
-	  
-          double count_sum = 0.0;
-          for (int ii=0; ii < (int) I; ii++) {
-            count_sum += facount[I-1](ii,i);
-          }
-	   
-          for (int ii=0; ii < (int) I; ii++) {
-            double cur_param = std::max(1e-15,dist_params[zero_offset + ii - i]);
-
-            double cur_count = facount[I-1](ii,i);
-	    
-            if (grouping_param < 0.0) {
-              m_dist_grad[zero_offset + ii-i] -= cur_count / cur_param;
-            }
-            else {
-	
-              if (abs(ii-i) > 5) {
-		//NOTE: -std::log( param / norm) = -std::log(param) + std::log(norm)
-		// => grouping_norm does NOT enter here
-                m_grouping_grad -= cur_count / grouping_param;  
-              }
-              else {
-                m_dist_grad[zero_offset + ii-i] -= cur_count / cur_param;
-              }
-            }
-          }
-
-          for (int ii=0; ii < (int) I; ii++) {
-            if (grouping_param < 0.0 || abs(ii-i) <= 5)
-              m_dist_grad[zero_offset + ii-i] += count_sum / non_zero_sum;
-          }
-
-	  if (grouping_param >= 0.0 && grouping_norm > 0.0)
-	    m_grouping_grad += count_sum / non_zero_sum;
-        }
-      }
-    }
+    ehmm_m_step_gradient(stats, dist_params, grouping_param, m_dist_grad, m_grouping_grad, weight);
 
     //go in gradient direction
     //double alpha  = 0.0001;
@@ -317,9 +421,9 @@ void ehmm_m_step(const FullHMMAlignmentModel& facount, Math1D::Vector<double>& d
 
     // reproject
     if (grouping_param < 0.0)      
-      projection_on_simplex(new_dist_params.direct_access(),dist_params.size());
+      projection_on_simplex(new_dist_params.direct_access(),dist_params.size(), proj_aux);
     else {
-      projection_on_simplex_with_slack(new_dist_params.direct_access()+zero_offset-5,new_grouping_param,11);
+      projection_on_simplex_with_slack(new_dist_params.direct_access()+zero_offset-5,new_grouping_param,11, proj_aux);
     }
 
     //find step-size
@@ -353,7 +457,7 @@ void ehmm_m_step(const FullHMMAlignmentModel& facount, Math1D::Vector<double>& d
       if (grouping_param >= 0.0)
 	hyp_grouping_param = std::max(1e-15,lambda * new_grouping_param + neg_lambda * grouping_param);
 
-      double new_energy = ehmm_m_step_energy(facount, hyp_dist_params, zero_offset, hyp_grouping_param);
+      double new_energy = ehmm_m_step_energy(stats, hyp_dist_params, hyp_grouping_param);
 
       if (new_energy < best_energy) {
         best_energy = new_energy;
@@ -411,7 +515,9 @@ double ehmm_init_m_step_energy(const InitialAlignmentProbability& init_acount, c
 
 void ehmm_init_m_step(const InitialAlignmentProbability& init_acount, Math1D::Vector<double>& init_params, uint nIter) {
 
-  projection_on_simplex(init_params.direct_access(), init_params.size());
+  std::vector<double> proj_aux;
+
+  projection_on_simplex(init_params.direct_access(), init_params.size(), proj_aux);
 
   Math1D::Vector<double> m_init_grad = init_params;
   Math1D::Vector<double> new_init_params = init_params;
@@ -463,7 +569,7 @@ void ehmm_init_m_step(const InitialAlignmentProbability& init_acount, Math1D::Ve
       if (new_init_params[k] <= -1e75)
 	new_init_params[k] = -9e74;
     }
-    projection_on_simplex(new_init_params.direct_access(),init_params.size());
+    projection_on_simplex(new_init_params.direct_access(),init_params.size(), proj_aux);
 
     //find step-size
     double best_energy = 1e300; 
@@ -619,9 +725,114 @@ void par2nonpar_hmm_alignment_model(const Math1D::Vector<double>& dist_params, c
   }
 }
 
-void init_hmm_from_ibm1(const Storage1D<Storage1D<uint> >& source, 
+void create_external_hmm_model(const std::set<uint>& seenIs, uint maxI,
+                               const FullHMMAlignmentModel& align_model, const InitialAlignmentProbability& initial_prob,
+                               Math1D::Vector<double>& init_params, Math1D::Vector<double>& dist_params,
+                               double& dist_grouping_param, Math1D::Vector<double>& source_fert,
+                               HmmAlignProbType align_type, HmmInitProbType init_type,
+                               FullHMMAlignmentModel& ext_align_model, InitialAlignmentProbability& ext_initial_prob) {
+
+  const uint max_extI = (seenIs.empty()) ? 0 : *seenIs.rbegin();
+
+  const uint train_zero_offset = maxI - 1;
+  const uint ext_zero_offset = max_extI - 1;
+
+  //handle case where init and/or distance parameters were not estimated in training
+  if (init_type == HmmInitNonpar || init_params.sum() < 1e-5) {
+
+    init_params.resize(maxI);
+    init_params.set_constant(0.0);
+
+    for (uint I=1; I <= maxI; I++) {
+        
+      for (uint l=0; l < std::min<uint>(I,initial_prob[I-1].size()); l++) {
+        if (l < init_params.size()) 
+          init_params[l] += initial_prob[I-1][l];
+      }
+    }
+      
+    double sum = init_params.sum();
+    assert(sum > 0.0);
+    init_params *= 1.0 / sum;
+  }
+    
+  if (align_type == HmmAlignProbNonpar || align_type == HmmAlignProbNonpar2 || dist_params.sum() < 1e-5) {
+
+    dist_grouping_param = -1.0;
+
+    dist_params.resize(2*maxI-1);
+    dist_params.set_constant(0.0);
+      
+    for (uint I=1; I <= maxI; I++) {
+        
+      for (uint i1 = 0; i1 < align_model[I-1].yDim(); i1++) 
+        for (uint i2 = 0; i2 < I; i2++) 
+          dist_params[train_zero_offset + i2 - i1] += align_model[I-1](i1,i2);
+    }
+      
+    dist_params *= 1.0 / dist_params.sum();
+  }
+
+  if ((init_type == HmmInitNonpar && align_type == HmmAlignProbNonpar) || source_fert.sum() < 0.95) {
+      
+    source_fert.resize(2);
+    source_fert[0] = 0.02;
+    source_fert[1] = 0.98;
+  }
+
+  Math1D::Vector<double> ext_init_params(max_extI,0.0);
+  Math1D::Vector<double> ext_dist_params((max_extI > 0) ? 2*max_extI-1 : 0,0.0);
+
+  for (uint i=0; i < std::min<uint>(max_extI,init_params.size()); i++) {
+    ext_init_params[i] = init_params[i];	
+      
+    ext_dist_params[ext_zero_offset - i] = dist_params[train_zero_offset - i];
+    ext_dist_params[ext_zero_offset + i] = dist_params[train_zero_offset + i];
+  }
+
+  ext_align_model.resize(max_extI+1);
+  ext_initial_prob.resize(max_extI+1);
+
+  for (std::set<uint>::const_iterator it = seenIs.begin(); it != seenIs.end(); it++) {
+      
+    uint I = *it;
+      
+    ext_align_model[I-1].resize(I+1,I,0.0); //because of empty words
+    ext_initial_prob[I-1].resize(2*I,0.0);
+  }
+
+  if (init_type != HmmInitFix && init_type != HmmInitFix2) {
+    par2nonpar_hmm_init_model(ext_init_params, source_fert, HmmInitPar, ext_initial_prob);
+    if (init_type == HmmInitNonpar) {
+      for (uint I=0; I < std::min(ext_initial_prob.size(),initial_prob.size()); I++) {
+        if (ext_initial_prob[I].size() > 0 && initial_prob[I].size() > 0)
+          ext_initial_prob[I] = initial_prob[I];
+      }
+    }
+  }
+  else {
+    par2nonpar_hmm_init_model(ext_init_params, source_fert, init_type, ext_initial_prob);
+  }
+
+  HmmAlignProbType mode = align_type;
+  if (mode == HmmAlignProbNonpar || align_type == HmmAlignProbNonpar2)
+    mode = HmmAlignProbFullpar;
+    
+  par2nonpar_hmm_alignment_model(ext_dist_params, ext_zero_offset, dist_grouping_param, source_fert,
+                                 mode, ext_align_model);
+    
+  if (align_type == HmmAlignProbNonpar || align_type == HmmAlignProbNonpar2) {
+      
+    for (uint I=0; I < std::min(ext_align_model.size(),align_model.size()); I++) {
+      if (ext_align_model.size() > 0 && align_model.size() > 0)
+        ext_align_model[I] = align_model[I];
+    }
+  }
+}
+
+void init_hmm_from_ibm1(const Corpus& source, 
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target,
+                        const Corpus& target,
                         const SingleWordDictionary& dict,
                         const CooccuringWordsType& wcooc,
                         FullHMMAlignmentModel& align_model,
@@ -651,7 +862,7 @@ void init_hmm_from_ibm1(const Storage1D<Storage1D<uint> >& source,
 
   const uint nSentences = source.size();
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   std::set<uint> seenIs;
 
@@ -827,9 +1038,188 @@ void init_hmm_from_ibm1(const Storage1D<Storage1D<uint> >& source,
   //std::cerr << "leaving init" << std::endl;
 }
 
-void train_extended_hmm(const Storage1D<Storage1D<uint> >& source, 
+//adds the posterior counts of one sentence pair. The (possibly rescaled) forward and backward tables
+// are turned into posteriors by the given factors: start_factor for backward(.,0), node_factor[j] for
+// forward(.,j)*backward(.,j) and trans_factor[j] for forward(.,j-1)*backward(.,j)
+template<typename T>
+void add_hmm_sentence_counts(const SentenceView& cur_source, const SentenceView& cur_target,
+                             const SingleLookupTable& cur_lookup, const SingleWordDictionary& dict,
+                             const Math2D::Matrix<double>& cur_align_model, const Math1D::Vector<double>& cur_initial_prob,
+                             bool start_empty_word, const Math2D::Matrix<T>& forward, const Math2D::Matrix<T>& backward,
+                             T start_factor, const Math1D::Vector<T>& node_factor, const Math1D::Vector<T>& trans_factor,
+                             Storage1D<Math1D::Vector<double> >& fwcount, Math2D::Matrix<double>& cur_facount,
+                             Math1D::Vector<double>& cur_ficount) {
+
+  const uint curJ = cur_source.size();
+  const uint curI = cur_target.size();
+
+  const uint start_s_idx = cur_source[0];
+
+  //start of sentence
+  for (uint i=0; i < curI; i++) {
+    uint t_idx = cur_target[i];
+
+    double coeff = start_factor * backward(i,0);
+    fwcount[t_idx][cur_lookup(0,i)] += coeff;
+
+    assert(!isnan(coeff));
+
+    cur_ficount[i] += coeff;
+  }
+  if (!start_empty_word) {
+    for (uint i=0; i < curI; i++) {
+      double coeff = start_factor * backward(i+curI,0);
+      fwcount[0][start_s_idx-1] += coeff;
+    
+      assert(!isnan(coeff));
+    
+      cur_ficount[i+curI] += coeff;
+    }
+  }
+  else
+    cur_ficount[curI] += start_factor * backward(2*curI,0);
+
+  //mid-sentence
+  for (uint j=1; j < curJ; j++) {
+
+    const uint s_idx = cur_source[j];
+    const uint j_prev = j -1;
+
+    //real positions
+    for (uint i=0; i < curI; i++) {
+      const uint t_idx = cur_target[i];
+
+
+      if (dict[t_idx][cur_lookup(j,i)] > 1e-305) {
+        fwcount[t_idx][cur_lookup(j,i)] += forward(i,j)*backward(i,j)*node_factor[j] / dict[t_idx][cur_lookup(j,i)];
+
+        const T bw = backward(i,j) * trans_factor[j];	  
+
+        uint i_prev;
+        T addon;
+	    
+        for (i_prev = 0; i_prev < curI; i_prev++) {
+          addon = bw * cur_align_model(i,i_prev) * (forward(i_prev,j_prev) + forward(i_prev+curI,j_prev));
+          assert(!isnan(addon));
+          cur_facount(i,i_prev) += addon;
+        }
+
+        //start empty word
+        if (start_empty_word) {
+          addon = bw * cur_initial_prob[i] * forward(2*curI,j_prev);
+          cur_ficount[i] += addon;
+        }
+      }
+    }
+
+    //empty words
+    for (uint i=curI; i < 2*curI; i++) {
+
+      const T bw = backward(i,j) * trans_factor[j];
+      T addon = bw * cur_align_model(curI,i-curI) * 
+        (forward(i,j_prev) + forward(i-curI,j_prev));
+
+      assert(!isnan(addon));
+
+      fwcount[0][s_idx-1] += addon;  
+      cur_facount(curI,i-curI) += addon;
+    }
+
+    //start empty word
+    if (start_empty_word) {
+
+      const T bw = backward(2*curI,j) * trans_factor[j];
+    
+      T addon = bw * forward(2*curI,j_prev) * cur_initial_prob[curI];
+      fwcount[0][s_idx-1] += addon;            
+      cur_ficount[curI] += addon;
+    }
+  }
+}
+
+//buffers of the scaled count collection. Each thread keeps one object over all its sentences,
+// resize_dirty() then only reallocates when a sentence is larger than all previous ones
+struct ScaledHmmBuffers {
+
+  Math2D::Matrix<double> forward_;
+  Math2D::Matrix<double> backward_;
+  Math1D::Vector<double> fwd_log_scale_;
+  Math1D::Vector<double> bwd_log_scale_;
+  Math1D::Vector<double> node_factor_;
+  Math1D::Vector<double> trans_factor_;
+  Math1D::Vector<double> prev_sum_;
+};
+
+//variant of the count collection for a single sentence pair where forward and backward are computed in double precision
+// with rescaling at every position. Returns the logarithm of the sentence probability
+double add_scaled_hmm_sentence_counts(const SentenceView& cur_source, const SentenceView& cur_target,
+                                      const SingleLookupTable& cur_lookup, const SingleWordDictionary& dict,
+                                      const Math2D::Matrix<double>& cur_align_model, const Math1D::Vector<double>& cur_initial_prob,
+                                      HmmAlignProbType align_type, bool start_empty_word,
+                                      Storage1D<Math1D::Vector<double> >& fwcount, Math2D::Matrix<double>& cur_facount,
+                                      Math1D::Vector<double>& cur_ficount, ScaledHmmBuffers& buffers) {
+
+  const uint curJ = cur_source.size();
+  const uint curI = cur_target.size();
+
+  Math2D::Matrix<double>& forward = buffers.forward_;
+  Math2D::Matrix<double>& backward = buffers.backward_;
+  forward.resize_dirty(2*curI,curJ);
+  backward.resize_dirty(2*curI,curJ);
+
+  Math1D::Vector<double>& fwd_log_scale = buffers.fwd_log_scale_;
+  Math1D::Vector<double>& bwd_log_scale = buffers.bwd_log_scale_;
+
+  if (start_empty_word) {
+    calculate_sehmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                            cur_initial_prob, forward, &fwd_log_scale, &buffers.prev_sum_);
+    calculate_sehmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                             cur_initial_prob, backward, true, &bwd_log_scale);
+  }
+  else {
+    calculate_hmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                          cur_initial_prob, align_type, forward, &fwd_log_scale, &buffers.prev_sum_);
+    calculate_hmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                           cur_initial_prob, align_type, backward, true, &bwd_log_scale);
+  }
+
+  double fwd_sum = 0.0;
+  for (uint i=0; i < forward.xDim(); i++)
+    fwd_sum += forward(i,curJ-1);
+
+  double bwd_sum = 0.0;
+  for (uint i=0; i < backward.xDim(); i++)
+    bwd_sum += backward(i,0);
+
+  const double log_sentence_prob = fwd_log_scale[curJ-1] + std::log(fwd_sum);
+  const double log_fwd_bwd_ratio = log_sentence_prob - (bwd_log_scale[0] + std::log(bwd_sum));
+
+  if (!(fabs(log_fwd_bwd_ratio) < 1e-3)) {
+    std::cerr << "fwd_bwd_ratio of " << std::exp(log_fwd_bwd_ratio) << " for sentence pair with I=" << curI
+              << ", J= " << curJ << std::endl;
+  }
+
+  Math1D::Vector<double>& node_factor = buffers.node_factor_;
+  Math1D::Vector<double>& trans_factor = buffers.trans_factor_;
+  node_factor.resize_dirty(curJ);
+  trans_factor.resize_dirty(curJ);
+  trans_factor[0] = 0.0;
+  for (uint j=0; j < curJ; j++) {
+    node_factor[j] = std::exp(fwd_log_scale[j] + bwd_log_scale[j] - log_sentence_prob);
+    if (j > 0)
+      trans_factor[j] = std::exp(fwd_log_scale[j-1] + bwd_log_scale[j] - log_sentence_prob);
+  }
+
+  add_hmm_sentence_counts(cur_source, cur_target, cur_lookup, dict, cur_align_model, cur_initial_prob,
+                          start_empty_word, forward, backward, std::exp(bwd_log_scale[0] - log_sentence_prob),
+                          node_factor, trans_factor, fwcount, cur_facount, cur_ficount);
+
+  return log_sentence_prob;
+}
+
+void train_extended_hmm(const Corpus& source, 
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target,
+                        const Corpus& target,
                         const CooccuringWordsType& wcooc,
                         FullHMMAlignmentModel& align_model,
                         Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -841,6 +1231,7 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
                         HmmOptions& options) {
 
   std::cerr << "starting Extended HMM EM-training" << std::endl;
+  std::cerr << "using " << hmm_kernel_name() << " kernels for the transition steps" << std::endl;
 
   uint nIterations = options.nIterations_;
   HmmInitProbType init_type = options.init_type_;
@@ -855,7 +1246,7 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
   assert(wcooc.size() == options.nTargetWords_);
   //NOTE: the dictionary is assumed to be initialized
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   const size_t nSentences = source.size();
   assert(nSentences == target.size());
@@ -911,22 +1302,30 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
     }
   }
 
+  const uint nThreads = std::max<uint>(1,options.nThreads_);
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math2D::Matrix<double> > > facount_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > ficount_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fwcount_shard[t] = fwcount;
+    facount_shard[t] = facount;
+    ficount_shard[t] = ficount;
+  }
+
+  Math1D::Vector<double> thread_perplexity(nThreads,0.0);
+
+  //each thread handles one block of the schedule and collects into its own count shards
+  const SentenceSchedule schedule(source,target,nThreads,options.sort_by_length_,options.stream_chunk_size_);
+
   for (uint iter = 1; iter <= nIterations; iter++) {
     
     std::cerr << "starting EHMM iteration #" << iter << std::endl;
 
     double prev_perplexity = 0.0;
 
-    //set counts to 0
-    for (uint i=0; i < options.nTargetWords_; i++) {
-      fwcount[i].set_constant(0.0);
-    }
-
-    for (uint I = 1; I <= maxI; I++) {
-      facount[I-1].set_constant(0.0);
-      ficount[I-1].set_constant(0.0);
-    }
-
+    //set counts to 0 (the shards of the individual threads are cleared by the threads themselves)
     if (align_type != HmmAlignProbNonpar) {
       dist_count.set_constant(0.0);
       source_fert_count.set_constant(0.0);
@@ -937,210 +1336,204 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       init_count.set_constant(0.0);
     }
 
-    for (size_t s=0; s < nSentences; s++) {
-
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
-      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
-      
-      const uint curJ = cur_source.size();
-      const uint curI = cur_target.size();
-
-      const Math2D::Matrix<double>& cur_align_model = align_model[curI-1];
-      Math2D::Matrix<double>& cur_facount = facount[curI-1];
-      
-      /**** Baum-Welch traininig: start with calculating forward and backward ********/
-
-      Math2D::NamedMatrix<long double> forward(2*curI,curJ,MAKENAME(forward));
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
 
-      if (start_empty_word) {
+      Storage1D<Math1D::Vector<double> >& thread_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math2D::Matrix<double> >& thread_facount = (t == 0) ? facount : facount_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& thread_ficount = (t == 0) ? ficount : ficount_shard[t-1];
 
-        calculate_sehmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                                initial_prob[curI-1], forward);
+      for (uint i=0; i < options.nTargetWords_; i++) {
+        thread_fwcount[i].set_constant(0.0);
       }
-      else {
-        calculate_hmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                              initial_prob[curI-1], align_type, forward);
+
+      for (uint I = 1; I <= maxI; I++) {
+        thread_facount[I-1].set_constant(0.0);
+        thread_ficount[I-1].set_constant(0.0);
       }
 
-      const uint start_s_idx = cur_source[0];
+      WordLookupBuffers aux_lookup;
 
-      long double sentence_prob = 0.0;
-      for (uint i=0; i < forward.xDim(); i++) {
+      double cur_perplexity = 0.0;
 
-	if (!(forward(i,curJ-1) >= 0.0)) {
-	  
-	  std::cerr << "s=" << s << ", I=" << curI << ", i= " << i << ", value " << forward(i,curJ-1) << std::endl;
+      //the buffers are kept over the sentences, so they are only reallocated when a sentence exceeds all previous sizes
+      Math1D::Vector<long double> node_factor;
+      Math2D::NamedMatrix<long double> forward(MAKENAME(forward));
+      Math2D::NamedMatrix<long double> backward(MAKENAME(backward));
+      Math1D::Vector<long double> prev_sum;
+      ScaledHmmBuffers scaled_buffers;
 
-	  for (uint k=0; k < initial_prob[curI-1].size(); k++) {
-	    double p = initial_prob[curI-1][k];
-	    if (!(p >= 0))
-	      std::cerr << "initial prob[" << k << "]: " << p << std::endl;
-	  }
+      for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
 
-	  for (uint x=0; x < cur_align_model.xDim(); x++) {
-	    for (uint y=0; y < cur_align_model.yDim(); y++) {
-	      double p = cur_align_model(x,y);
-	      if (!(p >= 0))
-		std::cerr << "align model(" << x << "," << y << "): " << p << std::endl;
-	    }
-	  }
+        const size_t s = schedule[k];
+        schedule.prefetch(t,k);
 
-	  for (uint j=0; j < curJ; j++) {
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+      
+        const uint curJ = cur_source.size();
+        const uint curI = cur_target.size();
 
-	    double p = dict[0][cur_source[j]-1];
-	    if (!(p >= 0))
-	      std::cerr << "null-prob for source word " << j << ": " << p << std::endl;
+        const Math2D::Matrix<double>& cur_align_model = align_model[curI-1];
+        Math2D::Matrix<double>& cur_facount = thread_facount[curI-1];
 
-	    for (uint i=0; i < curI; i++) {
-	      
-	      p = dict[cur_target[i]][cur_lookup(j,i)];
-	      if (!(p >= 0)) {
-		std::cerr << "dict-prob for source word " << j << " and target word " << i 
-			  << ": " << p << std::endl;
-	      }
-	    } 
-	  }
+        if (options.scaled_forward_backward_) {
+          cur_perplexity -= add_scaled_hmm_sentence_counts(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                                           initial_prob[curI-1], align_type, start_empty_word,
+                                                           thread_fwcount, cur_facount, thread_ficount[curI-1],
+                                                           scaled_buffers);
+          continue;
+        }
+      
+        /**** Baum-Welch traininig: start with calculating forward and backward ********/
 
-	  //DEBUG
-	  exit(1);
-	  //END_DEBUG
-	}
+        forward.resize_dirty(2*curI,curJ);
 
-        assert(forward(i,curJ-1) >= 0.0);
-        sentence_prob += forward(i,curJ-1);
-      }
+        if (start_empty_word) {
 
-      prev_perplexity -= std::log(sentence_prob);
-      
-      if (! (sentence_prob > 0.0)) {
-        //if (true) {
-        std::cerr << "sentence_prob " << sentence_prob << " for sentence pair " << s << " with I=" << curI
-                  << ", J= " << curJ << std::endl;
+          calculate_sehmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                  initial_prob[curI-1], forward, 0, &prev_sum);
+        }
+        else {
+          calculate_hmm_forward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                initial_prob[curI-1], align_type, forward, 0, &prev_sum);
+        }
 
-	//DEBUG
-	//exit(1);
-	//END_DEBUG
-      }
-      assert(sentence_prob > 0.0);
-      
-      Math2D::NamedMatrix<long double> backward(2*curI,curJ,MAKENAME(backward));
+        long double sentence_prob = 0.0;
+        for (uint i=0; i < forward.xDim(); i++) {
 
-      if (start_empty_word) {
+	  if (!(forward(i,curJ-1) >= 0.0)) {
+	  
+	    std::cerr << "s=" << s << ", I=" << curI << ", i= " << i << ", value " << forward(i,curJ-1) << std::endl;
 
-        calculate_sehmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                                 initial_prob[curI-1], backward, true);
-      }
-      else {
+	    for (uint k=0; k < initial_prob[curI-1].size(); k++) {
+	      double p = initial_prob[curI-1][k];
+	      if (!(p >= 0))
+		std::cerr << "initial prob[" << k << "]: " << p << std::endl;
+	    }
 
-        calculate_hmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
-                               initial_prob[curI-1], align_type, backward, true);
+	    for (uint x=0; x < cur_align_model.xDim(); x++) {
+	      for (uint y=0; y < cur_align_model.yDim(); y++) {
+		double p = cur_align_model(x,y);
+		if (!(p >= 0))
+		  std::cerr << "align model(" << x << "," << y << "): " << p << std::endl;
+	      }
+	    }
 
-      }
+	    for (uint j=0; j < curJ; j++) {
 
+	      double p = dict[0][cur_source[j]-1];
+	      if (!(p >= 0))
+		std::cerr << "null-prob for source word " << j << ": " << p << std::endl;
 
-      long double bwd_sentence_prob = 0.0;
-      for (uint i=0; i < backward.xDim(); i++)
-        bwd_sentence_prob += backward(i,0);
+	      for (uint i=0; i < curI; i++) {
+	      
+		p = dict[cur_target[i]][cur_lookup(j,i)];
+		if (!(p >= 0)) {
+		  std::cerr << "dict-prob for source word " << j << " and target word " << i 
+			    << ": " << p << std::endl;
+		}
+	      } 
+	    }
 
-      long double fwd_bwd_ratio = sentence_prob / bwd_sentence_prob;
+	    //DEBUG
+	    exit(1);
+	    //END_DEBUG
+	  }
 
-      if (fwd_bwd_ratio < 0.999 || fwd_bwd_ratio > 1.001) {
-	
-        std::cerr << "fwd_bwd_ratio of " << fwd_bwd_ratio << " for sentence pair " << s << " with I=" << curI
-                  << ", J= " << curJ << std::endl;
-      }
+          assert(forward(i,curJ-1) >= 0.0);
+          sentence_prob += forward(i,curJ-1);
+        }
 
-      assert(fwd_bwd_ratio < 1.001);
-      assert(fwd_bwd_ratio > 0.999);
+        cur_perplexity -= std::log(sentence_prob);
+      
+        if (! (sentence_prob > 0.0)) {
+          //if (true) {
+          std::cerr << "sentence_prob " << sentence_prob << " for sentence pair " << s << " with I=" << curI
+                    << ", J= " << curJ << std::endl;
 
-      const long double inv_sentence_prob = 1.0 / sentence_prob;
+	  //DEBUG
+	  //exit(1);
+	  //END_DEBUG
+        }
+        assert(sentence_prob > 0.0);
+      
+        backward.resize_dirty(2*curI,curJ);
 
-      /**** update counts ****/
-      //start of sentence
-      for (uint i=0; i < curI; i++) {
-        uint t_idx = cur_target[i];
+        if (start_empty_word) {
 
-        double coeff = inv_sentence_prob * backward(i,0);
-        fwcount[t_idx][cur_lookup(0,i)] += coeff;
+          calculate_sehmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                   initial_prob[curI-1], backward, true);
+        }
+        else {
 
-	assert(!isnan(coeff));
+          calculate_hmm_backward(cur_source, cur_target, cur_lookup, dict, cur_align_model,
+                                 initial_prob[curI-1], align_type, backward, true);
 
-        ficount[curI-1][i] += coeff;
-      }
-      if (!start_empty_word) {
-        for (uint i=0; i < curI; i++) {
-          double coeff = inv_sentence_prob * backward(i+curI,0);
-          fwcount[0][start_s_idx-1] += coeff;
-          
-          assert(!isnan(coeff));
-          
-          ficount[curI-1][i+curI] += coeff;
         }
-      }
-      else
-        ficount[curI-1][curI] += inv_sentence_prob * backward(2*curI,0);
 
-      //mid-sentence
-      for (uint j=1; j < curJ; j++) {
 
-        const uint s_idx = cur_source[j];
-        const uint j_prev = j -1;
+        long double bwd_sentence_prob = 0.0;
+        for (uint i=0; i < backward.xDim(); i++)
+          bwd_sentence_prob += backward(i,0);
 
-        //real positions
-        for (uint i=0; i < curI; i++) {
-          const uint t_idx = cur_target[i];
+        long double fwd_bwd_ratio = sentence_prob / bwd_sentence_prob;
 
+        if (fwd_bwd_ratio < 0.999 || fwd_bwd_ratio > 1.001) {
+	
+          std::cerr << "fwd_bwd_ratio of " << fwd_bwd_ratio << " for sentence pair " << s << " with I=" << curI
+                    << ", J= " << curJ << std::endl;
+        }
 
-          if (dict[t_idx][cur_lookup(j,i)] > 1e-305) {
-            fwcount[t_idx][cur_lookup(j,i)] += forward(i,j)*backward(i,j)*inv_sentence_prob / dict[t_idx][cur_lookup(j,i)];
+        assert(fwd_bwd_ratio < 1.001);
+        assert(fwd_bwd_ratio > 0.999);
 
-            const long double bw = backward(i,j) * inv_sentence_prob;	  
+        const long double inv_sentence_prob = 1.0 / sentence_prob;
 
-            uint i_prev;
-            long double addon;
-	    
-            for (i_prev = 0; i_prev < curI; i_prev++) {
-              addon = bw * cur_align_model(i,i_prev) * (forward(i_prev,j_prev) + forward(i_prev+curI,j_prev));
-	      assert(!isnan(addon));
-              cur_facount(i,i_prev) += addon;
-            }
+        //all probabilities are divided by the same sentence probability
+        node_factor.resize_dirty(curJ);
+        node_factor.set_constant(inv_sentence_prob);
 
-            //start empty word
-            if (start_empty_word) {
-              addon = bw * initial_prob[curI-1][i] * forward(2*curI,j_prev);
-              ficount[curI-1][i] += addon;
-            }
-          }
-        }
-
-        //empty words
-        for (uint i=curI; i < 2*curI; i++) {
+        add_hmm_sentence_counts(cur_source, cur_target, cur_lookup, dict, cur_align_model, initial_prob[curI-1],
+                                start_empty_word, forward, backward, inv_sentence_prob, node_factor, node_factor,
+                                thread_fwcount, cur_facount, thread_ficount[curI-1]);
+      } // loop over sentences finished
 
-          const long double bw = backward(i,j) * inv_sentence_prob;
-          long double addon = bw * cur_align_model(curI,i-curI) * 
-            (forward(i,j_prev) + forward(i-curI,j_prev));
+      thread_perplexity[t] = cur_perplexity;
+    }
 
-	  assert(!isnan(addon));
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    for (uint t=0; t < nThreads; t++)
+      prev_perplexity += thread_perplexity[t];
 
-          fwcount[0][s_idx-1] += addon;  
-          cur_facount(curI,i-curI) += addon;
-        }
+    if (nThreads > 1) {
 
-        //start empty word
-        if (start_empty_word) {
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) options.nTargetWords_; i++) {
+        for (uint t=1; t < nThreads; t++)
+          fwcount[i] += fwcount_shard[t-1][i];
+      }
 
-          const long double bw = backward(2*curI,j) * inv_sentence_prob;
-          
-          long double addon = bw * forward(2*curI,j_prev) * initial_prob[curI-1][curI];
-          fwcount[0][s_idx-1] += addon;            
-          ficount[curI-1][curI] += addon;
+      for (uint I = 1; I <= maxI; I++) {
+        for (uint t=1; t < nThreads; t++) {
+          facount[I-1] += facount_shard[t-1][I-1];
+          ficount[I-1] += ficount_shard[t-1][I-1];
         }
       }
-    } // loop over sentences finished
+    }
 
     prev_perplexity /= nSentences;
     std::cerr << "perplexity after iteration #" << (iter-1) << ": " << prev_perplexity << std::endl;
+
+    //the energy refers to the parameters the counts were collected with, so the regularity term is taken before the update.
+    // Without regularity it equals the perplexity
+    if (options.print_energy_ && dict_weight_sum > 0.0) {
+      std::cerr << "#### EHMM energy after iteration #" << (iter-1) << ": "
+                << (prev_perplexity + dict_regularity_term(dict, prior_weight, options.smoothed_l0_, options.l0_beta_) / nSentences)
+                << std::endl;
+    }
+
     std::cerr << "computing alignment and dictionary probabilities from normalized counts" << std::endl;
 
 
@@ -1176,7 +1569,10 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
     if (align_type != HmmAlignProbNonpar && align_type != HmmAlignProbNonpar2) {
 
-      double cur_energy = ehmm_m_step_energy(facount,dist_params,zero_offset,dist_grouping_param);
+      HmmDistortionStatistics distortion_stats;
+      compute_hmm_distortion_statistics(facount,zero_offset,distortion_stats,nThreads);
+
+      double cur_energy = ehmm_m_step_energy(distortion_stats,dist_params,dist_grouping_param);
         
       std::cerr << "cur energy: " << cur_energy << std::endl;
 
@@ -1184,7 +1580,7 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
         dist_count *= 1.0 / dist_count.sum();
 
-        double hyp_energy = ehmm_m_step_energy(facount,dist_count,zero_offset,dist_grouping_param);        
+        double hyp_energy = ehmm_m_step_energy(distortion_stats,dist_count,dist_grouping_param);        
 
         std::cerr << "hyp energy: " << hyp_energy << std::endl;
 
@@ -1201,7 +1597,7 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
         dist_count *= 1.0 / norm;
         dist_grouping_count *= 1.0 / norm;
 
-        double hyp_energy = ehmm_m_step_energy(facount,dist_count,zero_offset,dist_grouping_count);
+        double hyp_energy = ehmm_m_step_energy(distortion_stats,dist_count,dist_grouping_count);
 
         std::cerr << "hyp energy: " << hyp_energy << std::endl;
 
@@ -1213,7 +1609,7 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       }
 
       //call m-step
-      ehmm_m_step(facount, dist_params, zero_offset, options.align_m_step_iter_, dist_grouping_param);
+      ehmm_m_step(distortion_stats, dist_params, options.align_m_step_iter_, dist_grouping_param);
     }
 
     if (init_type == HmmInitPar) {
@@ -1256,7 +1652,8 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
       double alpha = 1.0;
 
-      for (uint i=0; i < options.nTargetWords_; i++) {
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+      for (int i=0; i < (int) options.nTargetWords_; i++) {
           
         double cur_energy = single_dict_m_step_energy(fwcount[i], prior_weight[i], dict[i], options.smoothed_l0_, options.l0_beta_);
 
@@ -1446,13 +1843,6 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       nErrors /= nContributors;
       sum_fmeasure /= nContributors;
 
-      if (options.print_energy_) {
-        std::cerr << "#### EHMM energy after iteration # " << iter << ": " 
-                  <<  extended_hmm_energy(source, slookup, target, align_model, initial_prob, 
-                                          dict, wcooc, nSourceWords, prior_weight, align_type, 
-                                          start_empty_word, options.smoothed_l0_, options.l0_beta_) 
-                  << std::endl;
-      }
       std::cerr << "#### EHMM Viterbi-AER after iteration #" << iter << ": " << sum_aer << " %" << std::endl;
       if (!start_empty_word)
         std::cerr << "---- EHMM Marginal-AER : " << sum_marg_aer << " %" << std::endl;
@@ -1465,9 +1855,9 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
 
 
-void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
+void train_extended_hmm_gd_stepcontrol(const Corpus& source,
                                        const LookupTable& slookup,
-                                       const Storage1D<Storage1D<uint> >& target,
+                                       const Corpus& target,
                                        const CooccuringWordsType& wcooc,
                                        FullHMMAlignmentModel& align_model,
                                        Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -1478,6 +1868,8 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
                                        const floatSingleWordDictionary& prior_weight,
                                        HmmOptions& options) {
 
+  std::vector<double> proj_aux;
+
   std::cerr << "starting Extended HMM GD-training" << std::endl;
 
   uint nIterations = options.nIterations_;
@@ -1505,7 +1897,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 
   const uint nSourceWords = options.nSourceWords_;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   std::set<uint> seenIs;
 
@@ -1602,7 +1994,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 
   double energy = extended_hmm_energy(source, slookup, target, align_model, initial_prob, 
 				      dict, wcooc, nSourceWords, prior_weight, align_type, 
-                                      start_empty_word, smoothed_l0, l0_beta);
+                                      start_empty_word, smoothed_l0, l0_beta, options.nThreads_);
 
 
   double line_reduction_factor = 0.5;
@@ -1640,8 +2032,8 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 
     for (size_t s=0; s < nSentences; s++) {
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
       
       const uint curJ = cur_source.size();
@@ -1931,7 +2323,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
       for (uint i=0; i < 2; i++)
         new_source_fert[i] = source_fert[i] - real_alpha * source_fert_grad[i];
 
-      projection_on_simplex(new_source_fert.direct_access(), 2);
+      projection_on_simplex(new_source_fert.direct_access(), 2, proj_aux);
     }
 
     if (init_type == HmmInitPar) {
@@ -1939,7 +2331,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
       for (uint k=0; k < init_params.size(); k++)
         new_init_params[k] = init_params[k] - real_alpha * init_param_grad[k];
 
-      projection_on_simplex(new_init_params.direct_access(), new_init_params.size());
+      projection_on_simplex(new_init_params.direct_access(), new_init_params.size(), proj_aux);
     }
 
     if (align_type == HmmAlignProbFullpar) {
@@ -1947,7 +2339,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
       for (uint k=0; k < dist_params.size(); k++)
         new_dist_params[k] = dist_params[k] - real_alpha * dist_grad[k];
 
-      projection_on_simplex(new_dist_params.direct_access(), new_dist_params.size());
+      projection_on_simplex(new_dist_params.direct_access(), new_dist_params.size(), proj_aux);
     }
     else if (align_type == HmmAlignProbReducedpar) {
 
@@ -1958,7 +2350,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 
       assert(new_dist_params.size() >= 11);
 
-      projection_on_simplex_with_slack(new_dist_params.direct_access()+zero_offset-5,new_dist_grouping_param,11);
+      projection_on_simplex_with_slack(new_dist_params.direct_access()+zero_offset-5,new_dist_grouping_param,11, proj_aux);
     }
 
     for (uint i=0; i < options.nTargetWords_; i++) {
@@ -2023,7 +2415,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 	  new_dict_prob[i][k] = 9e74;
       }
 
-      projection_on_simplex_with_slack(new_dict_prob[i].direct_access(),new_slack_vector[i],new_dict_prob[i].size());
+      projection_on_simplex_with_slack(new_dict_prob[i].direct_access(),new_slack_vector[i],new_dict_prob[i].size(), proj_aux);
     }
 
     for (uint I = 1; I <= maxI; I++) {
@@ -2043,7 +2435,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 	}
       }
 
-      projection_on_simplex(new_init_prob[I-1].direct_access(),new_init_prob[I-1].size());
+      projection_on_simplex(new_init_prob[I-1].direct_access(),new_init_prob[I-1].size(), proj_aux);
 
       if (align_type == HmmAlignProbNonpar) {
 
@@ -2059,7 +2451,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
         for (uint y=0; y < align_model[I-1].yDim(); y++) {
 	 	  
           projection_on_simplex(new_align_prob[I-1].direct_access() + y*align_model[I-1].xDim(),
-                                align_model[I-1].xDim());
+                                align_model[I-1].xDim(), proj_aux);
         }
       }
     }
@@ -2135,7 +2527,7 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 
       double new_energy = extended_hmm_energy(source, slookup, target, hyp_align_prob, 
                                               hyp_init_prob, hyp_dict_prob, wcooc, nSourceWords, prior_weight, 
-					      align_type, start_empty_word, smoothed_l0, l0_beta);   
+					      align_type, start_empty_word, smoothed_l0, l0_beta, options.nThreads_);   
 
       std::cerr << "new: " << new_energy << ", prev: " << hyp_energy << std::endl;
 
@@ -2288,9 +2680,9 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
 }
 
 
-void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
+void viterbi_train_extended_hmm(const Corpus& source,
                                 const LookupTable& slookup,
-                                const Storage1D<Storage1D<uint> >& target,
+                                const Corpus& target,
                                 const CooccuringWordsType& wcooc,
                                 FullHMMAlignmentModel& align_model,
                                 Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -2315,11 +2707,11 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
   const uint nSourceWords = options.nSourceWords_;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   for (size_t s=0; s < nSentences; s++) {
     
-    const Storage1D<uint>& cur_source = source[s];
+    const SentenceView& cur_source = source[s];
     viterbi_alignment[s].resize(cur_source.size());
   }
   assert(wcooc.size() == options.nTargetWords_);
@@ -2391,8 +2783,8 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
     for (size_t s=0; s < nSentences; s++) {
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
             
 
@@ -2589,7 +2981,10 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
         }
       }
       
-      double cur_energy = ehmm_m_step_energy(acount,dist_params,zero_offset,dist_grouping_param);
+      HmmDistortionStatistics distortion_stats;
+      compute_hmm_distortion_statistics(acount,zero_offset,distortion_stats,options.nThreads_);
+
+      double cur_energy = ehmm_m_step_energy(distortion_stats,dist_params,dist_grouping_param);
 
       std::cerr << "cur_energy: " << cur_energy << std::endl;
 
@@ -2597,7 +2992,7 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
 
         dist_count *= 1.0 / dist_count.sum();
 
-        double hyp_energy = ehmm_m_step_energy(acount,dist_count,zero_offset,dist_grouping_param);        
+        double hyp_energy = ehmm_m_step_energy(distortion_stats,dist_count,dist_grouping_param);        
 
         std::cerr << "hyp_energy: " << hyp_energy << std::endl;
 
@@ -2614,7 +3009,7 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
         dist_count *= 1.0 / norm;
         dist_grouping_count *= 1.0 / norm;
 
-        double hyp_energy = ehmm_m_step_energy(acount,dist_count,zero_offset,dist_grouping_count);
+        double hyp_energy = ehmm_m_step_energy(distortion_stats,dist_count,dist_grouping_count);
 
         std::cerr << "hyp_energy: " << hyp_energy << std::endl;
 
@@ -2626,7 +3021,7 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       }
 
       //call m-step
-      ehmm_m_step(acount, dist_params, zero_offset, options.align_m_step_iter_, dist_grouping_param);
+      ehmm_m_step(distortion_stats, dist_params, options.align_m_step_iter_, dist_grouping_param);
 
       par2nonpar_hmm_alignment_model(dist_params, zero_offset, dist_grouping_param, source_fert,
                                      align_type, align_model);
@@ -2656,8 +3051,8 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       const uint curJ = source[s].size();
       const uint curI = target[s].size();
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
 
       Math1D::Vector<AlignBaseType>& cur_alignment = viterbi_alignment[s];
 
@@ -3279,8 +3674,8 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       
       for (size_t s=0; s < nSentences; s++) {
         
-        const Storage1D<uint>& cur_source = source[s];
-        const Storage1D<uint>& cur_target = target[s];
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
         const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
 
 
@@ -3409,7 +3804,10 @@ void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
       }
       else {
 
-        ehmm_m_step(acount, dist_params, zero_offset, options.align_m_step_iter_, dist_grouping_param);
+        HmmDistortionStatistics distortion_stats;
+        compute_hmm_distortion_statistics(acount,zero_offset,distortion_stats,options.nThreads_);
+
+        ehmm_m_step(distortion_stats, dist_params, options.align_m_step_iter_, dist_grouping_param);
         //par2nonpar can only be called when source_fert has been updated (may still get some counts from the init model!)
       }
     }
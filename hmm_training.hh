@@ -31,6 +31,15 @@ public:
 
   bool print_energy_;
 
+  //EM: compute forward and backward in double precision with rescaling instead of long double
+  bool scaled_forward_backward_;
+
+  //EM: visit the sentence pairs grouped by length instead of in corpus order (see SentenceSchedule)
+  bool sort_by_length_;
+
+  //EM: if nonzero, stream through the corpus in chunks of this many sentence pairs per thread (see SentenceSchedule)
+  size_t stream_chunk_size_;
+
   uint nSourceWords_; 
   uint nTargetWords_;
 
@@ -38,15 +47,17 @@ public:
   uint align_m_step_iter_;
   uint dict_m_step_iter_;
 
+  uint nThreads_;
+
   IBM1TransferMode transfer_mode_;
 
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments_;
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments_;
 };
 
-void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
+void train_extended_hmm(const Corpus& source,
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target,
+                        const Corpus& target,
                         const CooccuringWordsType& wcooc,
                         FullHMMAlignmentModel& align_model,
                         Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -58,9 +69,9 @@ void train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
                         HmmOptions& options);
 
 
-void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
+void train_extended_hmm_gd_stepcontrol(const Corpus& source,
                                        const LookupTable& slookup,
-                                       const Storage1D<Storage1D<uint> >& target,
+                                       const Corpus& target,
                                        const CooccuringWordsType& wcooc,
                                        FullHMMAlignmentModel& align_model,
                                        Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -72,9 +83,9 @@ void train_extended_hmm_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source
                                        HmmOptions& options);
 
 
-void viterbi_train_extended_hmm(const Storage1D<Storage1D<uint> >& source,
+void viterbi_train_extended_hmm(const Corpus& source,
                                 const LookupTable& slookup,
-                                const Storage1D<Storage1D<uint> >& target,
+                                const Corpus& target,
                                 const CooccuringWordsType& wcooc,
                                 FullHMMAlignmentModel& align_model,
                                 Math1D::Vector<double>& dist_params, double& dist_grouping_param,
@@ -92,8 +103,40 @@ void par2nonpar_hmm_alignment_model(const Math1D::Vector<double>& dist_params, c
                                     const double dist_grouping_param, const Math1D::Vector<double>& source_fert,
                                     HmmAlignProbType align_type, FullHMMAlignmentModel& align_model);
 
+//derives alignment and initial models for sentences outside the training corpus (with the target lengths in seenIs).
+// maxI is the maximal target length of the training corpus. Parameters that were not estimated in training
+// are first derived from the nonparametric models
+void create_external_hmm_model(const std::set<uint>& seenIs, uint maxI,
+                               const FullHMMAlignmentModel& align_model, const InitialAlignmentProbability& initial_prob,
+                               Math1D::Vector<double>& init_params, Math1D::Vector<double>& dist_params,
+                               double& dist_grouping_param, Math1D::Vector<double>& source_fert,
+                               HmmAlignProbType align_type, HmmInitProbType init_type,
+                               FullHMMAlignmentModel& ext_align_model, InitialAlignmentProbability& ext_initial_prob);
+
+
+//sufficient statistics of the alignment counts for the M-step of the parametric alignment model.
+// They are computed once per EM-iteration, afterwards energy and gradient take O(maxI^2) time
+struct HmmDistortionStatistics {
+
+  uint zero_offset_;
+
+  //summed counts per displacement, indexed like the distortion parameters
+  Math1D::Vector<double> displacement_count_;
+
+  //summed counts of the displacements beyond +-5 (only used with a grouping parameter), indexed by the grouping norm
+  Math1D::Vector<double> far_count_;
+
+  //indexed by (I-1, i), summed counts of the jumps from position i for target length I. Zero for unseen lengths
+  Math2D::Matrix<double> position_count_;
+};
+
+void compute_hmm_distortion_statistics(const FullHMMAlignmentModel& facount, uint zero_offset,
+                                       HmmDistortionStatistics& stats, uint nThreads = 1);
+
+double ehmm_m_step_energy(const HmmDistortionStatistics& stats, const Math1D::Vector<double>& dist_params,
+                          double grouping_param = -1.0);
 
-void ehmm_m_step(const FullHMMAlignmentModel& facount, Math1D::Vector<double>& dist_params, uint zero_offset,
+void ehmm_m_step(const HmmDistortionStatistics& stats, Math1D::Vector<double>& dist_params,
                  uint nIter, double& grouping_param);
 
 void ehmm_init_m_step(const InitialAlignmentProbability& init_acount, Math1D::Vector<double>& init_params, uint nIter);
@@ -34,24 +34,44 @@ double prob_pen_prime(double x, double beta) {
   return - prob_penalty(x,beta) / beta;
 }
 
+double dict_regularity_term(const SingleWordDictionary& dict, const floatSingleWordDictionary& prior_weight,
+                            bool smoothed_l0, double l0_beta) {
+
+  double energy = 0.0; 
+
+  for (uint i=0; i < dict.size(); i++) {
+
+    const uint size = dict[i].size();
+    
+    for (uint k=0; k < size; k++) {
+      if (smoothed_l0)
+        energy += prior_weight[i][k] * prob_penalty(dict[i][k],l0_beta);
+      else
+        energy += prior_weight[i][k] * dict[i][k];
+    }
+  }
+
+  return energy;
+}
+
 
 IBM1Options::IBM1Options(uint nSourceWords,uint nTargetWords,
                          std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                          std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments) :
   nIterations_(5), smoothed_l0_(false), l0_beta_(1.0), print_energy_(true), 
-  nSourceWords_(nSourceWords), nTargetWords_(nTargetWords), dict_m_step_iter_(45),
+  nSourceWords_(nSourceWords), nTargetWords_(nTargetWords), dict_m_step_iter_(45), nThreads_(1),
   sure_ref_alignments_(sure_ref_alignments), possible_ref_alignments_(possible_ref_alignments) {}
 
 
-double ibm1_perplexity( const Storage1D<Storage1D<uint> >& source,
+double ibm1_perplexity( const Corpus& source,
                         const LookupTable& slookup,
-                        const Storage1D< Storage1D<uint> >& target,
+                        const Corpus& target,
                         const SingleWordDictionary& dict,
                         const CooccuringWordsType& wcooc, uint nSourceWords) {
 
   double sum = 0.0;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   const size_t nSentences = target.size();
   assert(slookup.size() == nSentences);
@@ -60,8 +80,8 @@ double ibm1_perplexity( const Storage1D<Storage1D<uint> >& source,
 
   for (size_t s=0; s < nSentences; s++) {
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
 
@@ -85,27 +105,15 @@ double ibm1_perplexity( const Storage1D<Storage1D<uint> >& source,
   return sum / nActualSentences;
 }
 
-double ibm1_energy( const Storage1D<Storage1D<uint> >& source,
+double ibm1_energy( const Corpus& source,
                     const LookupTable& slookup,
-                    const Storage1D< Storage1D<uint> >& target,
+                    const Corpus& target,
                     const SingleWordDictionary& dict,
                     const CooccuringWordsType& wcooc, uint nSourceWords,
                     const floatSingleWordDictionary& prior_weight,
                     bool smoothed_l0 = false, double l0_beta = 1.0) {
 
-  double energy = 0.0; 
-
-  for (uint i=0; i < dict.size(); i++) {
-
-    const uint size = dict[i].size();
-    
-    for (uint k=0; k < size; k++) {
-      if (smoothed_l0)
-        energy += prior_weight[i][k] * prob_penalty(dict[i][k],l0_beta);
-      else
-        energy += prior_weight[i][k] * dict[i][k];
-    }
-  }
+  double energy = dict_regularity_term(dict, prior_weight, smoothed_l0, l0_beta);
 
   energy /= target.size(); //since the perplexity is also divided by that amount
   
@@ -118,20 +126,30 @@ double single_dict_m_step_energy(const Math1D::Vector<double>& fdict_count,
                                  const Math1D::Vector<float>& prior_weight,
                                  const Math1D::Vector<double>& dict, bool smoothed_l0, double l0_beta) {
 
+  const uint size = dict.size();
+  const double* dict_data = dict.direct_access();
+  const double* count_data = fdict_count.direct_access();
+  const float* weight_data = prior_weight.direct_access();
 
   double energy = 0.0;
 
-  for (uint k=0; k < dict.size(); k++) {
-    if (!smoothed_l0)
-      energy += prior_weight[k] * dict[k];
-    else {
-      energy += prior_weight[k] * prob_penalty(dict[k],l0_beta);
-    }
+  //the regularity term is computed separately, so that the plain version vectorizes
+  if (!smoothed_l0) {
+#pragma omp simd reduction(+:energy)
+    for (uint k=0; k < size; k++)
+      energy += weight_data[k] * dict_data[k];
+  }
+  else {
+    for (uint k=0; k < size; k++)
+      energy += weight_data[k] * prob_penalty(dict_data[k],l0_beta);
+  }
+
+  for (uint k=0; k < size; k++) {
 
-    if (dict[k] > 1e-300)
-      energy -= fdict_count[k] * std::log(dict[k]);
+    if (dict_data[k] > 1e-300)
+      energy -= count_data[k] * std::log(dict_data[k]);
     else
-      energy += fdict_count[k] * 15000.0;
+      energy += count_data[k] * 15000.0;
   }
 
   return energy;
@@ -142,6 +160,8 @@ void single_dict_m_step(const Math1D::Vector<double>& fdict_count,
                         Math1D::Vector<double>& dict, double alpha, uint nIter,
                         bool smoothed_l0, double l0_beta) {
 
+  std::vector<double> proj_aux;
+
   if (prior_weight.max_abs() == 0.0) {
     
     const double sum = fdict_count.sum();
@@ -168,29 +188,40 @@ void single_dict_m_step(const Math1D::Vector<double>& fdict_count,
   double line_reduction_factor = 0.5;
 
 
+  const uint size = prior_weight.size();
+  const double* count_data = fdict_count.direct_access();
+  const float* weight_data = prior_weight.direct_access();
+  double* dict_data = dict.direct_access();
+  double* grad_data = dict_grad.direct_access();
+  double* hyp_data = hyp_dict.direct_access();
+  double* new_data = new_dict.direct_access();
+
   for (uint iter=1; iter <= nIter; iter++) {
 
     //set gradient to 0 and recalculate
-    for (uint k=0; k < prior_weight.size(); k++) {
-      double cur_dict_entry = std::max(1e-15, dict[k]);
-
-      if (!smoothed_l0)
-        dict_grad[k] = prior_weight[k] - fdict_count[k] / cur_dict_entry;
-      else
-        dict_grad[k] = prior_weight[k] * prob_pen_prime(cur_dict_entry,l0_beta) 
-          - fdict_count[k] / cur_dict_entry;
+    if (!smoothed_l0) {
+#pragma omp simd
+      for (uint k=0; k < size; k++) {
+        const double cur_dict_entry = (dict_data[k] > 1e-15) ? dict_data[k] : 1e-15;
+        grad_data[k] = weight_data[k] - count_data[k] / cur_dict_entry;
+      }
+    }
+    else {
+      for (uint k=0; k < size; k++) {
+        const double cur_dict_entry = std::max(1e-15, dict_data[k]);
+        grad_data[k] = weight_data[k] * prob_pen_prime(cur_dict_entry,l0_beta) - count_data[k] / cur_dict_entry;
+      }
     }
 
     //go in neg. gradient direction
-    for (uint k=0; k < prior_weight.size(); k++) {
-	
-      new_dict[k] = dict[k] - alpha * dict_grad[k];
-    }
+#pragma omp simd
+    for (uint k=0; k < size; k++)
+      new_data[k] = dict_data[k] - alpha * grad_data[k];
     
     new_slack_entry = slack_entry;
     
     //reproject
-    projection_on_simplex_with_slack(new_dict.direct_access(), new_slack_entry, new_dict.size());
+    projection_on_simplex_with_slack(new_dict.direct_access(), new_slack_entry, new_dict.size(), proj_aux);
 
     
     double hyp_energy = 1e300; 
@@ -209,9 +240,9 @@ void single_dict_m_step(const Math1D::Vector<double>& fdict_count,
       lambda *= line_reduction_factor;
       double neg_lambda = 1.0 - lambda;
       
-      for (uint k=0; k < prior_weight.size(); k++) {      
-        hyp_dict[k] = lambda * new_dict[k] + neg_lambda * dict[k];
-      }
+#pragma omp simd
+      for (uint k=0; k < size; k++)
+        hyp_data[k] = lambda * new_data[k] + neg_lambda * dict_data[k];
       
       double new_energy = single_dict_m_step_energy(fdict_count,prior_weight,hyp_dict,smoothed_l0,l0_beta);
 
@@ -248,9 +279,9 @@ void single_dict_m_step(const Math1D::Vector<double>& fdict_count,
     
     energy = best_energy;
 
-    for (uint k=0; k < prior_weight.size(); k++) {      
-      dict[k] = best_lambda * new_dict[k] + neg_best_lambda * dict[k];
-    }
+#pragma omp simd
+    for (uint k=0; k < size; k++)
+      dict_data[k] = best_lambda * new_data[k] + neg_best_lambda * dict_data[k];
 
     slack_entry = best_lambda * new_slack_entry + neg_best_lambda * slack_entry;
 
@@ -264,17 +295,52 @@ void single_dict_m_step(const Math1D::Vector<double>& fdict_count,
 void dict_m_step(const SingleWordDictionary& fdict_count, 
                  const floatSingleWordDictionary& prior_weight,
                  SingleWordDictionary& dict, double alpha, uint nIter,
-                 bool smoothed_l0, double l0_beta) {
+                 bool smoothed_l0, double l0_beta, uint nThreads) {
 
-  for (uint k=0; k < dict.size(); k++)
+  //the sizes of the cooccurrence lists are very skewed, hence the dynamic schedule
+#pragma omp parallel for schedule(dynamic,1) num_threads(std::max<uint>(1,nThreads))
+  for (int k=0; k < (int) dict.size(); k++)
     single_dict_m_step(fdict_count[k],prior_weight[k],dict[k],alpha,nIter, smoothed_l0, l0_beta);    
 }
 
 
 
-void train_ibm1(const Storage1D<Storage1D<uint> >& source, 
+//E-step of IBM-1 for a single sentence pair. The lookup table is either a SingleLookupTable or a table stored
+// with 16 bits, which is then read without expanding it. The negative log-likelihood is subtracted from perplexity
+template<typename LookupT>
+static void add_ibm1_sentence_counts(const SentenceView& cur_source, const SentenceView& cur_target,
+                                     const LookupT& cur_lookup, const SingleWordDictionary& dict,
+                                     Storage1D<Math1D::Vector<double> >& fcount, double& perplexity) {
+
+  const uint nCurSourceWords = cur_source.size();
+  const uint nCurTargetWords = cur_target.size();
+
+  for (uint j=0; j < nCurSourceWords; j++) {
+
+    const uint s_idx = cur_source[j];
+
+    double coeff = dict[0][s_idx-1]; // entry for empty word (the emtpy word is not listed, hence s_idx-1)
+    for (uint i=0; i < nCurTargetWords; i++) {
+      const uint t_idx = cur_target[i];
+      coeff += dict[t_idx][cur_lookup(j,i)];
+    }
+    perplexity -= std::log(coeff);
+    coeff = 1.0 / coeff;
+
+    assert(!isnan(coeff));
+
+    fcount[0][s_idx-1] += coeff * dict[0][s_idx-1];
+    for (uint i=0; i < nCurTargetWords; i++) {
+      const uint t_idx = cur_target[i];
+      const uint k = cur_lookup(j,i);
+      fcount[t_idx][k] += coeff * dict[t_idx][k];
+    }
+  }
+}
+
+void train_ibm1(const Corpus& source, 
                 const LookupTable& slookup,
-                const Storage1D<Storage1D<uint> >& target, 
+                const Corpus& target, 
                 const CooccuringWordsType& wcooc,
                 SingleWordDictionary& dict,
                 const floatSingleWordDictionary& prior_weight, 
@@ -297,7 +363,7 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
 
   const uint nSourceWords = options.nSourceWords_;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   //prepare dictionary
   for (uint i=0; i < options.nTargetWords_; i++) {
@@ -316,8 +382,8 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
 #if 0
   for (size_t s=0; s < nSentences; s++) {
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     const uint curJ = cur_source.size();
     const uint curI = cur_target.size();
@@ -346,50 +412,90 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
     fcount[i].resize(dict[i].size());
   }
 
+  const uint nThreads = std::max<uint>(1,options.nThreads_);
+
+  //count shards for the additional threads (the first thread collects directly into fcount)
+  Storage1D<Storage1D<Math1D::Vector<double> > > fcount_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fcount_shard[t].resize(options.nTargetWords_);
+    for (uint i=0; i < options.nTargetWords_; i++) 
+      fcount_shard[t][i].resize(dict[i].size());
+  }
+
+  Math1D::Vector<double> thread_perplexity(nThreads,0.0);
+
   for (uint iter = 1; iter <= nIter; iter++) {
 
     std::cerr << "starting IBM-1 EM-iteration #" << iter << std::endl;
 
-    /*** a) compute fractional counts ***/
+    /*** a) compute fractional counts (and the perplexity of the current dictionary) ***/
     
-    for (uint i=0; i < options.nTargetWords_; i++) {
-      fcount[i].set_constant(0.0);
-    }
+    //each thread handles a contiguous block of sentences and collects into its own count shard
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
 
-    for (size_t s=0; s < nSentences; s++) {
+      Storage1D<Math1D::Vector<double> >& cur_fcount = (t == 0) ? fcount : fcount_shard[t-1];
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      for (uint i=0; i < options.nTargetWords_; i++) {
+        cur_fcount[i].set_constant(0.0);
+      }
 
-      const uint nCurSourceWords = cur_source.size();
-      const uint nCurTargetWords = cur_target.size();
-      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+      WordLookupBuffers aux_lookup;
 
-      if (nCurSourceWords == 0)
-        std::cerr << "WARNING: empty source sentence #" << s << std::endl;
-      if (nCurTargetWords == 0)
-        std::cerr << "WARNING: empty target sentence #" << s << std::endl;
-      
-      for (uint j=0; j < nCurSourceWords; j++) {
-	
-        const uint s_idx = source[s][j];
+      double cur_perplexity = 0.0;
 
-        double coeff = dict[0][s_idx-1]; // entry for empty word (the emtpy word is not listed, hence s_idx-1)
-        for (uint i=0; i < nCurTargetWords; i++) {
-          const uint t_idx = cur_target[i];
-          coeff += dict[t_idx][cur_lookup(j,i)];
-        }
-        coeff = 1.0 / coeff;
+      const size_t start_s = (nSentences * t) / nThreads;
+      const size_t end_s = (nSentences * (t+1)) / nThreads;
+
+      for (size_t s=start_s; s < end_s; s++) {
+
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 
-        assert(!isnan(coeff));
+        const uint nCurSourceWords = cur_source.size();
+        const uint nCurTargetWords = cur_target.size();
 
-        fcount[0][s_idx-1] += coeff * dict[0][s_idx-1];
-        for (uint i=0; i < nCurTargetWords; i++) {
-          const uint t_idx = cur_target[i];
-          const uint k = cur_lookup(j,i);
-          fcount[t_idx][k] += coeff * dict[t_idx][k];
+        if (nCurSourceWords == 0)
+          std::cerr << "WARNING: empty source sentence #" << s << std::endl;
+        if (nCurTargetWords == 0)
+          std::cerr << "WARNING: empty target sentence #" << s << std::endl;
+
+        cur_perplexity += nCurSourceWords*std::log(nCurTargetWords);
+
+        if (slookup[s].is_narrow(nCurSourceWords,nCurTargetWords))
+          add_ibm1_sentence_counts(cur_source,cur_target,slookup[s].narrow(),dict,cur_fcount,cur_perplexity);
+        else {
+          const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+          add_ibm1_sentence_counts(cur_source,cur_target,cur_lookup,dict,cur_fcount,cur_perplexity);
         }
       }
+
+      thread_perplexity[t] = cur_perplexity;
+    }
+
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    double prev_perplexity = 0.0;
+    for (uint t=0; t < nThreads; t++)
+      prev_perplexity += thread_perplexity[t];
+    prev_perplexity /= nSentences;
+
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) options.nTargetWords_; i++) {
+        for (uint t=1; t < nThreads; t++)
+          fcount[i] += fcount_shard[t-1][i];
+      }
+    }
+
+    std::cerr << "IBM-1 perplexity after iteration #" << (iter-1) << ": " << prev_perplexity << std::endl;
+
+    //the energy refers to the dictionary the counts were collected with, so the regularity term is taken before the update.
+    // Without regularity it equals the perplexity
+    if (options.print_energy_ && dict_weight_sum > 0.0) {
+      std::cerr << "IBM-1 energy after iteration #" << (iter-1) << ": " 
+                << (prev_perplexity + dict_regularity_term(dict,prior_weight,smoothed_l0,l0_beta) / nSentences)
+                << std::endl;
     }
 
     std::cerr << "updating dict from counts" << std::endl;
@@ -402,8 +508,9 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
         alpha = 1.0;
       if (iter > 5)
         alpha = 0.1;
-     
-      for (uint i=0; i < options.nTargetWords_; i++) {
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+      for (int i=0; i < (int) options.nTargetWords_; i++) {
           
         double cur_energy = single_dict_m_step_energy(fcount[i], prior_weight[i], dict[i], smoothed_l0, l0_beta);
 
@@ -449,11 +556,6 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
       }
     }
 
-    if (options.print_energy_) {
-      std::cerr << "IBM-1 energy after iteration #" << iter << ": " 
-                << ibm1_energy(source,slookup,target,dict,wcooc,nSourceWords,prior_weight,smoothed_l0,l0_beta) << std::endl;
-    }
-
     /************* compute alignment error rate ****************/
     if (!options.possible_ref_alignments_.empty()) {
       
@@ -495,14 +597,16 @@ void train_ibm1(const Storage1D<Storage1D<uint> >& source,
 
 }
 
-void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source, 
+void train_ibm1_gd_stepcontrol(const Corpus& source, 
                                const LookupTable& slookup,
-                               const Storage1D<Storage1D<uint> >& target,
+                               const Corpus& target,
                                const CooccuringWordsType& wcooc, 
                                SingleWordDictionary& dict, //uint nIter,
                                const floatSingleWordDictionary& prior_weight, 
                                IBM1Options& options) {
 
+  std::vector<double> proj_aux;
+
   uint nIter = options.nIterations_;
   bool smoothed_l0 = options.smoothed_l0_;
   double l0_beta = options.l0_beta_;
@@ -524,7 +628,7 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
 
   Math1D::Vector<double> slack_vector(options.nTargetWords_,0.0);
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   const uint nSourceWords = options.nSourceWords_;
   
@@ -535,8 +639,8 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
 
   for (size_t s=0; s < nSentences; s++) {
     
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
     
     const uint curJ = cur_source.size();
     const uint curI = cur_target.size();
@@ -602,8 +706,8 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
     
     for (size_t s=0; s < nSentences; s++) {
       
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
 
       const uint curJ = cur_source.size();
       const uint curI = cur_target.size();
@@ -677,7 +781,7 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
 
       const uint nCurWords = new_dict[i].size();
 
-      projection_on_simplex_with_slack(new_dict[i].direct_access(),slack_vector[i],nCurWords);
+      projection_on_simplex_with_slack(new_dict[i].direct_access(),slack_vector[i],nCurWords, proj_aux);
     }
     
     double lambda = 1.0;
@@ -806,9 +910,9 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
 }
 
 
-void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source, 
+void ibm1_viterbi_training(const Corpus& source, 
                            const LookupTable& slookup,
-                           const Storage1D<Storage1D<uint> >& target,
+                           const Corpus& target,
                            const CooccuringWordsType& wcooc, 
                            SingleWordDictionary& dict,
                            const floatSingleWordDictionary& prior_weight,
@@ -831,7 +935,7 @@ void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source,
   }
   dict[0].set_constant(1.0 / dict[0].size());
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   const uint nSourceWords = options.nSourceWords_;
 
@@ -841,8 +945,8 @@ void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source,
   }
   for (size_t s=0; s < nSentences; s++) {
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     const uint curJ = cur_source.size();
     const uint curI = cur_target.size();
@@ -874,8 +978,8 @@ void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source,
   double energy_offset = 0.0;
   for (size_t s=0; s < nSentences; s++) {
     
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
     
     viterbi_alignment[s].resize(cur_source.size());
 
@@ -899,8 +1003,8 @@ void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source,
 
     for (size_t s=0; s < nSentences; s++) {
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+      const SentenceView& cur_source = source[s];
+      const SentenceView& cur_target = target[s];
 
       const uint nCurSourceWords = cur_source.size();
       const uint nCurTargetWords = cur_target.size();
@@ -991,8 +1095,8 @@ void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source,
         if ((s%12500) == 0)
           std::cerr << "s: " << s << std::endl;
 
-        const Storage1D<uint>& cur_source = source[s];
-        const Storage1D<uint>& cur_target = target[s];
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 
         const uint curJ = cur_source.size();
         const uint curI = cur_target.size();
@@ -32,22 +32,24 @@ public:
 
   uint dict_m_step_iter_;
 
+  uint nThreads_;
+
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments_;
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments_;
 };
 
 
-void train_ibm1(const Storage1D<Storage1D<uint> >& source, 
+void train_ibm1(const Corpus& source, 
                 const LookupTable& slookup,
-                const Storage1D<Storage1D<uint> >& target,
+                const Corpus& target,
                 const CooccuringWordsType& cooc, 
                 SingleWordDictionary& dict,
                 const floatSingleWordDictionary& prior_weight,
                 IBM1Options& options);
 
-void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source, 
+void train_ibm1_gd_stepcontrol(const Corpus& source, 
                                const LookupTable& slookup,
-                               const Storage1D<Storage1D<uint> >& target,
+                               const Corpus& target,
                                const CooccuringWordsType& cooc, 
                                SingleWordDictionary& dict,
                                const floatSingleWordDictionary& prior_weight,
@@ -56,7 +58,7 @@ void train_ibm1_gd_stepcontrol(const Storage1D<Storage1D<uint> >& source,
 void dict_m_step(const SingleWordDictionary& fdict_count, 
                  const floatSingleWordDictionary& prior_weight,
                  SingleWordDictionary& dict, double alpha, uint nIter = 100,
-                 bool smoothed_l0 = false, double l0_beta = 1.0);
+                 bool smoothed_l0 = false, double l0_beta = 1.0, uint nThreads = 1);
 
 void single_dict_m_step(const Math1D::Vector<double>& fdict_count, 
                         const Math1D::Vector<float>& prior_weight,
@@ -67,9 +69,9 @@ double single_dict_m_step_energy(const Math1D::Vector<double>& fdict_count,
                                  const Math1D::Vector<float>& prior_weight,
                                  const Math1D::Vector<double>& dict, bool smoothed_l0, double l0_beta);
 
-void ibm1_viterbi_training(const Storage1D<Storage1D<uint> >& source, 
+void ibm1_viterbi_training(const Corpus& source, 
                            const LookupTable& slookup,
-                           const Storage1D<Storage1D<uint> >& target,
+                           const Corpus& target,
                            const CooccuringWordsType& cooc, 
                            SingleWordDictionary& dict,
                            const floatSingleWordDictionary& prior_weight,
@@ -80,5 +82,10 @@ double prob_penalty(double x, double beta);
 
 double prob_pen_prime(double x, double beta);
 
+//sum of prior_weight[i][k] times the (smoothed) l0-penalty of dict[i][k]. The energies of the IBM-1 and the HMM
+// are the perplexity plus this term divided by the number of sentences
+double dict_regularity_term(const SingleWordDictionary& dict, const floatSingleWordDictionary& prior_weight,
+                            bool smoothed_l0, double l0_beta);
+
 
 #endif
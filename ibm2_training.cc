@@ -15,58 +15,58 @@
 #include "alignment_computation.hh"
 #include "projection.hh"
 
-double ibm2_perplexity( const Storage1D<Storage1D<uint> >& source,
-                        const LookupTable& slookup,
-                        const Storage1D< Storage1D<uint> >& target,
-                        const IBM2AlignmentModel& align_model,
-                        const SingleWordDictionary& dict, const CooccuringWordsType& wcooc, uint nSourceWords) {
+//E-step of IBM-2 for a single sentence pair. The lookup table is either a SingleLookupTable or a table stored
+// with 16 bits, which is then read without expanding it. The negative log-likelihood is subtracted from perplexity
+template<typename LookupT>
+static void add_ibm2_sentence_counts(const SentenceView& cur_source, const SentenceView& cur_target,
+                                     const LookupT& cur_lookup, const SingleWordDictionary& dict,
+                                     const Math2D::Matrix<double>& cur_align_model,
+                                     Storage1D<Math1D::Vector<double> >& fwcount, Math2D::Matrix<double>& cur_facount,
+                                     double& perplexity) {
 
-  std::cerr << "calculating IBM 2 perplexity" << std::endl;
+  const uint curJ = cur_source.size();
+  const uint curI = cur_target.size();
 
-  double sum = 0.0;
+  for (uint j=0; j < curJ; j++) {
 
-  const size_t nSentences = target.size();
-  assert(slookup.size() == nSentences);
+    const uint s_idx = cur_source[j];
 
-  SingleLookupTable aux_lookup;
+    double coeff = dict[0][s_idx-1]*cur_align_model(j,0);
 
-  for (size_t s=0; s < nSentences; s++) {
+    for (uint i=0; i < curI; i++) {
+      const uint t_idx = cur_target[i];
+      coeff += dict[t_idx][cur_lookup(j,i)] * cur_align_model(j,i+1);
+    }
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
-    const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+    perplexity -= std::log(coeff);
 
-    const uint curJ = cur_source.size();
-    const uint curI = cur_target.size();
+    coeff = 1.0 / coeff;
+    assert(!isnan(coeff));
 
-    uint k=0;
-    for (; k < align_model[curI].size(); k++) {
-      if (align_model[curI][k].xDim() == curJ)
-        break;
-    }
+    double addon;
+    addon = coeff*dict[0][s_idx-1]*cur_align_model(j,0);
 
-    assert(k < align_model[curI].size());
-    const Math2D::Matrix<double>& cur_align_model = align_model[curI][k];
+    fwcount[0][s_idx-1] += addon;
+    cur_facount(j,0) += addon;
 
-    for (uint j=0; j < curJ; j++) {
+    for (uint i=0; i < curI; i++) {
+      const uint t_idx = cur_target[i];
+      const uint l = cur_lookup(j,i);
 
-      uint s_idx = cur_source[j];
-      double cur_sum = cur_align_model(j,0)*dict[0][s_idx-1];
+      addon = coeff*dict[t_idx][l]*cur_align_model(j,i+1);
 
-      for (uint i=0; i < curI; i++) {
-        uint t_idx = cur_target[i];
-        cur_sum += cur_align_model(j,i+1)*dict[t_idx][cur_lookup(j,i)];
-      }
-      sum -= std::log(cur_sum);
+      //update dict
+      fwcount[t_idx][l] += addon;
+
+      //update alignment
+      cur_facount(j,i+1) += addon;
     }
   }
-
-  return sum / nSentences;
 }
 
-void train_ibm2(const Storage1D<Storage1D<uint> >& source, 
+void train_ibm2(const Corpus& source, 
                 const LookupTable& slookup,
-                const Storage1D<Storage1D<uint> >& target,
+                const Corpus& target,
                 const CooccuringWordsType& wcooc,
                 const CooccuringLengthsType& lcooc,
                 uint nSourceWords, uint nTargetWords,
@@ -74,7 +74,8 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
                 SingleWordDictionary& dict, 
                 uint nIterations,
                 std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
-                std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments) {
+                std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
+                bool sort_by_length, uint nThreads) {
 
   std::cerr << "starting IBM 2 training" << std::endl;
 
@@ -98,11 +99,14 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
     }
   }
 
-  SingleLookupTable aux_lookup;
-  
+  WordLookupBuffers aux_lookup;
+
+  nThreads = std::max<uint>(1,nThreads);
+
   Storage1D<Math1D::Vector<double> > fwcount(nTargetWords);
   for (uint i=0; i < nTargetWords; i++) {
-    fwcount[i].resize(wcooc[i].size());
+    //the entries of the empty word are indexed by the source word, so its list of cooccurring words does not apply
+    fwcount[i].resize(dict[i].size());
   }
   
   IBM2AlignmentModel facount(alignment_model.size(),MAKENAME(facount));
@@ -116,78 +120,106 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
       facount[I][k].resize_dirty(J,I+1);
     }
   }
-    
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Storage1D<Math2D::Matrix<double> > > > facount_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fwcount_shard[t] = fwcount;
+    facount_shard[t] = facount;
+  }
+
+  Math1D::Vector<double> thread_perplexity(nThreads,0.0);
+
+  //pairs of equal length use the same alignment parameters and are therefore processed together.
+  // Each thread handles one block of the schedule
+  const SentenceSchedule schedule(source,target,nThreads,sort_by_length);
+
   for (uint iter = 1; iter <= nIterations; iter++) {
 
     std::cerr << "starting IBM 2 iteration #" << iter << std::endl;
 
-    //set counts to 0
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0.0);
-    }
-    for (uint I=0; I < lcooc.size(); I++) {
-      uint cur_length = lcooc[I].size();
-      
-      for (uint k=0; k < cur_length; k++) {
-        facount[I][k].set_constant(0.0);
+    //the perplexity of the current parameters is computed in the same pass as the counts
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
+
+      Storage1D<Math1D::Vector<double> >& thread_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Storage1D<Math2D::Matrix<double> > >& thread_facount = (t == 0) ? facount : facount_shard[t-1];
+
+      //set counts to 0
+      for (uint i=0; i < nTargetWords; i++) {
+        thread_fwcount[i].set_constant(0.0);
       }
-    }
-    
-    for (size_t s=0; s < nSentences; s++) {
+      for (uint I=0; I < lcooc.size(); I++) {
+        uint cur_length = lcooc[I].size();
       
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+        for (uint k=0; k < cur_length; k++) {
+          thread_facount[I][k].set_constant(0.0);
+        }
+      }
 
-      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+      WordLookupBuffers thread_aux_lookup;
 
-      const uint curJ = cur_source.size();
-      const uint curI = cur_target.size();
+      double cur_perplexity = 0.0;
 
-      uint k=0;
-      for(; k < alignment_model[curI].size(); k++) {
-        if (alignment_model[curI][k].xDim() == curJ)
-          break;
-      }
+      for (size_t pos=schedule.block_start(t); pos < schedule.block_end(t); pos++) {
 
-      assert(k < alignment_model[curI].size());
-      const Math2D::Matrix<double>& cur_align_model = alignment_model[curI][k];
-      const Math2D::Matrix<double>& cur_facount= facount[curI][k];
+        const size_t s = schedule[pos];
+        schedule.prefetch(t,pos);
+      
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 
-      for (uint j=0; j < curJ; j++) {
+        const uint curJ = cur_source.size();
+        const uint curI = cur_target.size();
 
-        const uint s_idx = cur_source[j];
+        uint k=0;
+        for(; k < alignment_model[curI].size(); k++) {
+          if (alignment_model[curI][k].xDim() == curJ)
+            break;
+        }
 
-        double coeff = dict[0][s_idx-1]*cur_align_model(j,0);
+        assert(k < alignment_model[curI].size());
+        const Math2D::Matrix<double>& cur_align_model = alignment_model[curI][k];
+        Math2D::Matrix<double>& cur_facount = thread_facount[curI][k];
 
-        for (uint i=0; i < curI; i++) {
-          const uint t_idx = cur_target[i];
-          coeff += dict[t_idx][cur_lookup(j,i)] * cur_align_model(j,i+1);
+        if (slookup[s].is_narrow(curJ,curI))
+          add_ibm2_sentence_counts(cur_source,cur_target,slookup[s].narrow(),dict,cur_align_model,
+                                   thread_fwcount,cur_facount,cur_perplexity);
+        else {
+          const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],
+                                                               thread_aux_lookup);
+          add_ibm2_sentence_counts(cur_source,cur_target,cur_lookup,dict,cur_align_model,
+                                   thread_fwcount,cur_facount,cur_perplexity);
         }
+      }
 
-        coeff = 1.0 / coeff;
-        assert(!isnan(coeff));
+      thread_perplexity[t] = cur_perplexity;
+    }
 
-        double addon;
-        addon = coeff*dict[0][s_idx-1]*cur_align_model(j,0);
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    double prev_perplexity = 0.0;
+    for (uint t=0; t < nThreads; t++)
+      prev_perplexity += thread_perplexity[t];
 
-        fwcount[0][s_idx-1] += addon;
-        cur_facount(j,0) += addon;
+    if (nThreads > 1) {
 
-        for (uint i=0; i < curI; i++) {
-          const uint t_idx = cur_target[i];
-          const uint l = cur_lookup(j,i);
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++)
+          fwcount[i] += fwcount_shard[t-1][i];
+      }
 
-          addon = coeff*dict[t_idx][l]*cur_align_model(j,i+1);
-	  
-          //update dict
-          fwcount[t_idx][l] += addon;
-	  
-          //update alignment
-          cur_facount(j,i+1) += addon;
+      for (uint I=0; I < lcooc.size(); I++) {
+        for (uint k=0; k < lcooc[I].size(); k++) {
+          for (uint t=1; t < nThreads; t++)
+            facount[I][k] += facount_shard[t-1][I][k];
         }
       }
     }
 
+    std::cerr << "IBM 2 perplexity after iteration #" << (iter-1) << ": " << (prev_perplexity / nSentences) << std::endl;
+
     //compute new dict from normalized fractional counts
     for (uint i=0; i < nTargetWords; i++) {
 
@@ -239,11 +271,6 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
       }
     }
     
-    std::cerr << "IBM 2 perplexity after iteration #" << iter << ": "
-              << ibm2_perplexity(source, slookup, target, alignment_model, dict, wcooc, nSourceWords)
-              << std::endl;
-
-
     /************* compute alignment error rate ****************/
     if (!possible_ref_alignments.empty()) {
       
@@ -296,53 +323,9 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
 }
 
 
-double reduced_ibm2_perplexity( const Storage1D<Storage1D<uint> >& source,
-                                const LookupTable& slookup,
-                                const Storage1D< Storage1D<uint> >& target,
-                                const ReducedIBM2AlignmentModel& align_model,
-                                const SingleWordDictionary& dict,
-                                const CooccuringWordsType& wcooc,uint nSourceWords) {
-
-  std::cerr << "calculating reduced IBM 2 perplexity" << std::endl;
-
-  double sum = 0.0;
-
-  const size_t nSentences = target.size();
-  assert(slookup.size() == nSentences);
-
-  SingleLookupTable aux_lookup;
-
-  for (size_t s=0; s < nSentences; s++) {
-
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
-    const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
-    
-    const uint curJ = cur_source.size();
-    const uint curI = cur_target.size();
-
-    const Math2D::Matrix<double>& cur_align_model = align_model[curI];
-
-    for (uint j=0; j < curJ; j++) {
-
-      uint s_idx = cur_source[j];
-      double cur_sum = cur_align_model(j,0)*dict[0][s_idx-1];
-
-      for (uint i=0; i < curI; i++) {
-        uint t_idx = cur_target[i];
-        cur_sum += cur_align_model(j,i+1)*dict[t_idx][cur_lookup(j,i)];
-      }
-      sum -= std::log(cur_sum);
-    }
-  }
-
-  return sum / nSentences;
-}
-
-
-void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
+void train_reduced_ibm2(const Corpus& source,
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target,
+                        const Corpus& target,
                         const CooccuringWordsType& wcooc,
                         const CooccuringLengthsType& lcooc,
                         uint nSourceWords, uint nTargetWords,
@@ -350,7 +333,8 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
                         SingleWordDictionary& dict,
                         uint nIterations,
                         std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
-                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments) {
+                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
+                        bool sort_by_length, uint nThreads) {
 
   std::cerr << "starting reduced IBM 2 training" << std::endl;
 
@@ -377,13 +361,16 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
     }
   }
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   //TODO: estimate first alignment model from IBM1 dictionary
+
+  nThreads = std::max<uint>(1,nThreads);
   
   Storage1D<Math1D::Vector<double> > fwcount(nTargetWords);
   for (uint i=0; i < nTargetWords; i++) {
-    fwcount[i].resize(wcooc[i].size());
+    //the entries of the empty word are indexed by the source word, so its list of cooccurring words does not apply
+    fwcount[i].resize(dict[i].size());
   }
 
 
@@ -393,71 +380,99 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
     if (maxJ > 0) 
       facount[I].resize_dirty(maxJ,I+1);
   }
-    
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math2D::Matrix<double> > > facount_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fwcount_shard[t] = fwcount;
+    facount_shard[t] = facount;
+  }
+
+  Math1D::Vector<double> thread_perplexity(nThreads,0.0);
+
+  //pairs of equal length use the same alignment parameters and are therefore processed together.
+  // Each thread handles one block of the schedule
+  const SentenceSchedule schedule(source,target,nThreads,sort_by_length);
+
   for (uint iter = 1; iter <= nIterations; iter++) {
 
     std::cerr << "starting reduced IBM 2 iteration #" << iter << std::endl;
 
-    //set counts to 0
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0.0);
-    }
-    for (uint I=0; I < lcooc.size(); I++) {
-      if (facount[I].xDim() > 0)
-        facount[I].set_constant(0.0);
-    }
-    
-    for (size_t s=0; s < nSentences; s++) {
-      
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+    //the perplexity of the current parameters is computed in the same pass as the counts
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
 
-      const uint curJ = cur_source.size();
-      const uint curI = cur_target.size();
+      Storage1D<Math1D::Vector<double> >& thread_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math2D::Matrix<double> >& thread_facount = (t == 0) ? facount : facount_shard[t-1];
 
-      const Math2D::Matrix<double>& cur_align_model = alignment_model[curI];
-      const Math2D::Matrix<double>& cur_facount= facount[curI];
+      //set counts to 0
+      for (uint i=0; i < nTargetWords; i++) {
+        thread_fwcount[i].set_constant(0.0);
+      }
+      for (uint I=0; I < lcooc.size(); I++) {
+        if (thread_facount[I].xDim() > 0)
+          thread_facount[I].set_constant(0.0);
+      }
 
-      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+      WordLookupBuffers thread_aux_lookup;
 
-      assert(cur_align_model.xDim() >= curJ);
-      assert(cur_facount.xDim() >= curJ);
+      double cur_perplexity = 0.0;
+    
+      for (size_t pos=schedule.block_start(t); pos < schedule.block_end(t); pos++) {
 
+        const size_t s = schedule[pos];
+        schedule.prefetch(t,pos);
+      
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 
-      for (uint j=0; j < curJ; j++) {
+        const uint curJ = cur_source.size();
+        const uint curI = cur_target.size();
 
-        const uint s_idx = cur_source[j];
+        const Math2D::Matrix<double>& cur_align_model = alignment_model[curI];
+        Math2D::Matrix<double>& cur_facount = thread_facount[curI];
 
-        double coeff = dict[0][s_idx-1]*cur_align_model(j,0);
+        assert(cur_align_model.xDim() >= curJ);
+        assert(cur_facount.xDim() >= curJ);
 
-        for (uint i=0; i < curI; i++) {
-          const uint t_idx = cur_target[i];
-          coeff += dict[t_idx][cur_lookup(j,i)] * cur_align_model(j,i+1);
+        if (slookup[s].is_narrow(curJ,curI))
+          add_ibm2_sentence_counts(cur_source,cur_target,slookup[s].narrow(),dict,cur_align_model,
+                                   thread_fwcount,cur_facount,cur_perplexity);
+        else {
+          const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],
+                                                               thread_aux_lookup);
+          add_ibm2_sentence_counts(cur_source,cur_target,cur_lookup,dict,cur_align_model,
+                                   thread_fwcount,cur_facount,cur_perplexity);
         }
+      }
 
-        coeff = 1.0 / coeff;
-        assert(!isnan(coeff));
+      thread_perplexity[t] = cur_perplexity;
+    }
 
-        double addon;
-        addon = coeff*dict[0][s_idx-1]*cur_align_model(j,0);
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    double prev_perplexity = 0.0;
+    for (uint t=0; t < nThreads; t++)
+      prev_perplexity += thread_perplexity[t];
 
-        fwcount[0][s_idx-1] += addon;
-        cur_facount(j,0) += addon;
+    if (nThreads > 1) {
 
-        for (uint i=0; i < curI; i++) {
-          const uint t_idx = cur_target[i];
-          const uint l = cur_lookup(j,i);
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++)
+          fwcount[i] += fwcount_shard[t-1][i];
+      }
 
-          addon = coeff*dict[t_idx][l]*cur_align_model(j,i+1);
-	  
-          //update dict
-          fwcount[t_idx][l] += addon;
-	  
-          //update alignment
-          cur_facount(j,i+1) += addon;
+      for (uint I=0; I < lcooc.size(); I++) {
+        if (facount[I].xDim() > 0) {
+          for (uint t=1; t < nThreads; t++)
+            facount[I] += facount_shard[t-1][I];
         }
       }
     }
+
+    std::cerr << "reduced IBM 2 perplexity after iteration #" << (iter-1) << ": " << (prev_perplexity / nSentences)
+              << std::endl;
     
     //compute new dict from normalized fractional counts
     for (uint i=0; i < nTargetWords; i++) {
@@ -498,10 +513,6 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
       }
     }
 
-    std::cerr << "reduced IBM 2 perplexity after iteration #" << iter << ": "
-              << reduced_ibm2_perplexity(source, slookup, target, alignment_model, dict, wcooc, nSourceWords)
-              << std::endl;    
-
     /************* compute alignment error rate ****************/
     if (!possible_ref_alignments.empty()) {
       
@@ -546,9 +557,9 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
 }
 
 
-void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source, 
+void ibm2_viterbi_training(const Corpus& source, 
                            const LookupTable& slookup,
-                           const Storage1D<Storage1D<uint> >& target,
+                           const Corpus& target,
                            const CooccuringWordsType& wcooc,
                            const CooccuringLengthsType& lcooc,
                            uint nSourceWords, uint nTargetWords,
@@ -557,7 +568,8 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
                            uint nIterations,
                            std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                            std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
-                           const floatSingleWordDictionary& prior_weight) {
+                           const floatSingleWordDictionary& prior_weight, bool sort_by_length,
+                           uint nThreads) {
 
   //initialize alignment model
   alignment_model.resize_dirty(lcooc.size());
@@ -579,7 +591,7 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
     }
   }
 
-   SingleLookupTable aux_lookup;
+   WordLookupBuffers aux_lookup;
 
   const size_t nSentences = source.size();
   assert(nSentences == target.size());
@@ -588,7 +600,7 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
 
   for (size_t s=0; s < nSentences; s++) {
     
-    const Storage1D<uint>& cur_source = source[s];
+    const SentenceView& cur_source = source[s];
     
     viterbi_alignment[s].resize(cur_source.size());
   }
@@ -597,106 +609,145 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
   NamedStorage1D<Math1D::Vector<double> > dcount(nTargetWords,MAKENAME(dcount));
 
   for (uint i=0; i < nTargetWords; i++) {
-    dcount[i].resize(wcooc[i].size());
+    //the entries of the empty word are indexed by the source word, so its list of cooccurring words does not apply
+    dcount[i].resize(dict[i].size());
     dcount[i].set_constant(0);
   }
 
   Math1D::NamedVector<uint> prev_wsum(nTargetWords,0,MAKENAME(prev_wsum));  
 
+  nThreads = std::max<uint>(1,nThreads);
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math1D::Vector<double> > > dcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math2D::Matrix<double> > > acount_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    dcount_shard[t] = dcount;
+    acount_shard[t] = acount;
+  }
+
+  //pairs of equal length use the same alignment parameters and are therefore processed together.
+  // Each thread handles one block of the schedule
+  const SentenceSchedule schedule(source,target,nThreads,sort_by_length);
+
   for (uint iter = 1; iter <= nIterations; iter++) {
 
     std::cerr << "###iter " << iter << std::endl;
 
-    for (uint i=0; i < nTargetWords; i++) {      
-      dcount[i].set_constant(0);
-    }
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
+
+      Storage1D<Math1D::Vector<double> >& thread_dcount = (t == 0) ? dcount : dcount_shard[t-1];
+      Storage1D<Math2D::Matrix<double> >& thread_acount = (t == 0) ? acount : acount_shard[t-1];
+
+      for (uint i=0; i < nTargetWords; i++) {      
+        thread_dcount[i].set_constant(0);
+      }
 
-    for (uint I=0; I < acount.size(); I++) 
-      acount[I].set_constant(0.0);
+      for (uint I=0; I < thread_acount.size(); I++) 
+        thread_acount[I].set_constant(0.0);
 
-    double sum = 0.0;
+      WordLookupBuffers thread_aux_lookup;
 
-    for (size_t s=0; s < nSentences; s++) {
+      for (size_t pos=schedule.block_start(t); pos < schedule.block_end(t); pos++) {
 
-      const Storage1D<uint>& cur_source = source[s];
-      const Storage1D<uint>& cur_target = target[s];
+        const size_t s = schedule[pos];
+        schedule.prefetch(t,pos);
 
-      const uint nCurSourceWords = cur_source.size();
-      const uint nCurTargetWords = cur_target.size();
-      const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 
-      const Math2D::Matrix<double>& cur_align_model = alignment_model[nCurTargetWords];
+        const uint nCurSourceWords = cur_source.size();
+        const uint nCurTargetWords = cur_target.size();
+        const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],
+                                                             thread_aux_lookup);
+
+        const Math2D::Matrix<double>& cur_align_model = alignment_model[nCurTargetWords];
       
-      for (uint j=0; j < nCurSourceWords; j++) {
+        for (uint j=0; j < nCurSourceWords; j++) {
 	
-        const uint s_idx = source[s][j];
+          const uint s_idx = cur_source[j];
 
-        double min = 1e50;
-        uint arg_min = MAX_UINT;
+          double min = 1e50;
+          uint arg_min = MAX_UINT;
 
-        if (iter == 1) {
+          if (iter == 1) {
 
-          min = -std::log(dict[0][s_idx-1])* cur_align_model(j,0);
-          arg_min = 0;
+            min = -std::log(dict[0][s_idx-1])* cur_align_model(j,0);
+            arg_min = 0;
 
-          for (uint i=0; i < nCurTargetWords; i++) {
+            for (uint i=0; i < nCurTargetWords; i++) {
 
-            double hyp = -std::log(dict[cur_target[i]][cur_lookup(j,i)]*cur_align_model(j,i+1) );
+              double hyp = -std::log(dict[cur_target[i]][cur_lookup(j,i)]*cur_align_model(j,i+1) );
 	    
-            if (hyp < min) {
-              min = hyp;
-              arg_min = i+1;
+              if (hyp < min) {
+                min = hyp;
+                arg_min = i+1;
+              }
             }
           }
-        }
-        else {
+          else {
 	  
-          if (dict[0][s_idx-1] == 0.0 || cur_align_model(j,0) == 0.0) {
+            if (dict[0][s_idx-1] == 0.0 || cur_align_model(j,0) == 0.0) {
 	
-            min = 1e20;
-          }
-          else {
+              min = 1e20;
+            }
+            else {
 	    
-            min = -std::log(dict[0][s_idx-1] * cur_align_model(j,0) );
-          }
-          arg_min = 0;
+              min = -std::log(dict[0][s_idx-1] * cur_align_model(j,0) );
+            }
+            arg_min = 0;
 	  
-          for (uint i=0; i < nCurTargetWords; i++) {
+            for (uint i=0; i < nCurTargetWords; i++) {
 	    
-            double hyp;
+              double hyp;
 	    
-            if (dict[cur_target[i]][cur_lookup(j,i)] == 0.0 || cur_align_model(j,i+1) == 0) {
+              if (dict[cur_target[i]][cur_lookup(j,i)] == 0.0 || cur_align_model(j,i+1) == 0) {
 	      
-              hyp = 1e20;
-            }
-            else {
+                hyp = 1e20;
+              }
+              else {
 	      
-              hyp = -std::log( dict[cur_target[i]][cur_lookup(j,i)] * cur_align_model(j,i+1));
-            }
+                hyp = -std::log( dict[cur_target[i]][cur_lookup(j,i)] * cur_align_model(j,i+1));
+              }
 
-            if (hyp < min) {
-              min = hyp;
-              arg_min = i+1;
-            }
+              if (hyp < min) {
+                min = hyp;
+                arg_min = i+1;
+              }
 	    
+            }
           }
-        }
 
-        sum += min;
-	
-        viterbi_alignment[s][j] = arg_min;
+          viterbi_alignment[s][j] = arg_min;
 
-        if (arg_min == 0) {
-          dcount[0][s_idx-1]++;
-          acount[nCurTargetWords](j,0)++;
-        }
-        else {
-          dcount[cur_target[arg_min-1]][cur_lookup(j,arg_min-1)]++;
-          acount[nCurTargetWords](j,arg_min)++;
+          if (arg_min == 0) {
+            thread_dcount[0][s_idx-1]++;
+            thread_acount[nCurTargetWords](j,0)++;
+          }
+          else {
+            thread_dcount[cur_target[arg_min-1]][cur_lookup(j,arg_min-1)]++;
+            thread_acount[nCurTargetWords](j,arg_min)++;
+          }
         }
       }
     }
 
+    //the counts are integral, so the order of the reduction does not affect the result
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++)
+          dcount[i] += dcount_shard[t-1][i];
+      }
+
+      for (uint I=0; I < acount.size(); I++) {
+        for (uint t=1; t < nThreads; t++)
+          acount[I] += acount_shard[t-1][I];
+      }
+    }
+
     /*** ICM phase ***/
 
     if (true) {
@@ -726,13 +777,13 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
       
       for (size_t s=0; s < nSentences; s++) {
 
-        const Storage1D<uint>& cur_source = source[s];
-        const Storage1D<uint>& cur_target = target[s];
+        const SentenceView& cur_source = source[s];
+        const SentenceView& cur_target = target[s];
 	
         const uint curJ = source[s].size();
         const uint curI = target[s].size();
 	
-        const SingleLookupTable& cur_lookup = slookup[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc,nSourceWords,slookup[s],aux_lookup);
         const Math2D::Matrix<double>& cur_acount = acount[curI];
 	
         for (uint j=0; j < curJ; j++) {
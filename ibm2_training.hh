@@ -12,9 +12,9 @@
 #include <map>
 #include <set>
 
-void train_ibm2(const Storage1D<Storage1D<uint> >& source, 
+void train_ibm2(const Corpus& source, 
                 const LookupTable& slookup,
-                const Storage1D<Storage1D<uint> >& target,
+                const Corpus& target,
                 const CooccuringWordsType& wcooc,
                 const CooccuringLengthsType& lcooc,
                 uint nSourceWords, uint nTargetWords,
@@ -22,12 +22,13 @@ void train_ibm2(const Storage1D<Storage1D<uint> >& source,
                 SingleWordDictionary& dict,
                 uint nIterations,
                 std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
-                std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments);
+                std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
+                bool sort_by_length = true, uint nThreads = 1);
 
 
-void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
+void train_reduced_ibm2(const Corpus& source,
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target,
+                        const Corpus& target,
                         const CooccuringWordsType& wcooc,
                         const CooccuringLengthsType& lcooc,
                         uint nSourceWords, uint nTargetWords,
@@ -35,12 +36,13 @@ void train_reduced_ibm2(const Storage1D<Storage1D<uint> >& source,
                         SingleWordDictionary& dict,
                         uint nIterations,
                         std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
-                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments);
+                        std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
+                        bool sort_by_length = true, uint nThreads = 1);
 
 
-void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source, 
+void ibm2_viterbi_training(const Corpus& source, 
                            const LookupTable& slookup,
-                           const Storage1D<Storage1D<uint> >& target,
+                           const Corpus& target,
                            const CooccuringWordsType& wcooc,
                            const CooccuringLengthsType& lcooc,
                            uint nSourceWords, uint nTargetWords,
@@ -49,6 +51,7 @@ void ibm2_viterbi_training(const Storage1D<Storage1D<uint> >& source,
                            uint nIterations,
                            std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                            std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
-                           const floatSingleWordDictionary& prior_weight);
+                           const floatSingleWordDictionary& prior_weight, bool sort_by_length = true,
+                           uint nThreads = 1);
 
 #endif
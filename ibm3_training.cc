@@ -36,14 +36,15 @@
 
 #include <fstream>
 #include <set>
+#include <limits>
 #include "stl_out.hh"
 
 
 /************************** implementation of IBM3Trainer *********************/
 
-IBM3Trainer::IBM3Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
+IBM3Trainer::IBM3Trainer(const Corpus& source_sentence,
 			 const LookupTable& slookup,
-                         const Storage1D<Storage1D<uint> >& target_sentence,
+                         const Corpus& target_sentence,
                          const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                          const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
                          SingleWordDictionary& dict,
@@ -57,7 +58,7 @@ IBM3Trainer::IBM3Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
                           nSourceWords,nTargetWords,sure_ref_alignments,possible_ref_alignments),
     distortion_prob_(MAKENAME(distortion_prob_)), och_ney_empty_word_(och_ney_empty_word), prior_weight_(prior_weight),
     l0_fertpen_(l0_fertpen), parametric_distortion_(parametric_distortion), viterbi_ilp_(viterbi_ilp),
-    smoothed_l0_(smoothed_l0), l0_beta_(l0_beta), fix_p0_(false)
+    smoothed_l0_(smoothed_l0), l0_beta_(l0_beta), fix_p0_(false), saved_p_zero_(0.0)
 {
 
 #ifndef HAS_CBC
@@ -107,6 +108,38 @@ double IBM3Trainer::p_zero() const {
   return p_zero_;
 }
 
+void IBM3Trainer::write_checkpoint(CheckpointWriter& writer) const {
+
+  write_fertility_checkpoint(writer,"ibm3.");
+  writer.add_matrix_list("ibm3.distortion_prob",distortion_prob_);
+  writer.add_matrix("ibm3.distortion_param",distortion_param_);
+  writer.add_scalar("ibm3.p_zero",p_zero_);
+  writer.add_scalar("ibm3.p_nonzero",p_nonzero_);
+  writer.add_scalar("ibm3.parametric_distortion",(parametric_distortion_) ? 1.0 : 0.0);
+  writer.add_scalar("ibm3.och_ney_empty_word",(och_ney_empty_word_) ? 1.0 : 0.0);
+}
+
+void IBM3Trainer::read_checkpoint(const Checkpoint& checkpoint, bool model_only) {
+
+  if ((checkpoint.get_scalar("ibm3.parametric_distortion") != 0.0) != parametric_distortion_
+      || (checkpoint.get_scalar("ibm3.och_ney_empty_word") != 0.0) != och_ney_empty_word_) {
+    USER_ERROR << "the IBM-3 of the checkpoint was trained with different options (-nonpar-distortion, -org-empty-word)."
+               << " Exiting..." << std::endl;
+    exit(1);
+  }
+
+  read_fertility_checkpoint(checkpoint,"ibm3.",model_only);
+  checkpoint.get_matrix_list("ibm3.distortion_prob",distortion_prob_);
+  checkpoint.get_matrix("ibm3.distortion_param",distortion_param_);
+
+  if (distortion_prob_.size() != maxJ_) {
+    USER_ERROR << "the checkpoint is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+  p_zero_ = checkpoint.get_scalar("ibm3.p_zero");
+  p_nonzero_ = checkpoint.get_scalar("ibm3.p_nonzero");
+}
+
 void IBM3Trainer::release_memory() {
   best_known_alignment_.resize(0);
   fertility_prob_.resize(0);
@@ -126,7 +159,7 @@ void IBM3Trainer::init_from_hmm(const FullHMMAlignmentModel& align_model,
     fert_count[i].resize(fertility_prob_[i].size(),0);
   }
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   for (size_t s=0; s < source_sentence_.size(); s++) {
 
@@ -237,8 +270,8 @@ void IBM3Trainer::init_from_hmm(const FullHMMAlignmentModel& align_model,
   //init distortion probabilities using forward-backward
   for (size_t s=0; s < source_sentence_.size(); s++) {
     
-    const Storage1D<uint>& cur_source = source_sentence_[s];
-    const Storage1D<uint>& cur_target = target_sentence_[s];
+    const SentenceView& cur_source = source_sentence_[s];
+    const SentenceView& cur_target = target_sentence_[s];
     const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc_,
                                                          nSourceWords_,slookup_[s],aux_lookup);
     
@@ -479,6 +512,8 @@ double IBM3Trainer::par_distortion_m_step_energy(const ReducedIBM3DistortionMode
 
 void IBM3Trainer::par_distortion_m_step(const ReducedIBM3DistortionModel& fdistort_count, uint i) {
 
+  std::vector<double> proj_aux;
+
 
   double alpha = 0.1;
 
@@ -528,7 +563,7 @@ void IBM3Trainer::par_distortion_m_step(const ReducedIBM3DistortionModel& fdisto
     for (uint j=0; j < distortion_param_.xDim(); j++) 
       new_distortion_param[j] = distortion_param_(j,i) - alpha * distortion_grad[j];
 
-    projection_on_simplex(new_distortion_param.direct_access(),maxJ_);
+    projection_on_simplex(new_distortion_param.direct_access(),maxJ_, proj_aux);
 
 
     double best_lambda = 1.0;
@@ -591,7 +626,7 @@ void IBM3Trainer::par_distortion_m_step(const ReducedIBM3DistortionModel& fdisto
 
 long double IBM3Trainer::alignment_prob(uint s, const Math1D::Vector<AlignBaseType>& alignment) const {
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
   
   const SingleLookupTable& lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                    nSourceWords_,slookup_[s],aux_lookup);
@@ -599,13 +634,13 @@ long double IBM3Trainer::alignment_prob(uint s, const Math1D::Vector<AlignBaseTy
   return alignment_prob(source_sentence_[s],target_sentence_[s],lookup,alignment);
 }
 
-long double IBM3Trainer::alignment_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+long double IBM3Trainer::alignment_prob(const SentenceView& source, const SentenceView& target, 
                                         const SingleLookupTable& cur_lookup, const Math1D::Vector<AlignBaseType>& alignment) const {
 
   long double prob = 1.0;
 
-  const Storage1D<uint>& cur_source = source;
-  const Storage1D<uint>& cur_target = target;
+  const SentenceView& cur_source = source;
+  const SentenceView& cur_target = target;
 
   const uint curI = cur_target.size();
   const uint curJ = cur_source.size();
@@ -626,7 +661,7 @@ long double IBM3Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
 
   for (uint i=1; i <= curI; i++) {
     uint t_idx = cur_target[i-1];
-    prob *= ldfac(fertility[i]) * fertility_prob_[t_idx][fertility[i]];
+    prob *= combinatorics_.fac(fertility[i]) * fertility_prob_[t_idx][fertility[i]];
   }
   for (uint j=0; j < curJ; j++) {
     
@@ -644,7 +679,7 @@ long double IBM3Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
   //handle empty word
   assert(fertility[0] <= 2*curJ);
   
-  prob *= ldchoose(curJ-fertility[0],fertility[0]);
+  prob *= combinatorics_.choose(curJ-fertility[0],fertility[0]);
   for (uint k=1; k <= fertility[0]; k++)
     prob *= p_zero_;
   for (uint k=1; k <= curJ-2*fertility[0]; k++)
@@ -660,11 +695,150 @@ long double IBM3Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
 }
 
 
-long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>& source, const Storage1D<uint>& target,
+/**** helpers for the hillclimbing: all moves are scored by the logarithm of their probability ratio
+ **** to the current alignment ****/
+
+static const double hc_impossible = -std::numeric_limits<double>::infinity();
+
+static inline double hc_log(double x) {
+  return (x > 0.0) ? std::log(x) : hc_impossible;
+}
+
+static inline double hc_sum(double a, double b, double c) {
+  return (a == hc_impossible || b == hc_impossible || c == hc_impossible) ? hc_impossible : a + b + c;
+}
+
+//log-factors for increasing and decreasing the fertility of a real target word
+static void hc_fertility_factors(const Math1D::Vector<double>& fert_prob, uint cur_fert, uint fertility_limit,
+                                 double& log_increase, double& log_decrease) {
+
+  assert(fert_prob[cur_fert] > 0.0);
+
+  if (cur_fert > 0)
+    log_decrease = hc_log(((long double) fert_prob[cur_fert-1]) / (cur_fert * fert_prob[cur_fert]));
+  else
+    log_decrease = hc_impossible;
+
+  if (cur_fert+1 < fert_prob.size() && cur_fert+1 <= fertility_limit)
+    log_increase = hc_log(((long double) (cur_fert+1) * fert_prob[cur_fert+1]) / fert_prob[cur_fert]);
+  else
+    log_increase = hc_impossible;
+}
+
+//log-factors for increasing and decreasing the number of words aligned to the empty word
+static void hc_empty_word_factors(const CombinatoricTable& combinatorics, uint curJ, uint zero_fert,
+                                  double p_zero, double p_nonzero, bool och_ney_empty_word,
+                                  double& log_increase, double& log_decrease) {
+
+  const double log_cur_choose = combinatorics.log_choose(curJ-zero_fert,zero_fert);
+
+  log_increase = hc_impossible;
+  if (curJ >= 2*(zero_fert+1)) {
+    log_increase = hc_sum(combinatorics.log_choose(curJ-zero_fert-1,zero_fert+1) - log_cur_choose,
+                          hc_log(p_zero), -2.0 * hc_log(p_nonzero));
+
+    if (och_ney_empty_word)
+      log_increase += std::log((zero_fert+1) / ((double) curJ));
+  }
+  else {
+    if (curJ > 3) {
+      std::cerr << "WARNING: reached limit of allowed number of zero-aligned words, " 
+                << "J=" << curJ << ", zero_fert =" << zero_fert << std::endl;
+    }
+  }
+
+  log_decrease = hc_impossible;
+  if (zero_fert > 0) {
+    log_decrease = hc_sum(combinatorics.log_choose(curJ-zero_fert+1,zero_fert-1) - log_cur_choose,
+                          2.0 * hc_log(p_nonzero), -hc_log(p_zero));
+
+    if (och_ney_empty_word)
+      log_decrease += std::log(curJ / ((double) zero_fert));
+  }
+}
+
+//score of swapping the alignments of j1 and j2
+static inline double hc_swap_score(const Math2D::Matrix<double>& link_score, const Math1D::Vector<AlignBaseType>& alignment,
+                                   uint j1, uint j2) {
+
+  const uint aj1 = alignment[j1];
+  const uint aj2 = alignment[j2];
+
+  //we do not want to count the same alignment twice
+  if (aj1 == aj2 || j1 == j2)
+    return hc_impossible;
+
+  const double new_links = hc_sum(link_score(aj1,j2), link_score(aj2,j1), 0.0);
+  if (new_links == hc_impossible)
+    return hc_impossible;
+
+  return new_links - link_score(aj1,j1) - link_score(aj2,j2);
+}
+
+//log of a link probability. The product is formed directly unless it leaves the range of double
+static inline double hc_link_log(double dict_entry, double distort_prob) {
+
+  const double prod = dict_entry * distort_prob;
+  if (prod > 1e-300)
+    return std::log(prod);
+
+  return hc_sum(hc_log(dict_entry), hc_log(distort_prob), 0.0);
+}
+
+//maximum of row[begin] ... row[end-1] and the first position attaining it (MAX_UINT if all are impossible)
+static inline void hc_row_max(const double* row, uint begin, uint end, double& max_score, uint& arg_max) {
+
+  max_score = hc_impossible;
+  arg_max = MAX_UINT;
+  for (uint k=begin; k < end; k++) {
+    if (row[k] > max_score) {
+      max_score = row[k];
+      arg_max = k;
+    }
+  }
+}
+
+//the entry k of a row has changed to score. Returns false if the maximum of the row has to be recomputed
+static inline bool hc_update_row_max(uint k, double score, double& max_score, uint& arg_max) {
+
+  if (k == arg_max) {
+    if (score < max_score)
+      return false;
+    max_score = score;
+  }
+  else if (score > max_score || (score == max_score && k < arg_max)) {
+    max_score = score;
+    arg_max = k;
+  }
+
+  return true;
+}
+
+//recomputes the swap scores of j after its alignment has changed, together with the affected row maxima
+static void hc_update_swap_scores(const Math2D::Matrix<double>& link_score, const Math1D::Vector<AlignBaseType>& alignment,
+                                  uint j, Math2D::Matrix<double>& swap_score, Math1D::Vector<double>& best_swap_score,
+                                  Math1D::Vector<uint>& best_swap_j2) {
+
+  const uint curJ = alignment.size();
+
+  for (uint jj=0; jj < curJ; jj++) {
+    swap_score(jj,j) = hc_swap_score(link_score,alignment,jj,j);
+    swap_score(j,jj) = swap_score(jj,j);
+
+    //in the rows of the earlier positions only the entry of j has changed
+    if (jj < j && !hc_update_row_max(j, swap_score(j,jj), best_swap_score[jj], best_swap_j2[jj]))
+      hc_row_max(swap_score.direct_access() + jj*curJ, jj+1, curJ, best_swap_score[jj], best_swap_j2[jj]);
+  }
+
+  hc_row_max(swap_score.direct_access() + j*curJ, j+1, curJ, best_swap_score[j], best_swap_j2[j]);
+}
+
+long double IBM3Trainer::update_alignment_by_hillclimbing(const SentenceView& source, const SentenceView& target,
                                                           const SingleLookupTable& lookup,
                                                           uint& nIter, Math1D::Vector<uint>& fertility,
                                                           Math2D::Matrix<long double>& expansion_prob,
                                                           Math2D::Matrix<long double>& swap_prob, 
+                                                          HillclimbingScores& hc_scores,
                                                           Math1D::Vector<AlignBaseType>& alignment) {
 
   double improvement_factor = 1.001;
@@ -714,7 +888,7 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
     assert(fertility_prob_[t_idx][fert] > 0);
 
-    base_prob *= ldfac(fert) * fertility_prob_[t_idx][fert];
+    base_prob *= combinatorics_.fac(fert) * fertility_prob_[t_idx][fert];
   }
 
   assert(base_prob > 0.0);
@@ -729,7 +903,7 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
   else {
 
     assert(zero_fert <= 15);
-    base_prob *= ldchoose(curJ-zero_fert,zero_fert);
+    base_prob *= combinatorics_.choose(curJ-zero_fert,zero_fert);
     for (uint k=1; k <= zero_fert; k++)
       base_prob *= p_zero_;
     for (uint k=1; k <= curJ-2*zero_fert; k++) {
@@ -743,6 +917,7 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
     }
   }
 
+#ifndef NDEBUG
   long double check = alignment_prob(source,target,lookup,alignment);
 
   long double check_ratio = base_prob / check;
@@ -758,14 +933,86 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
   if (base_prob > 1e-300 || check > 1e-300)
     assert(check_ratio > 0.999 && check_ratio < 1.001);
+#endif
 
   assert(!isnan(base_prob));
 
+  swap_prob.resize_dirty(curJ,curJ);
+  expansion_prob.resize_dirty(curJ,curI+1);
+
+  if (!(base_prob > 0.0)) {
+    //no move can improve on an alignment of probability 0
+    swap_prob.set_constant(0.0);
+    expansion_prob.set_constant(0.0);
+    nIter++;
+    return base_prob;
+  }
+
+  /**** the moves are scored in double precision by the logarithm of their ratio to the current alignment.
+   **** After a change only the scores that depend on it are updated ****/
+
+  const double log_improvement = std::log(improvement_factor);
+
+  //lexical and distortion factor for every position and every target word (0 = empty word)
+  Math2D::Matrix<double>& link_score = hc_scores.link_score_;
+  link_score.resize_dirty(curI+1,curJ);
+  for (uint j=0; j < curJ; j++) {
+    link_score(0,j) = hc_log(dict_[0][source[j]-1]);
+    for (uint i=1; i <= curI; i++)
+      link_score(i,j) = hc_link_log(dict_[target[i-1]][lookup(j,i-1)], cur_distort_prob(j,i-1));
+  }
+
+  //fertility factors, the empty word is at index 0
+  Math1D::Vector<double>& log_fert_increase = hc_scores.log_fert_increase_;
+  Math1D::Vector<double>& log_fert_decrease = hc_scores.log_fert_decrease_;
+  log_fert_increase.resize_dirty(curI+1);
+  log_fert_decrease.resize_dirty(curI+1);
+  hc_empty_word_factors(combinatorics_,curJ,zero_fert,p_zero_,p_nonzero_,och_ney_empty_word_,log_fert_increase[0],log_fert_decrease[0]);
+  for (uint i=1; i <= curI; i++)
+    hc_fertility_factors(fertility_prob_[target[i-1]],fertility[i],fertility_limit_,log_fert_increase[i],log_fert_decrease[i]);
+
+  //removing j from its current word (as in the long double version, tiny link probabilities block the removal)
+  const double min_link_score = std::log(1e-305);
+  Math1D::Vector<double>& removal_score = hc_scores.removal_score_;
+  removal_score.resize_dirty(curJ);
+
+  //the score of moving j to cand_aj is stored in move_score(cand_aj,j)
+  Math2D::Matrix<double>& move_score = hc_scores.move_score_;
+  move_score.resize_dirty(curI+1,curJ);
+  //symmetric
+  Math2D::Matrix<double>& swap_score = hc_scores.swap_score_;
+  swap_score.resize_dirty(curJ,curJ);
+
+  //for every j: the best move of j and the best swap of j with a later position
+  Math1D::Vector<double>& best_move_score = hc_scores.best_move_score_;
+  Math1D::Vector<uint>& best_move_aj = hc_scores.best_move_aj_;
+  Math1D::Vector<double>& best_swap_score = hc_scores.best_swap_score_;
+  Math1D::Vector<uint>& best_swap_j2 = hc_scores.best_swap_j2_;
+  best_move_score.resize_dirty(curJ);
+  best_move_aj.resize_dirty(curJ);
+  best_swap_score.resize_dirty(curJ);
+  best_swap_j2.resize_dirty(curJ);
+
+  for (uint j=0; j < curJ; j++) {
+
+    const uint aj = alignment[j];
+    removal_score[j] = (link_score(aj,j) > min_link_score) ? log_fert_decrease[aj] - link_score(aj,j) : hc_impossible;
+
+    for (uint cand_aj = 0; cand_aj <= curI; cand_aj++)
+      move_score(cand_aj,j) = (cand_aj == aj) ? hc_impossible 
+        : hc_sum(removal_score[j], link_score(cand_aj,j), log_fert_increase[cand_aj]);
+
+    hc_row_max(move_score.direct_access() + j*(curI+1), 0, curI+1, best_move_score[j], best_move_aj[j]);
+
+    swap_score(j,j) = hc_impossible;
+    for (uint j2 = j+1; j2 < curJ; j2++) {
+      swap_score(j2,j) = hc_swap_score(link_score,alignment,j,j2);
+      swap_score(j,j2) = swap_score(j2,j);
+    }
+  }
 
-  swap_prob.resize(curJ,curJ);
-  expansion_prob.resize(curJ,curI+1);
-  swap_prob.set_constant(0.0);
-  expansion_prob.set_constant(0.0);
+  for (uint j=0; j < curJ; j++)
+    hc_row_max(swap_score.direct_access() + j*curJ, j+1, curJ, best_swap_score[j], best_swap_j2[j]);
 
   uint count_iter = 0;
 
@@ -777,373 +1024,171 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
     if (count_iter > 50)
       break;
 
-    //std::cerr << "****************** starting new hillclimb iteration, current best prob: " << base_prob << std::endl;
-
     bool improvement = false;
 
-    long double best_prob = base_prob;
+    double best_score = 0.0;
     bool best_change_is_move = false;
     uint best_move_j = MAX_UINT;
-    uint best_move_aj = MAX_UINT;
     uint best_swap_j1 = MAX_UINT;
-    uint best_swap_j2 = MAX_UINT;
-
-    /**** scan neighboring alignments and keep track of the best one that is better 
-     ****  than the current alignment  ****/
 
-    Math1D::Vector<long double> fert_increase_factor(curI+1);
-    Math1D::Vector<long double> fert_decrease_factor(curI+1);
+    /**** find the best neighboring alignment from the maxima of the rows. It has to improve on the current
+     **** alignment by the improvement factor, and a swap has to improve on the best move by this factor ****/
 
-    for (uint i=1; i <= curI; i++) {
-
-      uint t_idx = target[i-1];
-      uint cur_fert = fertility[i];
-
-      assert(fertility_prob_[t_idx][cur_fert] > 0.0);
-
-      if (cur_fert > 0) {
-        fert_decrease_factor[i] = ((long double) fertility_prob_[t_idx][cur_fert-1]) 
-          / (cur_fert * fertility_prob_[t_idx][cur_fert]);
-      }
-      else
-        fert_decrease_factor[i] = 0.0;
-
-      if (cur_fert+1 < fertility_prob_[t_idx].size())
-        fert_increase_factor[i] = ((long double) (cur_fert+1) * fertility_prob_[t_idx][cur_fert+1])
-          / fertility_prob_[t_idx][cur_fert];
-      else
-        fert_increase_factor[i] = 0.0;
-    }
-    
     //a) expansion moves
-
-    //std::cerr << "considering moves" << std::endl;
-
-    long double empty_word_increase_const = 0.0;
-    if (curJ >= 2*(zero_fert+1)) {
-      empty_word_increase_const = ldchoose(curJ-zero_fert-1,zero_fert+1) * p_zero_ 
-        / (ldchoose(curJ-zero_fert,zero_fert) * p_nonzero_ * p_nonzero_);
-
-      if (och_ney_empty_word_) {
-        empty_word_increase_const *= (zero_fert+1) / ((long double) curJ);
-      }
-    }
-    else {
-      if (curJ > 3) {
-        std::cerr << "WARNING: reached limit of allowed number of zero-aligned words, " 
-                  << "J=" << curJ << ", zero_fert =" << zero_fert << std::endl;
+    uint arg_best_move = MAX_UINT;
+    double best_move = 0.0;
+    for (uint j=0; j < curJ; j++) {
+      if (best_move_score[j] > best_move) {
+        best_move = best_move_score[j];
+        arg_best_move = j;
       }
     }
 
-    long double empty_word_decrease_const = 0.0;
-    if (zero_fert > 0) {
-      empty_word_decrease_const = ldchoose(curJ-zero_fert+1,zero_fert-1) * p_nonzero_ * p_nonzero_ 
-        / (ldchoose(curJ-zero_fert,zero_fert) * p_zero_);
+    if (best_move > log_improvement) {
+      improvement = true;
+      best_change_is_move = true;
+      best_score = best_move;
+      best_move_j = arg_best_move;
+    }
 
-      if (och_ney_empty_word_) {
-        empty_word_decrease_const *= curJ / ((long double) zero_fert);
+    //b) swap_moves (NOTE that swaps do not affect the fertilities)
+    uint arg_best_swap = MAX_UINT;
+    double best_swap = hc_impossible;
+    for (uint j1=0; j1 < curJ; j1++) {
+      if (best_swap_score[j1] > best_swap) {
+        best_swap = best_swap_score[j1];
+        arg_best_swap = j1;
       }
     }
 
-    for (uint j=0; j < curJ; j++) {
-
-      const uint s_idx = source[j];
-
-      const uint aj = alignment[j];
-      assert(fertility[aj] > 0);
-      expansion_prob(j,aj) = 0.0;
-      
-      long double mod_base_prob = base_prob;
+    if (best_swap > best_score + log_improvement) {
+      improvement = true;
+      best_change_is_move = false;
+      best_score = best_swap;
+      best_swap_j1 = arg_best_swap;
+    }
 
-      if (aj > 0) {
-        const uint t_idx = target[aj-1];
+    if (!improvement)
+      break;
 
-        if (dict_[t_idx][lookup(j,aj-1)] * cur_distort_prob(j,aj-1) > 1e-305) {
-          mod_base_prob *= fert_decrease_factor[aj] / dict_[t_idx][lookup(j,aj-1)];	
-          mod_base_prob /= cur_distort_prob(j,aj-1);
-        }
-        else
-          mod_base_prob *= 0.0;
-      }
-      else {
-        if (dict_[0][s_idx-1] > 1e-305)
-          mod_base_prob *= empty_word_decrease_const / dict_[0][s_idx-1];
-        else
-          mod_base_prob *= 0.0;
-      }
+    //update alignment and the affected scores
+    if (best_change_is_move) {
+      const uint new_aj = best_move_aj[best_move_j];
+      const uint cur_aj = alignment[best_move_j];
+      assert(cur_aj != new_aj);
 
-      if (isnan(mod_base_prob)) {
+      alignment[best_move_j] = new_aj;
+      fertility[cur_aj]--;
+      fertility[new_aj]++;
+      zero_fert = fertility[0];
 
-        std::cerr << "base prob: " << base_prob << std::endl;
-        std::cerr << "aj: " << aj << std::endl;
+      //the fertility factors of both words change
+      if (cur_aj == 0 || new_aj == 0)
+        hc_empty_word_factors(combinatorics_,curJ,zero_fert,p_zero_,p_nonzero_,och_ney_empty_word_,log_fert_increase[0],log_fert_decrease[0]);
+      if (cur_aj > 0)
+        hc_fertility_factors(fertility_prob_[target[cur_aj-1]],fertility[cur_aj],fertility_limit_,
+                             log_fert_increase[cur_aj],log_fert_decrease[cur_aj]);
+      if (new_aj > 0)
+        hc_fertility_factors(fertility_prob_[target[new_aj-1]],fertility[new_aj],fertility_limit_,
+                             log_fert_increase[new_aj],log_fert_decrease[new_aj]);
 
-        if (aj > 0) {
+      for (uint j=0; j < curJ; j++) {
 
-          const uint t_idx = target[aj-1];
+        const uint aj = alignment[j];
+        double* cur_move_score = move_score.direct_access() + j*(curI+1);
 
-          std::cerr << " mult by " << fert_decrease_factor[aj] << " / " << dict_[t_idx][lookup(j,aj-1)] << std::endl;
-          std::cerr << " div by " << cur_distort_prob(j,aj-1) << std::endl;
+        if (aj == cur_aj || aj == new_aj) {
+          //all moves of j are affected
+          removal_score[j] = (link_score(aj,j) > min_link_score) ? log_fert_decrease[aj] - link_score(aj,j) : hc_impossible;
 
-          uint cur_fert = fertility[aj];
+          for (uint cand_aj = 0; cand_aj <= curI; cand_aj++)
+            cur_move_score[cand_aj] = (cand_aj == aj) ? hc_impossible 
+              : hc_sum(removal_score[j], link_score(cand_aj,j), log_fert_increase[cand_aj]);
 
-          std::cerr << "fert dec. factor = " << ((long double) fertility_prob_[t_idx][cur_fert-1])  << " / ("
-                    << cur_fert  << " * " << fertility_prob_[t_idx][cur_fert] << ")" << std::endl;
+          hc_row_max(cur_move_score, 0, curI+1, best_move_score[j], best_move_aj[j]);
         }
-      }
-
-      assert(!isnan(mod_base_prob));
-      
-      for (uint cand_aj = 0; cand_aj <= curI; cand_aj++) {
-
-        // 	std::cerr << "examining move " << j << " -> " << cand_aj << " (instead of " << aj << ") in iteration #" 
-        // 		  << count_iter << std::endl;
-        // 	std::cerr << "cand_aj has then fertility " << (fertility[cand_aj]+1) << std::endl;
-        // 	std::cerr << "current aj reduces its fertility from " << fertility[aj] << " to " << (fertility[aj]-1)
-        // 		  << std::endl;
-
-        // 	if (cand_aj != 0 && cand_aj != aj) {
-        // 	  std::cerr << "previous fert prob of candidate: " 
-        // 		    << fertility_prob_[target[cand_aj-1]][fertility[cand_aj]] << std::endl;
-        // 	  std::cerr << "new fert prob of candidate: " 
-        // 		    << fertility_prob_[target[cand_aj-1]][fertility[cand_aj]+1] << std::endl;
-        // 	}
-        // 	if (aj != 0) {
-        // 	  std::cerr << "previous fert. prob of aj: " << fertility_prob_[target[aj-1]][fertility[aj]] << std::endl;
-        // 	  std::cerr << "new fert. prob of aj: " << fertility_prob_[target[aj-1]][fertility[aj]-1] << std::endl;
-        // 	}
-
-        // 	if (aj != 0) 
-        // 	  std::cerr << "prev distort prob: " << cur_distort_prob(j,aj-1) << std::endl;
-        // 	if (cand_aj != 0)
-        // 	  std::cerr << "new distort prob: " << cur_distort_prob(j,cand_aj-1) << std::endl;
-	
-        if (cand_aj != aj) {
-	  
-          long double hyp_prob = mod_base_prob;
-
-
-          if (cand_aj != 0) {
-
-	    if ((fertility[cand_aj]+1) > fertility_limit_) {
-	      expansion_prob(j,cand_aj) = 0.0;
-	      continue;
-	    }
-
-	    const uint t_idx = target[cand_aj-1];
-	    
-	    hyp_prob *= dict_[t_idx][lookup(j,cand_aj-1)];
-	    hyp_prob *= fert_increase_factor[cand_aj];
-	    hyp_prob *= cur_distort_prob(j,cand_aj-1);
-          }
-          else {
-            hyp_prob *= empty_word_increase_const * dict_[0][s_idx-1];
-          }
-
-          if (isnan(hyp_prob)) {
-            INTERNAL_ERROR << " nan in move " << j << " -> " << cand_aj << " . Exiting." << std::endl;
-
-            std::cerr << "mod_base_prob: " << mod_base_prob << std::endl;
-            if (cand_aj != 0) {
-
-              const uint t_idx = target[cand_aj-1];
-
-              std::cerr << "dict-factor: " << dict_[t_idx][lookup(j,cand_aj-1)] << std::endl;
-              std::cerr << "fert-factor: " << fert_increase_factor[cand_aj] << std::endl;
-              std::cerr << "distort-factor: " << cur_distort_prob(j,cand_aj-1) << std::endl;
-
-              std::cerr << "distort table: " << cur_distort_prob << std::endl;
-            }
-            exit(1);
-          }
-
-          assert(!isnan(hyp_prob));
-
-          //DEBUG
-          // 	  Math1D::Vector<uint> cand_alignment = alignment[s];
-          // 	  cand_alignment[j] = cand_aj;
-	
-          // 	  if (hyp_prob > 0.0) {
-          // 	    double check_ratio = hyp_prob / alignment_prob(s,cand_alignment);
-          // 	    if (hyp_prob > best_prob* 0.0000001) {
-
-          // 	      if (! (check_ratio > 0.999 && check_ratio < 1.001 ) ) {
-          // 		std::cerr << "check for sentence pair #" << s << " with " << curJ << " source words and "
-          // 			  << curI << " target words" << std::endl;
+        else {
+          //only the moves to the two words are affected
+          cur_move_score[cur_aj] = hc_sum(removal_score[j], link_score(cur_aj,j), log_fert_increase[cur_aj]);
+          cur_move_score[new_aj] = hc_sum(removal_score[j], link_score(new_aj,j), log_fert_increase[new_aj]);
 
-          // 		std::cerr << "j: " << j << ", aj: " << aj << std::endl;
-		
-          // 		std::cerr << "examining move " << j << " -> " << cand_aj << " (instead of " << aj << ") in iteration #" 
-          // 			  << count_iter << std::endl;
-          // 		std::cerr << "cand_aj has then fertility " << (fertility[cand_aj]+1) << std::endl;
-          // 		std::cerr << "current aj reduces its fertility from " << fertility[aj] << " to " << (fertility[aj]-1)
-          // 			  << std::endl;
-		
-          // 		if (cand_aj != 0 && cand_aj != aj) {
-          // 		  std::cerr << "previous fert prob of candidate: " 
-          // 			    << fertility_prob_[target[cand_aj-1]][fertility[cand_aj]] << std::endl;
-          // 		  std::cerr << "new fert prob of candidate: " 
-          // 			    << fertility_prob_[target[cand_aj-1]][fertility[cand_aj]+1] << std::endl;
-          // 		}
-          // 		if (aj != 0) {
-          // 		  std::cerr << "previous fert. prob of aj: " << fertility_prob_[target[aj-1]][fertility[aj]] 
-          // 			    << std::endl;
-          // 		  std::cerr << "new fert. prob of aj: " << fertility_prob_[target[aj-1]][fertility[aj]-1] 
-          // 			    << std::endl;
-          // 		}
-
-          // 		if (aj != 0) 
-          // 		  std::cerr << "prev distort prob: " << cur_distort_prob(j,aj-1) << std::endl;
-          // 		if (cand_aj != 0)
-          // 		  std::cerr << "new distort prob: " << cur_distort_prob(j,cand_aj-1) << std::endl;
-
-          // 		std::cerr << "hyp prob: " << hyp_prob << std::endl;
-          // 		std::cerr << "check: " << alignment_prob(s,cand_alignment) << std::endl;
-          // 		std::cerr << "best prob: " << best_prob << std::endl;
-          // 	      }
-	      
-          // 	      assert(check_ratio > 0.999 && check_ratio < 1.001);
-          // 	    }
-          // 	    else if (check_ratio < 0.999 || check_ratio > 1.001) {
-          // #if 0
-          // 	      std::cerr << "WARNING: ratio " << check_ratio << " for very unlikely alignment" << std::endl; 
-          // 	      std::cerr << "   hyp prob: " << hyp_prob << std::endl;
-          // 	      std::cerr << "   check: " << alignment_prob(s,cand_alignment) << std::endl;
-          // 	      std::cerr << "   best prob: " << best_prob << std::endl;
-          // #endif
-          // 	    }
-          // 	  }
-          //END_DEBUG
-
-          assert(!isnan(hyp_prob));
-
-          expansion_prob(j,cand_aj) = hyp_prob;
-	  
-          if (hyp_prob > improvement_factor*best_prob) {
-
-            best_prob = hyp_prob;
-            improvement = true;
-            best_change_is_move = true;
-            best_move_j = j;
-            best_move_aj = cand_aj;
-          }	  
+          if (!hc_update_row_max(cur_aj, cur_move_score[cur_aj], best_move_score[j], best_move_aj[j])
+              || !hc_update_row_max(new_aj, cur_move_score[new_aj], best_move_score[j], best_move_aj[j]))
+            hc_row_max(cur_move_score, 0, curI+1, best_move_score[j], best_move_aj[j]);
         }
       }
+
+      hc_update_swap_scores(link_score, alignment, best_move_j, swap_score, best_swap_score, best_swap_j2);
     }
+    else {
 
-    //b) swap_moves (NOTE that swaps do not affect the fertilities)
-    for (uint j1=0; j1 < curJ; j1++) {
+      const uint j1 = best_swap_j1;
+      const uint j2 = best_swap_j2[j1];
+      const uint cur_aj1 = alignment[j1];
+      const uint cur_aj2 = alignment[j2];
 
-      swap_prob(j1,j1) = 0.0;
+      assert(cur_aj1 != cur_aj2);
       
-      const uint aj1 = alignment[j1];
-      const uint s_j1 = source[j1];
-
-      for (uint j2 = j1+1; j2 < curJ; j2++) {
+      alignment[j1] = cur_aj2;
+      alignment[j2] = cur_aj1;
 
-        const uint aj2 = alignment[j2];
-        const uint s_j2 = source[j2];
+      const uint changed_j[2] = {j1, j2};
+      for (uint k=0; k < 2; k++) {
 
-        if (aj1 == aj2) {
-          //we do not want to count the same alignment twice
-          swap_prob(j1,j2) = 0.0;
-        }
-        else {
-
-          long double hyp_prob = base_prob;
-          if (aj1 != 0) {
-            const uint t_idx = target[aj1-1];
-            hyp_prob *= dict_[t_idx][lookup(j2,aj1-1)] * cur_distort_prob(j2,aj1-1)
-              / (dict_[t_idx][lookup(j1,aj1-1)] * cur_distort_prob(j1,aj1-1) ) ;
-          }
-          else
-            hyp_prob *= dict_[0][s_j2-1] / dict_[0][s_j1-1];
-
-          if (aj2 != 0) {
-            const uint t_idx = target[aj2-1];
-            hyp_prob *= dict_[t_idx][lookup(j1,aj2-1)] * cur_distort_prob(j1,aj2-1)
-              / (dict_[t_idx][lookup(j2,aj2-1)] * cur_distort_prob(j2,aj2-1) );
-          }
-          else {
-            hyp_prob *= dict_[0][s_j1-1] / dict_[0][s_j2-1];
-          }
+        const uint j = changed_j[k];
+        const uint aj = alignment[j];
+        double* cur_move_score = move_score.direct_access() + j*(curI+1);
 
-          //DEBUG
-          // 	  Math1D::Vector<uint> cand_alignment = alignment;
-          // 	  cand_alignment[j1] = aj2;
-          // 	  cand_alignment[j2] = aj1;
-	  
-          // 	  double check_ratio = hyp_prob / alignment_prob(s,cand_alignment);
-          // 	  if (hyp_prob > best_prob* 0.0000001) 
-          // 	    assert(check_ratio > 0.999 && check_ratio < 1.001);
-          //END_DEBUG
+        removal_score[j] = (link_score(aj,j) > min_link_score) ? log_fert_decrease[aj] - link_score(aj,j) : hc_impossible;
 
-          assert(!isnan(hyp_prob));
+        for (uint cand_aj = 0; cand_aj <= curI; cand_aj++)
+          cur_move_score[cand_aj] = (cand_aj == aj) ? hc_impossible 
+            : hc_sum(removal_score[j], link_score(cand_aj,j), log_fert_increase[cand_aj]);
 
-          swap_prob(j1,j2) = hyp_prob;
+        hc_row_max(cur_move_score, 0, curI+1, best_move_score[j], best_move_aj[j]);
 
-          if (hyp_prob > improvement_factor*best_prob) {
-	    
-            improvement = true;
-            best_change_is_move = false;
-            best_prob = hyp_prob;
-            best_swap_j1 = j1;
-            best_swap_j2 = j2;
-          }
-        }
-        swap_prob(j2,j1) = swap_prob(j1,j2);
+        hc_update_swap_scores(link_score, alignment, j, swap_score, best_swap_score, best_swap_j2);
       }
     }
 
-    if (!improvement)
-      break;
-
-    //update alignment
-    if (best_change_is_move) {
-      uint cur_aj = alignment[best_move_j];
-      assert(cur_aj != best_move_aj);
-
-      alignment[best_move_j] = best_move_aj;
-      fertility[cur_aj]--;
-      fertility[best_move_aj]++;
-      zero_fert = fertility[0];
-    }
-    else {
-
-      uint cur_aj1 = alignment[best_swap_j1];
-      uint cur_aj2 = alignment[best_swap_j2];
-
-      assert(cur_aj1 != cur_aj2);
-      
-      alignment[best_swap_j1] = cur_aj2;
-      alignment[best_swap_j2] = cur_aj1;
-    }
-
+    base_prob *= std::exp((long double) best_score);
 
     //THIS IS SLOW-> outcomment in release version
 #ifndef NDEBUG
-    long double check_ratio = best_prob / alignment_prob(source,target,lookup,alignment);
-    if (best_prob > 1e-300 && !(check_ratio > 0.995 && check_ratio < 1.005)) {
+    long double check_ratio = base_prob / alignment_prob(source,target,lookup,alignment);
+    if (base_prob > 1e-300 && !(check_ratio > 0.995 && check_ratio < 1.005)) {
 
       std::cerr << "hc iter " << nIter << std::endl;
 
       if (best_change_is_move) {
-        std::cerr << "moved j=" << best_move_j << " -> aj=" << best_move_aj << std::endl; 
+        std::cerr << "moved j=" << best_move_j << " -> aj=" << alignment[best_move_j] << std::endl; 
       }
       else {
-        std::cerr << "swapped j1=" << best_swap_j1 << " and j2=" << best_swap_j2 << std::endl;
-        std::cerr << "now aligned to " << alignment[best_swap_j1] << " and " << alignment[best_swap_j2] << std::endl;
+        std::cerr << "swapped j1=" << best_swap_j1 << std::endl;
       }
 
-      std::cerr << "probability improved from " << base_prob << " to " << best_prob << std::endl;
+      std::cerr << "probability improved by a log-factor of " << best_score << " to " << base_prob << std::endl;
       std::cerr << "check_ratio: " << check_ratio << std::endl;
     }
     
-    //std::cerr << "check_ratio: " << check_ratio << std::endl;
-    if (best_prob > 1e-275)
+    if (base_prob > 1e-275)
       assert(check_ratio > 0.995 && check_ratio < 1.005);
 #endif
+  }
 
-    base_prob = best_prob;
+  /**** the callers need the probabilities of all neighbors. The ratios are formed in double precision, 
+   **** those that underflow are negligible compared to the current alignment ****/
+  for (uint j=0; j < curJ; j++) {
+    for (uint cand_aj = 0; cand_aj <= curI; cand_aj++) {
+      const double score = move_score(cand_aj,j);
+      expansion_prob(j,cand_aj) = (score == hc_impossible) ? 0.0 : base_prob * std::exp(score);
+    }
+    swap_prob(j,j) = 0.0;
+    for (uint j2=j+1; j2 < curJ; j2++) {
+      const double score = swap_score(j2,j);
+      swap_prob(j,j2) = (score == hc_impossible) ? 0.0 : base_prob * std::exp(score);
+      swap_prob(j2,j) = swap_prob(j,j2);
+    }
   }
 
   assert(!isnan(base_prob));
@@ -1154,10 +1199,19 @@ long double IBM3Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 }
 
 
-long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+long double IBM3Trainer::compute_external_alignment(const SentenceView& source, const SentenceView& target,
                                                     const SingleLookupTable& lookup,
                                                     Math1D::Vector<AlignBaseType>& alignment, bool use_ilp) {
 
+  prepare_external_alignment(source, target, lookup, alignment);
+
+  return compute_prepared_alignment(source, target, lookup, alignment, use_ilp);
+}
+
+void IBM3Trainer::prepare_external_alignment(const SentenceView& source, const SentenceView& target,
+                                             const SingleLookupTable& lookup,
+                                             Math1D::Vector<AlignBaseType>& alignment) {
+
   const uint J = source.size();
   const uint I = target.size();
 
@@ -1171,8 +1225,10 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
     fertility[aj]++;
   }
 
-  if (fertility[0] > 0 && p_zero_ < 1e-12)
+  if (fertility[0] > 0 && p_zero_ < 1e-12) {
     p_zero_ = 1e-12;
+    model_changes_.global_ = true;
+  }
   
   if (2*fertility[0] > J) {
     
@@ -1185,12 +1241,14 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
         fertility[1]++;	
 
 	if (dict_[target[0]][lookup(j,0)] < 1e-12)
-	  dict_[target[0]][lookup(j,0)] = 1e-12;
+	  set_dict_entry(target[0],lookup(j,0),1e-12);
       }
     }
   }
 
   /*** check if respective distortion table is present. If not, create one from the parameters ***/
+  // Existing entries are not changed, and the new ones are the same whichever sentence pair needs them first.
+  // So this is not recorded as a change of the model
 
   if (parametric_distortion_) {
     if (distortion_param_.xDim() < J)
@@ -1227,6 +1285,12 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
   /*** check if fertility tables are large enough ***/
   for (uint i=0; i < I; i++) {
 
+    const Math1D::Vector<double>& cur_fertility = fertility_prob_[target[i]];
+    if (cur_fertility.size() >= J+1 && cur_fertility[fertility[i+1]] >= 1e-8 && cur_fertility.sum() >= 0.5)
+      continue;
+
+    save_fertilities(target[i]);
+
     if (fertility_prob_[target[i]].size() < J+1)
       fertility_prob_[target[i]].resize(J+1,1e-15);
 
@@ -1250,20 +1314,45 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
 
     if (sum < 1e-100) {
       for (uint i=0; i < I; i++)
-        dict_[target[i]][lookup(j,i)] = 1e-15;
+        set_dict_entry(target[i],lookup(j,i),1e-15);
     }
 
     uint aj = alignment[j];
     if (aj == 0) {
       if (dict_[0][src_idx-1] < 1e-20)
-        dict_[0][src_idx-1] = 1e-20;
+        set_dict_entry(0,src_idx-1,1e-20);
     }
     else {
       if (dict_[target[aj-1]][lookup(j,aj-1)] < 1e-20)
-        dict_[target[aj-1]][lookup(j,aj-1)] = 1e-20;
+        set_dict_entry(target[aj-1],lookup(j,aj-1),1e-20);
     }
   }
+}
+
+void IBM3Trainer::record_model_changes() {
+
+  record_changes_ = true;
+  model_changes_ = ExternalModelChanges();
+  saved_p_zero_ = p_zero_;
+}
 
+void IBM3Trainer::restore_model() {
+
+  restore_dict_and_fertilities();
+
+  p_zero_ = saved_p_zero_;
+}
+
+long double IBM3Trainer::compute_prepared_alignment(const SentenceView& source, const SentenceView& target,
+                                                    const SingleLookupTable& lookup,
+                                                    Math1D::Vector<AlignBaseType>& alignment, bool use_ilp) {
+
+  const uint J = source.size();
+  const uint I = target.size();
+
+  Math1D::Vector<uint> fertility(I+1,0);
+  for (uint j=0; j < J; j++)
+    fertility[alignment[j]]++;
 
 #ifndef HAS_CBC
   use_ilp = false;
@@ -1272,13 +1361,14 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
   //create matrices
   Math2D::Matrix<long double> expansion_prob(J,I+1);
   Math2D::Matrix<long double> swap_prob(J,J);
+  HillclimbingScores hc_scores;
   
   uint nIter;
   
   long double hc_prob;
 
   hc_prob =  update_alignment_by_hillclimbing(source, target, lookup, nIter, fertility,
-                                                expansion_prob, swap_prob, alignment);
+                                                expansion_prob, swap_prob, hc_scores, alignment);
   
   if (use_ilp) {
     
@@ -1292,7 +1382,7 @@ long double IBM3Trainer::compute_external_alignment(const Storage1D<uint>& sourc
 
 // <code> start_alignment </code> is used as initialization for hillclimbing and later modified
 // the extracted alignment is written to <code> postdec_alignment </code>
-void IBM3Trainer::compute_external_postdec_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+void IBM3Trainer::compute_external_postdec_alignment(const SentenceView& source, const SentenceView& target,
 						     const SingleLookupTable& lookup,
 						     Math1D::Vector<AlignBaseType>& alignment,
 						     std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
@@ -1410,13 +1500,14 @@ void IBM3Trainer::compute_external_postdec_alignment(const Storage1D<uint>& sour
   //create matrices
   Math2D::Matrix<long double> expansion_move_prob(J,I+1);
   Math2D::Matrix<long double> swap_move_prob(J,J);
+  HillclimbingScores hc_scores;
   
   uint nIter;
   
   long double best_prob;
   
   best_prob =  update_alignment_by_hillclimbing(source, target, lookup, nIter, fertility,
-                                                expansion_move_prob, swap_move_prob, alignment);
+                                                expansion_move_prob, swap_move_prob, hc_scores, alignment);
 
   
   const long double expansion_prob = expansion_move_prob.sum();
@@ -1473,21 +1564,33 @@ void IBM3Trainer::compute_external_postdec_alignment(const Storage1D<uint>& sour
 
 void IBM3Trainer::update_alignments_unconstrained() {
 
-  Math2D::NamedMatrix<long double> expansion_prob(MAKENAME(expansion_prob));
-  Math2D::NamedMatrix<long double> swap_prob(MAKENAME(swap_prob));
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads_,sort_by_length_,stream_chunk_size_);
 
-  for (size_t s=0; s < source_sentence_.size(); s++) {
+#pragma omp parallel for schedule(static,1) num_threads(nThreads_)
+  for (int t=0; t < (int) nThreads_; t++) {
 
-    const uint curI = target_sentence_[s].size();
-    Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
+    Math2D::NamedMatrix<long double> expansion_prob(MAKENAME(expansion_prob));
+    Math2D::NamedMatrix<long double> swap_prob(MAKENAME(swap_prob));
+    HillclimbingScores hc_scores;
+    Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
+
+    WordLookupBuffers aux_lookup;
+
+    for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
+
+      const size_t s = schedule[k];
+      schedule.prefetch(t,k);
+
+      const uint curI = target_sentence_[s].size();
+      fertility.resize_dirty(curI+1);
     
-    SingleLookupTable aux_lookup;
-    const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                                   nSourceWords_,slookup_[s],aux_lookup);
+      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                           nSourceWords_,slookup_[s],aux_lookup);
 
-    uint nIter=0;
-    update_alignment_by_hillclimbing(source_sentence_[s], target_sentence_[s], cur_lookup,nIter,fertility,
-                                     expansion_prob,swap_prob, best_known_alignment_[s]);
+      uint nIter=0;
+      update_alignment_by_hillclimbing(source_sentence_[s], target_sentence_[s], cur_lookup,nIter,fertility,
+                                       expansion_prob,swap_prob,hc_scores,best_known_alignment_[s]);
+    }
   }
 }
 
@@ -1512,8 +1615,6 @@ void IBM3Trainer::train_unconstrained(uint nIter) {
     dict_weight_sum += fabs(prior_weight_[i].sum());
   }
 
-  SingleLookupTable aux_lookup;
-
   if (parametric_distortion_)
     par2nonpar_distortion(distortion_prob_);
 
@@ -1532,9 +1633,31 @@ void IBM3Trainer::train_unconstrained(uint nIter) {
     ffert_count[i].resize_dirty(fertility_prob_[i].size());
   }
 
+  //the ILP-solver and the statistics on its results are only handled from a single thread
+  const uint nThreads = (viterbi_ilp_) ? 1 : nThreads_;
+
+  //each thread handles one block of the schedule and collects into its own count shard
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads,sort_by_length_,stream_chunk_size_);
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math2D::Matrix<double> > > fdistort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > ffert_count_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fdistort_count_shard[t] = fdistort_count;
+    fwcount_shard[t] = fwcount;
+    ffert_count_shard[t] = ffert_count;
+  }
+
   long double fzero_count;
   long double fnonzero_count;
 
+  Storage1D<long double> fzero_count_shard(nThreads-1);
+  Storage1D<long double> fnonzero_count_shard(nThreads-1);
+  Math1D::Vector<double> max_perplexity_shard(nThreads-1);
+  Math1D::Vector<double> approx_sum_perplexity_shard(nThreads-1);
+  Math1D::Vector<uint> sum_iter_shard(nThreads-1);
+
   for (uint iter=1; iter <= nIter; iter++) {
 
     std::cerr << "******* IBM-3 EM-iteration #" << iter << std::endl;
@@ -1547,285 +1670,339 @@ void IBM3Trainer::train_unconstrained(uint nIter) {
     fzero_count = 0.0;
     fnonzero_count = 0.0;
 
-    for (uint J=0; J < fdistort_count.size(); J++) {
-      fdistort_count[J].set_constant(0.0);
-    }
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0.0);
-      ffert_count[i].set_constant(0.0);
-    }
-
     max_perplexity = 0.0;
 
     std::clock_t tStartLoop = std::clock();
 
-    for (size_t s=0; s < source_sentence_.size(); s++) {
-      
-      if ((s% 10000) == 0)
-        std::cerr << "sentence pair #" << s << std::endl;
-      
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
-      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                           nSourceWords_,slookup_[s],aux_lookup);
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
+
+      Storage1D<Math2D::Matrix<double> >& cur_fdistort_count = (t == 0) ? fdistort_count : fdistort_count_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_ffert_count = (t == 0) ? ffert_count : ffert_count_shard[t-1];
+
+      long double& cur_fzero_count = (t == 0) ? fzero_count : fzero_count_shard[t-1];
+      long double& cur_fnonzero_count = (t == 0) ? fnonzero_count : fnonzero_count_shard[t-1];
+      double& cur_max_perplexity = (t == 0) ? max_perplexity : max_perplexity_shard[t-1];
+      double& cur_approx_sum_perplexity = (t == 0) ? approx_sum_perplexity : approx_sum_perplexity_shard[t-1];
+      uint& cur_sum_iter = (t == 0) ? sum_iter : sum_iter_shard[t-1];
+
+      if (t != 0) {
+        cur_fzero_count = 0.0;
+        cur_fnonzero_count = 0.0;
+        cur_max_perplexity = 0.0;
+        cur_approx_sum_perplexity = 0.0;
+        cur_sum_iter = 0;
+      }
 
-      const uint curI = cur_target.size();
-      const uint curJ = cur_source.size();
-      const Math2D::Matrix<double>& cur_distort_count = fdistort_count[curJ-1];
+      for (uint J=0; J < cur_fdistort_count.size(); J++) {
+        cur_fdistort_count[J].set_constant(0.0);
+      }
+      for (uint i=0; i < nTargetWords; i++) {
+        cur_fwcount[i].set_constant(0.0);
+        cur_ffert_count[i].set_constant(0.0);
+      }
 
-      Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
+      WordLookupBuffers aux_lookup;
 
-      Math2D::NamedMatrix<long double> swap_move_prob(curJ,curJ,MAKENAME(swap_move_prob));
-      Math2D::NamedMatrix<long double> expansion_move_prob(curJ,curI+1,MAKENAME(expansion_move_prob));
-      
-      long double best_prob;
+      //buffers for the hillclimbing, reused across the sentences of the block
+      Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
+      Math2D::NamedMatrix<long double> swap_move_prob(MAKENAME(swap_move_prob));
+      Math2D::NamedMatrix<long double> expansion_move_prob(MAKENAME(expansion_move_prob));
+      HillclimbingScores hc_scores;
 
+      for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
 
-      best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                   expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
+        const size_t s = schedule[k];
+        schedule.prefetch(t,k);
       
-      assert(!isnan(best_prob));
+        if ((s% 10000) == 0)
+          std::cerr << "sentence pair #" << s << std::endl;
       
-      uint maxFert = std::min(curJ,fertility_limit_);
+        const SentenceView& cur_source = source_sentence_[s];
+        const SentenceView& cur_target = target_sentence_[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                             nSourceWords_,slookup_[s],aux_lookup);
 
-      long double viterbi_prob = 0.0;
-      if (viterbi_ilp_) {
-        viterbi_alignment[s] = best_known_alignment_[s];
-        viterbi_prob = compute_viterbi_alignment_ilp(cur_source,cur_target,cur_lookup,maxFert,viterbi_alignment[s]);
-        //OPTIONAL
-        //best_known_alignment_[s] = viterbi_alignment[s];
-        //best_prob = update_alignment_by_hillclimbing(s,sum_iter,fertility,
-        // 						   expansion_move_prob,swap_move_prob);
-        //END_OPTIONAL
-        viterbi_max_perplexity -= std::log(viterbi_prob);
-
-        bool alignments_equal = true;
-        for (uint j=0; j < curJ; j++) {
+        const uint curI = cur_target.size();
+        const uint curJ = cur_source.size();
+        Math2D::Matrix<double>& cur_distort_count = cur_fdistort_count[curJ-1];
+
+        fertility.resize_dirty(curI+1);
+      
+        long double best_prob;
+
+
+        best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                     expansion_move_prob,swap_move_prob,hc_scores,best_known_alignment_[s]);
+      
+        assert(!isnan(best_prob));
+      
+        uint maxFert = std::min(curJ,fertility_limit_);
+
+        long double viterbi_prob = 0.0;
+        if (viterbi_ilp_) {
+          viterbi_alignment[s] = best_known_alignment_[s];
+          viterbi_prob = compute_viterbi_alignment_ilp(cur_source,cur_target,cur_lookup,maxFert,viterbi_alignment[s]);
+          //OPTIONAL
+          //best_known_alignment_[s] = viterbi_alignment[s];
+          //best_prob = update_alignment_by_hillclimbing(s,sum_iter,fertility,
+          // 						   expansion_move_prob,swap_move_prob);
+          //END_OPTIONAL
+          viterbi_max_perplexity -= std::log(viterbi_prob);
+
+          bool alignments_equal = true;
+          for (uint j=0; j < curJ; j++) {
 	  
-          if (best_known_alignment_[s][j] != viterbi_alignment[s][j])
-            alignments_equal = false;
-        }
+            if (best_known_alignment_[s][j] != viterbi_alignment[s][j])
+              alignments_equal = false;
+          }
 
-        if (!alignments_equal) {
+          if (!alignments_equal) {
 	  
-          double ratio = viterbi_prob / best_prob;
+            double ratio = viterbi_prob / best_prob;
 	  
-          if (ratio > 1.01) {
-            nViterbiBetter++;
+            if (ratio > 1.01) {
+              nViterbiBetter++;
 	    
-            // std::cerr << "pair #" << s << std::endl;
-            // std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
-            // std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
+              // std::cerr << "pair #" << s << std::endl;
+              // std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
+              // std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
 	    
-            // std::cerr << "hillclimbing prob: " << best_prob << std::endl;
-            // std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
-          }
-          else if (ratio < 0.99) {
-            nViterbiWorse++;
+              // std::cerr << "hillclimbing prob: " << best_prob << std::endl;
+              // std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
+            }
+            else if (ratio < 0.99) {
+              nViterbiWorse++;
 	    
-            std::cerr << "pair #" << s << ": WORSE!!!!" << std::endl;
-            std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
-            std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
+              std::cerr << "pair #" << s << ": WORSE!!!!" << std::endl;
+              std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
+              std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
 	    
-            std::cerr << "hillclimbing prob: " << best_prob << std::endl;
-            std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
-          }
-          if (ratio > max_ratio) {
-            max_ratio = ratio;
+              std::cerr << "hillclimbing prob: " << best_prob << std::endl;
+              std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
+            }
+            if (ratio > max_ratio) {
+              max_ratio = ratio;
 	    
-            std::cerr << "pair #" << s << std::endl;
-            std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
-            std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
+              std::cerr << "pair #" << s << std::endl;
+              std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
+              std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
 	    
-            std::cerr << "hillclimbing prob: " << best_prob << std::endl;
-            std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
-          }
-          if (ratio < min_ratio) {
-            min_ratio = ratio;
+              std::cerr << "hillclimbing prob: " << best_prob << std::endl;
+              std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
+            }
+            if (ratio < min_ratio) {
+              min_ratio = ratio;
 	
-            std::cerr << "pair #" << s << std::endl;
-            std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
-            std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
+              std::cerr << "pair #" << s << std::endl;
+              std::cerr << "ilp prob:          " << viterbi_prob << std::endl;
+              std::cerr << "ilp alignment: " << viterbi_alignment[s] << std::endl;
 	    
-            std::cerr << "hillclimbing prob: " << best_prob << std::endl;
-            std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
+              std::cerr << "hillclimbing prob: " << best_prob << std::endl;
+              std::cerr << "hc. alignment: " << best_known_alignment_[s] << std::endl;
+            }
           }
         }
-      }
 
-      max_perplexity -= std::log(best_prob);
+        cur_max_perplexity -= std::log(best_prob);
       
-      const long double expansion_prob = expansion_move_prob.sum();
-      const long double swap_prob =  0.5 * swap_move_prob.sum();
+        const long double expansion_prob = expansion_move_prob.sum();
+        const long double swap_prob =  0.5 * swap_move_prob.sum();
 
-      const long double sentence_prob = best_prob + expansion_prob +  swap_prob;
+        const long double sentence_prob = best_prob + expansion_prob +  swap_prob;
 
-      approx_sum_perplexity -= std::log(sentence_prob);
+        cur_approx_sum_perplexity -= std::log(sentence_prob);
 
-      const long double inv_sentence_prob = 1.0 / sentence_prob;
+        const long double inv_sentence_prob = 1.0 / sentence_prob;
      
-      if (isnan(inv_sentence_prob)) {
+        if (isnan(inv_sentence_prob)) {
 
-	std::cerr << "best prob: " << best_prob << std::endl;
-	std::cerr << "swap prob: " << swap_prob << std::endl;
-	std::cerr << "expansion prob: " << expansion_prob << std::endl;
-      }
+	  std::cerr << "best prob: " << best_prob << std::endl;
+	  std::cerr << "swap prob: " << swap_prob << std::endl;
+	  std::cerr << "expansion prob: " << expansion_prob << std::endl;
+        }
 
-      assert(!isnan(inv_sentence_prob));
+        assert(!isnan(inv_sentence_prob));
 
-      double cur_zero_weight = best_prob;
-      for (uint j=0; j < curJ; j++) {
-        if (best_known_alignment_[s][j] == 0) {
+        double cur_zero_weight = best_prob;
+        for (uint j=0; j < curJ; j++) {
+          if (best_known_alignment_[s][j] == 0) {
 	  
-          for (uint jj=j+1; jj < curJ; jj++) {
-            if (best_known_alignment_[s][jj] != 0)
-              cur_zero_weight += swap_move_prob(j,jj);
+            for (uint jj=j+1; jj < curJ; jj++) {
+              if (best_known_alignment_[s][jj] != 0)
+                cur_zero_weight += swap_move_prob(j,jj);
+            }
           }
         }
-      }
-      cur_zero_weight *= inv_sentence_prob;
+        cur_zero_weight *= inv_sentence_prob;
       
-      fzero_count += cur_zero_weight * (fertility[0]);
-      fnonzero_count += cur_zero_weight * (curJ - 2*fertility[0]);
+        cur_fzero_count += cur_zero_weight * (fertility[0]);
+        cur_fnonzero_count += cur_zero_weight * (curJ - 2*fertility[0]);
 
-      if (curJ >= 2*(fertility[0]+1)) {
-        long double inc_zero_weight = 0.0;
-        for (uint j=0; j < curJ; j++)
-          inc_zero_weight += expansion_move_prob(j,0);
+        if (curJ >= 2*(fertility[0]+1)) {
+          long double inc_zero_weight = 0.0;
+          for (uint j=0; j < curJ; j++)
+            inc_zero_weight += expansion_move_prob(j,0);
 	
-        inc_zero_weight *= inv_sentence_prob;
-        fzero_count += inc_zero_weight * (fertility[0]+1);
-        fnonzero_count += inc_zero_weight * (curJ -2*(fertility[0]+1));
-      }
+          inc_zero_weight *= inv_sentence_prob;
+          cur_fzero_count += inc_zero_weight * (fertility[0]+1);
+          cur_fnonzero_count += inc_zero_weight * (curJ -2*(fertility[0]+1));
+        }
 
-      if (fertility[0] > 1) {
-        long double dec_zero_weight = 0.0;
-        for (uint j=0; j < curJ; j++) {
-          if (best_known_alignment_[s][j] == 0) {
-            for (uint i=1; i <= curI; i++)
-              dec_zero_weight += expansion_move_prob(j,i);
+        if (fertility[0] > 1) {
+          long double dec_zero_weight = 0.0;
+          for (uint j=0; j < curJ; j++) {
+            if (best_known_alignment_[s][j] == 0) {
+              for (uint i=1; i <= curI; i++)
+                dec_zero_weight += expansion_move_prob(j,i);
+            }
           }
-        }
       
-        dec_zero_weight *= inv_sentence_prob;
+          dec_zero_weight *= inv_sentence_prob;
 
-        fzero_count += dec_zero_weight * (fertility[0]-1);
-        fnonzero_count += dec_zero_weight * (curJ -2*(fertility[0]-1));
-      }
+          cur_fzero_count += dec_zero_weight * (fertility[0]-1);
+          cur_fnonzero_count += dec_zero_weight * (curJ -2*(fertility[0]-1));
+        }
 
-      //increase counts for dictionary and distortion
-      for (uint j=0; j < curJ; j++) {
+        //increase counts for dictionary and distortion
+        for (uint j=0; j < curJ; j++) {
 
-        const uint s_idx = cur_source[j];
-        const uint cur_aj = best_known_alignment_[s][j];
+          const uint s_idx = cur_source[j];
+          const uint cur_aj = best_known_alignment_[s][j];
 
-        long double addon = sentence_prob;
-        for (uint i=0; i <= curI; i++) 
-          addon -= expansion_move_prob(j,i);
-        for (uint jj=0; jj < curJ; jj++)
-          addon -= swap_move_prob(j,jj);
+          long double addon = sentence_prob;
+          for (uint i=0; i <= curI; i++) 
+            addon -= expansion_move_prob(j,i);
+          for (uint jj=0; jj < curJ; jj++)
+            addon -= swap_move_prob(j,jj);
 
-        addon *= inv_sentence_prob;
+          addon *= inv_sentence_prob;
 
-        assert(!isnan(addon));
+          assert(!isnan(addon));
 
-        if (cur_aj != 0) {
-          fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += addon;
-          cur_distort_count(j,cur_aj-1) += addon;
-          assert(!isnan(cur_distort_count(j,cur_aj-1)));
-        }
-        else {
-          fwcount[0][s_idx-1] += addon;
-        }
+          if (cur_aj != 0) {
+            cur_fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += addon;
+            cur_distort_count(j,cur_aj-1) += addon;
+            assert(!isnan(cur_distort_count(j,cur_aj-1)));
+          }
+          else {
+            cur_fwcount[0][s_idx-1] += addon;
+          }
 
-        for (uint i=0; i <= curI; i++) {
+          for (uint i=0; i <= curI; i++) {
 
-          if (i != cur_aj) {
+            if (i != cur_aj) {
 
-            long double addon = expansion_move_prob(j,i);
-            for (uint jj=0; jj < curJ; jj++) {
-              if (best_known_alignment_[s][jj] == i)
-                addon += swap_move_prob(j,jj);
-            }
-            addon *= inv_sentence_prob;
+              long double addon = expansion_move_prob(j,i);
+              for (uint jj=0; jj < curJ; jj++) {
+                if (best_known_alignment_[s][jj] == i)
+                  addon += swap_move_prob(j,jj);
+              }
+              addon *= inv_sentence_prob;
 
-            assert(!isnan(addon));
+              assert(!isnan(addon));
 	
-            if (i!=0) {
-              fwcount[cur_target[i-1]][cur_lookup(j,i-1)] += addon;
-              cur_distort_count(j,i-1) += addon;
-              assert(!isnan(cur_distort_count(j,i-1)));
-            }
-            else {
-              fwcount[0][s_idx-1] += addon;
+              if (i!=0) {
+                cur_fwcount[cur_target[i-1]][cur_lookup(j,i-1)] += addon;
+                cur_distort_count(j,i-1) += addon;
+                assert(!isnan(cur_distort_count(j,i-1)));
+              }
+              else {
+                cur_fwcount[0][s_idx-1] += addon;
+              }
             }
           }
         }
-      }
 
-      //update fertility counts
-      for (uint i=1; i <= curI; i++) {
+        //update fertility counts
+        for (uint i=1; i <= curI; i++) {
 
-        const uint cur_fert = fertility[i];
-        const uint t_idx = cur_target[i-1];
+          const uint cur_fert = fertility[i];
+          const uint t_idx = cur_target[i-1];
 
-        long double addon = sentence_prob;
-        for (uint j=0; j < curJ; j++) {
-          if (best_known_alignment_[s][j] == i) {
-            for (uint ii=0; ii <= curI; ii++)
-              addon -= expansion_move_prob(j,ii);
+          long double addon = sentence_prob;
+          for (uint j=0; j < curJ; j++) {
+            if (best_known_alignment_[s][j] == i) {
+              for (uint ii=0; ii <= curI; ii++)
+                addon -= expansion_move_prob(j,ii);
+            }
+            else
+              addon -= expansion_move_prob(j,i);
+          }
+          addon *= inv_sentence_prob;
+
+          double daddon = (double) addon;
+          if (!(daddon > 0.0)) {
+            std::cerr << "STRANGE: fractional weight " << daddon << " for sentence pair #" << s << " with "
+                      << curJ << " source words and " << curI << " target words" << std::endl;
+            std::cerr << "best alignment prob: " << best_prob << std::endl;
+            std::cerr << "sentence prob: " << sentence_prob << std::endl;
+            std::cerr << "" << std::endl;
           }
-          else
-            addon -= expansion_move_prob(j,i);
-        }
-        addon *= inv_sentence_prob;
-
-        double daddon = (double) addon;
-        if (!(daddon > 0.0)) {
-          std::cerr << "STRANGE: fractional weight " << daddon << " for sentence pair #" << s << " with "
-                    << curJ << " source words and " << curI << " target words" << std::endl;
-          std::cerr << "best alignment prob: " << best_prob << std::endl;
-          std::cerr << "sentence prob: " << sentence_prob << std::endl;
-          std::cerr << "" << std::endl;
-        }
 
-        ffert_count[t_idx][cur_fert] += addon;
+          cur_ffert_count[t_idx][cur_fert] += addon;
 
-        //NOTE: swap moves do not change the fertilities
-        if (cur_fert > 0) {
-          long double alt_addon = 0.0;
-          for (uint j=0; j < curJ; j++) {
-            if (best_known_alignment_[s][j] == i) {
-              for (uint ii=0; ii <= curI; ii++) {
-                if (ii != i)
-                  alt_addon += expansion_move_prob(j,ii);
+          //NOTE: swap moves do not change the fertilities
+          if (cur_fert > 0) {
+            long double alt_addon = 0.0;
+            for (uint j=0; j < curJ; j++) {
+              if (best_known_alignment_[s][j] == i) {
+                for (uint ii=0; ii <= curI; ii++) {
+                  if (ii != i)
+                    alt_addon += expansion_move_prob(j,ii);
+                }
               }
             }
-          }
 
-          ffert_count[t_idx][cur_fert-1] += inv_sentence_prob * alt_addon;
-        }
+            cur_ffert_count[t_idx][cur_fert-1] += inv_sentence_prob * alt_addon;
+          }
 
-        if (cur_fert+1 < fertility_prob_[t_idx].size()) {
+          if (cur_fert+1 < fertility_prob_[t_idx].size()) {
 
-          long double alt_addon = 0.0;
-          for (uint j=0; j < curJ; j++) {
-            if (best_known_alignment_[s][j] != i) {
-              alt_addon += expansion_move_prob(j,i);
+            long double alt_addon = 0.0;
+            for (uint j=0; j < curJ; j++) {
+              if (best_known_alignment_[s][j] != i) {
+                alt_addon += expansion_move_prob(j,i);
+              }
             }
-          }
 
-          ffert_count[t_idx][cur_fert+1] += inv_sentence_prob * alt_addon;
+            cur_ffert_count[t_idx][cur_fert+1] += inv_sentence_prob * alt_addon;
+          }
         }
-      }
 
-      //       std::cerr << "fzero_count: " << fzero_count << std::endl;
-      //       std::cerr << "fnonzero_count: " << fnonzero_count << std::endl;
+        //       std::cerr << "fzero_count: " << fzero_count << std::endl;
+        //       std::cerr << "fnonzero_count: " << fnonzero_count << std::endl;
+
+        assert(!isnan(cur_fzero_count));
+        assert(!isnan(cur_fnonzero_count));
+
+      } //loop over sentences finished
+    }
+
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    for (uint t=1; t < nThreads; t++) {
+
+      fzero_count += fzero_count_shard[t-1];
+      fnonzero_count += fnonzero_count_shard[t-1];
+      max_perplexity += max_perplexity_shard[t-1];
+      approx_sum_perplexity += approx_sum_perplexity_shard[t-1];
+      sum_iter += sum_iter_shard[t-1];
 
-      assert(!isnan(fzero_count));
-      assert(!isnan(fnonzero_count));
+      for (uint J=0; J < fdistort_count.size(); J++)
+        fdistort_count[J] += fdistort_count_shard[t-1][J];
+    }
 
-    } //loop over sentences finished
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++) {
+          fwcount[i] += fwcount_shard[t-1][i];
+          ffert_count[i] += ffert_count_shard[t-1][i];
+        }
+      }
+    }
 
     std::clock_t tEndLoop = std::clock();
     
@@ -1905,7 +2082,7 @@ void IBM3Trainer::train_unconstrained(uint nIter) {
       if (iter > 5)
         alpha = 0.1;
 
-      dict_m_step(fwcount, prior_weight_, dict_, alpha, 45, smoothed_l0_, l0_beta_);
+      dict_m_step(fwcount, prior_weight_, dict_, alpha, 45, smoothed_l0_, l0_beta_, nThreads_);
     }
 
     //update distortion prob from counts
@@ -2101,10 +2278,16 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
     fdistort_count[J].resize_dirty(distortion_prob_[J].xDim(), distortion_prob_[J].yDim());
   }
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   const uint nTargetWords = dict_.size();
 
+  //the ILP-solver is only called from a single thread
+  const uint nThreads = (use_ilp) ? 1 : nThreads_;
+
+  //each thread handles one block of the schedule and collects into its own count shard
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads,sort_by_length_,stream_chunk_size_);
+
   NamedStorage1D<Math1D::Vector<uint> > fwcount(nTargetWords,MAKENAME(fwcount));
   NamedStorage1D<Math1D::Vector<double> > ffert_count(nTargetWords,MAKENAME(ffert_count));
 
@@ -2115,9 +2298,24 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
     ffert_count[i].resize_dirty(fertility_prob_[i].size());
   }
 
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Storage1D<Math2D::Matrix<double> > > fdistort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<uint> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > ffert_count_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fdistort_count_shard[t] = fdistort_count;
+    fwcount_shard[t] = fwcount;
+    ffert_count_shard[t] = ffert_count;
+  }
+
   long double fzero_count;
   long double fnonzero_count;
 
+  Storage1D<long double> fzero_count_shard(nThreads-1);
+  Storage1D<long double> fnonzero_count_shard(nThreads-1);
+  Math1D::Vector<double> max_perplexity_shard(nThreads-1);
+  Math1D::Vector<uint> sum_iter_shard(nThreads-1);
+
   for (uint iter=1; iter <= nIter; iter++) {
 
     std::cerr << "******* IBM-3 Viterbi-iteration #" << iter << std::endl;
@@ -2127,92 +2325,141 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
     fzero_count = 0.0;
     fnonzero_count = 0.0;
 
-    for (uint J=0; J < fdistort_count.size(); J++) {
-      fdistort_count[J].set_constant(0.0);
-    }
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0);
-      ffert_count[i].set_constant(0.0);
-    }
-
     max_perplexity = 0.0;
 
-    for (size_t s=0; s < source_sentence_.size(); s++) {
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
 
-      if ((s% 10000) == 0)
-        std::cerr << "sentence pair #" << s << std::endl;
+      Storage1D<Math2D::Matrix<double> >& cur_fdistort_count = (t == 0) ? fdistort_count : fdistort_count_shard[t-1];
+      Storage1D<Math1D::Vector<uint> >& cur_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_ffert_count = (t == 0) ? ffert_count : ffert_count_shard[t-1];
+
+      long double& cur_fzero_count = (t == 0) ? fzero_count : fzero_count_shard[t-1];
+      long double& cur_fnonzero_count = (t == 0) ? fnonzero_count : fnonzero_count_shard[t-1];
+      double& cur_max_perplexity = (t == 0) ? max_perplexity : max_perplexity_shard[t-1];
+      uint& cur_sum_iter = (t == 0) ? sum_iter : sum_iter_shard[t-1];
+
+      cur_fzero_count = 0.0;
+      cur_fnonzero_count = 0.0;
+      cur_max_perplexity = 0.0;
+      cur_sum_iter = 0;
+
+      for (uint J=0; J < cur_fdistort_count.size(); J++) {
+        cur_fdistort_count[J].set_constant(0.0);
+      }
+      for (uint i=0; i < nTargetWords; i++) {
+        cur_fwcount[i].set_constant(0);
+        cur_ffert_count[i].set_constant(0.0);
+      }
+
+      WordLookupBuffers aux_lookup;
+
+      //buffers for the hillclimbing, reused across the sentences of the block
+      Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
+      Math2D::NamedMatrix<long double> swap_move_prob(MAKENAME(swap_move_prob));
+      Math2D::NamedMatrix<long double> expansion_move_prob(MAKENAME(expansion_move_prob));
+      HillclimbingScores hc_scores;
+
+      for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
+
+        const size_t s = schedule[k];
+        schedule.prefetch(t,k);
+
+        if ((s% 10000) == 0)
+          std::cerr << "sentence pair #" << s << std::endl;
       
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
-      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                           nSourceWords_,slookup_[s],aux_lookup);
+        const SentenceView& cur_source = source_sentence_[s];
+        const SentenceView& cur_target = target_sentence_[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                             nSourceWords_,slookup_[s],aux_lookup);
       
-      const uint curI = cur_target.size();
-      const uint curJ = cur_source.size();
-      const Math2D::Matrix<double>& cur_distort_count = fdistort_count[curJ-1];
-
-      Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
+        const uint curI = cur_target.size();
+        const uint curJ = cur_source.size();
+        Math2D::Matrix<double>& cur_distort_count = cur_fdistort_count[curJ-1];
 
-      Math2D::NamedMatrix<long double> swap_move_prob(curJ,curJ,MAKENAME(swap_move_prob));
-      Math2D::NamedMatrix<long double> expansion_move_prob(curJ,curI+1,MAKENAME(expansion_move_prob));
+        fertility.resize_dirty(curI+1);
       
-      long double best_prob;
+        long double best_prob;
 
-      best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                   expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
+        best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                     expansion_move_prob,swap_move_prob,hc_scores,best_known_alignment_[s]);
 
 
 #ifdef HAS_CBC
-      if (use_ilp) {
+        if (use_ilp) {
 
-        Math1D::Vector<AlignBaseType> alignment = best_known_alignment_[s];
-        compute_viterbi_alignment_ilp(cur_source, cur_target, cur_lookup, std::min(curJ,fertility_limit_), 
-				      alignment, 0.25);
+          Math1D::Vector<AlignBaseType> alignment = best_known_alignment_[s];
+          compute_viterbi_alignment_ilp(cur_source, cur_target, cur_lookup, std::min(curJ,fertility_limit_), 
+					alignment, 0.25);
 
-        if (alignment_prob(s,alignment) > 1e-300) {
+          if (alignment_prob(s,alignment) > 1e-300) {
 
-          best_known_alignment_[s] = alignment;
+            best_known_alignment_[s] = alignment;
 	  
-          best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                       expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
+            best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                         expansion_move_prob,swap_move_prob,hc_scores,best_known_alignment_[s]);
+          }
         }
-      }
 #endif
 
-      assert(2*fertility[0] <= curJ);
+        assert(2*fertility[0] <= curJ);
 
-      max_perplexity -= std::log(best_prob);
+        cur_max_perplexity -= std::log(best_prob);
 
-      fzero_count += fertility[0];
-      fnonzero_count += curJ - 2*fertility[0];
+        cur_fzero_count += fertility[0];
+        cur_fnonzero_count += curJ - 2*fertility[0];
 
-      //increase counts for dictionary and distortion
-      for (uint j=0; j < curJ; j++) {
+        //increase counts for dictionary and distortion
+        for (uint j=0; j < curJ; j++) {
 
-        const uint s_idx = cur_source[j];
-        const uint cur_aj = best_known_alignment_[s][j];
+          const uint s_idx = cur_source[j];
+          const uint cur_aj = best_known_alignment_[s][j];
 
-        if (cur_aj != 0) {
-          fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += 1;
-          cur_distort_count(j,cur_aj-1) += 1.0;
-          assert(!isnan(cur_distort_count(j,cur_aj-1)));
+          if (cur_aj != 0) {
+            cur_fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += 1;
+            cur_distort_count(j,cur_aj-1) += 1.0;
+            assert(!isnan(cur_distort_count(j,cur_aj-1)));
+          }
+          else {
+            cur_fwcount[0][s_idx-1] += 1;
+          }
         }
-        else {
-          fwcount[0][s_idx-1] += 1;
+
+        //update fertility counts
+        for (uint i=1; i <= curI; i++) {
+
+          const uint cur_fert = fertility[i];
+          const uint t_idx = cur_target[i-1];
+
+          cur_ffert_count[t_idx][cur_fert] += 1.0;
         }
+
+        assert(!isnan(cur_fzero_count));
+        assert(!isnan(cur_fnonzero_count));
       }
+    }
 
-      //update fertility counts
-      for (uint i=1; i <= curI; i++) {
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    for (uint t=1; t < nThreads; t++) {
 
-        const uint cur_fert = fertility[i];
-        const uint t_idx = cur_target[i-1];
+      fzero_count += fzero_count_shard[t-1];
+      fnonzero_count += fnonzero_count_shard[t-1];
+      max_perplexity += max_perplexity_shard[t-1];
+      sum_iter += sum_iter_shard[t-1];
 
-        ffert_count[t_idx][cur_fert] += 1.0;
-      }
+      for (uint J=0; J < fdistort_count.size(); J++)
+        fdistort_count[J] += fdistort_count_shard[t-1][J];
+    }
 
-      assert(!isnan(fzero_count));
-      assert(!isnan(fnonzero_count));
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++) {
+          fwcount[i] += fwcount_shard[t-1][i];
+          ffert_count[i] += ffert_count_shard[t-1][i];
+        }
+      }
     }
 
     if (!fix_p0_) {
@@ -2236,8 +2483,8 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
       if ((s% 10000) == 0)
         std::cerr << "ICM, sentence pair #" << s << std::endl;
       
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
+      const SentenceView& cur_source = source_sentence_[s];
+      const SentenceView& cur_target = target_sentence_[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                            nSourceWords_,slookup_[s],aux_lookup);
       
@@ -2322,7 +2569,7 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
 		
                 uint zero_fert = cur_fertilities[0];
 		
-                change -= - std::log(ldchoose(curJ-zero_fert,zero_fert));
+                change -= - combinatorics_.log_choose(curJ-zero_fert,zero_fert);
 		change -= -std::log(p_zero_);
 		
                 if (och_ney_empty_word_) {
@@ -2330,7 +2577,7 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
                 }
 		
                 uint new_zero_fert = zero_fert-1;
-                change += - std::log(ldchoose(curJ-new_zero_fert,new_zero_fert));
+                change += - combinatorics_.log_choose(curJ-new_zero_fert,new_zero_fert);
 		change += 2.0*(-std::log(p_nonzero_));
               }
               else {
@@ -2353,11 +2600,11 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
 
                 uint zero_fert = cur_fertilities[0];
 
-                change -= -std::log(ldchoose(curJ-zero_fert,zero_fert));
+                change -= -combinatorics_.log_choose(curJ-zero_fert,zero_fert);
 		change -= 2.0*(-std::log(p_nonzero_));
 		
                 uint new_zero_fert = zero_fert+1;
-                change += - std::log(ldchoose(curJ-new_zero_fert,new_zero_fert));
+                change += - combinatorics_.log_choose(curJ-new_zero_fert,new_zero_fert);
 		change += -std::log(p_zero_);
 		
                 if (och_ney_empty_word_) {
@@ -2624,16 +2871,45 @@ void IBM3Trainer::train_viterbi(uint nIter, bool use_ilp) {
 }
 
 
-long double IBM3Trainer::compute_itg_viterbi_alignment_noemptyword(uint s, bool extended_reordering) {
+//orders the entries of a source span by the start and end of their target span
+static bool itg_entry_less(const ItgChart::Entry& e1, const ItgChart::Entry& e2) {
+  return (e1.i_ < e2.i_ || (e1.i_ == e2.i_ && e1.ii_ < e2.ii_));
+}
+
+//returns the position of the entry for the source span [j,j+J-1] and the target span [i,ii] (if present)
+static inline size_t itg_find_entry(const ItgChart& chart, uint j, uint J, uint i, uint ii) {
+
+  ItgChart::Entry key;
+  key.i_ = i;
+  key.ii_ = ii;
 
-  const Storage1D<uint>& cur_source = source_sentence_[s];
-  const Storage1D<uint>& cur_target = target_sentence_[s];
+  const std::vector<ItgChart::Entry>::const_iterator begin = chart.entry_.begin() + chart.span_begin_(j,J-1);
+  const std::vector<ItgChart::Entry>::const_iterator end = chart.entry_.begin() + chart.span_end_(j,J-1);
 
+  return std::lower_bound(begin,end,key,itg_entry_less) - chart.entry_.begin();
+}
+
+//stores for every target position i the position of the first of the entries [begin,end) that starts at i or later
+static inline void itg_index_starts(const ItgChart& chart, size_t begin, size_t end, uint curI,
+                                    Math1D::Vector<size_t>& first) {
 
-  std::cerr << "******** compute_itg_viterbi_alignment_noemptyword(" << s 
-            << ") J: " << cur_source.size() << ", I: " << cur_target.size() << " **********" << std::endl;
+  first.resize_dirty(curI+1);
 
-  SingleLookupTable aux_lookup;
+  size_t pos = begin;
+  for (uint i=0; i <= curI; i++) {
+    while (pos < end && chart.entry_[pos].i_ < i)
+      pos++;
+    first[i] = pos;
+  }
+}
+
+long double IBM3Trainer::compute_itg_viterbi_alignment_noemptyword(uint s, ItgChart& chart, bool extended_reordering,
+                                                                   double beam, uint max_live_factor) {
+
+  const SentenceView& cur_source = source_sentence_[s];
+  const SentenceView& cur_target = target_sentence_[s];
+
+  WordLookupBuffers aux_lookup;
 
   const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc_,
                                                        nSourceWords_,slookup_[s],aux_lookup);  
@@ -2641,232 +2917,338 @@ long double IBM3Trainer::compute_itg_viterbi_alignment_noemptyword(uint s, bool
   const uint curI = cur_target.size();
   const uint curJ = cur_source.size();
   const Math2D::Matrix<double>& cur_distort_prob = distortion_prob_[curJ-1];
-  
-  Math2D::NamedMatrix<long double> score0(curI,curI,0.0,MAKENAME(score0));
 
+  //a beam of 0 disables the pruning
+  const bool prune = (beam > 0.0);
+  const double log_beam = (prune) ? std::log(beam) : hc_impossible;
+  const size_t max_live = std::max<size_t>(1,((size_t) max_live_factor) * curI);
+
+  //all scores are logarithms
+  Math1D::Vector<double> log_fert0(curI);
+  Math1D::Vector<double> log_fert1(curI);
   for (uint i=0; i < curI; i++) {
-    long double prob = fertility_prob_[cur_target[i]][0];
-    score0(i,i) = prob;
-    for (uint ii=i+1; ii < curI; ii++) {
-      prob *= fertility_prob_[cur_target[ii]][0];
-      score0(i,ii) = prob;
-    }
+    log_fert0[i] = std::log(std::max(1e-300,fertility_prob_[cur_target[i]][0]));
+    log_fert1[i] = hc_log(fertility_prob_[cur_target[i]][1]);
   }
 
-  NamedStorage1D<Math3D::NamedTensor<long double> > score(curJ+1,MAKENAME(score));
-  NamedStorage1D<Math3D::NamedTensor<uint> > trace(curJ+1,MAKENAME(trace));
+  Math2D::Matrix<double> log_link(curI,curJ);
+  for (uint j=0; j < curJ; j++) {
+    for (uint i=0; i < curI; i++)
+      log_link(i,j) = hc_log(dict_[cur_target[i]][cur_lookup(j,i)] * cur_distort_prob(j,i));
+  }
 
-  score[1].set_name("score[1]");
-  score[1].resize(curJ,curI,curI,0.0);
-  trace[1].set_name("trace[1]");
-  trace[1].resize(curJ,curI,curI,MAX_UINT);
+  //the target spans of the current alignment (usually found by hillclimbing) are never pruned. This only covers
+  // source spans without words aligned to NULL and not the spans extended by words with zero fertility,
+  // so the pruned decoder can still end up below the current alignment
+  const Math1D::Vector<AlignBaseType>& seed = best_known_alignment_[s];
 
-  Math3D::NamedTensor<long double>& score1 = score[1];
-  Math3D::NamedTensor<uint>& trace1 = trace[1];
+  chart.entry_.clear();
+  chart.span_begin_.resize_dirty(curJ,curJ);
+  chart.span_end_.resize_dirty(curJ,curJ);
+  chart.work_score_.resize_dirty(curI,curI);
+  chart.work_trace_.resize_dirty(curI,curI);
+  chart.work_keep_.resize_dirty(curI,curI);
 
-  for (uint j=0; j < curJ; j++) {
-    
-    for (uint i=0; i < curI; i++) {
-      for (uint ii=i; ii < curI; ii++) {
+  Math2D::Matrix<double>& score = chart.work_score_;
+  Math2D::Matrix<uint>& trace = chart.work_trace_;
+  Math2D::Matrix<uchar>& keep = chart.work_keep_;
 
-        const long double zero_prob = score0(i,ii);
+  for (uint J=1; J <= curJ; J++) {
 
-        long double best_prob = 0.0;
-	
-        for (uint iii=i; iii <= ii; iii++) {
+    const double log_Jfac = combinatorics_.log_fac(J);
+
+    for (uint j=0; j < (curJ-(J-1)); j++) {
 
-          const uint t_idx = cur_target[iii];
+      const uint jj = j + J - 1;
 
-          long double hyp_prob = fertility_prob_[t_idx][1]
-            * cur_distort_prob(j,iii) * dict_[t_idx][cur_lookup(j,iii)] / fertility_prob_[t_idx][0];
+      score.set_constant(hc_impossible);
+      trace.set_constant(MAX_UINT);
 
-          if (hyp_prob > best_prob) {
-            best_prob = hyp_prob;
-            trace1(j,i,ii) = iii;
+      if (J == 1) {
+
+        for (uint i=0; i < curI; i++) {
+
+          double zero_score = 0.0;
+          double best_score = hc_impossible;
+          uint best_iii = MAX_UINT;
+
+          for (uint ii=i; ii < curI; ii++) {
+
+            zero_score += log_fert0[ii];
+
+            const double hyp_score = hc_sum(log_fert1[ii],log_link(ii,j),-log_fert0[ii]);
+            if (hyp_score > best_score) {
+              best_score = hyp_score;
+              best_iii = ii;
+            }
+
+            if (best_score != hc_impossible) {
+              score(i,ii) = zero_score + best_score;
+              trace(i,ii) = best_iii;
+            }
           }
         }
-
-        score1(j,i,ii) = zero_prob * best_prob;
       }
-    }
-  }
+      else {
 
-  for (uint J=2; J <= curJ; J++) {
+        //a single target word produces the entire source span
+        for (uint i=0; i < curI; i++) {
 
-    //std::cerr << "J: " << J << std::endl;
+          double cur_score = hc_log(fertility_prob_[cur_target[i]][J]);
+          if (cur_score != hc_impossible) {
+            cur_score += log_Jfac;
+            for (uint jjj = j; jjj <= jj; jjj++)
+              cur_score += log_link(i,jjj);
+          }
+          score(i,i) = cur_score;
+        }
 
-    score[J].set_name("score[" + toString(J) + "]");
-    score[J].resize(curJ,curI,curI,0.0);
-    trace[J].set_name("trace[" + toString(J) + "]");
-    trace[J].resize(curJ,curI,curI,MAX_UINT);
+        //split both source and target span. Only the combinations of live entries need to be considered
+        for (uint split_j = j; split_j < jj; split_j++) {
 
-    const long double Jfac = ldfac(J);
+          //partitioning into [j,split_j] and [split_j+1,jj]
+          const uint J1 = split_j - j + 1;
+          const uint J2 = jj - split_j;
 
-    Math3D::NamedTensor<uint>& traceJ = trace[J];
-    Math3D::NamedTensor<long double>& scoreJ = score[J];
-    
-    for (uint I=1; I <= curI; I++) {
+          const size_t left_begin = chart.span_begin_(j,J1-1);
+          const size_t left_end = chart.span_end_(j,J1-1);
+          const size_t right_begin = chart.span_begin_(split_j+1,J2-1);
+          const size_t right_end = chart.span_end_(split_j+1,J2-1);
 
-      for (uint i=0; i < (curI-(I-1)); i++) {
+          itg_index_starts(chart,left_begin,left_end,curI,chart.left_first_);
+          itg_index_starts(chart,right_begin,right_end,curI,chart.right_first_);
 
-        const uint ii=i+I-1;
-        assert(ii < curI);
-        assert(ii >= i);
+          //monotone: the left source span is aligned to [i,split_i], the right one to [split_i+1,ii]
+          for (size_t l=left_begin; l < left_end; l++) {
 
-        const uint ti = cur_target[i];
-        const uint tii = cur_target[ii];
+            const ItgChart::Entry& left = chart.entry_[l];
+            const uint next_i = left.ii_ + 1;
+            if (next_i >= curI)
+              continue;
 
-        for (uint j=0; j < (curJ-(J-1)); j++) {
-	  
-          const uint jj = j + J -1; 
-          assert(jj < curJ);
-          assert(jj >= j);
-	  
-          long double best_prob = 0.0;
-          uint trace_entry = MAX_UINT;
+            for (size_t r=chart.right_first_[next_i]; r < right_end
+                   && chart.entry_[r].i_ == next_i; r++) {
 
-          if (I==1) {
-            best_prob = 1.0;
-            for (uint jjj = j; jjj <= jj; jjj++)
-              best_prob *= dict_[ti][cur_lookup(jjj,i)] * cur_distort_prob(jjj,i);
-            best_prob *= fertility_prob_[ti][J] * Jfac;
+              const ItgChart::Entry& right = chart.entry_[r];
+              const double hyp_score = left.score_ + right.score_;
+              if (hyp_score > score(left.i_,right.ii_)) {
+                score(left.i_,right.ii_) = hyp_score;
+                trace(left.i_,right.ii_) = 2*(split_j * curI + left.ii_);
+              }
+            }
           }
-          else {
 
-            if (extended_reordering && I <= 10 && J <= 10) {
+          //inverted: the right source span is aligned to [i,split_i], the left one to [split_i+1,ii]
+          for (size_t r=right_begin; r < right_end; r++) {
 
-              long double base_prob;
-              base_prob = ldfac(J-1) * fertility_prob_[ti][J-1] * fertility_prob_[tii][1];
-              for (uint iii=i+1; iii <= ii-1; iii++)
-                base_prob *= fertility_prob_[cur_target[iii]][0];
-	      
-              for (uint k=1; k < J-1; k++) {
-		
-                long double hyp_prob = base_prob;
-                for (uint l=0; l < J; l++) {
-		  
-                  if (l==k)
-                    hyp_prob *= dict_[tii][cur_lookup(j+l,ii)] * cur_distort_prob(j+l,ii);
-                  else
-                    hyp_prob *= dict_[ti][cur_lookup(j+l,i)] * cur_distort_prob(j+l,i);
-		  
-                }
-                if (hyp_prob > best_prob) {
-                  best_prob = hyp_prob;
-		    
-                  trace_entry = 0xC0000000;
-                  uint base = 1;
-                  for (uint l=0; l < J; l++) {
-                    if (l==k)
-                      trace_entry += base;
-                    base *= 2;
-                  }
-                }
+            const ItgChart::Entry& right = chart.entry_[r];
+            const uint next_i = right.ii_ + 1;
+            if (next_i >= curI)
+              continue;
+
+            for (size_t l=chart.left_first_[next_i]; l < left_end
+                   && chart.entry_[l].i_ == next_i; l++) {
+
+              const ItgChart::Entry& left = chart.entry_[l];
+              const double hyp_score = left.score_ + right.score_;
+              if (hyp_score > score(right.i_,left.ii_)) {
+                score(right.i_,left.ii_) = hyp_score;
+                trace(right.i_,left.ii_) = 2*(split_j * curI + right.ii_) + 1;
               }
-		
-              base_prob = ldfac(J-1) * fertility_prob_[tii][J-1] * fertility_prob_[ti][1];
+            }
+          }
+        }
+
+        if (extended_reordering && J <= 10) {
+
+          for (uint I=2; I <= std::min<uint>(10,curI); I++) {
+
+            for (uint i=0; i < (curI-(I-1)); i++) {
+
+              const uint ii = i + I - 1;
+
+              double inner_score = 0.0;
               for (uint iii=i+1; iii <= ii-1; iii++)
-                base_prob *= fertility_prob_[cur_target[iii]][0];
-		
-              for (uint k=1; k < J-1; k++) {
-		  
-                long double hyp_prob = base_prob;
-                for (uint l=0; l < J; l++) {
-		    
-                  if (l==k)
-                    hyp_prob *= dict_[ti][cur_lookup(j+l,i)] * cur_distort_prob(j+l,i);
-                  else
-                    hyp_prob *= dict_[tii][cur_lookup(j+l,ii)] * cur_distort_prob(j+l,ii);
-		    
-                }
-                if (hyp_prob > best_prob) {
-                  best_prob = hyp_prob;
-		  
-                  trace_entry = 0xC0000000;
-                  uint base = 1;
-                  for (uint l=0; l < J; l++) {
-                    if (l!=k)
-                      trace_entry += base;
-                    base *= 2;
+                inner_score += log_fert0[iii];
+
+              for (uint inverted = 0; inverted < 2; inverted++) {
+
+                //the outer word produces all but one source word, the remaining one is produced by the other end
+                const uint outer = (inverted == 0) ? i : ii;
+                const uint other = (inverted == 0) ? ii : i;
+
+                const double base_score = hc_sum(combinatorics_.log_fac(J-1) + inner_score,
+                                                 hc_log(fertility_prob_[cur_target[outer]][J-1]),
+                                                 hc_log(fertility_prob_[cur_target[other]][1]));
+                if (base_score == hc_impossible)
+                  continue;
+
+                for (uint k=1; k < J-1; k++) {
+
+                  double hyp_score = base_score;
+                  for (uint l=0; l < J; l++)
+                    hyp_score += (l == k) ? log_link(other,j+l) : log_link(outer,j+l);
+
+                  if (hyp_score > score(i,ii)) {
+                    score(i,ii) = hyp_score;
+
+                    uint trace_entry = 0xC0000000;
+                    uint base = 1;
+                    for (uint l=0; l < J; l++) {
+                      //set bits mark the source positions aligned to ii
+                      if ((l == k) == (inverted == 0))
+                        trace_entry += base;
+                      base *= 2;
+                    }
+                    trace(i,ii) = trace_entry;
                   }
                 }
               }
-            } //end of extended reordering
+            }
+          }
+        } //end of extended reordering
+
+        //extend the target span by words with zero fertility. Shorter spans are final when they are extended
+        for (uint I=2; I <= curI; I++) {
 
-            //1.) consider extending the target interval by a zero-fertility word
-            const double left_extend_prob  = scoreJ(j,i+1,ii) * fertility_prob_[ti][0];
-            if (left_extend_prob > best_prob) {
-              best_prob = left_extend_prob;
-              trace_entry = MAX_UINT - 1;
+          for (uint i=0; i < (curI-(I-1)); i++) {
+
+            const uint ii = i + I - 1;
+
+            const double left_extend_score = score(i+1,ii) + log_fert0[i];
+            if (left_extend_score > score(i,ii)) {
+              score(i,ii) = left_extend_score;
+              trace(i,ii) = MAX_UINT - 1;
             }
-            const double right_extend_prob = scoreJ(j,i,ii-1) * fertility_prob_[tii][0];
-            if (right_extend_prob > best_prob) {
-              best_prob = right_extend_prob;
-              trace_entry = MAX_UINT - 2;
+            const double right_extend_score = score(i,ii-1) + log_fert0[ii];
+            if (right_extend_score > score(i,ii)) {
+              score(i,ii) = right_extend_score;
+              trace(i,ii) = MAX_UINT - 2;
             }
+          }
+        }
+      }
 
-            //2.) consider splitting both source and target interval
-	    
-            for (uint split_j = j; split_j < jj; split_j++) {
-	      
-              //partitioning into [j,split_j] and [split_j+1,jj]
-	      
-              const uint J1 = split_j - j + 1;
-              const uint J2 = jj - split_j;
-              assert(J1 >= 1 && J1 < J);
-              assert(J2 >= 1 && J2 < J);
-              assert(J1 + J2 == J);
-              const uint split_j_p1 = split_j + 1;
-	      
-              const Math3D::Tensor<long double>& score_J1 = score[J1];
-              const Math3D::Tensor<long double>& score_J2 = score[J2];
-	      
-              for (uint split_i = i; split_i < ii; split_i++) {
-		
-                //partitioning into [i,split_i] and [split_i+1,ii]
-		
-                // 		const uint I1 = split_i - i + 1;
-                // 		const uint I2 = ii - split_i;
-                // 		assert(I1 >= 1 && I1 < I);
-                // 		assert(I2 >= 1 && I2 < I);
+      //prune and store the live entries of the source span
+      keep.set_constant(0);
 
-                const long double hyp_monotone_prob = score_J1(j,i,split_i) * score_J2(split_j_p1,split_i+1,ii);
+      if (J == curJ) {
+        //only the full target span is needed
+        keep(0,curI-1) = 1;
+      }
+      else if (!prune) {
+        keep.set_constant(1);
+      }
+      else {
 
-                if (hyp_monotone_prob > best_prob) {
-                  best_prob = hyp_monotone_prob;
-                  trace_entry = 2*(split_j * curI + split_i);
-                }
-		
-                const long double hyp_invert_prob = score_J2(split_j_p1,i,split_i) * score_J1(j,split_i+1,ii);
+        double best_score = hc_impossible;
+        for (uint i=0; i < curI; i++)
+          for (uint ii=i; ii < curI; ii++)
+            best_score = std::max(best_score,score(i,ii));
 
-                if (hyp_invert_prob > best_prob) {
-                  best_prob = hyp_invert_prob;
-                  trace_entry = 2*(split_j * curI + split_i) + 1;
-                }
-              }
+        if (best_score != hc_impossible) {
+
+          //beam pruning, then histogram pruning. Among equal scores the shorter target spans survive
+          const double threshold = best_score + log_beam;
+
+          chart.candidate_.clear();
+          for (uint i=0; i < curI; i++) {
+            for (uint ii=i; ii < curI; ii++) {
+              if (score(i,ii) >= threshold)
+                chart.candidate_.push_back(std::make_pair(-score(i,ii),(ii-i)*curI + i));
             }
           }
 
-          scoreJ(j,i,ii) = best_prob;
-          traceJ(j,i,ii) = trace_entry;
+          if (chart.candidate_.size() > max_live) {
+            std::nth_element(chart.candidate_.begin(),chart.candidate_.begin() + max_live,chart.candidate_.end());
+            chart.candidate_.resize(max_live);
+          }
+
+          for (size_t c=0; c < chart.candidate_.size(); c++) {
+            const uint i = chart.candidate_[c].second % curI;
+            const uint ii = i + chart.candidate_[c].second / curI;
+            keep(i,ii) = 1;
+          }
+        }
+
+        //protect the span of the current alignment
+        uint seed_i = MAX_UINT;
+        uint seed_ii = 0;
+        for (uint jjj = j; jjj <= jj; jjj++) {
+          if (seed[jjj] == 0) {
+            seed_i = MAX_UINT;
+            break;
+          }
+          seed_i = std::min<uint>(seed_i,seed[jjj]-1);
+          seed_ii = std::max<uint>(seed_ii,seed[jjj]-1);
+        }
+
+        if (seed_i != MAX_UINT)
+          keep(seed_i,seed_ii) = 1;
+      }
+
+      //the traceback of a kept entry may pass through the entries it was extended from
+      for (uint I=curI; I >= 2; I--) {
+
+        for (uint i=0; i < (curI-(I-1)); i++) {
+
+          const uint ii = i + I - 1;
+          if (keep(i,ii) != 0) {
+            if (trace(i,ii) == MAX_UINT - 1)
+              keep(i+1,ii) = 1;
+            else if (trace(i,ii) == MAX_UINT - 2)
+              keep(i,ii-1) = 1;
+          }
+        }
+      }
+
+      chart.span_begin_(j,J-1) = chart.entry_.size();
+
+      for (uint i=0; i < curI; i++) {
+        for (uint ii=i; ii < curI; ii++) {
+
+          if (keep(i,ii) != 0 && score(i,ii) != hc_impossible) {
+
+            ItgChart::Entry entry;
+            entry.i_ = i;
+            entry.ii_ = ii;
+            entry.trace_ = trace(i,ii);
+            entry.score_ = score(i,ii);
+            chart.entry_.push_back(entry);
+          }
         }
       }
+
+      chart.span_end_(j,J-1) = chart.entry_.size();
     }
   }
 
+  //the full source span can also hold the spans that the full target span was extended from
+  const size_t top = itg_find_entry(chart,0,curJ,0,curI-1);
+
+  if (top == chart.span_end_(0,curJ-1) || chart.entry_[top].i_ != 0 || chart.entry_[top].ii_ != curI-1) {
+
+    //no alignment satisfying the constraints survived the pruning: decode again without pruning
+    if (prune)
+      return compute_itg_viterbi_alignment_noemptyword(s,chart,extended_reordering,0.0,max_live_factor);
+
+    //no alignment satisfying the constraints has a positive probability. The current alignment is kept
+    return 0.0;
+  }
+
   best_known_alignment_[s].set_constant(0);
-  itg_traceback(s,trace,curJ,0,0,curI-1);
+  itg_traceback(s,chart,curJ,0,0,curI-1);
 
-  return score[curJ](0,0,curI-1);
+  return std::exp((long double) chart.entry_[top].score_);
 }
 
-void IBM3Trainer::itg_traceback(uint s, const NamedStorage1D<Math3D::NamedTensor<uint> >& trace, 
-                                uint J, uint j, uint i, uint ii) {
-
+void IBM3Trainer::itg_traceback(uint s, const ItgChart& chart, uint J, uint j, uint i, uint ii) {
 
-  //std::cerr << "****itg_traceback(" << J << "," << j << "," << i << "," << ii << ")" << std::endl; 
+  const size_t idx = itg_find_entry(chart,j,J,i,ii);
+  assert(idx < chart.span_end_(j,J-1));
+  assert(chart.entry_[idx].i_ == i && chart.entry_[idx].ii_ == ii);
 
-  uint trace_entry = trace[J](j,i,ii);
+  uint trace_entry = chart.entry_[idx].trace_;
 
   if (J == 1) {
     best_known_alignment_[s][j] = trace_entry+1;
@@ -2878,10 +3260,10 @@ void IBM3Trainer::itg_traceback(uint s, const NamedStorage1D<Math3D::NamedTensor
       best_known_alignment_[s][jj] = i+1;
   }
   else if (trace_entry == MAX_UINT-1) {
-    itg_traceback(s,trace,J,j,i+1,ii);
+    itg_traceback(s,chart,J,j,i+1,ii);
   }
   else if (trace_entry == MAX_UINT-2) {
-    itg_traceback(s,trace,J,j,i,ii-1);
+    itg_traceback(s,chart,J,j,i,ii-1);
   }
   else if (trace_entry >= 0xC0000000) {
 
@@ -2909,19 +3291,27 @@ void IBM3Trainer::itg_traceback(uint s, const NamedStorage1D<Math3D::NamedTensor
     const uint J2 = J - J1;
 
     if (!reverse) {
-      itg_traceback(s,trace,J1,j,i,split_i);
-      itg_traceback(s,trace,J2,split_j+1,split_i+1,ii);
+      itg_traceback(s,chart,J1,j,i,split_i);
+      itg_traceback(s,chart,J2,split_j+1,split_i+1,ii);
     }
     else {
-      itg_traceback(s,trace,J2,split_j+1,i,split_i);
-      itg_traceback(s,trace,J1,j,split_i+1,ii);
+      itg_traceback(s,chart,J2,split_j+1,i,split_i);
+      itg_traceback(s,chart,J1,j,split_i+1,ii);
     }
   }
 
 }
 
-void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reordering, bool verbose) {
+void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reordering, bool verbose,
+                                             double beam, uint max_live_factor) {
 
+  const size_t nSentences = source_sentence_.size();
+
+  //one chart per thread, reused for all sentences and iterations
+  Storage1D<ItgChart> chart(nThreads_);
+
+  Math1D::NamedVector<long double> itg_prob(nSentences,0.0,MAKENAME(itg_prob));
+  Math1D::NamedVector<long double> hillclimb_prob(nSentences,0.0,MAKENAME(hillclimb_prob));
 
   ReducedIBM3DistortionModel fdistort_count(distortion_prob_.size(),MAKENAME(fdistort_count));
   for (uint J=0; J < fdistort_count.size(); J++) {
@@ -2941,7 +3331,7 @@ void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reorderin
   long double fzero_count;
   long double fnonzero_count;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
     
   for (uint iter=1; iter <= nIter; iter++) {
 
@@ -2963,21 +3353,43 @@ void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reorderin
 
     uint nBetter = 0;
     uint nEqual = 0;
+    uint nUnconstrained = 0;
 
-    for (size_t s=0; s < source_sentence_.size(); s++) {
+    //the alignments are computed in parallel, the counts are then collected in the order of the sentences
+#pragma omp parallel for schedule(static,1) num_threads(nThreads_)
+    for (int t=0; t < (int) nThreads_; t++) {
 
-      long double hillclimbprob = alignment_prob(s,best_known_alignment_[s]);
+      //sentences are distributed round-robin, so that long sentences are spread over the threads
+      for (size_t s=t; s < nSentences; s += nThreads_) {
 
-      long double prob = compute_itg_viterbi_alignment_noemptyword(s,extended_reordering);
+        if (verbose)
+          hillclimb_prob[s] = alignment_prob(s,best_known_alignment_[s]);
 
-      long double actual_prob = prob * pow(p_nonzero_,source_sentence_[s].size());
+        itg_prob[s] = compute_itg_viterbi_alignment_noemptyword(s,chart[t],extended_reordering,beam,max_live_factor);
+      }
+    }
+
+    for (size_t s=0; s < nSentences; s++) {
+
+      const long double hillclimbprob = hillclimb_prob[s];
+
+      const bool itg_found = (itg_prob[s] > 0.0);
+
+      long double actual_prob;
+      if (itg_found)
+        actual_prob = itg_prob[s] * pow(p_nonzero_,source_sentence_[s].size());
+      else {
+        //there is no alignment satisfying the constraints, so the counts are collected from the current alignment
+        actual_prob = alignment_prob(s,best_known_alignment_[s]);
+        nUnconstrained++;
+      }
 
       max_perplexity -= std::log(actual_prob);
 
       if (actual_prob < 1e-305)
         continue;
       
-      if (verbose) {
+      if (verbose && itg_found) {
         long double check_prob = alignment_prob(s,best_known_alignment_[s]);
         long double check_ratio = actual_prob / check_prob;
 	
@@ -2989,8 +3401,8 @@ void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reorderin
         assert(check_ratio >= 0.999 && check_ratio < 1.001);
       }
 
-      const Storage1D<uint>&  cur_source = source_sentence_[s];
-      const Storage1D<uint>&  cur_target = target_sentence_[s];
+      const SentenceView&  cur_source = source_sentence_[s];
+      const SentenceView&  cur_target = target_sentence_[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                            nSourceWords_,slookup_[s],aux_lookup);
 
@@ -3135,6 +3547,8 @@ void IBM3Trainer::train_with_itg_constraints(uint nIter, bool extended_reorderin
 
 
     std::cerr << "max-perplexility after iteration #" << (iter - 1) << ": " << max_perplexity << std::endl;
+    if (nUnconstrained > 0)
+      std::cerr << "no alignment satisfies the itg-constraints in " << nUnconstrained << " cases" << std::endl;
     if (verbose) {
       std::cerr << "itg-constraints are eqaul to hillclimbing in " << nEqual << " cases" << std::endl;
       std::cerr << "itg-constraints are better than hillclimbing in " << nBetter << " cases" << std::endl;
@@ -3153,10 +3567,10 @@ long double IBM3Trainer::compute_ibmconstrained_viterbi_alignment_noemptyword(ui
   //convention here: target positions start at 0, source positions start at 1 
   // (so we can express that no source position was covered yet)
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
-  const Storage1D<uint>& cur_source = source_sentence_[s];
-  const Storage1D<uint>& cur_target = target_sentence_[s];
+  const SentenceView& cur_source = source_sentence_[s];
+  const SentenceView& cur_target = target_sentence_[s];
   const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                        nSourceWords_,slookup_[s],aux_lookup);
   
@@ -3265,7 +3679,7 @@ long double IBM3Trainer::compute_ibmconstrained_viterbi_alignment_noemptyword(ui
   for (uint fert = 0; fert <= maxFertility; fert++) {
     long double fert_factor = (fertility_prob_[t_start].size() > fert) ? fertility_prob_[t_start][fert] : 0.0;
     if (fert > 1)
-      fert_factor *= ldfac(fert);
+      fert_factor *= combinatorics_.fac(fert);
 
     for (uint state = 0; state <= start_allfert_max_reachable_state; state++) 
       score[0](state,fert) *= fert_factor;
@@ -3403,7 +3817,7 @@ long double IBM3Trainer::compute_ibmconstrained_viterbi_alignment_noemptyword(ui
     for (uint fert = 0; fert <= maxFertility; fert++) {
       long double fert_factor = (fertility_prob_[ti].size() > fert) ? fertility_prob_[ti][fert] : 0.0;
       if (fert > 1)
-        fert_factor *= ldfac(fert);
+        fert_factor *= combinatorics_.fac(fert);
       
       for (uint state=0; state <= allfert_max_reachable_state; state++) 
         cur_score(state,fert) *= fert_factor;
@@ -3585,13 +3999,13 @@ IBM3IPHeuristic::IBM3IPHeuristic(const CbcHeuristic& heuristic, CbcModel& /*mode
 }
 #endif
 
-long double IBM3Trainer::compute_viterbi_alignment_ilp(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+long double IBM3Trainer::compute_viterbi_alignment_ilp(const SentenceView& source, const SentenceView& target, 
                                                        const SingleLookupTable& cur_lookup, uint max_fertility,
                                                        Math1D::Vector<AlignBaseType>& alignment, double time_limit) {
 
 #ifdef HAS_CBC
-  const Storage1D<uint>& cur_source = source;
-  const Storage1D<uint>& cur_target = target;
+  const SentenceView& cur_source = source;
+  const SentenceView& cur_target = target;
   
   const uint curI = cur_target.size();
   const uint curJ = cur_source.size();
@@ -3658,7 +4072,7 @@ long double IBM3Trainer::compute_viterbi_alignment_ilp(const Storage1D<uint>& so
     if (curJ-fert >= fert) {
       long double prob = 1.0;
       
-      prob *= ldchoose(curJ-fert,fert);
+      prob *= combinatorics_.choose(curJ-fert,fert);
       for (uint k=1; k <= fert; k++)
         prob *= p_zero_;
       for (uint k=1; k <= curJ-2*fert; k++)
@@ -3701,7 +4115,7 @@ long double IBM3Trainer::compute_viterbi_alignment_ilp(const Storage1D<uint>& so
       uint idx = fert_var_offs + (i+1)*nFertVarsPerWord + fert;
 
       if (fertility_prob_[ti][fert] > 1e-75) {
-        cost[idx] = -logl( ldfac(fert) * fertility_prob_[ti][fert]  );
+        cost[idx] = -logl( combinatorics_.fac(fert) * fertility_prob_[ti][fert]  );
         assert(!isnan(cost[fert_var_offs + (i+1)*nFertVarsPerWord + fert]));
       }
       else 
@@ -4108,7 +4522,7 @@ void IBM3Trainer::train_with_ibm_constraints(uint nIter, uint maxFertility, uint
   long double fzero_count;
   long double fnonzero_count;
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
 
   compute_uncovered_sets(nMaxSkips); 
   compute_coverage_states();
@@ -4160,8 +4574,8 @@ void IBM3Trainer::train_with_ibm_constraints(uint nIter, uint maxFertility, uint
           nBetter++;
       }
 
-      const Storage1D<uint>&  cur_source = source_sentence_[s];
-      const Storage1D<uint>&  cur_target = target_sentence_[s];
+      const SentenceView&  cur_source = source_sentence_[s];
+      const SentenceView&  cur_target = target_sentence_[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(cur_source,cur_target,wcooc_,
                                                            nSourceWords_,slookup_[s],aux_lookup);
 
@@ -4335,7 +4749,7 @@ void IBM3Trainer::write_postdec_alignments(const std::string filename, double th
     Math1D::Vector<AlignBaseType> viterbi_alignment = best_known_alignment_[s];
     std::set<std::pair<AlignBaseType,AlignBaseType> > postdec_alignment;
   
-    SingleLookupTable aux_lookup;
+    WordLookupBuffers aux_lookup;
 
     const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                          nSourceWords_,slookup_[s],aux_lookup);
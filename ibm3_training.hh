@@ -8,14 +8,63 @@
 #include "singleword_fertility_training.hh"
 #include "hmm_training.hh"
 
+#include <vector>
+
 class IBM4Trainer;
 
+//chart of the pruned ITG decoder: for every source span only the target spans that survive the pruning are kept,
+// sorted by their start and end. The memory is reused across sentences
+struct ItgChart {
+
+  struct Entry {
+    AlignBaseType i_;
+    AlignBaseType ii_;
+    uint trace_;
+    double score_; //logarithm
+  };
+
+  std::vector<Entry> entry_;
+
+  //the entries for the source span [j,j+J-1] are entry_[span_begin_(j,J-1)] ... entry_[span_end_(j,J-1)-1]
+  Math2D::Matrix<size_t> span_begin_;
+  Math2D::Matrix<size_t> span_end_;
+
+  //scores and traces of all target spans for the current source span
+  Math2D::Matrix<double> work_score_;
+  Math2D::Matrix<uint> work_trace_;
+  Math2D::Matrix<uchar> work_keep_;
+
+  std::vector<std::pair<double,uint> > candidate_;
+
+  //for the two parts of the current split: position of the first entry whose target span starts at i
+  Math1D::Vector<size_t> left_first_;
+  Math1D::Vector<size_t> right_first_;
+};
+
+//score buffers of the hillclimbing, all scores are logarithms of ratios to the current alignment.
+// The memory is reused across sentences
+struct HillclimbingScores {
+
+  Math2D::Matrix<double> link_score_;
+  Math2D::Matrix<double> move_score_;
+  Math2D::Matrix<double> swap_score_;
+  Math1D::Vector<double> removal_score_;
+  Math1D::Vector<double> log_fert_increase_;
+  Math1D::Vector<double> log_fert_decrease_;
+
+  //for every source position: the best move and the best swap with a later position
+  Math1D::Vector<double> best_move_score_;
+  Math1D::Vector<uint> best_move_aj_;
+  Math1D::Vector<double> best_swap_score_;
+  Math1D::Vector<uint> best_swap_j2_;
+};
+
 class IBM3Trainer : public FertilityModelTrainer {
 public:
   
-  IBM3Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
+  IBM3Trainer(const Corpus& source_sentence,
               const LookupTable& slookup,
-              const Storage1D<Storage1D<uint> >& target_sentence,
+              const Corpus& target_sentence,
               const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
               const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
               SingleWordDictionary& dict,
@@ -41,7 +90,12 @@ public:
   //training for IBM reordering constraints. This is done exactly
   void train_with_ibm_constraints(uint nIter, uint maxFertility, uint nMaxSkips = 4, bool verbose = false);
 
-  void train_with_itg_constraints(uint nIter, bool extended_reordering = false, bool verbose = false);
+  //Viterbi training with ITG constraints, the alignments are computed by a pruned chart decoder:
+  // for every source span the target spans with a probability below beam times the best one are discarded,
+  // and at most max_live_factor*I are kept (a beam of 0 disables the pruning). Sentences where the pruning removes
+  // all alignments are decoded again without pruning
+  void train_with_itg_constraints(uint nIter, bool extended_reordering = false, bool verbose = false,
+                                  double beam = 1e-8, uint max_live_factor = 8);
 
   void update_alignments_unconstrained();
 
@@ -49,13 +103,29 @@ public:
 
   void fix_p0(double p0);
 
-  long double compute_external_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+  long double compute_external_alignment(const SentenceView& source, const SentenceView& target,
+                                         const SingleLookupTable& lookup,
+                                         Math1D::Vector<AlignBaseType>& alignment, bool ilp=false);
+
+  //the two parts of compute_external_alignment(): the first adapts the start alignment and extends the model
+  // where the sentence pair needs it, so it must not run concurrently with anything else. The second
+  // only reads the model and can be called from several threads at once (after set_nthreads())
+  void prepare_external_alignment(const SentenceView& source, const SentenceView& target,
+                                  const SingleLookupTable& lookup, Math1D::Vector<AlignBaseType>& alignment);
+
+  long double compute_prepared_alignment(const SentenceView& source, const SentenceView& target,
                                          const SingleLookupTable& lookup,
                                          Math1D::Vector<AlignBaseType>& alignment, bool ilp=false);
 
+  //from now on the changes that prepare_external_alignment() makes to the model are recorded (see recorded_changes()),
+  // restore_model() takes them back. This way sentence pairs can be aligned with the model as it was trained
+  void record_model_changes();
+
+  void restore_model();
+
   // <code> start_alignment </code> is used as initialization for hillclimbing and later modified
   // the extracted alignment is written to <code> postdec_alignment </code>
-  void compute_external_postdec_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+  void compute_external_postdec_alignment(const SentenceView& source, const SentenceView& target,
 					  const SingleLookupTable& lookup,
 					  Math1D::Vector<AlignBaseType>& start_alignment,
 					  std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
@@ -64,6 +134,11 @@ public:
   void release_memory();
 
   void write_postdec_alignments(const std::string filename, double thresh);
+
+  void write_checkpoint(CheckpointWriter& writer) const;
+
+  //with model_only the trainer was constructed without a corpus and only the parameters are read
+  void read_checkpoint(const Checkpoint& checkpoint, bool model_only = false);
   
 protected:
   
@@ -82,25 +157,27 @@ protected:
 
   long double alignment_prob(uint s, const Math1D::Vector<AlignBaseType>& alignment) const;
 
-  long double alignment_prob(const Storage1D<uint>& source, const Storage1D<uint>& target,
+  long double alignment_prob(const SentenceView& source, const SentenceView& target,
                              const SingleLookupTable& lookup, const Math1D::Vector<AlignBaseType>& alignment) const;
 
   //improves the currently best known alignment using hill climbing and
-  // returns the probability of the resulting alignment
-  long double update_alignment_by_hillclimbing(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  // returns the probability of the resulting alignment. hc_scores are working buffers, to be reused across calls
+  long double update_alignment_by_hillclimbing(const SentenceView& source, const SentenceView& target, 
                                                const SingleLookupTable& lookup, uint& nIter, Math1D::Vector<uint>& fertility,
                                                Math2D::Matrix<long double>& expansion_prob,
-                                               Math2D::Matrix<long double>& swap_prob, Math1D::Vector<AlignBaseType>& alignment);
+                                               Math2D::Matrix<long double>& swap_prob, HillclimbingScores& hc_scores,
+                                               Math1D::Vector<AlignBaseType>& alignment);
 
-  long double compute_itg_viterbi_alignment_noemptyword(uint s, bool extended_reordering = false);
+  long double compute_itg_viterbi_alignment_noemptyword(uint s, ItgChart& chart, bool extended_reordering,
+                                                        double beam, uint max_live_factor);
 
   //@param time_limit: maximum amount of seconds spent in the ILP-solver.
   //          values <= 0 indicate that no time limit is set
-  long double compute_viterbi_alignment_ilp(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  long double compute_viterbi_alignment_ilp(const SentenceView& source, const SentenceView& target, 
                                             const SingleLookupTable& lookup, uint max_fertility,
                                             Math1D::Vector<AlignBaseType>& alignment, double time_limit = -1.0);
 
-  void itg_traceback(uint s, const NamedStorage1D<Math3D::NamedTensor<uint> >& trace, uint J, uint j, uint i, uint ii);
+  void itg_traceback(uint s, const ItgChart& chart, uint J, uint j, uint i, uint ii);
 
   long double compute_ibmconstrained_viterbi_alignment_noemptyword(uint s, uint maxFertility, uint nMaxSkips);
 
@@ -120,6 +197,9 @@ protected:
   double l0_beta_;
 
   bool fix_p0_;
+
+  //the probability of the empty word before the recorded changes
+  double saved_p_zero_;
 };
 
 
@@ -13,27 +13,98 @@
 #include "gzstream.h"
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 #include <fstream>
 #include <set>
 #include "stl_out.hh"
 
 
-IBM4CacheStruct::IBM4CacheStruct(uchar j, WordClassType sc, WordClassType tc) : j_(j), sclass_(sc), tclass_(tc) {}
+IBM4CacheStruct::IBM4CacheStruct(ushort J, WordClassType sc, WordClassType tc) : J_(J), sclass_(sc), tclass_(tc) {}
 
 bool operator<(const IBM4CacheStruct& c1, const IBM4CacheStruct& c2) {
 
-  if (c1.j_ != c2.j_)
-    return (c1.j_ < c2.j_);
+  if (c1.J_ != c2.J_)
+    return (c1.J_ < c2.J_);
   if (c1.sclass_ != c2.sclass_)
     return (c1.sclass_ < c2.sclass_);
 
   return c1.tclass_ < c2.tclass_;
 }
 
+bool operator==(const IBM4CacheStruct& c1, const IBM4CacheStruct& c2) {
+
+  return (c1.J_ == c2.J_ && c1.sclass_ == c2.sclass_ && c1.tclass_ == c2.tclass_);
+}
+
+IBM4CacheEntry::IBM4CacheEntry(const IBM4CacheStruct& key) : key_(key) {}
+
+IBM4InterDistortionCache::IBM4InterDistortionCache() 
+  : nBytes_(0), byte_limit_(0), nLookups_(0), nHits_(0), nEvictions_(0) {}
+
+void IBM4InterDistortionCache::clear() {
+
+  drop_tables();
+
+  nLookups_ = 0;
+  nHits_ = 0;
+  nEvictions_ = 0;
+}
+
+void IBM4InterDistortionCache::drop_tables() {
+
+  entries_.clear();
+  index_.clear();
+  nBytes_ = 0;
+}
+
+const Math2D::Matrix<float,ushort>* IBM4InterDistortionCache::find(const IBM4CacheStruct& key) {
+
+  //most lookups in a row concern the same table
+  if (!entries_.empty() && entries_.front().key_ == key)
+    return &entries_.front().prob_;
+
+  std::map<IBM4CacheStruct,std::list<IBM4CacheEntry>::iterator>::iterator it = index_.find(key);
+  if (it == index_.end())
+    return 0;
+
+  //move to the front, this keeps the iterators valid
+  entries_.splice(entries_.begin(),entries_,it->second);
+  return &entries_.front().prob_;
+}
+
+Math2D::Matrix<float,ushort>& IBM4InterDistortionCache::insert(const IBM4CacheStruct& key) {
+
+  assert(index_.find(key) == index_.end());
+
+  //the map node is not counted
+  const size_t entry_bytes = sizeof(IBM4CacheEntry) + size_t(key.J_) * size_t(key.J_) * sizeof(float);
+
+  //the new table is always stored, even if it alone exceeds the limit
+  while (!entries_.empty() && nBytes_ + entry_bytes > byte_limit_) {
+
+    const IBM4CacheEntry& last = entries_.back();
+    nBytes_ -= sizeof(IBM4CacheEntry) + size_t(last.key_.J_) * size_t(last.key_.J_) * sizeof(float);
+    index_.erase(last.key_);
+    entries_.pop_back();
+    nEvictions_++;
+  }
+
+  entries_.push_front(IBM4CacheEntry(key));
+  index_[key] = entries_.begin();
+  nBytes_ += entry_bytes;
+
+  Math2D::Matrix<float,ushort>& table = entries_.front().prob_;
+  table.resize_dirty(key.J_,key.J_);
+  return table;
+}
+
 
-IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
+IBM4Trainer::IBM4Trainer(const Corpus& source_sentence,
                          const LookupTable& slookup,
-                         const Storage1D<Storage1D<uint> >& target_sentence,
+                         const Corpus& target_sentence,
                          const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
                          const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
                          SingleWordDictionary& dict,
@@ -46,7 +117,8 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
                          bool use_sentence_start_prob,
                          bool no_factorial, 
                          bool reduce_deficiency,
-                         IBM4CeptStartMode cept_start_mode, bool smoothed_l0, double l0_beta, double l0_fertpen)
+                         IBM4CeptStartMode cept_start_mode, bool smoothed_l0, double l0_beta, double l0_fertpen,
+                         size_t inter_distortion_byte_limit)
   : FertilityModelTrainer(source_sentence,slookup,target_sentence,dict,wcooc,
                           nSourceWords,nTargetWords,sure_ref_alignments,possible_ref_alignments),
     cept_start_prob_(MAKENAME(cept_start_prob_)),
@@ -56,14 +128,13 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
     och_ney_empty_word_(och_ney_empty_word), cept_start_mode_(cept_start_mode),
     use_sentence_start_prob_(use_sentence_start_prob), no_factorial_(no_factorial), reduce_deficiency_(reduce_deficiency),
     prior_weight_(prior_weight), smoothed_l0_(smoothed_l0), l0_beta_(l0_beta), l0_fertpen_(l0_fertpen), fix_p0_(false),
-    storage_limit_(12)
+    inter_distortion_byte_limit_(inter_distortion_byte_limit), dense_inter_distortion_bytes_(0), dense_length_limit_(0),
+    saved_p_zero_(0.0)
 {
 
   const uint nDisplacements = 2*maxJ_-1;
   displacement_offset_ = maxJ_-1;
 
-  inter_distortion_cache_.resize(maxJ_+1);
-
   uint max_source_class = 0;
   uint min_source_class = MAX_UINT;
   for (uint j=1; j < source_class_.size(); j++) {
@@ -91,6 +162,10 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
   nSourceClasses_ = max_source_class+1;
   nTargetClasses_ = max_target_class+1;
 
+  //without a corpus, the tables are sized in read_checkpoint()
+  if (maxJ_ == 0)
+    return;
+
   cept_start_prob_.resize(nSourceClasses_,nTargetClasses_,2*maxJ_-1);
   within_cept_prob_.resize(nTargetClasses_,maxJ_);
 
@@ -113,6 +188,24 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
   inter_distortion_prob_.resize(maxJ_+1);
   intra_distortion_prob_.resize(maxJ_+1);
 
+  //the fixed tables for the shortest lengths may use up to half the memory limit
+  if (nSourceClasses_*nTargetClasses_ <= 10)
+    dense_length_limit_ = maxJ_;
+  else {
+    for (uint J=1; J <= maxJ_; J++) {
+      if (seenJs.find(J) != seenJs.end()) {
+
+        const size_t nBytes = size_t(nSourceClasses_) * size_t(nTargetClasses_) * J * J * sizeof(float);
+        if (2*(dense_inter_distortion_bytes_ + nBytes) > inter_distortion_byte_limit_)
+          break;
+        dense_inter_distortion_bytes_ += nBytes;
+      }
+      dense_length_limit_ = J;
+    }
+  }
+
+  init_inter_distortion_cache(1);
+
 
   for (uint J=1; J <= maxJ_; J++) {
     if (seenJs.find(J) != seenJs.end()) {
@@ -122,7 +215,7 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
       for (uint j=0; j < J; j++)
         sentence_start_prob_[J][j] = sentence_start_parameters_[j];
 
-      if (J <= storage_limit_ || nSourceClasses_*nTargetClasses_ <= 10) 
+      if (J <= dense_length_limit_) 
         inter_distortion_prob_[J].resize(nSourceClasses_,nTargetClasses_);
       //inter_distortion_prob_[J].resize(1,1);
     }
@@ -146,7 +239,7 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
     for (uint j=0; j < curJ; j++) {
       const uint sclass = source_class_[source_sentence_[s][j]];
 
-      if (curJ <= storage_limit_ || nSourceClasses_*nTargetClasses_ <= 10) {
+      if (curJ <= dense_length_limit_) {
         if (inter_distortion_prob_[curJ].xDim() <= sclass || inter_distortion_prob_[curJ].yDim() <= max_t)
           inter_distortion_prob_[curJ].resize(std::max<uint>(inter_distortion_prob_[curJ].xDim(),sclass+1),
                                               std::max<uint>(inter_distortion_prob_[curJ].yDim(),max_t+1));
@@ -155,7 +248,7 @@ IBM4Trainer::IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
       for (uint i=0; i < curI; i++) {
         const uint tclass = target_class_[target_sentence_[s][i]];
 
-        if (curJ <= storage_limit_ || nSourceClasses_ * nTargetClasses_ <= 10) {
+        if (curJ <= dense_length_limit_) {
           
           if (inter_distortion_prob_[curJ](sclass,tclass).size() == 0) {
             inter_distortion_prob_[curJ](sclass,tclass).resize(curJ,curJ);
@@ -241,6 +334,77 @@ void IBM4Trainer::fix_p0(double p0) {
   fix_p0_ = true;
 }
 
+void IBM4Trainer::write_checkpoint(CheckpointWriter& writer) const {
+
+  write_fertility_checkpoint(writer,"ibm4.");
+  writer.add_tensor("ibm4.cept_start_prob",cept_start_prob_);
+  writer.add_matrix("ibm4.within_cept_prob",within_cept_prob_);
+  writer.add_vector("ibm4.sentence_start_parameters",sentence_start_parameters_);
+  writer.add_scalar("ibm4.p_zero",p_zero_);
+  writer.add_scalar("ibm4.p_nonzero",p_nonzero_);
+  writer.add_scalar("ibm4.och_ney_empty_word",(och_ney_empty_word_) ? 1.0 : 0.0);
+  writer.add_scalar("ibm4.use_sentence_start_prob",(use_sentence_start_prob_) ? 1.0 : 0.0);
+  writer.add_scalar("ibm4.reduce_deficiency",(reduce_deficiency_) ? 1.0 : 0.0);
+  writer.add_scalar("ibm4.cept_start_mode",cept_start_mode_);
+  writer.add_vector("ibm4.source_class",source_class_);
+  writer.add_vector("ibm4.target_class",target_class_);
+}
+
+void IBM4Trainer::read_checkpoint(const Checkpoint& checkpoint, bool model_only) {
+
+  if ((checkpoint.get_scalar("ibm4.och_ney_empty_word") != 0.0) != och_ney_empty_word_
+      || (checkpoint.get_scalar("ibm4.use_sentence_start_prob") != 0.0) != use_sentence_start_prob_
+      || (checkpoint.get_scalar("ibm4.reduce_deficiency") != 0.0) != reduce_deficiency_
+      || IBM4CeptStartMode(checkpoint.get_scalar("ibm4.cept_start_mode")) != cept_start_mode_) {
+    USER_ERROR << "the IBM-4 of the checkpoint was trained with different options (-org-empty-word, -dont-reduce-deficiency,"
+               << " -ibm4-mode). Exiting..." << std::endl;
+    exit(1);
+  }
+
+  Storage1D<WordClassType> source_class;
+  Storage1D<WordClassType> target_class;
+  checkpoint.get_vector("ibm4.source_class",source_class);
+  checkpoint.get_vector("ibm4.target_class",target_class);
+
+  bool same_classes = (source_class.size() == source_class_.size() && target_class.size() == target_class_.size());
+  for (uint k=0; same_classes && k < source_class.size(); k++)
+    same_classes = (source_class[k] == source_class_[k]);
+  for (uint k=0; same_classes && k < target_class.size(); k++)
+    same_classes = (target_class[k] == target_class_[k]);
+
+  if (!same_classes) {
+    USER_ERROR << "the IBM-4 of the checkpoint was trained with different word classes (-sclasses, -tclasses). Exiting..." << std::endl;
+    exit(1);
+  }
+
+  read_fertility_checkpoint(checkpoint,"ibm4.",model_only);
+  checkpoint.get_tensor("ibm4.cept_start_prob",cept_start_prob_);
+  checkpoint.get_matrix("ibm4.within_cept_prob",within_cept_prob_);
+  checkpoint.get_vector("ibm4.sentence_start_parameters",sentence_start_parameters_);
+  p_zero_ = checkpoint.get_scalar("ibm4.p_zero");
+  p_nonzero_ = checkpoint.get_scalar("ibm4.p_nonzero");
+
+  if (cept_start_prob_.zDim() != 2*maxJ_-1 || within_cept_prob_.yDim() != maxJ_) {
+    USER_ERROR << "the checkpoint is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  if (model_only) {
+
+    //the non-parametric tables are created for the lengths of the sentences to align
+    displacement_offset_ = maxJ_-1;
+    inter_distortion_prob_.resize(maxJ_+1);
+    intra_distortion_prob_.resize(maxJ_+1);
+    if (use_sentence_start_prob_)
+      sentence_start_prob_.resize(maxJ_+1);
+  }
+
+  par2nonpar_inter_distortion();
+  par2nonpar_intra_distortion();
+  if (use_sentence_start_prob_)
+    par2nonpar_start_prob();
+}
+
 
 double IBM4Trainer::inter_distortion_prob(int j, int j_prev, uint sclass, uint tclass, uint J)  const {
 
@@ -248,37 +412,96 @@ double IBM4Trainer::inter_distortion_prob(int j, int j_prev, uint sclass, uint t
     return cept_start_prob_(sclass,tclass,j-j_prev+displacement_offset_);
   
 
-  if (inter_distortion_prob_[J].size() == 0)
-    inter_distortion_prob_[J].resize(nSourceClasses_,nTargetClasses_);
-
-  if (inter_distortion_prob_[J].size() > 0 && inter_distortion_prob_[J](sclass,tclass).size() > 0) 
+  //NOTE: this is called concurrently from several threads, so nothing shared may be modified here
+  if (inter_distortion_prob_[J].xDim() > sclass && inter_distortion_prob_[J].yDim() > tclass
+      && inter_distortion_prob_[J](sclass,tclass).size() > 0) 
     return inter_distortion_prob_[J](sclass,tclass)(j,j_prev);
 
-  
-  IBM4CacheStruct cs(j,sclass,tclass);
-  
-  std::map<IBM4CacheStruct,float>::const_iterator it = inter_distortion_cache_[J][j_prev].find(cs);
+  IBM4InterDistortionCache& cache = thread_inter_distortion_cache();
 
-  if (it == inter_distortion_cache_[J][j_prev].end()) {
+  cache.nLookups_++;
 
-    double sum = 0.0;
-                
-    for (int jj=0; jj < int(J); jj++) {
-      sum += cept_start_prob_(sclass,tclass,jj-j_prev+displacement_offset_);
-      assert(!isnan(sum));
+  const IBM4CacheStruct key(J,sclass,tclass);
+
+  const Math2D::Matrix<float,ushort>* table = cache.find(key);
+
+  if (table == 0) {
+
+    Math2D::Matrix<float,ushort>& new_table = cache.insert(key);
+
+    for (int jj_prev=0; jj_prev < int(J); jj_prev++) {
+
+      double sum = 0.0;
+
+      for (int jj=0; jj < int(J); jj++) {
+        sum += cept_start_prob_(sclass,tclass,jj-jj_prev+displacement_offset_);
+        assert(!isnan(sum));
+      }
+
+      for (int jj=0; jj < int(J); jj++)
+        new_table(jj,jj_prev) = std::max(1e-8,cept_start_prob_(sclass,tclass,jj-jj_prev+displacement_offset_) / sum);
     }
-    
-    float prob = std::max(1e-8,cept_start_prob_(sclass,tclass,j-j_prev+displacement_offset_) / sum);
-    inter_distortion_cache_[J][j_prev][cs] = prob;
-    return prob;
+
+    table = &new_table;
   }
   else
-    return it->second;
+    cache.nHits_++;
+
+  return (*table)(j,j_prev);
+}
+
+void IBM4Trainer::init_inter_distortion_cache(uint nThreads) {
+
+  size_t byte_limit = 0;
+  if (inter_distortion_byte_limit_ > dense_inter_distortion_bytes_)
+    byte_limit = (inter_distortion_byte_limit_ - dense_inter_distortion_bytes_) / nThreads;
+
+  inter_distortion_cache_.resize(nThreads);
+  for (uint t=0; t < nThreads; t++) {
+    inter_distortion_cache_[t].clear();
+    inter_distortion_cache_[t].byte_limit_ = byte_limit;
+  }
+}
+
+IBM4InterDistortionCache& IBM4Trainer::thread_inter_distortion_cache() const {
+
+#ifdef _OPENMP
+  return inter_distortion_cache_[omp_get_thread_num()];
+#else
+  return inter_distortion_cache_[0];
+#endif
+}
+
+void IBM4Trainer::print_inter_distortion_cache_stats() {
+
+  size_t nLookups = 0;
+  size_t nHits = 0;
+  size_t nEvictions = 0;
+  size_t nBytes = 0;
+  for (uint t=0; t < inter_distortion_cache_.size(); t++) {
+    nLookups += inter_distortion_cache_[t].nLookups_;
+    nHits += inter_distortion_cache_[t].nHits_;
+    nEvictions += inter_distortion_cache_[t].nEvictions_;
+    nBytes += inter_distortion_cache_[t].nBytes_;
+    inter_distortion_cache_[t].nLookups_ = 0;
+    inter_distortion_cache_[t].nHits_ = 0;
+    inter_distortion_cache_[t].nEvictions_ = 0;
+  }
+
+  if (nLookups > 0)
+    std::cerr << "inter distortion cache: " << nLookups << " lookups, " << nHits << " hits ("
+              << (100.0 * nHits) / nLookups << "%), " << (nLookups - nHits) << " misses, " << nEvictions
+              << " evictions, " << (nBytes / (1024.0*1024.0)) << " MB in use" << std::endl;
 }
 
 
 void IBM4Trainer::par2nonpar_inter_distortion() {
 
+  //the cached tables are derived from the parameters as well
+  for (uint t=0; t < inter_distortion_cache_.size(); t++) {
+    inter_distortion_cache_[t].drop_tables();
+  }
+
   for (int J=1; J <= (int) maxJ_; J++) {
 
     if (inter_distortion_prob_[J].size() > 0) {
@@ -423,9 +646,10 @@ void IBM4Trainer::par2nonpar_start_prob() {
 }
 
 double IBM4Trainer::inter_distortion_m_step_energy(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
-                                                   const std::map<DistortCount,double>& sparse_inter_distort_count,
+                                                   const std::vector<std::pair<DistortCount,double> >& sparse_inter_distort_count,
                                                    const Math3D::Tensor<double>& inter_param, uint class1, uint class2) {
 
+
   double energy = 0.0;
 
   for (int J=1; J <= (int) maxJ_; J++) {
@@ -445,7 +669,6 @@ double IBM4Trainer::inter_distortion_m_step_energy(const Storage1D<Storage2D<Mat
           sum += std::max(1e-15,inter_param(class1,class2,j2-j1 + displacement_offset_));
         }
 
-
         for (int j2=0; j2 < J; j2++) {
 
           const double count = cur_count(j2,j1);
@@ -467,7 +690,12 @@ double IBM4Trainer::inter_distortion_m_step_energy(const Storage1D<Storage2D<Mat
     }
   }
 
-  for (std::map<DistortCount,double>::const_iterator it = sparse_inter_distort_count.begin(); it != sparse_inter_distort_count.end(); it++) {
+  //the counts are sorted by J, so the normalizations of the current J can be kept (negative = not yet computed)
+  Math1D::Vector<double> j1_sum;
+  uint cur_J = 0;
+
+  for (std::vector<std::pair<DistortCount,double> >::const_iterator it = sparse_inter_distort_count.begin(); 
+       it != sparse_inter_distort_count.end(); it++) {
 
     const DistortCount& dist_count = it->first;
     const double weight = it->second;
@@ -475,89 +703,24 @@ double IBM4Trainer::inter_distortion_m_step_energy(const Storage1D<Storage2D<Mat
     uchar J = dist_count.J_;
     int j1 = dist_count.j_prev_;
 
-    double sum = 0.0;
-
-    for (int j2=0; j2 < J; j2++) {
-      sum += std::max(1e-15,inter_param(class1,class2,j2-j1 + displacement_offset_));
-    }
-    
-    int j2 = dist_count.j_;
-
-    const double cur_param = std::max(1e-15, inter_param(class1,class2,j2-j1 + displacement_offset_));
-
-    energy -= weight * std::log( cur_param / sum);
-    if (isnan(energy)) {
-      
-      std::cerr << "j1: " << j1 << ", j2: " << j2 << std::endl;
-      std::cerr << "added " << weight << "* log(" << cur_param 
-                << "/" << sum << ")" << std::endl;
+    if (J != cur_J) {
+      cur_J = J;
+      j1_sum.resize_dirty(J);
+      j1_sum.set_constant(-1.0);
     }
-    assert(!isnan(energy));
-  }
-
-  return energy;
-}
-
-double IBM4Trainer::inter_distortion_m_step_energy(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
-                                                   const std::vector<std::pair<DistortCount,double> >& sparse_inter_distort_count,
-                                                   const Math3D::Tensor<double>& inter_param, uint class1, uint class2) {
-
-
-  double energy = 0.0;
-
-  for (int J=1; J <= (int) maxJ_; J++) {
-
-    if (inter_distort_count[J].xDim() > class1 && inter_distort_count[J].yDim() > class2) {
-
-      const Math2D::Matrix<double>& cur_count = inter_distort_count[J](class1,class2);
-
-      if (cur_count.size() == 0)
-        continue;
-
-      for (int j1=0; j1 < J; j1++) {
-
-        double sum = 0.0;
-
-        for (int j2=0; j2 < J; j2++) {
-          sum += std::max(1e-15,inter_param(class1,class2,j2-j1 + displacement_offset_));
-        }
-
-        for (int j2=0; j2 < J; j2++) {
-
-          const double count = cur_count(j2,j1);
-          if (count == 0.0)
-            continue;
 
-          const double cur_param = std::max(1e-15, inter_param(class1,class2,j2-j1 + displacement_offset_));
+    if (j1_sum[j1] < 0.0) {
 
-          energy -= count * std::log( cur_param / sum);
-          if (isnan(energy)) {
+      double sum = 0.0;
 
-            std::cerr << "j1: " << j1 << ", j2: " << j2 << std::endl;
-            std::cerr << "added " << cur_count(j2,j1) << "* log(" << cur_param 
-                      << "/" << sum << ")" << std::endl;
-          }
-          assert(!isnan(energy));
-        }
+      for (int j2=0; j2 < J; j2++) {
+        sum += std::max(1e-15,inter_param(class1,class2,j2-j1 + displacement_offset_));
       }
+      j1_sum[j1] = sum;
     }
-  }
-
-  for (std::vector<std::pair<DistortCount,double> >::const_iterator it = sparse_inter_distort_count.begin(); 
-       it != sparse_inter_distort_count.end(); it++) {
-
-    const DistortCount& dist_count = it->first;
-    const double weight = it->second;
-
-    uchar J = dist_count.J_;
-    int j1 = dist_count.j_prev_;
 
-    double sum = 0.0;
+    const double sum = j1_sum[j1];
 
-    for (int j2=0; j2 < J; j2++) {
-      sum += std::max(1e-15,inter_param(class1,class2,j2-j1 + displacement_offset_));
-    }
-    
     int j2 = dist_count.j_;
 
     const double cur_param = std::max(1e-15, inter_param(class1,class2,j2-j1 + displacement_offset_));
@@ -608,23 +771,19 @@ double IBM4Trainer::intra_distortion_m_step_energy(const Storage1D<Math3D::Tenso
 }
 
 void IBM4Trainer::inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
-                                          const std::map<DistortCount,double>& sparse_inter_distort_count,
+                                          const std::vector<std::pair<DistortCount,double> >& sparse_inter_distort_count,
                                           uint class1, uint class2) {
 
-  //iterating over a vector is a lot faster than iterating over a map -> copy
-  std::vector<std::pair<DistortCount,double> > vec_sparse_inter_distort_count;
-  vec_sparse_inter_distort_count.reserve(sparse_inter_distort_count.size());
-  for (std::map<DistortCount,double>::const_iterator it = sparse_inter_distort_count.begin();
-       it != sparse_inter_distort_count.end(); it++)
-    vec_sparse_inter_distort_count.push_back(*it);
+  std::vector<double> proj_aux;
 
   Math3D::Tensor<double> new_ceptstart_prob = cept_start_prob_;
   Math3D::Tensor<double> hyp_ceptstart_prob = cept_start_prob_;
   Math1D::Vector<double> ceptstart_grad(cept_start_prob_.zDim());
+  Math1D::Vector<double> j1_sum;
 
   double alpha = 0.01;
 
-  double energy = inter_distortion_m_step_energy(inter_distort_count,vec_sparse_inter_distort_count,cept_start_prob_,class1,class2);
+  double energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count,cept_start_prob_,class1,class2);
 
   if (nSourceClasses_*nTargetClasses_ <= 4)
     std::cerr << "start energy: " << energy << std::endl;
@@ -682,20 +841,35 @@ void IBM4Trainer::inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matr
     }
 
 
-    for (std::vector<std::pair<DistortCount,double> >::const_iterator it = vec_sparse_inter_distort_count.begin(); 
-         it != vec_sparse_inter_distort_count.end(); it++) {
+    //as in the energy, the normalizations are kept for the current J
+    uint cur_J = 0;
+
+    for (std::vector<std::pair<DistortCount,double> >::const_iterator it = sparse_inter_distort_count.begin(); 
+         it != sparse_inter_distort_count.end(); it++) {
 
       const DistortCount& dist_count = it->first;
       const double weight = it->second;
       
       uchar J = dist_count.J_;
       int j1 = dist_count.j_prev_;
-      
-      double sum = 0.0;
-      
-      for (int j2=0; j2 < J; j2++) {
-        sum += std::max(1e-15,cept_start_prob_(class1,class2,j2-j1 + displacement_offset_));
+
+      if (J != cur_J) {
+        cur_J = J;
+        j1_sum.resize_dirty(J);
+        j1_sum.set_constant(-1.0);
+      }
+
+      if (j1_sum[j1] < 0.0) {
+
+        double sum = 0.0;
+
+        for (int j2=0; j2 < J; j2++) {
+          sum += std::max(1e-15,cept_start_prob_(class1,class2,j2-j1 + displacement_offset_));
+        }
+        j1_sum[j1] = sum;
       }
+
+      const double sum = j1_sum[j1];
       
       int j2 = dist_count.j_;
       
@@ -721,7 +895,7 @@ void IBM4Trainer::inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matr
     for (uint k=0; k < temp.size(); k++)
       temp[k] = new_ceptstart_prob(class1,class2,k);
     
-    projection_on_simplex(temp.direct_access(),cept_start_prob_.zDim());
+    projection_on_simplex(temp.direct_access(),cept_start_prob_.zDim(), proj_aux);
 
     for (uint k=0; k < temp.size(); k++)
       new_ceptstart_prob(class1,class2,k) = temp[k];
@@ -742,7 +916,7 @@ void IBM4Trainer::inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matr
         hyp_ceptstart_prob(class1,class2,k) = neg_lambda * cept_start_prob_(class1,class2,k) 
           + lambda * new_ceptstart_prob(class1,class2,k);
 
-      double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,vec_sparse_inter_distort_count,hyp_ceptstart_prob,class1,class2);
+      double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count,hyp_ceptstart_prob,class1,class2);
 
       if (hyp_energy < best_energy) {
 
@@ -773,6 +947,8 @@ void IBM4Trainer::inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matr
 void IBM4Trainer::intra_distortion_m_step(const Storage1D<Math3D::Tensor<double> >& intra_distort_count,
                                           uint word_class) {
 
+  std::vector<double> proj_aux;
+
 
   Math2D::Matrix<double> new_within_cept_prob = within_cept_prob_;
   Math2D::Matrix<double> hyp_within_cept_prob = within_cept_prob_;
@@ -839,7 +1015,7 @@ void IBM4Trainer::intra_distortion_m_step(const Storage1D<Math3D::Tensor<double>
     for (uint k=0; k < temp.size(); k++)
       temp[k] = new_within_cept_prob(word_class,k);
     
-    projection_on_simplex(temp.direct_access(),temp.size());
+    projection_on_simplex(temp.direct_access(),temp.size(), proj_aux);
 
     for (uint k=0; k < temp.size(); k++)
       new_within_cept_prob(word_class,k) = temp[k];
@@ -918,6 +1094,8 @@ double IBM4Trainer::start_prob_m_step_energy(const Storage1D<Math1D::Vector<doub
 
 void IBM4Trainer::start_prob_m_step(const Storage1D<Math1D::Vector<double> >& start_count) {
 
+  std::vector<double> proj_aux;
+
   Math1D::Vector<double> param_grad = sentence_start_parameters_;
   Math1D::Vector<double> new_param = sentence_start_parameters_;
   Math1D::Vector<double> hyp_param = sentence_start_parameters_;
@@ -958,7 +1136,7 @@ void IBM4Trainer::start_prob_m_step(const Storage1D<Math1D::Vector<double> >& st
       new_param[k] = sentence_start_parameters_[k] - alpha * param_grad[k];
 
     //reproject
-    projection_on_simplex(new_param.direct_access(), new_param.size());
+    projection_on_simplex(new_param.direct_access(), new_param.size(), proj_aux);
 
     //find step-size
     double best_energy = 1e300;
@@ -1059,8 +1237,8 @@ void IBM4Trainer::init_from_ibm3(IBM3Trainer& ibm3trainer, bool clear_ibm3,
  
     for (size_t s=0; s < source_sentence_.size(); s++) {
 
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
+      const SentenceView& cur_source = source_sentence_[s];
+      const SentenceView& cur_target = target_sentence_[s];
 
       const uint curI = cur_target.size();
       const uint curJ = cur_source.size();
@@ -1230,47 +1408,40 @@ void IBM4Trainer::init_from_ibm3(IBM3Trainer& ibm3trainer, bool clear_ibm3,
 
 void IBM4Trainer::update_alignments_unconstrained() {
 
-  Math2D::NamedMatrix<long double> expansion_prob(MAKENAME(expansion_prob));
-  Math2D::NamedMatrix<long double> swap_prob(MAKENAME(swap_prob));
+  init_inter_distortion_cache(nThreads_);
 
-  for (size_t s=0; s < source_sentence_.size(); s++) {
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads_,sort_by_length_,stream_chunk_size_);
 
+#pragma omp parallel for schedule(static,1) num_threads(nThreads_)
+  for (int t=0; t < (int) nThreads_; t++) {
 
-    if (nSourceClasses_*nTargetClasses_ >= 10 && (s%25) == 0) {
-      for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
-        
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-            inter_distortion_prob_[J](x,y).resize(0,0);
-      }
-    }
+    Math2D::NamedMatrix<long double> expansion_prob(MAKENAME(expansion_prob));
+    Math2D::NamedMatrix<long double> swap_prob(MAKENAME(swap_prob));
+    Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
 
-    const uint curI = target_sentence_[s].size();
-    Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
-    
-    SingleLookupTable aux_lookup;
-    const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                         nSourceWords_,slookup_[s],aux_lookup);
+    WordLookupBuffers aux_lookup;
 
-    uint nIter=0;
-    update_alignment_by_hillclimbing(source_sentence_[s],target_sentence_[s],cur_lookup,
-                                     nIter,fertility,expansion_prob,swap_prob,best_known_alignment_[s]);
-  }
+    for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
 
-  if (nSourceClasses_*nTargetClasses_ >= 10) {
-    for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
-      
-      for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-        for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-          inter_distortion_prob_[J](x,y).resize(0,0);
+      const size_t s = schedule[k];
+      schedule.prefetch(t,k);
+
+      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                           nSourceWords_,slookup_[s],aux_lookup);
+
+      uint nIter=0;
+      update_alignment_by_hillclimbing(source_sentence_[s],target_sentence_[s],cur_lookup,
+                                       nIter,fertility,expansion_prob,swap_prob,best_known_alignment_[s]);
     }
   }
+
+  print_inter_distortion_cache_stats();
 }
 
 
 long double IBM4Trainer::alignment_prob(uint s, const Math1D::Vector<AlignBaseType>& alignment) {
 
-  SingleLookupTable aux_lookup;
+  WordLookupBuffers aux_lookup;
   
   const SingleLookupTable& lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                    nSourceWords_,slookup_[s],aux_lookup);
@@ -1278,7 +1449,7 @@ long double IBM4Trainer::alignment_prob(uint s, const Math1D::Vector<AlignBaseTy
   return alignment_prob(source_sentence_[s],target_sentence_[s],lookup,alignment);
 }
 
-long double IBM4Trainer::alignment_prob(const Storage1D<uint>& source, const Storage1D<uint>& target,
+long double IBM4Trainer::alignment_prob(const SentenceView& source, const SentenceView& target,
                                         const SingleLookupTable& lookup,const Math1D::Vector<AlignBaseType>& alignment) {
 
   long double prob = 1.0;
@@ -1316,7 +1487,7 @@ long double IBM4Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
     uint t_idx = target[i-1];
     prob *= fertility_prob_[t_idx][fertility[i]];
     if (!no_factorial_)
-      prob *= ldfac(fertility[i]);
+      prob *= combinatorics_.fac(fertility[i]);
   }
 
   //DEBUG
@@ -1438,7 +1609,7 @@ long double IBM4Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
 
   //dictionary probs were handled above
   
-  prob *= ldchoose(curJ-fertility[0],fertility[0]);
+  prob *= combinatorics_.choose(curJ-fertility[0],fertility[0]);
   for (uint k=1; k <= fertility[0]; k++)
     prob *= p_zero_;
   for (uint k=1; k <= curJ-2*fertility[0]; k++)
@@ -1454,7 +1625,7 @@ long double IBM4Trainer::alignment_prob(const Storage1D<uint>& source, const Sto
 }
 
 
-long double IBM4Trainer::distortion_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+long double IBM4Trainer::distortion_prob(const SentenceView& source, const SentenceView& target, 
 					 const Math1D::Vector<AlignBaseType>& alignment) {
 
   const uint curI = target.size();
@@ -1475,7 +1646,7 @@ long double IBM4Trainer::distortion_prob(const Storage1D<uint>& source, const St
 
 
 //NOTE: the vectors need to be sorted
-long double IBM4Trainer::distortion_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+long double IBM4Trainer::distortion_prob(const SentenceView& source, const SentenceView& target, 
 					 const Storage1D<std::vector<AlignBaseType> >& aligned_source_words) {
 
   long double prob = 1.0;
@@ -1568,14 +1739,14 @@ long double IBM4Trainer::distortion_prob(const Storage1D<uint>& source, const St
 }
 
 
-void IBM4Trainer::print_alignment_prob_factors(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+void IBM4Trainer::print_alignment_prob_factors(const SentenceView& source, const SentenceView& target, 
 					       const SingleLookupTable& cur_lookup, const Math1D::Vector<AlignBaseType>& alignment) {
 
 
   long double prob = 1.0;
 
-  const Storage1D<uint>& cur_source = source;
-  const Storage1D<uint>& cur_target = target;
+  const SentenceView& cur_source = source;
+  const SentenceView& cur_target = target;
 
   const uint curI = cur_target.size();
   const uint curJ = cur_source.size();
@@ -1616,9 +1787,9 @@ void IBM4Trainer::print_alignment_prob_factors(const Storage1D<uint>& source, co
 	      << ", result: " << prob << std::endl;
 
     if (!no_factorial_) {
-      prob *= ldfac(fertility[i]);
+      prob *= combinatorics_.fac(fertility[i]);
 
-      std::cerr << "mult by factorial " << ldfac(fertility[i]) 
+      std::cerr << "mult by factorial " << combinatorics_.fac(fertility[i]) 
 		<< ", result: " << prob << std::endl;
     }
   }
@@ -1735,9 +1906,9 @@ void IBM4Trainer::print_alignment_prob_factors(const Storage1D<uint>& source, co
 
   //dictionary probs were handled above
   
-  prob *= ldchoose(curJ-fertility[0],fertility[0]);
+  prob *= combinatorics_.choose(curJ-fertility[0],fertility[0]);
 
-  std::cerr << "mult by ldchoose " << ldchoose(curJ-fertility[0],fertility[0]) << ", result: " << prob << std::endl;
+  std::cerr << "mult by ldchoose " << combinatorics_.choose(curJ-fertility[0],fertility[0]) << ", result: " << prob << std::endl;
 
   for (uint k=1; k <= fertility[0]; k++) {
     prob *= p_zero_;
@@ -1761,7 +1932,7 @@ void IBM4Trainer::print_alignment_prob_factors(const Storage1D<uint>& source, co
 }
 
 
-long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+long double IBM4Trainer::update_alignment_by_hillclimbing(const SentenceView& source, const SentenceView& target, 
                                                           const SingleLookupTable& lookup, uint& nIter, Math1D::Vector<uint>& fertility,
                                                           Math2D::Matrix<long double>& expansion_prob,
                                                           Math2D::Matrix<long double>& swap_prob, Math1D::Vector<AlignBaseType>& alignment) {
@@ -1776,8 +1947,8 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
   long double base_prob = alignment_prob(source,target,lookup,alignment);
 
-  swap_prob.resize(curJ,curJ);
-  expansion_prob.resize(curJ,curI+1);
+  swap_prob.resize_dirty(curJ,curJ);
+  expansion_prob.resize_dirty(curJ,curI+1);
   swap_prob.set_constant(0.0);
   expansion_prob.set_constant(0.0);
 
@@ -1799,12 +1970,17 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
   long double base_distortion_prob = distortion_prob(source,target,aligned_source_words);
 
+  //allocated once for all hillclimbing iterations
+  Math1D::NamedVector<uint> prev_cept(curI+1,MAKENAME(prev_cept));
+  Math1D::NamedVector<uint> next_cept(curI+1,MAKENAME(next_cept));
+  Math1D::NamedVector<uint> cept_center(curI+1,MAKENAME(cept_center));
+  NamedStorage1D< std::vector<AlignBaseType> > hyp_aligned_source_words(curI+1,MAKENAME(hyp_aligned_source_words));
 
   while (true) {    
 
-    Math1D::NamedVector<uint> prev_cept(curI+1,MAX_UINT,MAKENAME(prev_cept));
-    Math1D::NamedVector<uint> next_cept(curI+1,MAX_UINT,MAKENAME(next_cept));
-    Math1D::NamedVector<uint> cept_center(curI+1,MAX_UINT,MAKENAME(cept_center));
+    prev_cept.set_constant(MAX_UINT);
+    next_cept.set_constant(MAX_UINT);
+    cept_center.set_constant(MAX_UINT);
 
     uint prev_i = MAX_UINT;
     for (uint i=1; i <= curI; i++) {
@@ -1864,7 +2040,6 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
     //a) expansion moves
 
-    NamedStorage1D< std::vector<AlignBaseType> > hyp_aligned_source_words(MAKENAME(hyp_aligned_source_words));
     hyp_aligned_source_words = aligned_source_words;
 
     for (uint j=0; j < curJ; j++) {
@@ -1929,8 +2104,8 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
               incoming_prob *= fertility_prob_[prev_ti][fertility[aj]-1];
 
               if (!no_factorial_) {
-                incoming_prob *= ldfac(fertility[cand_aj]+1);
-                incoming_prob *= ldfac(fertility[aj]-1);
+                incoming_prob *= combinatorics_.fac(fertility[cand_aj]+1);
+                incoming_prob *= combinatorics_.fac(fertility[aj]-1);
               }
 
               leaving_prob *= fertility_prob_[new_ti][fertility[cand_aj]];
@@ -1939,8 +2114,8 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
               assert(leaving_prob > 0.0);
 
               if (!no_factorial_) {
-                leaving_prob *= ldfac(fertility[cand_aj]);
-                leaving_prob *= ldfac(fertility[aj]);
+                leaving_prob *= combinatorics_.fac(fertility[cand_aj]);
+                leaving_prob *= combinatorics_.fac(fertility[aj]);
               }
 
               const uint prev_aj_fert = fertility[aj];
@@ -2310,9 +2485,9 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
               incoming_prob *= fertility_prob_[prev_ti][fertility[aj]-1];
               if (!no_factorial_)
-                incoming_prob *= ldfac(fertility[aj]-1);
+                incoming_prob *= combinatorics_.fac(fertility[aj]-1);
 
-              incoming_prob *= ldchoose(curJ-new_zero_fert,new_zero_fert);
+              incoming_prob *= combinatorics_.choose(curJ-new_zero_fert,new_zero_fert);
 
               for (uint k=1; k <= new_zero_fert; k++)
                 incoming_prob *= p_zero_;
@@ -2326,9 +2501,9 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
               leaving_prob *= fertility_prob_[prev_ti][fertility[aj]];
               if (!no_factorial_)
-                leaving_prob *= ldfac(fertility[aj]);
+                leaving_prob *= combinatorics_.fac(fertility[aj]);
 
-              leaving_prob *= ldchoose(curJ-prev_zero_fert,prev_zero_fert);
+              leaving_prob *= combinatorics_.choose(curJ-prev_zero_fert,prev_zero_fert);
 
               for (uint k=1; k <= prev_zero_fert; k++)
                 leaving_prob *= p_zero_;
@@ -2523,9 +2698,9 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 	      incoming_prob *= fertility_prob_[prev_ti][fertility[aj]-1];
 	    
 	    if (!no_factorial_) {
-              incoming_prob *= ldfac(fertility[cand_aj]+1);
+              incoming_prob *= combinatorics_.fac(fertility[cand_aj]+1);
 	      if (aj != 0)
-		incoming_prob *= ldfac(fertility[aj]-1);
+		incoming_prob *= combinatorics_.fac(fertility[aj]-1);
 	    }
 
             leaving_prob *= fertility_prob_[new_ti][fertility[cand_aj]];
@@ -2535,9 +2710,9 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 	    assert(leaving_prob > 0.0);
 	    
 	    if (!no_factorial_) {
-              leaving_prob *= ldfac(fertility[cand_aj]);
+              leaving_prob *= combinatorics_.fac(fertility[cand_aj]);
 	      if (aj != 0)
-		leaving_prob *= ldfac(fertility[aj]);
+		leaving_prob *= combinatorics_.fac(fertility[aj]);
 	    }
 
 
@@ -2553,7 +2728,7 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 
 	    if (prev_zero_fert != new_zero_fert) {
 
-	      leaving_prob *= ldchoose(curJ-prev_zero_fert,prev_zero_fert);
+	      leaving_prob *= combinatorics_.choose(curJ-prev_zero_fert,prev_zero_fert);
 	      for (uint k=1; k <= prev_zero_fert; k++)
 		leaving_prob *= p_zero_;
 	      for (uint k=1; k <= curJ-2*prev_zero_fert; k++)
@@ -2566,7 +2741,7 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
 	      }
 
 
-	      incoming_prob *= ldchoose(curJ-new_zero_fert,new_zero_fert);
+	      incoming_prob *= combinatorics_.choose(curJ-new_zero_fert,new_zero_fert);
 	      for (uint k=1; k <= new_zero_fert; k++)
 		incoming_prob *= p_zero_;
 	      for (uint k=1; k <= curJ-2*new_zero_fert; k++)
@@ -3213,10 +3388,19 @@ long double IBM4Trainer::update_alignment_by_hillclimbing(const Storage1D<uint>&
   return base_prob;
 }
 
-long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+long double IBM4Trainer::compute_external_alignment(const SentenceView& source, const SentenceView& target,
                                                     const SingleLookupTable& lookup,
                                                     Math1D::Vector<AlignBaseType>& alignment) {
 
+  prepare_external_alignment(source, target, lookup, alignment);
+
+  return compute_prepared_alignment(source, target, lookup, alignment);
+}
+
+void IBM4Trainer::prepare_external_alignment(const SentenceView& source, const SentenceView& target,
+                                             const SingleLookupTable& lookup,
+                                             Math1D::Vector<AlignBaseType>& alignment) {
+
   const uint J = source.size();
   const uint I = target.size();
 
@@ -3232,8 +3416,10 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
     fertility[aj]++;
   }
 
-  if (fertility[0] > 0 && p_zero_ < 1e-12)
+  if (fertility[0] > 0 && p_zero_ < 1e-12) {
     p_zero_ = 1e-12;
+    model_changes_.global_ = true;
+  }
   
   if (2*fertility[0] > J) {
     
@@ -3246,13 +3432,15 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
         fertility[1]++;	
 
 	if (dict_[target[0]][lookup(j,0)] < 1e-12)
-	  dict_[target[0]][lookup(j,0)] = 1e-12;
+	  set_dict_entry(target[0],lookup(j,0),1e-12);
       }
     }
   }
 
 
   /*** check if respective distortion table is present. If not, create one from the parameters ***/
+  // The tables of the lengths that were present do not change, and the new ones are the same whichever sentence pair
+  // needs them first. So this is not recorded as a change of the model
 
   int oldJ = (cept_start_prob_.zDim() + 1) / 2;
 
@@ -3261,8 +3449,6 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
   if (oldJ < int(J)) {
     update = true;
 
-    inter_distortion_cache_.resize(J+1);
-
     //inter params
     IBM4CeptStartModel new_param(cept_start_prob_.xDim(),cept_start_prob_.yDim(),2*J-1,1e-8,MAKENAME(new_param));
     uint new_zero_offset = J-1;
@@ -3343,6 +3529,12 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
   /*** check if fertility tables are large enough ***/
   for (uint i=0; i < I; i++) {
 
+    const Math1D::Vector<double>& cur_fertility = fertility_prob_[target[i]];
+    if (cur_fertility.size() >= J+1 && cur_fertility[fertility[i+1]] >= 1e-8 && cur_fertility.sum() >= 0.5)
+      continue;
+
+    save_fertilities(target[i]);
+
     if (fertility_prob_[target[i]].size() < J+1)
       fertility_prob_[target[i]].resize(J+1,1e-15);
 
@@ -3366,20 +3558,50 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
 
     if (sum < 1e-100) {
       for (uint i=0; i < I; i++)
-        dict_[target[i]][lookup(j,i)] = 1e-15;
+        set_dict_entry(target[i],lookup(j,i),1e-15);
     }
 
     uint aj = alignment[j];
     if (aj == 0) {
       if (dict_[0][src_idx-1] < 1e-20)
-        dict_[0][src_idx-1] = 1e-20;
+        set_dict_entry(0,src_idx-1,1e-20);
     }
     else {
       if (dict_[target[aj-1]][lookup(j,aj-1)] < 1e-20)
-        dict_[target[aj-1]][lookup(j,aj-1)] = 1e-20;
+        set_dict_entry(target[aj-1],lookup(j,aj-1),1e-20);
     }
   }
 
+  //one cache per thread that may call compute_prepared_alignment()
+  if (inter_distortion_cache_.size() < nThreads_)
+    init_inter_distortion_cache(nThreads_);
+}
+
+void IBM4Trainer::record_model_changes() {
+
+  record_changes_ = true;
+  model_changes_ = ExternalModelChanges();
+  saved_p_zero_ = p_zero_;
+}
+
+void IBM4Trainer::restore_model() {
+
+  restore_dict_and_fertilities();
+
+  p_zero_ = saved_p_zero_;
+}
+
+long double IBM4Trainer::compute_prepared_alignment(const SentenceView& source, const SentenceView& target,
+                                                    const SingleLookupTable& lookup,
+                                                    Math1D::Vector<AlignBaseType>& alignment) {
+
+  const uint J = source.size();
+  const uint I = target.size();
+
+  Math1D::Vector<uint> fertility(I+1,0);
+  for (uint j=0; j < J; j++)
+    fertility[alignment[j]]++;
+
   //create matrices
   Math2D::Matrix<long double> expansion_prob(J,I+1);
   Math2D::Matrix<long double> swap_prob(J,J);
@@ -3392,7 +3614,7 @@ long double IBM4Trainer::compute_external_alignment(const Storage1D<uint>& sourc
 
 // <code> start_alignment </code> is used as initialization for hillclimbing and later modified
 // the extracted alignment is written to <code> postdec_alignment </code>
-void IBM4Trainer::compute_external_postdec_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+void IBM4Trainer::compute_external_postdec_alignment(const SentenceView& source, const SentenceView& target,
 						     const SingleLookupTable& lookup,
 						     Math1D::Vector<AlignBaseType>& alignment,
 						     std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
@@ -3444,8 +3666,6 @@ void IBM4Trainer::compute_external_postdec_alignment(const Storage1D<uint>& sour
   if (oldJ < int(J)) {
     update = true;
 
-    inter_distortion_cache_.resize(J+1);
-
     //inter params
     IBM4CeptStartModel new_param(cept_start_prob_.xDim(),cept_start_prob_.yDim(),2*J-1,1e-8,MAKENAME(new_param));
     uint new_zero_offset = J-1;
@@ -3628,46 +3848,127 @@ void IBM4Trainer::compute_external_postdec_alignment(const Storage1D<uint>& sour
 DistortCount::DistortCount(uchar J, uchar j, uchar j_prev)
   : J_(J), j_(j), j_prev_(j_prev) {}
 
-bool operator<(const DistortCount& d1, const DistortCount& d2) {
-  if (d1.J_ != d2.J_)
-    return (d1.J_ < d2.J_);
-  if (d1.j_ != d2.j_)
-    return (d1.j_ < d2.j_);
-  return (d1.j_prev_ < d2.j_prev_);
-}
+SparseDistortCountAccumulator::SparseDistortCountAccumulator() : log_capacity_(0), nEntries_(0) {}
 
-void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
+void SparseDistortCountAccumulator::add(uchar J, uchar j, uchar j_prev, double count) {
 
-  std::cerr << "starting IBM-4 training without constraints";
-  if (ibm3 != 0)
-    std::cerr << " (init from IBM-3) ";
-  std::cerr << std::endl;
+  assert(J > 0);
 
+  if (2*(nEntries_+1) > key_.size())
+    grow();
 
-  double max_perplexity = 0.0;
-  double approx_sum_perplexity = 0.0;
+  //the ordering of the packed keys is the ordering by (J, j, j_prev)
+  const uint key = (uint(J) << 16) | (uint(j) << 8) | uint(j_prev);
+  const uint mask = key_.size() - 1;
 
-  IBM4CeptStartModel fceptstart_count(cept_start_prob_.xDim(),cept_start_prob_.yDim(),2*maxJ_-1,MAKENAME(fceptstart_count));
-  IBM4WithinCeptModel fwithincept_count(within_cept_prob_.xDim(),within_cept_prob_.yDim(),MAKENAME(fwithincept_count));
-  Math1D::NamedVector<double> fsentence_start_count(maxJ_,MAKENAME(fsentence_start_count));
+  uint pos = (key * 2654435761u) >> (32 - log_capacity_);
+  while (key_[pos] != 0 && key_[pos] != key)
+    pos = (pos + 1) & mask;
 
-  Storage1D<Storage2D<Math2D::Matrix<double> > > inter_distort_count(maxJ_+1);
-  Storage1D<Math3D::Tensor<double> > intra_distort_count(maxJ_+1);
-  
-  Storage1D<Math1D::Vector<double> > sentence_start_count(maxJ_+1);
+  if (key_[pos] == 0) {
+    key_[pos] = key;
+    nEntries_++;
+  }
+  value_[pos] += count;
+}
 
-  SingleLookupTable aux_lookup;
+void SparseDistortCountAccumulator::add(const SparseDistortCountAccumulator& other) {
 
-  for (uint J=1; J <= maxJ_; J++) {
+  for (size_t k=0; k < other.key_.size(); k++) {
 
-    if (reduce_deficiency_) {
-      inter_distort_count[J].resize(inter_distortion_prob_[J].xDim(),inter_distortion_prob_[J].yDim());
+    const uint key = other.key_[k];
+    if (key != 0)
+      add(key >> 16, (key >> 8) & 255, key & 255, other.value_[k]);
+  }
+}
 
-      for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          inter_distort_count[J](x,y).resize(inter_distortion_prob_[J](x,y).xDim(),inter_distortion_prob_[J](x,y).yDim(),0.0);
+void SparseDistortCountAccumulator::grow() {
 
-      intra_distort_count[J].resize(intra_distortion_prob_[J].xDim(),intra_distortion_prob_[J].yDim(),
+  std::vector<uint> old_key;
+  std::vector<double> old_value;
+  old_key.swap(key_);
+  old_value.swap(value_);
+
+  log_capacity_ = std::max<uint>(6,log_capacity_+1);
+  key_.resize(size_t(1) << log_capacity_,0);
+  value_.resize(key_.size(),0.0);
+  nEntries_ = 0;
+
+  const uint mask = key_.size() - 1;
+
+  for (size_t k=0; k < old_key.size(); k++) {
+
+    const uint key = old_key[k];
+    if (key != 0) {
+
+      uint pos = (key * 2654435761u) >> (32 - log_capacity_);
+      while (key_[pos] != 0)
+        pos = (pos + 1) & mask;
+
+      key_[pos] = key;
+      value_[pos] = old_value[k];
+      nEntries_++;
+    }
+  }
+}
+
+void SparseDistortCountAccumulator::compact() {
+
+  std::vector<std::pair<uint,double> > sorted;
+  sorted.reserve(nEntries_);
+  for (size_t k=0; k < key_.size(); k++) {
+    if (key_[k] != 0)
+      sorted.push_back(std::make_pair(key_[k],value_[k]));
+  }
+  std::sort(sorted.begin(),sorted.end());
+
+  counts_.clear();
+  counts_.reserve(sorted.size());
+  for (size_t k=0; k < sorted.size(); k++) {
+    const uint key = sorted[k].first;
+    counts_.push_back(std::make_pair(DistortCount(key >> 16, (key >> 8) & 255, key & 255),sorted[k].second));
+  }
+
+  std::vector<uint>().swap(key_);
+  std::vector<double>().swap(value_);
+  log_capacity_ = 0;
+  nEntries_ = 0;
+}
+
+const std::vector<std::pair<DistortCount,double> >& SparseDistortCountAccumulator::counts() const {
+  return counts_;
+}
+
+void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
+
+  std::cerr << "starting IBM-4 training without constraints";
+  if (ibm3 != 0)
+    std::cerr << " (init from IBM-3) ";
+  std::cerr << std::endl;
+
+
+  double max_perplexity = 0.0;
+  double approx_sum_perplexity = 0.0;
+
+  IBM4CeptStartModel fceptstart_count(cept_start_prob_.xDim(),cept_start_prob_.yDim(),2*maxJ_-1,MAKENAME(fceptstart_count));
+  IBM4WithinCeptModel fwithincept_count(within_cept_prob_.xDim(),within_cept_prob_.yDim(),MAKENAME(fwithincept_count));
+  Math1D::NamedVector<double> fsentence_start_count(maxJ_,MAKENAME(fsentence_start_count));
+
+  Storage1D<Storage2D<Math2D::Matrix<double> > > inter_distort_count(maxJ_+1);
+  Storage1D<Math3D::Tensor<double> > intra_distort_count(maxJ_+1);
+  
+  Storage1D<Math1D::Vector<double> > sentence_start_count(maxJ_+1);
+
+  for (uint J=1; J <= maxJ_; J++) {
+
+    if (reduce_deficiency_) {
+      inter_distort_count[J].resize(inter_distortion_prob_[J].xDim(),inter_distortion_prob_[J].yDim());
+
+      for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
+        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
+          inter_distort_count[J](x,y).resize(inter_distortion_prob_[J](x,y).xDim(),inter_distortion_prob_[J](x,y).yDim(),0.0);
+
+      intra_distort_count[J].resize(intra_distortion_prob_[J].xDim(),intra_distortion_prob_[J].yDim(),
                                     intra_distortion_prob_[J].zDim(),0.0);
     }
     
@@ -3695,594 +3996,709 @@ void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
   double hillclimbtime = 0.0;
   double countcollecttime = 0.0;
 
+  const uint nThreads = nThreads_;
+  init_inter_distortion_cache(nThreads);
+
+  //each thread handles one block of the schedule and collects into its own count shard
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads,sort_by_length_,stream_chunk_size_);
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Math3D::Tensor<double> > fceptstart_count_shard(nThreads-1);
+  Storage1D<Math2D::Matrix<double> > fwithincept_count_shard(nThreads-1);
+  Storage1D<Math1D::Vector<double> > fsentence_start_count_shard(nThreads-1);
+  Storage1D<Storage1D<Storage2D<Math2D::Matrix<double> > > > inter_distort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math3D::Tensor<double> > > intra_distort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > sentence_start_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > ffert_count_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fceptstart_count_shard[t] = fceptstart_count;
+    fwithincept_count_shard[t] = fwithincept_count;
+    fsentence_start_count_shard[t] = fsentence_start_count;
+    inter_distort_count_shard[t] = inter_distort_count;
+    intra_distort_count_shard[t] = intra_distort_count;
+    sentence_start_count_shard[t] = sentence_start_count;
+    fwcount_shard[t] = fwcount;
+    ffert_count_shard[t] = ffert_count;
+  }
+
+  Storage1D<long double> fzero_count_shard(nThreads-1);
+  Storage1D<long double> fnonzero_count_shard(nThreads-1);
+  Math1D::Vector<double> max_perplexity_shard(nThreads-1);
+  Math1D::Vector<double> approx_sum_perplexity_shard(nThreads-1);
+  Math1D::Vector<uint> sum_iter_shard(nThreads-1);
+  Math1D::Vector<double> hillclimbtime_shard(nThreads-1);
+  Math1D::Vector<double> countcollecttime_shard(nThreads-1);
+
   for (uint iter=1; iter <= nIter; iter++) {
 
-    Storage2D<std::map<DistortCount,double> > sparse_inter_distort_count(nSourceClasses_,nTargetClasses_);
+    Storage2D<SparseDistortCountAccumulator> sparse_inter_distort_count;
+    Storage1D<Storage2D<SparseDistortCountAccumulator> > sparse_inter_distort_count_shard(nThreads-1);
 
     std::cerr << "******* IBM-4 EM-iteration " << iter << std::endl;
 
     uint sum_iter = 0;
 
-    fzero_count = 0.0;
-    fnonzero_count = 0.0;
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
+
+      Math3D::Tensor<double>& cur_fceptstart_count = (t == 0) ? fceptstart_count : fceptstart_count_shard[t-1];
+      Math2D::Matrix<double>& cur_fwithincept_count = (t == 0) ? fwithincept_count : fwithincept_count_shard[t-1];
+      Math1D::Vector<double>& cur_fsentence_start_count = (t == 0) ? fsentence_start_count : fsentence_start_count_shard[t-1];
+      Storage1D<Storage2D<Math2D::Matrix<double> > >& cur_inter_distort_count = 
+        (t == 0) ? inter_distort_count : inter_distort_count_shard[t-1];
+      Storage2D<SparseDistortCountAccumulator>& cur_sparse_inter_distort_count = 
+        (t == 0) ? sparse_inter_distort_count : sparse_inter_distort_count_shard[t-1];
+      Storage1D<Math3D::Tensor<double> >& cur_intra_distort_count = (t == 0) ? intra_distort_count : intra_distort_count_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_sentence_start_count = (t == 0) ? sentence_start_count : sentence_start_count_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_ffert_count = (t == 0) ? ffert_count : ffert_count_shard[t-1];
+
+      long double& cur_fzero_count = (t == 0) ? fzero_count : fzero_count_shard[t-1];
+      long double& cur_fnonzero_count = (t == 0) ? fnonzero_count : fnonzero_count_shard[t-1];
+      double& cur_max_perplexity = (t == 0) ? max_perplexity : max_perplexity_shard[t-1];
+      double& cur_approx_sum_perplexity = (t == 0) ? approx_sum_perplexity : approx_sum_perplexity_shard[t-1];
+      uint& cur_sum_iter = (t == 0) ? sum_iter : sum_iter_shard[t-1];
+      double& cur_hillclimbtime = (t == 0) ? hillclimbtime : hillclimbtime_shard[t-1];
+      double& cur_countcollecttime = (t == 0) ? countcollecttime : countcollecttime_shard[t-1];
+
+      cur_fzero_count = 0.0;
+      cur_fnonzero_count = 0.0;
+      cur_max_perplexity = 0.0;
+      cur_approx_sum_perplexity = 0.0;
+      cur_sum_iter = 0;
+      if (t != 0) {
+        cur_hillclimbtime = 0.0;
+        cur_countcollecttime = 0.0;
+      }
 
-    fceptstart_count.set_constant(0.0);
-    fwithincept_count.set_constant(0.0);
-    fsentence_start_count.set_constant(0.0);
+      cur_fceptstart_count.set_constant(0.0);
+      cur_fwithincept_count.set_constant(0.0);
+      cur_fsentence_start_count.set_constant(0.0);
 
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0.0);
-      ffert_count[i].set_constant(0.0);
-    }
+      for (uint i=0; i < nTargetWords; i++) {
+        cur_fwcount[i].set_constant(0.0);
+        cur_ffert_count[i].set_constant(0.0);
+      }
 
-    for (uint J=1; J <= maxJ_; J++) {
-      if (inter_distort_count[J].size() > 0) {
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-            inter_distort_count[J](x,y).set_constant(0.0);
+      for (uint J=1; J <= maxJ_; J++) {
+        if (cur_inter_distort_count[J].size() > 0) {
+          for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
+            for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
+              cur_inter_distort_count[J](x,y).set_constant(0.0);
+        }
+        cur_intra_distort_count[J].set_constant(0.0);
+        cur_sentence_start_count[J].set_constant(0.0);
       }
-      intra_distort_count[J].set_constant(0.0);
-      sentence_start_count[J].set_constant(0.0);
-    }
 
-    max_perplexity = 0.0;
-    approx_sum_perplexity = 0.0;
+      cur_sparse_inter_distort_count.resize(nSourceClasses_,nTargetClasses_);
 
-    for (size_t s=0; s < source_sentence_.size(); s++) {
+      WordLookupBuffers aux_lookup;
 
-      if ((s% 10000) == 0)
-        std::cerr << "sentence pair #" << s << std::endl;
+      //buffers for the hillclimbing, reused across the sentences of the block
+      Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
+      Math2D::NamedMatrix<long double> swap_move_prob(MAKENAME(swap_move_prob));
+      Math2D::NamedMatrix<long double> expansion_move_prob(MAKENAME(expansion_move_prob));
+      //for the hillclimbing of the IBM-3 in the first iteration
+      HillclimbingScores ibm3_hc_scores;
+
+      //buffers for the count collection
+      NamedStorage1D<std::set<int> > aligned_source_words(MAKENAME(aligned_source_words));
+      NamedStorage1D<std::set<int> > exp_aligned_source_words(MAKENAME(exp_aligned_source_words));
+      NamedStorage1D<std::set<int> > swap_aligned_source_words(MAKENAME(swap_aligned_source_words));
+      Math1D::NamedVector<int> cept_center(MAKENAME(cept_center));
+      //denotes the largest preceding target position that produces source words
+      Math1D::NamedVector<int> prev_cept(MAKENAME(prev_cept));
+      Math1D::NamedVector<int> first_aligned_source_word(MAKENAME(first_aligned_source_word));
+      Math1D::NamedVector<int> second_aligned_source_word(MAKENAME(second_aligned_source_word));
 
+      for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
 
-      if (nSourceClasses_*nTargetClasses_ >= 10 && (s%25) == 0) {
-        for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
+        const size_t s = schedule[k];
+        schedule.prefetch(t,k);
 
-          for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-            for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-              inter_distortion_prob_[J](x,y).resize(0,0);
-        }
-      }
+        if ((s% 10000) == 0)
+          std::cerr << "sentence pair #" << s << std::endl;
       
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
-      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                           nSourceWords_,slookup_[s],aux_lookup);
+        const SentenceView& cur_source = source_sentence_[s];
+        const SentenceView& cur_target = target_sentence_[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                             nSourceWords_,slookup_[s],aux_lookup);
       
-      const uint curI = cur_target.size();
-      const uint curJ = cur_source.size();
+        const uint curI = cur_target.size();
+        const uint curJ = cur_source.size();
 
-      Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
-
-      Math2D::NamedMatrix<long double> swap_move_prob(curJ,curJ,MAKENAME(swap_move_prob));
-      Math2D::NamedMatrix<long double> expansion_move_prob(curJ,curI+1,MAKENAME(expansion_move_prob));
+        fertility.resize_dirty(curI+1);
 
-      std::clock_t tHillclimbStart, tHillclimbEnd;
-      tHillclimbStart = std::clock();
+        std::clock_t tHillclimbStart, tHillclimbEnd;
+        tHillclimbStart = std::clock();
 
-      long double best_prob = 0.0;
+        long double best_prob = 0.0;
 
-      if (ibm3 != 0 && iter == 1) {
+        if (ibm3 != 0 && iter == 1) {
 
-        best_prob = ibm3->update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                           expansion_move_prob,swap_move_prob,best_known_alignment_[s]);	
-      }
-      else {
+          best_prob = ibm3->update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                             expansion_move_prob,swap_move_prob,ibm3_hc_scores,best_known_alignment_[s]);	
+        }
+        else {
         
-        best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                     expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
-      }
-      max_perplexity -= std::log(best_prob);
+          best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                       expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
+        }
+        cur_max_perplexity -= std::log(best_prob);
 
-      tHillclimbEnd = std::clock();
+        tHillclimbEnd = std::clock();
 
-      hillclimbtime += diff_seconds(tHillclimbEnd,tHillclimbStart);
+        cur_hillclimbtime += diff_seconds(tHillclimbEnd,tHillclimbStart);
 
-      const long double expansion_prob = expansion_move_prob.sum();
-      const long double swap_prob =  0.5 * swap_move_prob.sum();
+        const long double expansion_prob = expansion_move_prob.sum();
+        const long double swap_prob =  0.5 * swap_move_prob.sum();
 
-      const long double sentence_prob = best_prob + expansion_prob +  swap_prob;
+        const long double sentence_prob = best_prob + expansion_prob +  swap_prob;
 
-      approx_sum_perplexity -= std::log(sentence_prob);
+        cur_approx_sum_perplexity -= std::log(sentence_prob);
       
-      const long double inv_sentence_prob = 1.0 / sentence_prob;
+        const long double inv_sentence_prob = 1.0 / sentence_prob;
 
-      /**** update empty word counts *****/
+        /**** update empty word counts *****/
 	
-      double cur_zero_weight = best_prob;
-      for (uint j=0; j < curJ; j++) {
-        if (best_known_alignment_[s][j] == 0) {
+        double cur_zero_weight = best_prob;
+        for (uint j=0; j < curJ; j++) {
+          if (best_known_alignment_[s][j] == 0) {
 	  
-          for (uint jj=j+1; jj < curJ; jj++) {
-            if (best_known_alignment_[s][jj] != 0)
-              cur_zero_weight += swap_move_prob(j,jj);
+            for (uint jj=j+1; jj < curJ; jj++) {
+              if (best_known_alignment_[s][jj] != 0)
+                cur_zero_weight += swap_move_prob(j,jj);
+            }
           }
         }
-      }
-      cur_zero_weight *= inv_sentence_prob;
+        cur_zero_weight *= inv_sentence_prob;
 
-      assert(!isnan(cur_zero_weight));
-      assert(!isinf(cur_zero_weight));
+        assert(!isnan(cur_zero_weight));
+        assert(!isinf(cur_zero_weight));
       
-      fzero_count += cur_zero_weight * (fertility[0]);
-      fnonzero_count += cur_zero_weight * (curJ - 2*fertility[0]);
+        cur_fzero_count += cur_zero_weight * (fertility[0]);
+        cur_fnonzero_count += cur_zero_weight * (curJ - 2*fertility[0]);
 
-      if (curJ >= 2*(fertility[0]+1)) {
-        long double inc_zero_weight = 0.0;
-        for (uint j=0; j < curJ; j++)
-          inc_zero_weight += expansion_move_prob(j,0);
+        if (curJ >= 2*(fertility[0]+1)) {
+          long double inc_zero_weight = 0.0;
+          for (uint j=0; j < curJ; j++)
+            inc_zero_weight += expansion_move_prob(j,0);
 	
-        inc_zero_weight *= inv_sentence_prob;
-        fzero_count += inc_zero_weight * (fertility[0]+1);
-        fnonzero_count += inc_zero_weight * (curJ -2*(fertility[0]+1));
+          inc_zero_weight *= inv_sentence_prob;
+          cur_fzero_count += inc_zero_weight * (fertility[0]+1);
+          cur_fnonzero_count += inc_zero_weight * (curJ -2*(fertility[0]+1));
 
-        assert(!isnan(inc_zero_weight));
-        assert(!isinf(inc_zero_weight));
-      }
+          assert(!isnan(inc_zero_weight));
+          assert(!isinf(inc_zero_weight));
+        }
 
-      if (fertility[0] > 1) {
-        long double dec_zero_weight = 0.0;
-        for (uint j=0; j < curJ; j++) {
-          if (best_known_alignment_[s][j] == 0) {
-            for (uint i=1; i <= curI; i++)
-              dec_zero_weight += expansion_move_prob(j,i);
+        if (fertility[0] > 1) {
+          long double dec_zero_weight = 0.0;
+          for (uint j=0; j < curJ; j++) {
+            if (best_known_alignment_[s][j] == 0) {
+              for (uint i=1; i <= curI; i++)
+                dec_zero_weight += expansion_move_prob(j,i);
+            }
           }
-        }
       
-        dec_zero_weight *= inv_sentence_prob;
+          dec_zero_weight *= inv_sentence_prob;
 
-        fzero_count += dec_zero_weight * (fertility[0]-1);
-        fnonzero_count += dec_zero_weight * (curJ -2*(fertility[0]-1));
+          cur_fzero_count += dec_zero_weight * (fertility[0]-1);
+          cur_fnonzero_count += dec_zero_weight * (curJ -2*(fertility[0]-1));
 
-        assert(!isnan(dec_zero_weight));
-        assert(!isinf(dec_zero_weight));
-      }
+          assert(!isnan(dec_zero_weight));
+          assert(!isinf(dec_zero_weight));
+        }
 
-      /**** update fertility counts *****/
-      for (uint i=1; i <= curI; i++) {
+        /**** update fertility counts *****/
+        for (uint i=1; i <= curI; i++) {
 
-        const uint cur_fert = fertility[i];
-        const uint t_idx = cur_target[i-1];
+          const uint cur_fert = fertility[i];
+          const uint t_idx = cur_target[i-1];
 
-        long double addon = sentence_prob;
-        for (uint j=0; j < curJ; j++) {
-          if (best_known_alignment_[s][j] == i) {
-            for (uint ii=0; ii <= curI; ii++)
-              addon -= expansion_move_prob(j,ii);
+          long double addon = sentence_prob;
+          for (uint j=0; j < curJ; j++) {
+            if (best_known_alignment_[s][j] == i) {
+              for (uint ii=0; ii <= curI; ii++)
+                addon -= expansion_move_prob(j,ii);
+            }
+            else
+              addon -= expansion_move_prob(j,i);
           }
-          else
-            addon -= expansion_move_prob(j,i);
-        }
-        addon *= inv_sentence_prob;
+          addon *= inv_sentence_prob;
 
-        double daddon = (double) addon;
-        if (!(daddon > 0.0)) {
-          std::cerr << "STRANGE: fractional weight " << daddon << " for sentence pair #" << s << " with "
-                    << curJ << " source words and " << curI << " target words" << std::endl;
-          std::cerr << "best alignment prob: " << best_prob << std::endl;
-          std::cerr << "sentence prob: " << sentence_prob << std::endl;
-          std::cerr << "" << std::endl;
+          double daddon = (double) addon;
+          if (!(daddon > 0.0)) {
+            std::cerr << "STRANGE: fractional weight " << daddon << " for sentence pair #" << s << " with "
+                      << curJ << " source words and " << curI << " target words" << std::endl;
+            std::cerr << "best alignment prob: " << best_prob << std::endl;
+            std::cerr << "sentence prob: " << sentence_prob << std::endl;
+            std::cerr << "" << std::endl;
 
-          //DEBUG
-          exit(1);
-          //END_DEBUG
-        }
+            //DEBUG
+            exit(1);
+            //END_DEBUG
+          }
 
-        ffert_count[t_idx][cur_fert] += addon;
+          cur_ffert_count[t_idx][cur_fert] += addon;
 
-        //NOTE: swap moves do not change the fertilities
-        if (cur_fert > 0) {
-          long double alt_addon = 0.0;
-          for (uint j=0; j < curJ; j++) {
-            if (best_known_alignment_[s][j] == i) {
-              for (uint ii=0; ii <= curI; ii++) {
-                if (ii != i)
-                  alt_addon += expansion_move_prob(j,ii);
+          //NOTE: swap moves do not change the fertilities
+          if (cur_fert > 0) {
+            long double alt_addon = 0.0;
+            for (uint j=0; j < curJ; j++) {
+              if (best_known_alignment_[s][j] == i) {
+                for (uint ii=0; ii <= curI; ii++) {
+                  if (ii != i)
+                    alt_addon += expansion_move_prob(j,ii);
+                }
               }
             }
-          }
 
-          ffert_count[t_idx][cur_fert-1] += inv_sentence_prob * alt_addon;
-        }
+            cur_ffert_count[t_idx][cur_fert-1] += inv_sentence_prob * alt_addon;
+          }
 
-        if (cur_fert+1 < fertility_prob_[t_idx].size()) {
+          if (cur_fert+1 < fertility_prob_[t_idx].size()) {
 
-          long double alt_addon = 0.0;
-          for (uint j=0; j < curJ; j++) {
-            if (best_known_alignment_[s][j] != i) {
-              alt_addon += expansion_move_prob(j,i);
+            long double alt_addon = 0.0;
+            for (uint j=0; j < curJ; j++) {
+              if (best_known_alignment_[s][j] != i) {
+                alt_addon += expansion_move_prob(j,i);
+              }
             }
-          }
 
-          ffert_count[t_idx][cur_fert+1] += inv_sentence_prob * alt_addon;
+            cur_ffert_count[t_idx][cur_fert+1] += inv_sentence_prob * alt_addon;
+          }
         }
-      }
 
-      /**** update dictionary counts *****/
-      for (uint j=0; j < curJ; j++) {
+        /**** update dictionary counts *****/
+        for (uint j=0; j < curJ; j++) {
 
-        const uint s_idx = cur_source[j];
-        const uint cur_aj = best_known_alignment_[s][j];
+          const uint s_idx = cur_source[j];
+          const uint cur_aj = best_known_alignment_[s][j];
 
-        long double addon = sentence_prob;
-        for (uint i=0; i <= curI; i++) 
-          addon -= expansion_move_prob(j,i);
-        for (uint jj=0; jj < curJ; jj++)
-          addon -= swap_move_prob(j,jj);
+          long double addon = sentence_prob;
+          for (uint i=0; i <= curI; i++) 
+            addon -= expansion_move_prob(j,i);
+          for (uint jj=0; jj < curJ; jj++)
+            addon -= swap_move_prob(j,jj);
 
-        addon *= inv_sentence_prob;
-        if (cur_aj != 0) {
-          fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += addon;
-        }
-        else {
-          fwcount[0][s_idx-1] += addon;
-        }
+          addon *= inv_sentence_prob;
+          if (cur_aj != 0) {
+            cur_fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += addon;
+          }
+          else {
+            cur_fwcount[0][s_idx-1] += addon;
+          }
 
-        for (uint i=0; i <= curI; i++) {
+          for (uint i=0; i <= curI; i++) {
 
-          if (i != cur_aj) {
+            if (i != cur_aj) {
 
-            long double addon = expansion_move_prob(j,i);
-            for (uint jj=0; jj < curJ; jj++) {
-              if (best_known_alignment_[s][jj] == i)
-                addon += swap_move_prob(j,jj);
-            }
-            addon *= inv_sentence_prob;
+              long double addon = expansion_move_prob(j,i);
+              for (uint jj=0; jj < curJ; jj++) {
+                if (best_known_alignment_[s][jj] == i)
+                  addon += swap_move_prob(j,jj);
+              }
+              addon *= inv_sentence_prob;
 
-            if (i!=0) {
-              fwcount[cur_target[i-1]][cur_lookup(j,i-1)] += addon;
-            }
-            else {
-              fwcount[0][s_idx-1] += addon;
+              if (i!=0) {
+                cur_fwcount[cur_target[i-1]][cur_lookup(j,i-1)] += addon;
+              }
+              else {
+                cur_fwcount[0][s_idx-1] += addon;
+              }
             }
           }
         }
-      }
 
-      std::clock_t tCountCollectStart, tCountCollectEnd;
-      tCountCollectStart = std::clock();
+        std::clock_t tCountCollectStart, tCountCollectEnd;
+        tCountCollectStart = std::clock();
 
-      /**** update distortion counts *****/
-      NamedStorage1D<std::set<int> > aligned_source_words(curI+1,MAKENAME(aligned_source_words));
-      Math1D::NamedVector<int> cept_center(curI+1,-100,MAKENAME(cept_center));
+        /**** update distortion counts *****/
+        aligned_source_words.resize_dirty(curI+1);
+        for (uint i=0; i <= curI; i++)
+          aligned_source_words[i].clear();
 
-      //denotes the largest preceding target position that produces source words
-      Math1D::NamedVector<int> prev_cept(curI+1,-100,MAKENAME(prev_cept));
-      Math1D::NamedVector<int> first_aligned_source_word(curI+1,-100,
-                                                         MAKENAME(first_aligned_source_word));
-      Math1D::NamedVector<int> second_aligned_source_word(curI+1,-100,
-                                                          MAKENAME(second_aligned_source_word));
+        cept_center.resize_dirty(curI+1);
+        cept_center.set_constant(-100);
+        prev_cept.resize_dirty(curI+1);
+        prev_cept.set_constant(-100);
+        first_aligned_source_word.resize_dirty(curI+1);
+        first_aligned_source_word.set_constant(-100);
+        second_aligned_source_word.resize_dirty(curI+1);
+        second_aligned_source_word.set_constant(-100);
 
-      for (uint j=0; j < curJ; j++) {
-        const uint cur_aj = best_known_alignment_[s][j];
-        aligned_source_words[cur_aj].insert(j);	
-      }
+        for (uint j=0; j < curJ; j++) {
+          const uint cur_aj = best_known_alignment_[s][j];
+          aligned_source_words[cur_aj].insert(j);	
+        }
 
-      int cur_prev_cept = -100;
-      for (uint i=0; i <= curI; i++) {
+        int cur_prev_cept = -100;
+        for (uint i=0; i <= curI; i++) {
 
-        assert(aligned_source_words[i].size() == fertility[i]);
+          assert(aligned_source_words[i].size() == fertility[i]);
 
-        if (fertility[i] > 0) {
+          if (fertility[i] > 0) {
 	  
-          std::set<int>::iterator ait = aligned_source_words[i].begin();
-          first_aligned_source_word[i] = *ait;
+            std::set<int>::iterator ait = aligned_source_words[i].begin();
+            first_aligned_source_word[i] = *ait;
 
-          if (fertility[i] > 1) {
-            ait++;
-            second_aligned_source_word[i] = *ait;
-          } 	    
-
-          switch (cept_start_mode_) {
-          case IBM4CENTER: {
-	    double sum = 0.0;
-	    for (std::set<int>::iterator ait = aligned_source_words[i].begin(); ait != aligned_source_words[i].end(); ait++) {
-	      sum += *ait;
+            if (fertility[i] > 1) {
+              ait++;
+              second_aligned_source_word[i] = *ait;
+            } 	    
+
+            switch (cept_start_mode_) {
+            case IBM4CENTER: {
+	      double sum = 0.0;
+	      for (std::set<int>::iterator ait = aligned_source_words[i].begin(); ait != aligned_source_words[i].end(); ait++) {
+		sum += *ait;
+	      }
+              cept_center[i] = (int) round(sum / fertility[i]);
+              break;
 	    }
-            cept_center[i] = (int) round(sum / fertility[i]);
-            break;
-	  }
-          case IBM4FIRST:
-            cept_center[i] = first_aligned_source_word[i];
-            break;
-          case IBM4LAST: {
-            std::set<int>::iterator ait = aligned_source_words[i].end();
-            ait--;
-            cept_center[i] = *ait;
-            break;
-          }
-          case IBM4UNIFORM:
-	    cept_center[i] = first_aligned_source_word[i];
-            break;
-          default:
-            assert(false);
-          }
+            case IBM4FIRST:
+              cept_center[i] = first_aligned_source_word[i];
+              break;
+            case IBM4LAST: {
+              std::set<int>::iterator ait = aligned_source_words[i].end();
+              ait--;
+              cept_center[i] = *ait;
+              break;
+            }
+            case IBM4UNIFORM:
+	      cept_center[i] = first_aligned_source_word[i];
+              break;
+            default:
+              assert(false);
+            }
 
-          prev_cept[i] = cur_prev_cept;
-          cur_prev_cept = i;
+            prev_cept[i] = cur_prev_cept;
+            cur_prev_cept = i;
+          }
         }
-      }
 
-      // 1. handle viterbi alignment
-      for (uint i=1; i <= curI; i++) {
+        // 1. handle viterbi alignment
+        for (uint i=1; i <= curI; i++) {
 
-        const uint tclass = target_class_[ cur_target[i-1] ];
+          const uint tclass = target_class_[ cur_target[i-1] ];
 
-        const long double cur_prob = inv_sentence_prob * best_prob;
+          const long double cur_prob = inv_sentence_prob * best_prob;
 	
-        if (fertility[i] > 0) {
+          if (fertility[i] > 0) {
           
-          const int cur_prev_cept = prev_cept[i];
+            const int cur_prev_cept = prev_cept[i];
 	  
-          //a) update head prob
-          if (cur_prev_cept >= 0) {
+            //a) update head prob
+            if (cur_prev_cept >= 0) {
 
-            const uint prev_cept_center = cept_center[cur_prev_cept];
+              const uint prev_cept_center = cept_center[cur_prev_cept];
             
-            const uint sclass = source_class_[ cur_source[prev_cept_center]  ];
+              const uint sclass = source_class_[ cur_source[prev_cept_center]  ];
 
-            int diff = first_aligned_source_word[i] - prev_cept_center;
-            diff += displacement_offset_;
+              int diff = first_aligned_source_word[i] - prev_cept_center;
+              diff += displacement_offset_;
 
-            fceptstart_count(sclass,tclass,diff) += cur_prob;
+              cur_fceptstart_count(sclass,tclass,diff) += cur_prob;
 
-            if (reduce_deficiency_) {
-              if (inter_distort_count[curJ].size() == 0 || inter_distort_count[curJ](sclass,tclass).size() == 0)
-                sparse_inter_distort_count(sclass,tclass)[DistortCount(curJ,first_aligned_source_word[i],prev_cept_center)] += cur_prob;
-              else
-                inter_distort_count[curJ](sclass,tclass)(first_aligned_source_word[i],prev_cept_center) += cur_prob;
+              if (reduce_deficiency_) {
+                if (cur_inter_distort_count[curJ].size() == 0 || cur_inter_distort_count[curJ](sclass,tclass).size() == 0)
+                  cur_sparse_inter_distort_count(sclass,tclass).add(curJ,first_aligned_source_word[i],prev_cept_center,cur_prob);
+                else
+                  cur_inter_distort_count[curJ](sclass,tclass)(first_aligned_source_word[i],prev_cept_center) += cur_prob;
+              }
+            }
+            else if (use_sentence_start_prob_) {
+              cur_fsentence_start_count[first_aligned_source_word[i]] += cur_prob;
+              cur_sentence_start_count[curJ][first_aligned_source_word[i]] += cur_prob;
             }
-          }
-          else if (use_sentence_start_prob_) {
-            fsentence_start_count[first_aligned_source_word[i]] += cur_prob;
-            sentence_start_count[curJ][first_aligned_source_word[i]] += cur_prob;
-          }
 
-          //b) update within-cept prob
-          int prev_aligned_j = first_aligned_source_word[i];
-          std::set<int>::iterator ait = aligned_source_words[i].begin();
-          ait++;
-          for (;ait != aligned_source_words[i].end(); ait++) {
+            //b) update within-cept prob
+            int prev_aligned_j = first_aligned_source_word[i];
+            std::set<int>::iterator ait = aligned_source_words[i].begin();
+            ait++;
+            for (;ait != aligned_source_words[i].end(); ait++) {
 
-            const int cur_j = *ait;
-            int diff = cur_j - prev_aligned_j;
-            fwithincept_count(tclass,diff) += cur_prob;
+              const int cur_j = *ait;
+              int diff = cur_j - prev_aligned_j;
+              cur_fwithincept_count(tclass,diff) += cur_prob;
 
-            if (reduce_deficiency_)
-              intra_distort_count[curJ](tclass,cur_j,prev_aligned_j) += cur_prob;
+              if (reduce_deficiency_)
+                cur_intra_distort_count[curJ](tclass,cur_j,prev_aligned_j) += cur_prob;
 
-            prev_aligned_j = cur_j;
+              prev_aligned_j = cur_j;
+            }
           }
         }
-      }
 
-      // 2. handle expansion moves
-      NamedStorage1D<std::set<int> > exp_aligned_source_words(MAKENAME(exp_aligned_source_words));
-      exp_aligned_source_words = aligned_source_words;
+        // 2. handle expansion moves
+        exp_aligned_source_words.resize_dirty(curI+1);
+        exp_aligned_source_words = aligned_source_words;
 
-      for (uint exp_j=0; exp_j < curJ; exp_j++) {
+        for (uint exp_j=0; exp_j < curJ; exp_j++) {
 
-        const uint cur_aj = best_known_alignment_[s][exp_j];
+          const uint cur_aj = best_known_alignment_[s][exp_j];
 
-        for (uint exp_i=0; exp_i <= curI; exp_i++) {
+          for (uint exp_i=0; exp_i <= curI; exp_i++) {
 
-          long double cur_prob = expansion_move_prob(exp_j,exp_i);
+            long double cur_prob = expansion_move_prob(exp_j,exp_i);
 
-          if (cur_prob > best_prob * 1e-11) {
+            if (cur_prob > best_prob * 1e-11) {
 
-            cur_prob *= inv_sentence_prob;
+              cur_prob *= inv_sentence_prob;
 	    
-	    //modify
-            exp_aligned_source_words[cur_aj].erase(exp_j);
-            exp_aligned_source_words[exp_i].insert(exp_j);
+	      //modify
+              exp_aligned_source_words[cur_aj].erase(exp_j);
+              exp_aligned_source_words[exp_i].insert(exp_j);
 	    
-            int prev_center = -100;
+              int prev_center = -100;
 	    
-            for (uint i=1; i <= curI; i++) {
+              for (uint i=1; i <= curI; i++) {
 	    
-              if (!exp_aligned_source_words[i].empty()) {
+                if (!exp_aligned_source_words[i].empty()) {
 
-                const uint tclass = target_class_[cur_target[i-1]];
+                  const uint tclass = target_class_[cur_target[i-1]];
                 
-                double sum_j = 0;
-                uint nAlignedWords = 0;
+                  double sum_j = 0;
+                  uint nAlignedWords = 0;
 
-                std::set<int>::iterator ait = exp_aligned_source_words[i].begin();
-                const int first_j = *ait;
-                sum_j += *ait;
-                nAlignedWords++;
+                  std::set<int>::iterator ait = exp_aligned_source_words[i].begin();
+                  const int first_j = *ait;
+                  sum_j += *ait;
+                  nAlignedWords++;
 		
-                //collect counts for the head model
-                if (prev_center >= 0) {
-                  const uint sclass = source_class_[ cur_source[prev_center] ];
-
-                  int diff =  first_j - prev_center;
-                  diff += displacement_offset_;
-                  fceptstart_count(sclass,tclass,diff) += cur_prob;
-
-                  if (reduce_deficiency_) {
-                    if (inter_distort_count[curJ].size() == 0 || inter_distort_count[curJ](sclass,tclass).size() == 0)
-                      sparse_inter_distort_count(sclass,tclass)[DistortCount(curJ,first_j,prev_center)] += cur_prob;
-                    else
-                      inter_distort_count[curJ](sclass,tclass)(first_j,prev_center) += cur_prob;
+                  //collect counts for the head model
+                  if (prev_center >= 0) {
+                    const uint sclass = source_class_[ cur_source[prev_center] ];
+
+                    int diff =  first_j - prev_center;
+                    diff += displacement_offset_;
+                    cur_fceptstart_count(sclass,tclass,diff) += cur_prob;
+
+                    if (reduce_deficiency_) {
+                      if (cur_inter_distort_count[curJ].size() == 0 || cur_inter_distort_count[curJ](sclass,tclass).size() == 0)
+                        cur_sparse_inter_distort_count(sclass,tclass).add(curJ,first_j,prev_center,cur_prob);
+                      else
+                        cur_inter_distort_count[curJ](sclass,tclass)(first_j,prev_center) += cur_prob;
+                    }
+                  }
+                  else if (use_sentence_start_prob_) {
+                    cur_fsentence_start_count[first_j] += cur_prob;
+                    cur_sentence_start_count[curJ][first_j] += cur_prob;
                   }
-                }
-                else if (use_sentence_start_prob_) {
-                  fsentence_start_count[first_j] += cur_prob;
-                  sentence_start_count[curJ][first_j] += cur_prob;
-                }
 
-                //collect counts for the within-cept model
-                int prev_j = first_j;
-                for (ait++; ait != exp_aligned_source_words[i].end(); ait++) {
+                  //collect counts for the within-cept model
+                  int prev_j = first_j;
+                  for (ait++; ait != exp_aligned_source_words[i].end(); ait++) {
 
-                  const int cur_j = *ait;
-                  sum_j += cur_j;
-                  nAlignedWords++;
+                    const int cur_j = *ait;
+                    sum_j += cur_j;
+                    nAlignedWords++;
 
-                  int diff = cur_j - prev_j;
-                  fwithincept_count(tclass,diff) += cur_prob;
+                    int diff = cur_j - prev_j;
+                    cur_fwithincept_count(tclass,diff) += cur_prob;
 
-                  if (reduce_deficiency_)
-                    intra_distort_count[curJ](tclass,cur_j,prev_j) += cur_prob;
+                    if (reduce_deficiency_)
+                      cur_intra_distort_count[curJ](tclass,cur_j,prev_j) += cur_prob;
 
-                  prev_j = cur_j;
-                }
+                    prev_j = cur_j;
+                  }
 
-                //update prev_center
-                switch (cept_start_mode_) {
-                case IBM4CENTER:
-                  prev_center = (int) round(sum_j / nAlignedWords);
-                  break;
-                case IBM4FIRST:
-                  prev_center = first_j;
-                  break;
-                case IBM4LAST:
-                  prev_center = prev_j;
-                  break;
-                case IBM4UNIFORM:
-                  prev_center = (int) round(sum_j / nAlignedWords);
-                  break;
-                default:
-                  assert(false);
+                  //update prev_center
+                  switch (cept_start_mode_) {
+                  case IBM4CENTER:
+                    prev_center = (int) round(sum_j / nAlignedWords);
+                    break;
+                  case IBM4FIRST:
+                    prev_center = first_j;
+                    break;
+                  case IBM4LAST:
+                    prev_center = prev_j;
+                    break;
+                  case IBM4UNIFORM:
+                    prev_center = (int) round(sum_j / nAlignedWords);
+                    break;
+                  default:
+                    assert(false);
+                  }
                 }
-              }
-	    }
+	      }
 
-	    //restore
-            //exp_aligned_source_words[cur_aj].insert(exp_j);
-            //exp_aligned_source_words[exp_i].erase(exp_j);
-            exp_aligned_source_words[cur_aj] = aligned_source_words[cur_aj];
-            exp_aligned_source_words[exp_i] = aligned_source_words[exp_i];
+	      //restore
+              //exp_aligned_source_words[cur_aj].insert(exp_j);
+              //exp_aligned_source_words[exp_i].erase(exp_j);
+              exp_aligned_source_words[cur_aj] = aligned_source_words[cur_aj];
+              exp_aligned_source_words[exp_i] = aligned_source_words[exp_i];
 
+            }
           }
         }
-      }
       
-      //3. handle swap moves
-      NamedStorage1D<std::set<int> > swap_aligned_source_words(MAKENAME(swap_aligned_source_words));
-      swap_aligned_source_words = aligned_source_words;
+        //3. handle swap moves
+        swap_aligned_source_words.resize_dirty(curI+1);
+        swap_aligned_source_words = aligned_source_words;
 
-      for (uint swap_j1 = 0; swap_j1 < curJ; swap_j1++) {
+        for (uint swap_j1 = 0; swap_j1 < curJ; swap_j1++) {
 
-        const uint aj1 = best_known_alignment_[s][swap_j1];
+          const uint aj1 = best_known_alignment_[s][swap_j1];
 
-        for (uint swap_j2 = 0; swap_j2 < curJ; swap_j2++) {
+          for (uint swap_j2 = 0; swap_j2 < curJ; swap_j2++) {
 	  
-          long double cur_prob = swap_move_prob(swap_j1, swap_j2);
+            long double cur_prob = swap_move_prob(swap_j1, swap_j2);
 
-          if (cur_prob > best_prob * 1e-11) {
+            if (cur_prob > best_prob * 1e-11) {
 
-            cur_prob *= inv_sentence_prob;
+              cur_prob *= inv_sentence_prob;
 
-            const uint aj2 = best_known_alignment_[s][swap_j2];
+              const uint aj2 = best_known_alignment_[s][swap_j2];
 
-	    //modify
-            swap_aligned_source_words[aj1].erase(swap_j1);
-            swap_aligned_source_words[aj1].insert(swap_j2);
-            swap_aligned_source_words[aj2].erase(swap_j2);
-            swap_aligned_source_words[aj2].insert(swap_j1);
+	      //modify
+              swap_aligned_source_words[aj1].erase(swap_j1);
+              swap_aligned_source_words[aj1].insert(swap_j2);
+              swap_aligned_source_words[aj2].erase(swap_j2);
+              swap_aligned_source_words[aj2].insert(swap_j1);
 
-            int prev_center = -100;
+              int prev_center = -100;
 	    
-            for (uint i=1; i <= curI; i++) {
+              for (uint i=1; i <= curI; i++) {
 	    
-              if (!swap_aligned_source_words[i].empty()) {
+                if (!swap_aligned_source_words[i].empty()) {
 
-                const uint tclass = target_class_[cur_target[i-1]];
+                  const uint tclass = target_class_[cur_target[i-1]];
 
-                double sum_j = 0;
-                uint nAlignedWords = 0;
+                  double sum_j = 0;
+                  uint nAlignedWords = 0;
 
-                std::set<int>::iterator ait = swap_aligned_source_words[i].begin();
-                const int first_j = *ait;
-                sum_j += *ait;
-                nAlignedWords++;
+                  std::set<int>::iterator ait = swap_aligned_source_words[i].begin();
+                  const int first_j = *ait;
+                  sum_j += *ait;
+                  nAlignedWords++;
 		
-                //collect counts for the head model
-                if (prev_center >= 0) {
+                  //collect counts for the head model
+                  if (prev_center >= 0) {
 
-                  const uint sclass = source_class_[ cur_source[prev_center] ];
+                    const uint sclass = source_class_[ cur_source[prev_center] ];
 
-                  int diff =  first_j - prev_center;
-                  diff += displacement_offset_;
-                  fceptstart_count(sclass,tclass,diff) += cur_prob;
+                    int diff =  first_j - prev_center;
+                    diff += displacement_offset_;
+                    cur_fceptstart_count(sclass,tclass,diff) += cur_prob;
 
-                  if (reduce_deficiency_) {
-                    if (inter_distort_count[curJ].size() == 0 || inter_distort_count[curJ](sclass,tclass).size() == 0)
-                      sparse_inter_distort_count(sclass,tclass)[DistortCount(curJ,first_j,prev_center)] += cur_prob;
-                    else
-                      inter_distort_count[curJ](sclass,tclass)(first_j,prev_center) += cur_prob;
+                    if (reduce_deficiency_) {
+                      if (cur_inter_distort_count[curJ].size() == 0 || cur_inter_distort_count[curJ](sclass,tclass).size() == 0)
+                        cur_sparse_inter_distort_count(sclass,tclass).add(curJ,first_j,prev_center,cur_prob);
+                      else
+                        cur_inter_distort_count[curJ](sclass,tclass)(first_j,prev_center) += cur_prob;
+                    }
+                  }
+                  else if (use_sentence_start_prob_) {
+                    cur_fsentence_start_count[first_j] += cur_prob;
+                    cur_sentence_start_count[curJ][first_j] += cur_prob;
                   }
-                }
-                else if (use_sentence_start_prob_) {
-                  fsentence_start_count[first_j] += cur_prob;
-                  sentence_start_count[curJ][first_j] += cur_prob;
-                }
 		
-                //collect counts for the within-cept model
-                int prev_j = first_j;
-                for (ait++; ait != swap_aligned_source_words[i].end(); ait++) {
+                  //collect counts for the within-cept model
+                  int prev_j = first_j;
+                  for (ait++; ait != swap_aligned_source_words[i].end(); ait++) {
 
-                  const int cur_j = *ait;
-                  sum_j += cur_j;
-                  nAlignedWords++;
+                    const int cur_j = *ait;
+                    sum_j += cur_j;
+                    nAlignedWords++;
 
-                  int diff = cur_j - prev_j;
-                  fwithincept_count(tclass,diff) += cur_prob;
+                    int diff = cur_j - prev_j;
+                    cur_fwithincept_count(tclass,diff) += cur_prob;
 
-                  if (reduce_deficiency_)
-                    intra_distort_count[curJ](tclass,cur_j,prev_j) += cur_prob;
+                    if (reduce_deficiency_)
+                      cur_intra_distort_count[curJ](tclass,cur_j,prev_j) += cur_prob;
 
-                  prev_j = cur_j;
-                }
+                    prev_j = cur_j;
+                  }
 
-                //update prev_center
-                switch (cept_start_mode_) {
-                case IBM4CENTER:
-                  prev_center = (int) round(sum_j / nAlignedWords);
-                  break;
-                case IBM4FIRST:
-                  prev_center = first_j;
-                  break;
-                case IBM4LAST:
-                  prev_center = prev_j;
-                  break;
-                case IBM4UNIFORM:
-                  prev_center = (int) round(sum_j / nAlignedWords);
-                  break;
-                default:
-                  assert(false);
+                  //update prev_center
+                  switch (cept_start_mode_) {
+                  case IBM4CENTER:
+                    prev_center = (int) round(sum_j / nAlignedWords);
+                    break;
+                  case IBM4FIRST:
+                    prev_center = first_j;
+                    break;
+                  case IBM4LAST:
+                    prev_center = prev_j;
+                    break;
+                  case IBM4UNIFORM:
+                    prev_center = (int) round(sum_j / nAlignedWords);
+                    break;
+                  default:
+                    assert(false);
+                  }
                 }
-              }
-	    }
+	      }
 
-	    //restore
-            swap_aligned_source_words[aj1] = aligned_source_words[aj1];
-	    swap_aligned_source_words[aj2] = aligned_source_words[aj2];
+	      //restore
+              swap_aligned_source_words[aj1] = aligned_source_words[aj1];
+	      swap_aligned_source_words[aj2] = aligned_source_words[aj2];
+            }
           }
         }
-      }
 
       
-      tCountCollectEnd = std::clock();
-      countcollecttime += diff_seconds(tCountCollectEnd,tCountCollectStart);
+        tCountCollectEnd = std::clock();
+        cur_countcollecttime += diff_seconds(tCountCollectEnd,tCountCollectStart);
 
+      } //loop over sentences finished
+    }
 
-      //clean up cache
-      for (uint j=0; j < inter_distortion_cache_[curJ].size(); j++)
-        inter_distortion_cache_[curJ][j].clear();
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    for (uint t=1; t < nThreads; t++) {
 
-    } //loop over sentences finished
+      fzero_count += fzero_count_shard[t-1];
+      fnonzero_count += fnonzero_count_shard[t-1];
+      max_perplexity += max_perplexity_shard[t-1];
+      approx_sum_perplexity += approx_sum_perplexity_shard[t-1];
+      sum_iter += sum_iter_shard[t-1];
+      hillclimbtime += hillclimbtime_shard[t-1];
+      countcollecttime += countcollecttime_shard[t-1];
 
-    if (nSourceClasses_*nTargetClasses_ >= 10) {
-      for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
-        
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-            inter_distortion_prob_[J](x,y).resize(0,0);
+      fceptstart_count += fceptstart_count_shard[t-1];
+      fwithincept_count += fwithincept_count_shard[t-1];
+      fsentence_start_count += fsentence_start_count_shard[t-1];
+
+      for (uint J=1; J <= maxJ_; J++) {
+        for (uint y=0; y < inter_distort_count[J].yDim(); y++)
+          for (uint x=0; x < inter_distort_count[J].xDim(); x++)
+            inter_distort_count[J](x,y) += inter_distort_count_shard[t-1][J](x,y);
+
+        intra_distort_count[J] += intra_distort_count_shard[t-1][J];
+        sentence_start_count[J] += sentence_start_count_shard[t-1][J];
       }
     }
 
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++) {
+          fwcount[i] += fwcount_shard[t-1][i];
+          ffert_count[i] += ffert_count_shard[t-1][i];
+        }
+      }
+    }
+
+    //merge the sparse counts in the order of the threads and compact them for the M-step
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+    for (int c=0; c < (int) (nSourceClasses_*nTargetClasses_); c++) {
+
+      const uint x = c % nSourceClasses_;
+      const uint y = c / nSourceClasses_;
+
+      for (uint t=1; t < nThreads; t++) {
+        sparse_inter_distort_count(x,y).add(sparse_inter_distort_count_shard[t-1](x,y));
+        sparse_inter_distort_count_shard[t-1](x,y) = SparseDistortCountAccumulator();
+      }
+      sparse_inter_distort_count(x,y).compact();
+    }
+
+    print_inter_distortion_cache_stats();
+
     /***** update probability models from counts *******/
 
     //update p_zero_ and p_nonzero_
@@ -4363,7 +4779,7 @@ void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
       if (iter > 5)
         alpha = 0.1;
 
-      dict_m_step(fwcount, prior_weight_, dict_, alpha, 45, smoothed_l0_, l0_beta_);
+      dict_m_step(fwcount, prior_weight_, dict_, alpha, 45, smoothed_l0_, l0_beta_, nThreads_);
     }
 
     //update fertility probabilities
@@ -4418,9 +4834,9 @@ void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
             for (uint d=0; d < cept_start_prob_.zDim(); d++) 
               hyp_cept_start_prob(x,y,d) = inv_sum * fceptstart_count(x,y,d);
               
-            double cur_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y),
+            double cur_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y).counts(),
                                                                cept_start_prob_,x,y);
-            double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y),
+            double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y).counts(),
                                                                hyp_cept_start_prob,x,y);
             
             if (hyp_energy < cur_energy)
@@ -4429,7 +4845,7 @@ void IBM4Trainer::train_unconstrained(uint nIter, IBM3Trainer* ibm3) {
         }
 
         if (reduce_deficiency_) 
-          inter_distortion_m_step(inter_distort_count,sparse_inter_distort_count(x,y),x,y);
+          inter_distortion_m_step(inter_distort_count,sparse_inter_distort_count(x,y).counts(),x,y);
       }
     }
 
@@ -4573,258 +4989,362 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
   long double fzero_count;
   long double fnonzero_count;
 
+  const uint nThreads = nThreads_;
+  init_inter_distortion_cache(nThreads);
+
+  //each thread handles one block of the schedule and collects into its own count shard
+  const SentenceSchedule schedule(source_sentence_,target_sentence_,nThreads,sort_by_length_,stream_chunk_size_);
+
+  //count shards for the additional threads (the first thread collects directly into the main counts)
+  Storage1D<Math3D::Tensor<double> > fceptstart_count_shard(nThreads-1);
+  Storage1D<Math2D::Matrix<double> > fwithincept_count_shard(nThreads-1);
+  Storage1D<Math1D::Vector<double> > fsentence_start_count_shard(nThreads-1);
+  Storage1D<Storage1D<Storage2D<Math2D::Matrix<double> > > > inter_distort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math3D::Tensor<double> > > intra_distort_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > sentence_start_count_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > fwcount_shard(nThreads-1);
+  Storage1D<Storage1D<Math1D::Vector<double> > > ffert_count_shard(nThreads-1);
+  for (uint t=0; t < nThreads-1; t++) {
+    fceptstart_count_shard[t] = fceptstart_count;
+    fwithincept_count_shard[t] = fwithincept_count;
+    fsentence_start_count_shard[t] = fsentence_start_count;
+    inter_distort_count_shard[t] = inter_distort_count;
+    intra_distort_count_shard[t] = intra_distort_count;
+    sentence_start_count_shard[t] = sentence_start_count;
+    fwcount_shard[t] = fwcount;
+    ffert_count_shard[t] = ffert_count;
+  }
+
+  Storage1D<long double> fzero_count_shard(nThreads-1);
+  Storage1D<long double> fnonzero_count_shard(nThreads-1);
+  Math1D::Vector<double> max_perplexity_shard(nThreads-1);
+  Math1D::Vector<uint> sum_iter_shard(nThreads-1);
+
   for (uint iter=1; iter <= nIter; iter++) {
 
     std::cerr << "******* IBM-4 Viterbi-iteration #" << iter << std::endl;
 
     uint sum_iter = 0;
 
-    fzero_count = 0.0;
-    fnonzero_count = 0.0;
+    Storage2D<SparseDistortCountAccumulator> sparse_inter_distort_count;
+    Storage1D<Storage2D<SparseDistortCountAccumulator> > sparse_inter_distort_count_shard(nThreads-1);
 
-    fceptstart_count.set_constant(0.0);
-    fwithincept_count.set_constant(0.0);
-    fsentence_start_count.set_constant(0.0);
+    WordLookupBuffers aux_lookup;
 
-    for (uint i=0; i < nTargetWords; i++) {
-      fwcount[i].set_constant(0.0);
-      ffert_count[i].set_constant(0.0);
-    }
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+    for (int t=0; t < (int) nThreads; t++) {
 
-    for (uint J=1; J <= maxJ_; J++) {
-      if (inter_distort_count[J].size() > 0) {
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-            inter_distort_count[J](x,y).set_constant(0.0);
-      }
-      intra_distort_count[J].set_constant(0.0);
-      sentence_start_count[J].set_constant(0.0);
-    }
+      Math3D::Tensor<double>& cur_fceptstart_count = (t == 0) ? fceptstart_count : fceptstart_count_shard[t-1];
+      Math2D::Matrix<double>& cur_fwithincept_count = (t == 0) ? fwithincept_count : fwithincept_count_shard[t-1];
+      Math1D::Vector<double>& cur_fsentence_start_count = (t == 0) ? fsentence_start_count : fsentence_start_count_shard[t-1];
+      Storage1D<Storage2D<Math2D::Matrix<double> > >& cur_inter_distort_count = 
+        (t == 0) ? inter_distort_count : inter_distort_count_shard[t-1];
+      Storage2D<SparseDistortCountAccumulator>& cur_sparse_inter_distort_count = 
+        (t == 0) ? sparse_inter_distort_count : sparse_inter_distort_count_shard[t-1];
+      Storage1D<Math3D::Tensor<double> >& cur_intra_distort_count = (t == 0) ? intra_distort_count : intra_distort_count_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_sentence_start_count = (t == 0) ? sentence_start_count : sentence_start_count_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_fwcount = (t == 0) ? fwcount : fwcount_shard[t-1];
+      Storage1D<Math1D::Vector<double> >& cur_ffert_count = (t == 0) ? ffert_count : ffert_count_shard[t-1];
 
-    Storage2D<std::map<DistortCount,double> > sparse_inter_distort_count(nSourceClasses_,nTargetClasses_);
+      long double& cur_fzero_count = (t == 0) ? fzero_count : fzero_count_shard[t-1];
+      long double& cur_fnonzero_count = (t == 0) ? fnonzero_count : fnonzero_count_shard[t-1];
+      double& cur_max_perplexity = (t == 0) ? max_perplexity : max_perplexity_shard[t-1];
+      uint& cur_sum_iter = (t == 0) ? sum_iter : sum_iter_shard[t-1];
 
-    SingleLookupTable aux_lookup;
+      cur_fzero_count = 0.0;
+      cur_fnonzero_count = 0.0;
+      cur_max_perplexity = 0.0;
+      cur_sum_iter = 0;
 
-    max_perplexity = 0.0;
+      cur_fceptstart_count.set_constant(0.0);
+      cur_fwithincept_count.set_constant(0.0);
+      cur_fsentence_start_count.set_constant(0.0);
 
-    for (size_t s=0; s < source_sentence_.size(); s++) {
-
-      //DEBUG
-      uint prev_sum_iter = sum_iter;
-      //END_DEBUG
-
-      if ((s% 10000) == 0)
-        std::cerr << "sentence pair #" << s << std::endl;
-
-      if (nSourceClasses_*nTargetClasses_ >= 10 && (s%25) == 0) {
-        for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
+      for (uint i=0; i < nTargetWords; i++) {
+        cur_fwcount[i].set_constant(0.0);
+        cur_ffert_count[i].set_constant(0.0);
+      }
 
+      for (uint J=1; J <= maxJ_; J++) {
+        if (cur_inter_distort_count[J].size() > 0) {
           for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
             for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-              inter_distortion_prob_[J](x,y).resize(0,0);
+              cur_inter_distort_count[J](x,y).set_constant(0.0);
         }
+        cur_intra_distort_count[J].set_constant(0.0);
+        cur_sentence_start_count[J].set_constant(0.0);
       }
+
+      cur_sparse_inter_distort_count.resize(nSourceClasses_,nTargetClasses_);
+
+      WordLookupBuffers aux_lookup;
+
+      //buffers for the hillclimbing, reused across the sentences of the block
+      Math1D::NamedVector<uint> fertility(MAKENAME(fertility));
+      Math2D::NamedMatrix<long double> swap_move_prob(MAKENAME(swap_move_prob));
+      Math2D::NamedMatrix<long double> expansion_move_prob(MAKENAME(expansion_move_prob));
+      //for the hillclimbing of the IBM-3 in the first iteration
+      HillclimbingScores ibm3_hc_scores;
+
+      for (size_t k=schedule.block_start(t); k < schedule.block_end(t); k++) {
+
+        const size_t s = schedule[k];
+        schedule.prefetch(t,k);
+
+        //DEBUG
+        uint prev_sum_iter = cur_sum_iter;
+        //END_DEBUG
+
+        if ((s% 10000) == 0)
+          std::cerr << "sentence pair #" << s << std::endl;
       
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
-      const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
-                                                           nSourceWords_,slookup_[s],aux_lookup);
+        const SentenceView& cur_source = source_sentence_[s];
+        const SentenceView& cur_target = target_sentence_[s];
+        const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                             nSourceWords_,slookup_[s],aux_lookup);
       
-      const uint curI = cur_target.size();
-      const uint curJ = cur_source.size();
+        const uint curI = cur_target.size();
+        const uint curJ = cur_source.size();
       
-      Math1D::NamedVector<uint> fertility(curI+1,0,MAKENAME(fertility));
-
-      Math2D::NamedMatrix<long double> swap_move_prob(curJ,curJ,MAKENAME(swap_move_prob));
-      Math2D::NamedMatrix<long double> expansion_move_prob(curJ,curI+1,MAKENAME(expansion_move_prob));
+        fertility.resize_dirty(curI+1);
 
-      //std::clock_t tHillclimbStart, tHillclimbEnd;
-      //tHillclimbStart = std::clock();
+        //std::clock_t tHillclimbStart, tHillclimbEnd;
+        //tHillclimbStart = std::clock();
 
 
-      long double best_prob = 0.0;
+        long double best_prob = 0.0;
 
-      if (ibm3 != 0 && iter == 1) {
-        best_prob = ibm3->update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                           expansion_move_prob,swap_move_prob,best_known_alignment_[s]);	
+        if (ibm3 != 0 && iter == 1) {
+          best_prob = ibm3->update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                             expansion_move_prob,swap_move_prob,ibm3_hc_scores,best_known_alignment_[s]);	
 
-	//DEBUG
-	long double align_prob = alignment_prob(s,best_known_alignment_[s]);
+	  //DEBUG
+	  long double align_prob = alignment_prob(s,best_known_alignment_[s]);
       
-	if (isinf(align_prob) || isnan(align_prob) || align_prob == 0.0) {
+	  if (isinf(align_prob) || isnan(align_prob) || align_prob == 0.0) {
 	  
-	  std::cerr << "ERROR: after hillclimbing: align-prob for sentence " << s << " has prob " << align_prob << std::endl;
+	    std::cerr << "ERROR: after hillclimbing: align-prob for sentence " << s << " has prob " << align_prob << std::endl;
 	  
-	  print_alignment_prob_factors(source_sentence_[s], target_sentence_[s], slookup_[s], best_known_alignment_[s]);
+	    print_alignment_prob_factors(source_sentence_[s], target_sentence_[s], cur_lookup, best_known_alignment_[s]);
 	  
-	  exit(1);
-	}
-	//END_DEBUG
+	    exit(1);
+	  }
+	  //END_DEBUG
 
-      }
-      else {
-        best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,sum_iter,fertility,
-                                                     expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
-      }
+        }
+        else {
+          best_prob = update_alignment_by_hillclimbing(cur_source,cur_target,cur_lookup,cur_sum_iter,fertility,
+                                                       expansion_move_prob,swap_move_prob,best_known_alignment_[s]);
+        }
 
-      max_perplexity -= std::log(best_prob);
+        cur_max_perplexity -= std::log(best_prob);
 
-      //DEBUG
-      if (isinf(max_perplexity)) {
+        //DEBUG
+        if (isinf(cur_max_perplexity)) {
 
-	std::cerr << "ERROR: inf after sentence  " << s << ", last alignment prob: " << best_prob << std::endl;
-	std::cerr << "J = " << curJ << ", I = " << curI << std::endl;
-	std::cerr << "preceding number of hillclimbing iterations: " << (sum_iter - prev_sum_iter) << std::endl;
+	  std::cerr << "ERROR: inf after sentence  " << s << ", last alignment prob: " << best_prob << std::endl;
+	  std::cerr << "J = " << curJ << ", I = " << curI << std::endl;
+	  std::cerr << "preceding number of hillclimbing iterations: " << (cur_sum_iter - prev_sum_iter) << std::endl;
 
-	exit(1);
-      }
-      //END_DEBUG
+	  exit(1);
+        }
+        //END_DEBUG
 
-      //tHillclimbEnd = std::clock();
+        //tHillclimbEnd = std::clock();
 
 
-      /**** update empty word counts *****/
+        /**** update empty word counts *****/
 
-      fzero_count += fertility[0];
-      fnonzero_count += curJ - 2*fertility[0];
+        cur_fzero_count += fertility[0];
+        cur_fnonzero_count += curJ - 2*fertility[0];
 
-      /**** update fertility counts *****/
-      for (uint i=1; i <= curI; i++) {
+        /**** update fertility counts *****/
+        for (uint i=1; i <= curI; i++) {
 
-        const uint cur_fert = fertility[i];
-        const uint t_idx = cur_target[i-1];
+          const uint cur_fert = fertility[i];
+          const uint t_idx = cur_target[i-1];
 
-        ffert_count[t_idx][cur_fert] += 1.0;
-      }
+          cur_ffert_count[t_idx][cur_fert] += 1.0;
+        }
 
-      /**** update dictionary counts *****/
-      for (uint j=0; j < curJ; j++) {
+        /**** update dictionary counts *****/
+        for (uint j=0; j < curJ; j++) {
 
-        const uint s_idx = cur_source[j];
-        const uint cur_aj = best_known_alignment_[s][j];
+          const uint s_idx = cur_source[j];
+          const uint cur_aj = best_known_alignment_[s][j];
 
-        if (cur_aj != 0) {
-          fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += 1.0;
-        }
-        else {
-          fwcount[0][s_idx-1] += 1.0;
+          if (cur_aj != 0) {
+            cur_fwcount[cur_target[cur_aj-1]][cur_lookup(j,cur_aj-1)] += 1.0;
+          }
+          else {
+            cur_fwcount[0][s_idx-1] += 1.0;
+          }
         }
-      }
 
-      /**** update distortion counts *****/
-      NamedStorage1D<std::set<int> > aligned_source_words(curI+1,MAKENAME(aligned_source_words));
-      Math1D::NamedVector<int> cept_center(curI+1,-100,MAKENAME(cept_center));
+        /**** update distortion counts *****/
+        NamedStorage1D<std::set<int> > aligned_source_words(curI+1,MAKENAME(aligned_source_words));
+        Math1D::NamedVector<int> cept_center(curI+1,-100,MAKENAME(cept_center));
 
-      //denotes the largest preceding target position that produces source words
-      Math1D::NamedVector<int> prev_cept(curI+1,-100,MAKENAME(prev_cept));
-      Math1D::NamedVector<int> first_aligned_source_word(curI+1,-100,
-                                                         MAKENAME(first_aligned_source_word));
-      Math1D::NamedVector<int> second_aligned_source_word(curI+1,-100,
-                                                          MAKENAME(second_aligned_source_word));
+        //denotes the largest preceding target position that produces source words
+        Math1D::NamedVector<int> prev_cept(curI+1,-100,MAKENAME(prev_cept));
+        Math1D::NamedVector<int> first_aligned_source_word(curI+1,-100,
+                                                           MAKENAME(first_aligned_source_word));
+        Math1D::NamedVector<int> second_aligned_source_word(curI+1,-100,
+                                                            MAKENAME(second_aligned_source_word));
 
-      for (uint j=0; j < curJ; j++) {
-        const uint cur_aj = best_known_alignment_[s][j];
-        aligned_source_words[cur_aj].insert(j);	
-      }
+        for (uint j=0; j < curJ; j++) {
+          const uint cur_aj = best_known_alignment_[s][j];
+          aligned_source_words[cur_aj].insert(j);	
+        }
 
-      int cur_prev_cept = -100;
-      for (uint i=0; i <= curI; i++) {
+        int cur_prev_cept = -100;
+        for (uint i=0; i <= curI; i++) {
 
-        assert(aligned_source_words[i].size() == fertility[i]);
+          assert(aligned_source_words[i].size() == fertility[i]);
 
-        if (fertility[i] > 0) {
+          if (fertility[i] > 0) {
 	  
-          std::set<int>::iterator ait = aligned_source_words[i].begin();
-          first_aligned_source_word[i] = *ait;
+            std::set<int>::iterator ait = aligned_source_words[i].begin();
+            first_aligned_source_word[i] = *ait;
 
-          if (fertility[i] > 1) {
-            ait++;
-            second_aligned_source_word[i] = *ait;
-          } 	    
+            if (fertility[i] > 1) {
+              ait++;
+              second_aligned_source_word[i] = *ait;
+            } 	    
 
-          switch (cept_start_mode_) {
-          case IBM4CENTER: {
+            switch (cept_start_mode_) {
+            case IBM4CENTER: {
 
-            double sum = 0.0;
-            for (std::set<int>::iterator ait = aligned_source_words[i].begin(); ait != aligned_source_words[i].end(); ait++) {
-              sum += *ait;
+              double sum = 0.0;
+              for (std::set<int>::iterator ait = aligned_source_words[i].begin(); ait != aligned_source_words[i].end(); ait++) {
+                sum += *ait;
+              }
+
+              cept_center[i] = (uint) round(sum / fertility[i]);
+              break;
+            }
+            case IBM4FIRST:
+              cept_center[i] = first_aligned_source_word[i];
+              break;
+            case IBM4LAST: {
+              std::set<int>::iterator ait = aligned_source_words[i].end();
+              ait--;
+              cept_center[i] = *ait;
+              break;
+            }
+            case IBM4UNIFORM:
+              cept_center[i] = first_aligned_source_word[i];
+              break;
+            default:
+              assert(false);
             }
 
-            cept_center[i] = (uint) round(sum / fertility[i]);
-            break;
-          }
-          case IBM4FIRST:
-            cept_center[i] = first_aligned_source_word[i];
-            break;
-          case IBM4LAST: {
-            std::set<int>::iterator ait = aligned_source_words[i].end();
-            ait--;
-            cept_center[i] = *ait;
-            break;
+            prev_cept[i] = cur_prev_cept;
+            cur_prev_cept = i;
           }
-          case IBM4UNIFORM:
-            cept_center[i] = first_aligned_source_word[i];
-            break;
-          default:
-            assert(false);
-          }
-
-          prev_cept[i] = cur_prev_cept;
-          cur_prev_cept = i;
         }
-      }
 
-      // handle viterbi alignment
-      for (uint i=1; i <= curI; i++) {
+        // handle viterbi alignment
+        for (uint i=1; i <= curI; i++) {
 
-        const uint tclass = target_class_[ cur_target[i-1] ];
+          const uint tclass = target_class_[ cur_target[i-1] ];
 
-        if (fertility[i] > 0) {
+          if (fertility[i] > 0) {
 
-          const int cur_prev_cept = prev_cept[i];
+            const int cur_prev_cept = prev_cept[i];
 	  
-          //a) update head prob
-          if (cur_prev_cept >= 0) {
+            //a) update head prob
+            if (cur_prev_cept >= 0) {
 
-            const uint prev_cept_center = cept_center[cur_prev_cept];
+              const uint prev_cept_center = cept_center[cur_prev_cept];
 
-            const uint sclass = source_class_[ cur_source[prev_cept_center]  ];
+              const uint sclass = source_class_[ cur_source[prev_cept_center]  ];
 
-            int diff = first_aligned_source_word[i] - prev_cept_center;
-            diff += displacement_offset_;
+              int diff = first_aligned_source_word[i] - prev_cept_center;
+              diff += displacement_offset_;
 
-            fceptstart_count(sclass,tclass,diff) += 1.0;
+              cur_fceptstart_count(sclass,tclass,diff) += 1.0;
 
-            if (reduce_deficiency_) {
-              if (inter_distort_count[curJ].size() == 0 || inter_distort_count[curJ](sclass,tclass).size() == 0)
-                sparse_inter_distort_count(sclass,tclass)[DistortCount(curJ,first_aligned_source_word[i],prev_cept_center)] += 1.0;
-              else
-                inter_distort_count[curJ](sclass,tclass)(first_aligned_source_word[i],prev_cept_center) += 1.0;
+              if (reduce_deficiency_) {
+                if (cur_inter_distort_count[curJ].size() == 0 || cur_inter_distort_count[curJ](sclass,tclass).size() == 0)
+                  cur_sparse_inter_distort_count(sclass,tclass).add(curJ,first_aligned_source_word[i],prev_cept_center,1.0);
+                else
+                  cur_inter_distort_count[curJ](sclass,tclass)(first_aligned_source_word[i],prev_cept_center) += 1.0;
+              }
+            }
+            else if (use_sentence_start_prob_) {
+              cur_fsentence_start_count[first_aligned_source_word[i]] += 1.0;
+              cur_sentence_start_count[curJ][first_aligned_source_word[i]] += 1.0;
             }
-          }
-          else if (use_sentence_start_prob_) {
-            fsentence_start_count[first_aligned_source_word[i]] += 1.0;
-            sentence_start_count[curJ][first_aligned_source_word[i]] += 1.0;
-          }
 
-          //b) update within-cept prob
-          int prev_aligned_j = first_aligned_source_word[i];
-          std::set<int>::iterator ait = aligned_source_words[i].begin();
-          ait++;
-          for (;ait != aligned_source_words[i].end(); ait++) {
+            //b) update within-cept prob
+            int prev_aligned_j = first_aligned_source_word[i];
+            std::set<int>::iterator ait = aligned_source_words[i].begin();
+            ait++;
+            for (;ait != aligned_source_words[i].end(); ait++) {
 
-            const int cur_j = *ait;
-            int diff = cur_j - prev_aligned_j;
-            fwithincept_count(tclass,diff) += 1.0;
+              const int cur_j = *ait;
+              int diff = cur_j - prev_aligned_j;
+              cur_fwithincept_count(tclass,diff) += 1.0;
 
-            if (reduce_deficiency_)
-              intra_distort_count[curJ](tclass,cur_j,prev_aligned_j) += 1.0;
+              if (reduce_deficiency_)
+                cur_intra_distort_count[curJ](tclass,cur_j,prev_aligned_j) += 1.0;
 
-            prev_aligned_j = cur_j;
+              prev_aligned_j = cur_j;
+            }
           }
         }
+      } // loop over sentences finished
+    }
+
+    //reduce the shards in a fixed order, so that the result does not depend on the thread timing
+    for (uint t=1; t < nThreads; t++) {
+
+      fzero_count += fzero_count_shard[t-1];
+      fnonzero_count += fnonzero_count_shard[t-1];
+      max_perplexity += max_perplexity_shard[t-1];
+      sum_iter += sum_iter_shard[t-1];
+
+      fceptstart_count += fceptstart_count_shard[t-1];
+      fwithincept_count += fwithincept_count_shard[t-1];
+      fsentence_start_count += fsentence_start_count_shard[t-1];
+
+      for (uint J=1; J <= maxJ_; J++) {
+        for (uint y=0; y < inter_distort_count[J].yDim(); y++)
+          for (uint x=0; x < inter_distort_count[J].xDim(); x++)
+            inter_distort_count[J](x,y) += inter_distort_count_shard[t-1][J](x,y);
+
+        intra_distort_count[J] += intra_distort_count_shard[t-1][J];
+        sentence_start_count[J] += sentence_start_count_shard[t-1][J];
       }
-    } // loop over sentences finished
+    }
+
+    if (nThreads > 1) {
+
+#pragma omp parallel for schedule(dynamic,256) num_threads(nThreads)
+      for (int i=0; i < (int) nTargetWords; i++) {
+        for (uint t=1; t < nThreads; t++) {
+          fwcount[i] += fwcount_shard[t-1][i];
+          ffert_count[i] += ffert_count_shard[t-1][i];
+        }
+      }
+    }
+
+    //merge the sparse counts in the order of the threads and compact them for the M-step
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+    for (int c=0; c < (int) (nSourceClasses_*nTargetClasses_); c++) {
+
+      const uint x = c % nSourceClasses_;
+      const uint y = c / nSourceClasses_;
+
+      for (uint t=1; t < nThreads; t++) {
+        sparse_inter_distort_count(x,y).add(sparse_inter_distort_count_shard[t-1](x,y));
+        sparse_inter_distort_count_shard[t-1](x,y) = SparseDistortCountAccumulator();
+      }
+      sparse_inter_distort_count(x,y).compact();
+    }
+
+    print_inter_distortion_cache_stats();
 
     /***** update probability models from counts *******/
 
@@ -4929,9 +5449,9 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
             for (uint d=0; d < cept_start_prob_.zDim(); d++) 
               hyp_cept_start_prob(x,y,d) = inv_sum * fceptstart_count(x,y,d);
             
-            double cur_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y),
+            double cur_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y).counts(),
                                                                cept_start_prob_,x,y);
-            double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y),
+            double hyp_energy = inter_distortion_m_step_energy(inter_distort_count,sparse_inter_distort_count(x,y).counts(),
                                                                hyp_cept_start_prob,x,y);
             
             if (hyp_energy < cur_energy)
@@ -4940,7 +5460,7 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
         }
 
         if (reduce_deficiency_) 
-          inter_distortion_m_step(inter_distort_count,sparse_inter_distort_count(x,y),x,y);  
+          inter_distortion_m_step(inter_distort_count,sparse_inter_distort_count(x,y).counts(),x,y);  
       }
     }
 
@@ -5030,17 +5550,8 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
       if ((s% 10000) == 0)
         std::cerr << "sentence pair #" << s << std::endl;
 
-      if (nSourceClasses_*nTargetClasses_ >= 10 && (s%25) == 0) {
-        for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
-
-          for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-            for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-              inter_distortion_prob_[J](x,y).resize(0,0);
-        }
-      }
-
-      const Storage1D<uint>& cur_source = source_sentence_[s];
-      const Storage1D<uint>& cur_target = target_sentence_[s];
+      const SentenceView& cur_source = source_sentence_[s];
+      const SentenceView& cur_target = target_sentence_[s];
       const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
                                                            nSourceWords_,slookup_[s],aux_lookup);
       
@@ -5135,7 +5646,7 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
 		
 		uint zero_fert = fertility[0];
 		
-		change -= - std::log(ldchoose(curJ-zero_fert,zero_fert));
+		change -= - combinatorics_.log_choose(curJ-zero_fert,zero_fert);
 		change -= -std::log(p_zero_);
 		
 		if (och_ney_empty_word_) {
@@ -5143,7 +5654,7 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
 		}
 		
 		uint new_zero_fert = zero_fert-1;
-		change += - std::log(ldchoose(curJ-new_zero_fert,new_zero_fert));
+		change += - combinatorics_.log_choose(curJ-new_zero_fert,new_zero_fert);
 		change += 2.0*(-std::log(p_nonzero_));
 	      }
 	      else {
@@ -5169,11 +5680,11 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
 
 	      uint zero_fert = fertility[0];
 
-	      change -= -std::log(ldchoose(curJ-zero_fert,zero_fert));
+	      change -= -combinatorics_.log_choose(curJ-zero_fert,zero_fert);
 	      change -= 2.0*(-std::log(p_nonzero_));
 	      
 	      uint new_zero_fert = zero_fert+1;
-	      change += - std::log(ldchoose(curJ-new_zero_fert,new_zero_fert));
+	      change += - combinatorics_.log_choose(curJ-new_zero_fert,new_zero_fert);
 	      change += -std::log(p_zero_);
 	      
 	      if (och_ney_empty_word_) {
@@ -5255,15 +5766,6 @@ void IBM4Trainer::train_viterbi(uint nIter, IBM3Trainer* ibm3) {
     } //loop over sentences finished
     std::cerr << nSwitches << " changes in ICM stage" << std::endl;
 
-    if (nSourceClasses_*nTargetClasses_ >= 10) {
-      for (uint J=storage_limit_+1; J < inter_distortion_prob_.size(); J++) {
-        
-        for (uint y=0; y < inter_distortion_prob_[J].yDim(); y++)
-          for (uint x=0; x < inter_distortion_prob_[J].xDim(); x++)
-            inter_distortion_prob_[J](x,y).resize(0,0);
-      }
-    }
-
 
     //update dictionary
     for (uint i=0; i < nTargetWords; i++) {
@@ -5350,12 +5852,17 @@ void IBM4Trainer::write_postdec_alignments(const std::string filename, double th
 #endif
 
 
+  WordLookupBuffers aux_lookup;
+
   for (uint s=0; s < source_sentence_.size(); s++) {
     
     Math1D::Vector<AlignBaseType> viterbi_alignment = best_known_alignment_[s];
     std::set<std::pair<AlignBaseType,AlignBaseType> > postdec_alignment;
+
+    const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence_[s],target_sentence_[s],wcooc_,
+                                                         nSourceWords_,slookup_[s],aux_lookup);
   
-    compute_external_postdec_alignment(source_sentence_[s], target_sentence_[s], slookup_[s],
+    compute_external_postdec_alignment(source_sentence_[s], target_sentence_[s], cur_lookup,
 				       viterbi_alignment, postdec_alignment, thresh);
 
     for(std::set<std::pair<AlignBaseType,AlignBaseType> >::iterator it = postdec_alignment.begin(); 
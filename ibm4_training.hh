@@ -6,6 +6,8 @@
 
 #include "ibm3_training.hh"
 
+#include <list>
+
 enum IBM4CeptStartMode { IBM4CENTER, IBM4FIRST, IBM4LAST, IBM4UNIFORM };
 
 struct DistortCount {
@@ -17,23 +19,97 @@ struct DistortCount {
   uchar j_prev_;
 };
 
+//collects the inter distortion counts of a class combination that has no dense count table.
+// The counts are accumulated in a flat hash table (open addressing with linear probing) and
+// compacted into a vector sorted by (J, j, j_prev) before the M-step
+class SparseDistortCountAccumulator {
+public:
+
+  SparseDistortCountAccumulator();
+
+  void add(uchar J, uchar j, uchar j_prev, double count);
+
+  //adds all counts of other, which must not be compacted yet
+  void add(const SparseDistortCountAccumulator& other);
+
+  //moves the counts to counts() and frees the hash table. No counts may be added afterwards
+  void compact();
+
+  //only valid after compact()
+  const std::vector<std::pair<DistortCount,double> >& counts() const;
+
+protected:
+
+  void grow();
+
+  //(J,j,j_prev) packed into one number, 0 marks an empty slot
+  std::vector<uint> key_;
+  std::vector<double> value_;
+  uint log_capacity_;
+  size_t nEntries_;
+
+  std::vector<std::pair<DistortCount,double> > counts_;
+};
+
+//key of a cached inter distortion table
 struct IBM4CacheStruct {
 
-  IBM4CacheStruct(uchar j, WordClassType sc, WordClassType tc);
+  IBM4CacheStruct(ushort J, WordClassType sc, WordClassType tc);
 
-  uchar j_;
+  ushort J_;
   WordClassType sclass_;
   WordClassType tclass_;
 };
 
 bool operator<(const IBM4CacheStruct& c1, const IBM4CacheStruct& c2);
 
+bool operator==(const IBM4CacheStruct& c1, const IBM4CacheStruct& c2);
+
+struct IBM4CacheEntry {
+
+  IBM4CacheEntry(const IBM4CacheStruct& key);
+
+  IBM4CacheStruct key_;
+  Math2D::Matrix<float,ushort> prob_; //indexed by (j, j_prev)
+};
+
+//inter distortion tables for class combinations and lengths without a table of their own, filled lazily.
+// The tables are evicted in least-recently-used order once the memory limit is exceeded.
+// Every thread works on its own cache, so no locking is needed
+struct IBM4InterDistortionCache {
+
+  IBM4InterDistortionCache();
+
+  //drops all tables and resets the counters
+  void clear();
+
+  //drops all tables, but keeps the counters
+  void drop_tables();
+
+  //returns 0 if the table is not present. A found table becomes the most recently used one
+  const Math2D::Matrix<float,ushort>* find(const IBM4CacheStruct& key);
+
+  //creates an (uninitialized) table of size JxJ, evicting old tables if needed
+  Math2D::Matrix<float,ushort>& insert(const IBM4CacheStruct& key);
+
+  //most recently used first
+  std::list<IBM4CacheEntry> entries_;
+  std::map<IBM4CacheStruct,std::list<IBM4CacheEntry>::iterator> index_;
+
+  size_t nBytes_;
+  size_t byte_limit_;
+
+  size_t nLookups_;
+  size_t nHits_;
+  size_t nEvictions_;
+};
+
 class IBM4Trainer : public FertilityModelTrainer {
 public: 
 
-  IBM4Trainer(const Storage1D<Storage1D<uint> >& source_sentence,
+  IBM4Trainer(const Corpus& source_sentence,
               const LookupTable& slookup,
-              const Storage1D<Storage1D<uint> >& target_sentence,
+              const Corpus& target_sentence,
               const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& sure_ref_alignments,
               const std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > >& possible_ref_alignments,
               SingleWordDictionary& dict,
@@ -47,7 +123,8 @@ public:
               bool no_factorial = true, 
               bool reduce_deficiency = true,
               IBM4CeptStartMode cept_start_mode = IBM4CENTER,
-              bool smoothed_l0 = false, double l0_beta = 1.0, double l0_fertpen = 0.0);
+              bool smoothed_l0 = false, double l0_beta = 1.0, double l0_fertpen = 0.0,
+              size_t inter_distortion_byte_limit = 64*1024*1024);
 
 
   void init_from_ibm3(IBM3Trainer& ibm3trainer, bool clear_ibm3 = true, 
@@ -64,13 +141,29 @@ public:
 
   void fix_p0(double p0);
 
-  long double compute_external_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+  long double compute_external_alignment(const SentenceView& source, const SentenceView& target,
+                                         const SingleLookupTable& lookup,
+                                         Math1D::Vector<AlignBaseType>& alignment);
+
+  //the two parts of compute_external_alignment(): the first adapts the start alignment and extends the model
+  // where the sentence pair needs it, so it must not run concurrently with anything else. The second
+  // only reads the model and can be called from several threads at once (after set_nthreads())
+  void prepare_external_alignment(const SentenceView& source, const SentenceView& target,
+                                  const SingleLookupTable& lookup, Math1D::Vector<AlignBaseType>& alignment);
+
+  long double compute_prepared_alignment(const SentenceView& source, const SentenceView& target,
                                          const SingleLookupTable& lookup,
                                          Math1D::Vector<AlignBaseType>& alignment);
 
+  //from now on the changes that prepare_external_alignment() makes to the model are recorded (see recorded_changes()),
+  // restore_model() takes them back. This way sentence pairs can be aligned with the model as it was trained
+  void record_model_changes();
+
+  void restore_model();
+
   // <code> start_alignment </code> is used as initialization for hillclimbing and later modified
   // the extracted alignment is written to <code> postdec_alignment </code>
-  void compute_external_postdec_alignment(const Storage1D<uint>& source, const Storage1D<uint>& target,
+  void compute_external_postdec_alignment(const SentenceView& source, const SentenceView& target,
 					  const SingleLookupTable& lookup,
 					  Math1D::Vector<AlignBaseType>& start_alignment,
 					  std::set<std::pair<AlignBaseType,AlignBaseType> >& postdec_alignment,
@@ -79,27 +172,33 @@ public:
 
   void write_postdec_alignments(const std::string filename, double thresh);
 
+  void write_checkpoint(CheckpointWriter& writer) const;
+
+  //the distortion tables are recomputed from the parameters. With model_only the trainer was constructed
+  // without a corpus and only the parameters are read
+  void read_checkpoint(const Checkpoint& checkpoint, bool model_only = false);
+
 protected:
 
   double inter_distortion_prob(int j, int j_prev, uint sclass, uint tclass, uint J) const;
 
-  long double alignment_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  long double alignment_prob(const SentenceView& source, const SentenceView& target, 
                              const SingleLookupTable& lookup, const Math1D::Vector<AlignBaseType>& alignment);
 
 
-  long double distortion_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  long double distortion_prob(const SentenceView& source, const SentenceView& target, 
 			      const Math1D::Vector<AlignBaseType>& alignment);
 
   //NOTE: the vectors need to be sorted
-  long double distortion_prob(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  long double distortion_prob(const SentenceView& source, const SentenceView& target, 
 			      const Storage1D<std::vector<AlignBaseType> >& aligned_source_words);
 
-  void print_alignment_prob_factors(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  void print_alignment_prob_factors(const SentenceView& source, const SentenceView& target, 
 				    const SingleLookupTable& lookup, const Math1D::Vector<AlignBaseType>& alignment);
 
   long double alignment_prob(uint s, const Math1D::Vector<AlignBaseType>& alignment);
 
-  long double update_alignment_by_hillclimbing(const Storage1D<uint>& source, const Storage1D<uint>& target, 
+  long double update_alignment_by_hillclimbing(const SentenceView& source, const SentenceView& target, 
                                                const SingleLookupTable& lookup, uint& nIter, Math1D::Vector<uint>& fertility,
                                                Math2D::Matrix<long double>& expansion_prob,
                                                Math2D::Matrix<long double>& swap_prob, Math1D::Vector<AlignBaseType>& alignment);
@@ -107,16 +206,20 @@ protected:
 
   void par2nonpar_inter_distortion();
 
+  //provide one (cleared) cache per thread, the threads share the part of the byte limit not taken by the fixed tables
+  void init_inter_distortion_cache(uint nThreads);
+
+  //the cache of the calling thread
+  IBM4InterDistortionCache& thread_inter_distortion_cache() const;
+
+  void print_inter_distortion_cache_stats();
+
   void par2nonpar_inter_distortion(int J, uint sclass, uint tclass);
 
   void par2nonpar_intra_distortion();
 
   void par2nonpar_start_prob();
 
-  double inter_distortion_m_step_energy(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
-                                        const std::map<DistortCount,double>& sparse_inter_distort_count,
-                                        const Math3D::Tensor<double>& inter_param, uint class1, uint class2);
-
   double inter_distortion_m_step_energy(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
                                         const std::vector<std::pair<DistortCount,double> >& sparse_inter_distort_count,
                                         const Math3D::Tensor<double>& inter_param, uint class1, uint class2);
@@ -126,7 +229,7 @@ protected:
                                         const Math2D::Matrix<double>& intra_param, uint word_class);
 
   void inter_distortion_m_step(const Storage1D<Storage2D<Math2D::Matrix<double> > >& inter_distort_count,
-                               const std::map<DistortCount,double>& sparse_inter_distort_count,
+                               const std::vector<std::pair<DistortCount,double> >& sparse_inter_distort_count,
                                uint class1, uint class2);
 
   void intra_distortion_m_step(const Storage1D<Math3D::Tensor<double> >& intra_distort_count,
@@ -147,7 +250,8 @@ protected:
   Storage1D<Storage2D<Math2D::Matrix<float,ushort> > > inter_distortion_prob_;
   Storage1D<Math3D::Tensor<float> > intra_distortion_prob_;
 
-  mutable Storage1D<std::map<ushort, std::map<IBM4CacheStruct,float> > > inter_distortion_cache_;
+  //indexed by the thread number
+  mutable Storage1D<IBM4InterDistortionCache> inter_distortion_cache_;
 
   Storage1D<WordClassType> source_class_;
   Storage1D<WordClassType> target_class_;  
@@ -172,7 +276,14 @@ protected:
   uint nSourceClasses_;
   uint nTargetClasses_;
 
-  const ushort storage_limit_; //if there are many word classes, inter distortion tables are only keep for J<=storag_limit_
+  //memory limit in bytes for the inter distortion tables. If there are many word classes, fixed tables are only kept
+  // for J<=dense_length_limit_ (using at most half the limit), the other ones are cached per thread
+  size_t inter_distortion_byte_limit_;
+  size_t dense_inter_distortion_bytes_;
+  uint dense_length_limit_;
+
+  //the probability of the empty word before the recorded changes
+  double saved_p_zero_;
 };
 
 #endif
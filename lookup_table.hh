@@ -0,0 +1,109 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+#ifndef LOOKUP_TABLE_HH
+#define LOOKUP_TABLE_HH
+
+#include "matrix.hh"
+#include "vector.hh"
+
+#include <vector>
+
+//for each source position j and target position i the index of the source word in the cooc list of the target word
+typedef Math2D::Matrix<uint,ushort> SingleLookupTable;
+
+//a lookup table as it is kept in memory for the entire training.
+// Indices are stored with 16 bits if all of them permit it, otherwise with 32 bits.
+// Tables are only stored within the memory budget passed to generate_wordlookup(),
+// all others are computed on demand by get_wordlookup()
+class CompactLookupTable {
+public:
+
+  CompactLookupTable();
+
+  bool is_stored() const;
+
+  //memory occupied by the entries
+  size_t nBytes() const;
+
+  //memory that storing the given table would take
+  static size_t nBytes_needed(const SingleLookupTable& table);
+
+  void set(const SingleLookupTable& table);
+
+  //returns an empty table if the entries are stored with 16 bits (or not at all)
+  const SingleLookupTable& wide() const;
+
+  //returns an empty table if the entries are stored with 32 bits (or not at all)
+  const Math2D::Matrix<ushort,ushort>& narrow() const;
+
+  //true if the entries are stored with 16 bits for a sentence pair of the given lengths.
+  // E-steps templated on the table type then read them via narrow() without expanding them
+  bool is_narrow(uint J, uint I) const;
+
+protected:
+
+  SingleLookupTable wide_;
+  Math2D::Matrix<ushort,ushort> narrow_;
+};
+
+//per-thread buffers of get_wordlookup(): the table computed or expanded there and the scratch of compute_wordlookup()
+struct WordLookupBuffers {
+
+  SingleLookupTable table_;
+  std::vector<std::pair<uint,uint> > word_pos_;
+  Math1D::Vector<uint> source_first_occ_;
+  Math1D::Vector<uint> target_first_occ_;
+};
+
+/************************ implementation **************************/
+
+inline CompactLookupTable::CompactLookupTable() {}
+
+inline bool CompactLookupTable::is_stored() const {
+  return (wide_.size() > 0 || narrow_.size() > 0);
+}
+
+inline size_t CompactLookupTable::nBytes() const {
+  return wide_.size() * sizeof(uint) + narrow_.size() * sizeof(ushort);
+}
+
+inline size_t CompactLookupTable::nBytes_needed(const SingleLookupTable& table) {
+
+  const uint* data = table.direct_access();
+  const uint max_entry = (table.size() > 0) ? *std::max_element(data,data+table.size()) : 0;
+
+  return (max_entry <= MAX_USHORT) ? table.size() * sizeof(ushort) : table.size() * sizeof(uint);
+}
+
+inline void CompactLookupTable::set(const SingleLookupTable& table) {
+
+  const uint* data = table.direct_access();
+  const uint max_entry = (table.size() > 0) ? *std::max_element(data,data+table.size()) : 0;
+
+  if (max_entry <= MAX_USHORT) {
+    wide_.resize_dirty(0,0);
+    narrow_.resize_dirty(table.xDim(),table.yDim());
+    ushort* narrow_data = narrow_.direct_access();
+    const size_t size = size_t(table.xDim()) * size_t(table.yDim());
+    for (size_t k=0; k < size; k++)
+      narrow_data[k] = data[k];
+  }
+  else {
+    narrow_.resize_dirty(0,0);
+    wide_ = table;
+  }
+}
+
+inline const SingleLookupTable& CompactLookupTable::wide() const {
+  return wide_;
+}
+
+inline const Math2D::Matrix<ushort,ushort>& CompactLookupTable::narrow() const {
+  return narrow_;
+}
+
+inline bool CompactLookupTable::is_narrow(uint J, uint I) const {
+  return (narrow_.size() > 0 && narrow_.xDim() == J && narrow_.yDim() == I);
+}
+
+#endif
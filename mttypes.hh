@@ -7,6 +7,8 @@
 #include "vector.hh"
 #include "matrix.hh"
 #include "tensor.hh"
+#include "corpus.hh"
+#include "lookup_table.hh"
 
 typedef NamedStorage1D<Math1D::Vector<double> > SingleWordDictionary;
 typedef NamedStorage1D<Math1D::Vector<uint> > CooccuringWordsType;
@@ -32,8 +34,7 @@ typedef Math3D::NamedTensor<double> IBM4CeptStartModel;
 //indexed by (source word class, displacement)
 typedef Math2D::NamedMatrix<double> IBM4WithinCeptModel;
 
-typedef Math2D::Matrix<uint,ushort> SingleLookupTable;
-typedef Storage1D<SingleLookupTable> LookupTable;
+typedef Storage1D<CompactLookupTable> LookupTable;
 
 enum HmmInitProbType {HmmInitFix, HmmInitNonpar, HmmInitPar, HmmInitFix2, HmmInitInvalid};
 
@@ -4,6 +4,7 @@
 #include "application.hh"
 #include "stringprocessing.hh"
 #include "fileio.hh"
+#include "corpusio.hh"
 #include <fstream>
 #include <string>
 #include <vector>
@@ -16,39 +17,51 @@ int main(int argc, char** argv) {
 
   if (argc == 1 || strings_equal(argv[1],"-h")) {
 
-    std::cerr << "USAGE: " << argv[0] << " -i <input file> -voc <vocabulary file> -o <output file (indices)>" << std::endl;
+    std::cerr << "USAGE: " << argv[0] << " -i <input file> -voc <vocabulary file> -o <output file (indices)> [-binary]" << std::endl;
+    std::cerr << " -binary : write the binary corpus format that the aligner maps into memory." << std::endl
+              << "           Without -voc the input is expected to consist of word indices already" << std::endl;
     exit(0);
   }
 
-  const int nParams = 3;
-  ParamDescr  params[nParams] = {{"-i",mandInFilename,0,""},{"-voc",mandInFilename,0,""},
-                                 {"-o",mandOutFilename,0,""}};
+  const int nParams = 4;
+  ParamDescr  params[nParams] = {{"-i",mandInFilename,0,""},{"-voc",optInFilename,0,""},
+                                 {"-o",mandOutFilename,0,""},{"-binary",flag,0,""}};
 
   Application app(argc,argv,params,nParams);
 
+  const bool binary = app.is_set("-binary");
+
+  if (!app.is_set("-voc") && !binary) {
+    USER_ERROR << "a vocabulary has to be given unless -binary is set. Exiting..." << std::endl;
+    exit(1);
+  }
+
   std::map<std::string,uint> vocabulary;
 
-  std::istream* voc_stream;
+  if (app.is_set("-voc")) {
+
+    std::istream* voc_stream;
 
 #ifdef HAS_GZSTREAM
-  if (is_gzip_file(app.getParam("-voc"))) {
-    voc_stream = new igzstream(app.getParam("-voc").c_str());
-  }
-  else {
-    voc_stream = new std::ifstream(app.getParam("-voc").c_str());
-  }
+    if (is_gzip_file(app.getParam("-voc"))) {
+      voc_stream = new igzstream(app.getParam("-voc").c_str());
+    }
+    else {
+      voc_stream = new std::ifstream(app.getParam("-voc").c_str());
+    }
 #else
-  voc_stream = new std::ifstream(app.getParam("-voc").c_str());
+    voc_stream = new std::ifstream(app.getParam("-voc").c_str());
 #endif
 
-  std::string word;
-  uint nWords = 0;
-  while ((*voc_stream) >> word) {
+    std::string word;
+    uint nWords = 0;
+    while ((*voc_stream) >> word) {
 
-    vocabulary[word] = nWords;
-    nWords++;
+      vocabulary[word] = nWords;
+      nWords++;
+    }
+    delete voc_stream;
   }
-  delete voc_stream;
   
   std::istream* plain_stream;
 #ifdef HAS_GZSTREAM
@@ -62,6 +75,44 @@ int main(int argc, char** argv) {
   plain_stream = new std::ifstream(app.getParam("-i").c_str());
 #endif
 
+  std::vector<std::string> tokens;
+
+  char cline[65536];
+
+  if (binary) {
+
+    BinaryCorpusWriter writer(app.getParam("-o"));
+
+    std::vector<uint> sentence;
+
+    while (plain_stream->getline(cline,65536)) {
+
+      std::string line = cline;
+      tokenize(line,tokens,' ');
+
+      sentence.resize(tokens.size());
+      for (uint i=0; i < tokens.size(); i++) {
+
+        if (app.is_set("-voc")) {
+          std::map<std::string,uint>::iterator it = vocabulary.find(tokens[i]);
+          if (it == vocabulary.end()) {
+            USER_ERROR << "OOV word \"" << tokens[i] << "\" cannot be stored in a binary corpus. Exiting..." << std::endl;
+            exit(1);
+          }
+          sentence[i] = it->second;
+        }
+        else
+          sentence[i] = convert<uint>(tokens[i]);
+      }
+
+      writer.add_sentence(sentence);
+    }
+
+    writer.close();
+    delete plain_stream;
+    return 0;
+  }
+
   std::ostream* out_stream;
 
 #ifdef HAS_GZSTREAM
@@ -75,11 +126,8 @@ int main(int argc, char** argv) {
     out_stream = new std::ofstream(app.getParam("-o").c_str());
   }
 
-  std::vector<std::string> tokens;
-
   bool oov_words=false;
 
-  char cline[65536];
   while (plain_stream->getline(cline,65536)) {
 
     std::string line = cline;
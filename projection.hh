@@ -3,128 +3,100 @@
 #ifndef PROJECTION_HH
 #define PROJECTION_HH
 
+#include <vector>
+
+//returns the threshold tau of the euclidean projection of (first,data[0],...,data[nData-1]) on the probability simplex,
+// i.e. the projection is max(x - tau, 0) for every entry x.
+// This is the algorithm of [L. Condat, "Fast Projection onto the Simplex and the l1 Ball", Math. Programming 2016]:
+// a single pass over the vector collects the candidates for the active set, and a few (usually very short) passes
+// over the candidates remove the ones that fall below the threshold. The expected run-time is linear.
+// aux is used as buffer, it is resized to nData+1
 template <typename T>
-inline void projection_on_simplex(T* data, const uint nData) {
+inline T simplex_projection_threshold(T first, const T* data, const uint nData, std::vector<T>& aux) {
 
-  /**** reproject on the simplices [Michelot 1986]****/
+  aux.resize(nData+1);
 
-  assert(nData > 0);
-  
-  uint nNonZeros = nData;
-
-  //TEST
-  uint iter = 0;
-  uint start = 0;
-  uint end = nData-1;
-  //END_TEST
-
-  while (true) {
-
-    //TEST
-    iter++;
-      
-    if ((iter % 5) == 0) {
-
-      while (data[start] == 0.0)
-        start++;
-      while(data[end] == 0.0)
-        end--;
+  T* const aux0 = &aux[0];
+  T* cand = aux0;
+  int nCand = 1;
+  int nDiscarded = -1;
+
+  aux0[0] = first;
+  T tau = first - 1.0;
+
+  //1.) one pass: the candidates are kept in the front of aux. When the threshold has to be reset, the previous
+  //    candidates are kept in aux as well, but marked as discarded
+  for (uint k=0; k < nData; k++) {
+
+    const T y = data[k];
+    if (y > tau) {
+      cand[nCand] = y;
+      tau += (y - tau) / (nCand - nDiscarded);
+      if (tau <= y - 1.0) {
+        tau = y - 1.0;
+        nDiscarded = nCand - 1;
+      }
+      nCand++;
     }
-    //END_TEST
+  }
 
-    //a) project onto the plane
-    T mean_dev = - 1.0;
+  //2.) reconsider the discarded candidates
+  if (nDiscarded >= 0) {
 
-    //for (uint k=0; k < nData; k++)
-    for (uint k=start; k <= end; k++) {
-      mean_dev += data[k];
-      assert(fabs(data[k]) < 1e75);
+    nCand -= ++nDiscarded;
+    cand += nDiscarded;
+    while (--nDiscarded >= 0) {
+      if (aux0[nDiscarded] > tau) {
+        *(--cand) = aux0[nDiscarded];
+        tau += (*cand - tau) / (++nCand);
+      }
     }
-    
-    mean_dev /= nNonZeros;
-    assert(!isnan(mean_dev));
-      
-    //b) subtract mean
-    bool all_pos = true;
+  }
 
-    const bool first_iter = (nNonZeros == nData);
+  //3.) remove candidates below the threshold until nothing changes
+  int nPrevCand;
+  do {
+    nPrevCand = nCand - 1;
+    nCand = 0;
+    for (int i=0; i <= nPrevCand; i++) {
+      if (cand[i] > tau)
+        cand[nCand++] = cand[i];
+      else
+        tau += (tau - cand[i]) / (nPrevCand - i + nCand);
+    }
+  } while (nCand <= nPrevCand);
 
-    //for (uint k=0; k < nData; k++) {
-    for (uint k=start; k <= end; k++) {
+  return tau;
+}
 
+//aux is used as buffer, so that callers that project repeatedly (e.g. in a line search) allocate only once
+template <typename T>
+inline void projection_on_simplex(T* data, const uint nData, std::vector<T>& aux) {
 
-      T temp = data[k];
+  /**** reproject on the simplices [Condat 2016] ****/
 
-      if (first_iter || temp != 0.0) {
-        temp -= mean_dev;
+  assert(nData > 0);
 
-        if (temp < 1e-12) {
-          all_pos = false;
-          temp = 0.0;
-          nNonZeros--;
-        }
-        data[k] = temp;
-      }
-    }
+  const T tau = simplex_projection_threshold(data[0], data+1, nData-1, aux);
+  assert(!isnan(tau));
 
-    if (all_pos)
-      break;
-  }
+  //the shift is branch-free so that it vectorizes (this matters for long cooccurrence lists)
+#pragma omp simd
+  for (uint k=0; k < nData; k++)
+    data[k] = (data[k] > tau) ? data[k] - tau : 0.0;
 }
 
-inline void projection_on_simplex_with_slack(double* data, double& slack, uint nData) {
+//the slack is an additional entry of the simplex that is not stored in data. aux is used as buffer
+inline void projection_on_simplex_with_slack(double* data, double& slack, uint nData, std::vector<double>& aux) {
 
-  uint nNonZeros = nData + 1;
-
-  while (nNonZeros > 0) {
-      
-    //a) project onto the plane
-    double mean_dev = - 1.0 + slack;
-    for (uint k=0; k < nData; k++) {
-      mean_dev += data[k];
-      assert(fabs(data[k]) < 1e75);
-    }
-    
-    mean_dev /= nNonZeros;
-      
-    //b) subtract mean
-    bool all_pos = true;
-    
-    if (nNonZeros == (nData+1) || slack != 0.0) {
-      slack -= mean_dev;
-
-      if (slack < 0.0)
-        all_pos = false;
-    }
+  const double tau = simplex_projection_threshold(slack, data, nData, aux);
+  assert(!isnan(tau));
 
-    for (uint k=0; k < nData; k++) {
-      
-      if (nNonZeros == (nData+1) || data[k] != 0.0) {
-        data[k] -= mean_dev;
-	
-        if (data[k] < 0.0)
-          all_pos = false;
-      }
-    }
-    
-    if (all_pos)
-      break;
-    
-    //c) fix negatives to 0
-    nNonZeros = nData+1;
-    if (slack < 1e-8) {
-      slack = 0.0;
-      nNonZeros--;
-    }
+  slack = (slack > tau) ? slack - tau : 0.0;
 
-    for (uint k=0; k < nData; k++) {
-	
-      if (data[k] < 1e-8) {
-        data[k] = 0.0;
-        nNonZeros--;
-      }
-    }
-  }
+#pragma omp simd
+  for (uint k=0; k < nData; k++)
+    data[k] = (data[k] > tau) ? data[k] - tau : 0.0;
 }
 
 #endif
@@ -0,0 +1,677 @@
+/*** contributed to RegAligner in 2026 (not by the original author) ***/
+
+//aligns sentence pairs with a model that was trained before (and stored as a checkpoint by regaligner_swb).
+// The model is loaded once, afterwards sentence pairs are read from stdin or from the clients of a local socket.
+// Requests that arrive together are aligned as one batch, distributed over the threads.
+
+#include "makros.hh"
+#include "application.hh"
+#include "corpusio.hh"
+#include "hmm_training.hh"
+#include "ibm3_training.hh"
+#include "ibm4_training.hh"
+#include "training_common.hh"
+#include "alignment_computation.hh"
+#include "stringprocessing.hh"
+#include "checkpoint.hh"
+
+#include <sstream>
+#include <algorithm>
+#include <cstring>
+#include <cerrno>
+#include <csignal>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+
+//a sentence pair to align, together with everything computed for it
+struct AlignmentRequest {
+
+  uint connection_;
+
+  std::vector<uint> source_;
+  std::vector<uint> target_;
+
+  //non-empty if the request cannot be served
+  std::string error_;
+
+  SingleLookupTable lookup_;
+  Math1D::Vector<AlignBaseType> alignment_;
+};
+
+//requests are read from in_fd_ and answered on out_fd_ (for socket clients both are the same)
+struct Connection {
+
+  Connection(int in_fd, int out_fd);
+
+  //moves the next complete line from the buffer to line. Returns false if there is none
+  bool next_line(std::string& line);
+
+  int in_fd_;
+  int out_fd_;
+  std::string buffer_;
+  bool closed_;
+};
+
+Connection::Connection(int in_fd, int out_fd) : in_fd_(in_fd), out_fd_(out_fd), closed_(false) {}
+
+bool Connection::next_line(std::string& line) {
+
+  const size_t pos = buffer_.find('\n');
+  if (pos == std::string::npos)
+    return false;
+
+  line = buffer_.substr(0,pos);
+  buffer_.erase(0,pos+1);
+  return true;
+}
+
+//requests have the form "<source indices> ||| <target indices>"
+void parse_request(const std::string& line, uint nSourceWords, uint nTargetWords, AlignmentRequest& request) {
+
+  const size_t sep = line.find("|||");
+  if (sep == std::string::npos) {
+    request.error_ = "expected \"<source indices> ||| <target indices>\"";
+    return;
+  }
+
+  std::istringstream source_stream(line.substr(0,sep));
+  std::istringstream target_stream(line.substr(sep+3));
+
+  uint idx;
+  while (source_stream >> idx)
+    request.source_.push_back(idx);
+  if (!source_stream.eof()) {
+    request.error_ = "the source sentence contains something other than indices";
+    return;
+  }
+
+  while (target_stream >> idx)
+    request.target_.push_back(idx);
+  if (!target_stream.eof()) {
+    request.error_ = "the target sentence contains something other than indices";
+    return;
+  }
+
+  if (request.source_.empty() || request.target_.empty())
+    request.error_ = "empty sentences are not allowed";
+  else if (request.source_.size() > 254 || request.target_.size() > 254)
+    request.error_ = "maximum sentence length is 254";
+
+  for (uint j=0; request.error_.empty() && j < request.source_.size(); j++) {
+    if (request.source_[j] == 0 || request.source_[j] >= nSourceWords)
+      request.error_ = "source index out of the range of the model";
+  }
+  for (uint i=0; request.error_.empty() && i < request.target_.size(); i++) {
+    if (request.target_[i] == 0 || request.target_[i] >= nTargetWords)
+      request.error_ = "target index out of the range of the model";
+  }
+}
+
+//word pairs that did not cooccur in the training data are added to the dictionary with probability 0
+// (as it happens in training for pairs that only cooccur in the development corpus).
+// They are recorded in added, so that remove_cooccurrences() can take them out after the batch
+void add_cooccurrences(const std::vector<uint>& source, const std::vector<uint>& target,
+                       CooccuringWordsType& wcooc, SingleWordDictionary& dict,
+                       std::map<uint,std::set<uint> >& added) {
+
+  for (uint i=0; i < target.size(); i++) {
+
+    const uint tidx = target[i];
+
+    for (uint j=0; j < source.size(); j++) {
+
+      const uint sidx = source[j];
+
+      Math1D::Vector<uint>& cur_cooc = wcooc[tidx];
+      const uint* start = cur_cooc.direct_access();
+      const size_t pos = std::lower_bound(start,start+cur_cooc.size(),sidx) - start;
+
+      if (pos < cur_cooc.size() && cur_cooc[pos] == sidx)
+        continue;
+
+      Math1D::Vector<uint> new_cooc(cur_cooc.size()+1);
+      Math1D::Vector<double> new_dict(cur_cooc.size()+1);
+      for (size_t k=0; k < pos; k++) {
+        new_cooc[k] = cur_cooc[k];
+        new_dict[k] = dict[tidx][k];
+      }
+      new_cooc[pos] = sidx;
+      new_dict[pos] = 0.0;
+      for (size_t k=pos; k < cur_cooc.size(); k++) {
+        new_cooc[k+1] = cur_cooc[k];
+        new_dict[k+1] = dict[tidx][k];
+      }
+
+      cur_cooc = new_cooc;
+      dict[tidx] = new_dict;
+      added[tidx].insert(sidx);
+    }
+  }
+}
+
+//takes the word pairs added for a batch out of the dictionary again, so that a long-running server does not grow
+// with the vocabulary of its requests
+void remove_cooccurrences(CooccuringWordsType& wcooc, SingleWordDictionary& dict,
+                          std::map<uint,std::set<uint> >& added) {
+
+  for (std::map<uint,std::set<uint> >::const_iterator it = added.begin(); it != added.end(); it++) {
+
+    const uint tidx = it->first;
+    const std::set<uint>& cur_added = it->second;
+
+    const Math1D::Vector<uint>& cur_cooc = wcooc[tidx];
+    const size_t new_size = cur_cooc.size() - cur_added.size();
+
+    Math1D::Vector<uint> new_cooc(new_size);
+    Math1D::Vector<double> new_dict(new_size);
+
+    size_t l=0;
+    for (size_t k=0; k < cur_cooc.size(); k++) {
+      if (cur_added.find(cur_cooc[k]) == cur_added.end()) {
+        new_cooc[l] = cur_cooc[k];
+        new_dict[l] = dict[tidx][k];
+        l++;
+      }
+    }
+    assert(l == new_size);
+
+    wcooc[tidx] = new_cooc;
+    dict[tidx] = new_dict;
+  }
+
+  added.clear();
+}
+
+//true if the changes of the model that prepare_external_alignment() made for one request touch what the
+// alignment of the given request reads
+bool changes_affect(const ExternalModelChanges& changes, const AlignmentRequest& request,
+                    const CooccuringWordsType& wcooc) {
+
+  if (!request.error_.empty())
+    return false;
+  if (changes.global_)
+    return true;
+
+  const std::vector<uint>& source = request.source_;
+  const std::vector<uint>& target = request.target_;
+
+  for (std::map<uint,Math1D::Vector<double> >::const_iterator it = changes.fertility_.begin();
+       it != changes.fertility_.end(); it++) {
+    if (std::find(target.begin(),target.end(),it->first) != target.end())
+      return true;
+  }
+
+  for (size_t k=0; k < changes.dict_entry_.size(); k++) {
+
+    const uint tidx = changes.dict_entry_[k].first.first;
+    const uint pos = changes.dict_entry_[k].first.second;
+
+    //the entries of the empty word are indexed by the source word
+    const uint sidx = (tidx == 0) ? pos+1 : wcooc[tidx][pos];
+
+    if ((tidx == 0 || std::find(target.begin(),target.end(),tidx) != target.end())
+        && std::find(source.begin(),source.end(),sidx) != source.end())
+      return true;
+  }
+
+  return false;
+}
+
+//the following call the IBM-3 or the IBM-4, whichever is used
+void record_model_changes(IBM3Trainer* ibm3_trainer, IBM4Trainer* ibm4_trainer) {
+
+  if (ibm3_trainer != 0)
+    ibm3_trainer->record_model_changes();
+  else
+    ibm4_trainer->record_model_changes();
+}
+
+void restore_model(IBM3Trainer* ibm3_trainer, IBM4Trainer* ibm4_trainer) {
+
+  if (ibm3_trainer != 0)
+    ibm3_trainer->restore_model();
+  else
+    ibm4_trainer->restore_model();
+}
+
+void prepare_alignment(IBM3Trainer* ibm3_trainer, IBM4Trainer* ibm4_trainer, AlignmentRequest& request) {
+
+  const SentenceView source(&request.source_[0],request.source_.size());
+  const SentenceView target(&request.target_[0],request.target_.size());
+
+  if (ibm3_trainer != 0)
+    ibm3_trainer->prepare_external_alignment(source, target, request.lookup_, request.alignment_);
+  else
+    ibm4_trainer->prepare_external_alignment(source, target, request.lookup_, request.alignment_);
+}
+
+void compute_prepared_alignment(IBM3Trainer* ibm3_trainer, IBM4Trainer* ibm4_trainer, AlignmentRequest& request) {
+
+  const SentenceView source(&request.source_[0],request.source_.size());
+  const SentenceView target(&request.target_[0],request.target_.size());
+
+  if (ibm3_trainer != 0)
+    ibm3_trainer->compute_prepared_alignment(source, target, request.lookup_, request.alignment_);
+  else
+    ibm4_trainer->compute_prepared_alignment(source, target, request.lookup_, request.alignment_);
+}
+
+void write_fully(int fd, const std::string& data) {
+
+  size_t pos = 0;
+  while (pos < data.size()) {
+
+    const ssize_t nWritten = write(fd,data.c_str()+pos,data.size()-pos);
+    if (nWritten < 0) {
+      if (errno == EINTR)
+        continue;
+      //the client is gone, its remaining requests are dropped when it is closed
+      return;
+    }
+    pos += nWritten;
+  }
+}
+
+int main(int argc, char** argv) {
+
+  if (argc == 1 || strings_equal(argv[1],"-h")) {
+
+    std::cerr << "USAGE: " << argv[0] << std::endl
+              << " -model <file> : checkpoint written by regaligner_swb (option -checkpoint)" << std::endl
+              << " [-fert-limit <uint>]: fertility limit for IBM-3/4, default: 10000" << std::endl
+              << " [-threads <uint>] : number of threads used for aligning a batch. Default: 1" << std::endl
+              << " [-batch-size <uint>] : maximal number of requests aligned together. Default: 64" << std::endl
+              << " [-socket <file>] : serve the clients of a local (Unix domain) socket instead of stdin" << std::endl
+              << std::endl;
+
+    std::cerr << "The options of the model structure (and the word classes) are taken from the checkpoint." << std::endl
+              << "Every input line \"<source indices> ||| <target indices>\" is answered by a line" << std::endl
+              << "with the alignment (in the format of regaligner_swb) or by \"ERROR: <reason>\"." << std::endl;
+
+    exit(0);
+  }
+
+  const int nParams = 5;
+  ParamDescr  params[nParams] = {{"-model",mandInFilename,0,""},
+                                 {"-fert-limit",optWithValue,1,"10000"},{"-threads",optWithValue,1,"1"},
+                                 {"-batch-size",optWithValue,1,"64"},{"-socket",optWithValue,0,""}};
+
+  Application app(argc,argv,params,nParams);
+
+  const uint nThreads = std::max<uint>(1,convert<uint>(app.getParam("-threads")));
+  const uint batch_size = std::max<uint>(1,convert<uint>(app.getParam("-batch-size")));
+
+  /*** load the model ***/
+
+  Checkpoint model(app.getParam("-model"));
+
+  Math1D::Vector<size_t> corpus_size;
+  Math1D::Vector<uint> max_lengths;
+  model.get_vector("corpus_size",corpus_size);
+  model.get_vector("max_lengths",max_lengths);
+  if (corpus_size.size() != 3 || max_lengths.size() != 2) {
+    USER_ERROR << "the model is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  const uint maxI = max_lengths[1];
+
+  //these include the words of the development corpus
+  const uint nSourceWords = corpus_size[1];
+  const uint nTargetWords = corpus_size[2];
+
+  const TrainingStage stage = model.stage();
+  if (stage == StageIBM2) {
+    USER_ERROR << "alignments for IBM-2 are currently only supported on the training set. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  CooccuringWordsType wcooc(MAKENAME(wcooc));
+  SingleWordDictionary dict(MAKENAME(dict));
+  FullHMMAlignmentModel hmmalign_model(MAKENAME(hmmalign_model));
+  InitialAlignmentProbability initial_prob(MAKENAME(initial_prob));
+
+  Math1D::Vector<double> source_fert;
+  Math1D::Vector<double> hmm_init_params;
+  Math1D::Vector<double> hmm_dist_params;
+  double hmm_dist_grouping_param = -1.0;
+
+  HmmAlignProbType hmm_align_mode = HmmAlignProbReducedpar;
+  HmmInitProbType hmm_init_mode = HmmInitPar;
+
+  model.get_nested("wcooc",wcooc);
+  model.get_nested("dict",dict);
+
+  if (stage >= StageHMM) {
+    model.get_matrix_list("hmm.align_model",hmmalign_model);
+    model.get_nested("hmm.initial_prob",initial_prob);
+    model.get_vector("hmm.dist_params",hmm_dist_params);
+    hmm_dist_grouping_param = model.get_scalar("hmm.dist_grouping_param");
+    model.get_vector("hmm.source_fert",source_fert);
+    model.get_vector("hmm.init_params",hmm_init_params);
+    hmm_align_mode = HmmAlignProbType(model.get_scalar("hmm.align_type"));
+    hmm_init_mode = HmmInitProbType(model.get_scalar("hmm.init_type"));
+  }
+
+  if (wcooc.size() != nTargetWords || dict.size() != nTargetWords) {
+    USER_ERROR << "the model is corrupt. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  for (uint e=0; e < dict.size(); e++) {
+    if (dict[e].sum() == 0.0)
+      dict[e].set_constant(1e-5);
+  }
+
+  //the fertility based models are set up without the training corpus, everything they need is in the checkpoint
+  Corpus source_sentence;
+  Corpus target_sentence;
+  LookupTable slookup;
+  std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > sure_ref_alignments;
+  std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > possible_ref_alignments;
+
+  floatSingleWordDictionary prior_weight(nTargetWords, MAKENAME(prior_weight));
+  for (uint i=0; i < nTargetWords; i++)
+    prior_weight[i].resize(dict[i].size(),0.0);
+
+  IBM3Trainer* ibm3_trainer = 0;
+  IBM4Trainer* ibm4_trainer = 0;
+
+  Storage1D<WordClassType> source_class(nSourceWords,0);
+  Storage1D<WordClassType> target_class(nTargetWords,0);
+
+  if (stage == StageIBM3) {
+
+    ibm3_trainer = new IBM3Trainer(source_sentence, slookup, target_sentence,
+                                   sure_ref_alignments, possible_ref_alignments,
+                                   dict, wcooc, nSourceWords, nTargetWords, prior_weight,
+                                   model.get_scalar("ibm3.parametric_distortion") != 0.0,
+                                   model.get_scalar("ibm3.och_ney_empty_word") != 0.0, false);
+    ibm3_trainer->set_fertility_limit(convert<uint>(app.getParam("-fert-limit")));
+    ibm3_trainer->set_nthreads(nThreads);
+    ibm3_trainer->read_checkpoint(model,true);
+  }
+  else if (stage == StageIBM4) {
+
+    model.get_vector("ibm4.source_class",source_class);
+    model.get_vector("ibm4.target_class",target_class);
+    if (source_class.size() != nSourceWords || target_class.size() != nTargetWords) {
+      USER_ERROR << "the model is corrupt. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    ibm4_trainer = new IBM4Trainer(source_sentence, slookup, target_sentence,
+                                   sure_ref_alignments, possible_ref_alignments,
+                                   dict, wcooc, nSourceWords, nTargetWords, prior_weight, source_class, target_class,
+                                   model.get_scalar("ibm4.och_ney_empty_word") != 0.0,
+                                   model.get_scalar("ibm4.use_sentence_start_prob") != 0.0, true,
+                                   model.get_scalar("ibm4.reduce_deficiency") != 0.0,
+                                   IBM4CeptStartMode(model.get_scalar("ibm4.cept_start_mode")));
+    ibm4_trainer->set_fertility_limit(convert<uint>(app.getParam("-fert-limit")));
+    ibm4_trainer->set_nthreads(nThreads);
+    ibm4_trainer->read_checkpoint(model,true);
+  }
+
+  //the HMM models are derived for every target length when it first occurs
+  std::set<uint> seenIs;
+  FullHMMAlignmentModel ext_hmmalign_model(MAKENAME(ext_hmmalign_model));
+  InitialAlignmentProbability ext_initial_prob(MAKENAME(ext_initial_prob));
+
+  /*** set up the connections ***/
+
+  std::vector<Connection> connection;
+  int listen_fd = -1;
+
+  if (app.is_set("-socket")) {
+
+    const std::string socket_name = app.getParam("-socket");
+
+    struct sockaddr_un address;
+    memset(&address,0,sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (socket_name.size() >= sizeof(address.sun_path)) {
+      USER_ERROR << "the socket name \"" << socket_name << "\" is too long. Exiting..." << std::endl;
+      exit(1);
+    }
+    strcpy(address.sun_path,socket_name.c_str());
+
+    listen_fd = socket(AF_UNIX,SOCK_STREAM,0);
+    unlink(socket_name.c_str());
+    if (listen_fd < 0 || bind(listen_fd,(struct sockaddr*) &address,sizeof(address)) != 0
+        || listen(listen_fd,16) != 0) {
+      IO_ERROR << "could not create the socket \"" << socket_name << "\". Exiting..." << std::endl;
+      exit(1);
+    }
+
+    //a client that disconnects early must not end the server
+    signal(SIGPIPE,SIG_IGN);
+
+    std::cerr << "serving requests on \"" << socket_name << "\"" << std::endl;
+  }
+  else {
+    connection.push_back(Connection(0,1));
+    std::cerr << "serving requests on stdin" << std::endl;
+  }
+
+  /*** serve ***/
+
+  std::vector<AlignmentRequest> batch;
+  std::map<uint,std::set<uint> > added_cooc;
+  std::string line;
+  size_t next_connection = 0;
+
+  while (listen_fd >= 0 || !connection.empty()) {
+
+    //wait for input, but only if no complete request is pending. Everything that is available is read
+    bool pending = false;
+    for (uint c=0; c < connection.size(); c++)
+      pending = pending || (connection[c].buffer_.find('\n') != std::string::npos);
+
+    std::vector<struct pollfd> poll_fd;
+    for (uint c=0; c < connection.size(); c++) {
+      struct pollfd cur_fd = {connection[c].in_fd_, POLLIN, 0};
+      poll_fd.push_back(cur_fd);
+    }
+    if (listen_fd >= 0) {
+      struct pollfd cur_fd = {listen_fd, POLLIN, 0};
+      poll_fd.push_back(cur_fd);
+    }
+
+    if (poll(&poll_fd[0],poll_fd.size(),(pending) ? 0 : -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      IO_ERROR << "waiting for requests failed. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    char buffer[65536];
+    for (uint c=0; c < connection.size(); c++) {
+
+      if ((poll_fd[c].revents & (POLLIN | POLLHUP | POLLERR)) == 0)
+        continue;
+
+      const ssize_t nRead = read(connection[c].in_fd_,buffer,sizeof(buffer));
+      if (nRead > 0)
+        connection[c].buffer_.append(buffer,nRead);
+      else if (nRead == 0 || errno != EINTR) {
+        connection[c].closed_ = true;
+        //a last request without line break is still served
+        if (!connection[c].buffer_.empty() && connection[c].buffer_[connection[c].buffer_.size()-1] != '\n')
+          connection[c].buffer_ += '\n';
+      }
+    }
+
+    if (listen_fd >= 0 && (poll_fd.back().revents & POLLIN) != 0) {
+      const int client_fd = accept(listen_fd,0,0);
+      if (client_fd >= 0)
+        connection.push_back(Connection(client_fd,client_fd));
+    }
+
+    //collect a batch, taking requests from the connections in turn
+    batch.clear();
+    bool found = true;
+    while (batch.size() < batch_size && found) {
+
+      found = false;
+      for (uint k=0; k < connection.size() && batch.size() < batch_size; k++) {
+
+        const uint c = (next_connection + k) % connection.size();
+
+        if (connection[c].next_line(line)) {
+          found = true;
+          batch.push_back(AlignmentRequest());
+          batch.back().connection_ = c;
+          parse_request(line, nSourceWords, nTargetWords, batch.back());
+        }
+      }
+    }
+    if (!connection.empty())
+      next_connection = (next_connection + 1) % connection.size();
+
+    /*** align the batch ***/
+
+    if (!batch.empty()) {
+
+      //changes of the model are made before the threads start
+      bool new_length = false;
+      for (uint k=0; k < batch.size(); k++) {
+        if (batch[k].error_.empty()) {
+          add_cooccurrences(batch[k].source_, batch[k].target_, wcooc, dict, added_cooc);
+          new_length = seenIs.insert(batch[k].target_.size()).second || new_length;
+        }
+      }
+
+      if (stage >= StageHMM && new_length)
+        create_external_hmm_model(seenIs, maxI, hmmalign_model, initial_prob, hmm_init_params, hmm_dist_params,
+                                  hmm_dist_grouping_param, source_fert, hmm_align_mode, hmm_init_mode,
+                                  ext_hmmalign_model, ext_initial_prob);
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+      for (int k=0; k < (int) batch.size(); k++) {
+
+        AlignmentRequest& request = batch[k];
+        if (!request.error_.empty())
+          continue;
+
+        const SentenceView source(&request.source_[0],request.source_.size());
+        const SentenceView target(&request.target_[0],request.target_.size());
+        const uint curI = target.size();
+
+        compute_wordlookup(source, target, wcooc, nSourceWords, request.lookup_);
+
+        if (stage >= StageHMM)
+          compute_ehmm_viterbi_alignment(source, request.lookup_, target, dict, ext_hmmalign_model[curI-1],
+                                         ext_initial_prob[curI-1], request.alignment_, hmm_align_mode, false);
+        else
+          compute_ibm1_viterbi_alignment(source, request.lookup_, target, dict, request.alignment_);
+      }
+
+      if (ibm3_trainer != 0 || ibm4_trainer != 0) {
+
+        //prepare_external_alignment() floors the model where a sentence pair needs it. So that an answer
+        // does not depend on the other requests, every request has to see the loaded model with only its own changes.
+        // Hence the changes of each request are determined first and taken back. Then the requests are aligned
+        // in rounds of consecutive requests whose changes do not touch what the others read, and the model
+        // is restored after each round. The distortion tables of new lengths are kept, they follow from the parameters
+        std::vector<ExternalModelChanges> changes(batch.size());
+
+        for (uint k=0; k < batch.size(); k++) {
+
+          AlignmentRequest& request = batch[k];
+          if (!request.error_.empty())
+            continue;
+
+          const Math1D::Vector<AlignBaseType> start_alignment = request.alignment_;
+
+          record_model_changes(ibm3_trainer, ibm4_trainer);
+          prepare_alignment(ibm3_trainer, ibm4_trainer, request);
+          changes[k] = (ibm3_trainer != 0) ? ibm3_trainer->recorded_changes() : ibm4_trainer->recorded_changes();
+          restore_model(ibm3_trainer, ibm4_trainer);
+
+          request.alignment_ = start_alignment;
+        }
+
+        uint round_start = 0;
+        while (round_start < batch.size()) {
+
+          uint round_end = round_start + 1;
+          bool independent = true;
+          while (independent && round_end < batch.size()) {
+
+            for (uint k=round_start; k < round_end && independent; k++)
+              independent = !changes_affect(changes[k], batch[round_end], wcooc)
+                && !changes_affect(changes[round_end], batch[k], wcooc);
+
+            if (independent)
+              round_end++;
+          }
+
+          record_model_changes(ibm3_trainer, ibm4_trainer);
+
+          for (uint k=round_start; k < round_end; k++) {
+            if (batch[k].error_.empty())
+              prepare_alignment(ibm3_trainer, ibm4_trainer, batch[k]);
+          }
+
+#pragma omp parallel for schedule(dynamic,1) num_threads(nThreads)
+          for (int k=round_start; k < (int) round_end; k++) {
+            if (batch[k].error_.empty())
+              compute_prepared_alignment(ibm3_trainer, ibm4_trainer, batch[k]);
+          }
+
+          restore_model(ibm3_trainer, ibm4_trainer);
+
+          round_start = round_end;
+        }
+      }
+
+      remove_cooccurrences(wcooc, dict, added_cooc);
+
+      /*** answer ***/
+
+      std::vector<std::string> answer(connection.size());
+
+      for (uint k=0; k < batch.size(); k++) {
+
+        const AlignmentRequest& request = batch[k];
+        std::ostringstream out;
+
+        if (!request.error_.empty())
+          out << "ERROR: " << request.error_;
+        else {
+          for (uint j=0; j < request.alignment_.size(); j++) {
+            if (request.alignment_[j] > 0)
+              out << (request.alignment_[j]-1) << " " << j << " ";
+          }
+        }
+        out << std::endl;
+
+        answer[request.connection_] += out.str();
+      }
+
+      for (uint c=0; c < connection.size(); c++) {
+        if (!answer[c].empty())
+          write_fully(connection[c].out_fd_, answer[c]);
+      }
+    }
+
+    //connections are closed when all their requests are answered
+    for (uint c=0; c < connection.size(); ) {
+
+      if (connection[c].closed_ && connection[c].buffer_.empty()) {
+        if (listen_fd >= 0)
+          close(connection[c].in_fd_);
+        connection.erase(connection.begin() + c);
+        next_connection = 0;
+      }
+      else
+        c++;
+    }
+  }
+
+  delete ibm3_trainer;
+  delete ibm4_trainer;
+}
@@ -19,6 +19,7 @@
 #include "alignment_computation.hh"
 #include "alignment_error_rate.hh"
 #include "stringprocessing.hh"
+#include "checkpoint.hh"
 
 #include <fstream>
 
@@ -26,6 +27,57 @@
 #include "gzstream.h"
 #endif
 
+//writes everything the pipeline has trained up to and including the given stage
+void write_checkpoint(std::string prefix, TrainingStage stage, const Corpus& source_sentence, uint maxJ, uint maxI,
+                      uint nSourceWords, uint nTargetWords, const CooccuringWordsType& wcooc,
+                      const SingleWordDictionary& dict, const ReducedIBM2AlignmentModel& reduced_ibm2align_model,
+                      const FullHMMAlignmentModel& hmmalign_model, const InitialAlignmentProbability& initial_prob,
+                      const Math1D::Vector<double>& hmm_dist_params, double hmm_dist_grouping_param,
+                      const Math1D::Vector<double>& source_fert, const Math1D::Vector<double>& hmm_init_params,
+                      HmmAlignProbType hmm_align_mode, HmmInitProbType hmm_init_mode,
+                      const IBM3Trainer* ibm3_trainer = 0, const IBM4Trainer* ibm4_trainer = 0) {
+
+  const char* stage_name[6] = {"none","ibm1","ibm2","hmm","ibm3","ibm4"};
+
+  CheckpointWriter writer(prefix + "." + stage_name[stage] + ".ckpt",stage);
+
+  Math1D::Vector<size_t> corpus_size(3);
+  corpus_size[0] = source_sentence.size();
+  corpus_size[1] = nSourceWords;
+  corpus_size[2] = nTargetWords;
+  writer.add_vector("corpus_size",corpus_size);
+
+  //the maximal sentence lengths of the training corpus
+  Math1D::Vector<uint> max_lengths(2);
+  max_lengths[0] = maxJ;
+  max_lengths[1] = maxI;
+  writer.add_vector("max_lengths",max_lengths);
+
+  writer.add_nested("wcooc",wcooc);
+  writer.add_nested("dict",dict);
+
+  if (reduced_ibm2align_model.size() > 0)
+    writer.add_matrix_list("ibm2.align_model",reduced_ibm2align_model);
+
+  if (stage >= StageHMM) {
+    writer.add_matrix_list("hmm.align_model",hmmalign_model);
+    writer.add_nested("hmm.initial_prob",initial_prob);
+    writer.add_vector("hmm.dist_params",hmm_dist_params);
+    writer.add_scalar("hmm.dist_grouping_param",hmm_dist_grouping_param);
+    writer.add_vector("hmm.source_fert",source_fert);
+    writer.add_vector("hmm.init_params",hmm_init_params);
+    writer.add_scalar("hmm.align_type",hmm_align_mode);
+    writer.add_scalar("hmm.init_type",hmm_init_mode);
+  }
+
+  if (ibm3_trainer != 0)
+    ibm3_trainer->write_checkpoint(writer);
+  if (ibm4_trainer != 0)
+    ibm4_trainer->write_checkpoint(writer);
+
+  writer.close();
+}
+
 int main(int argc, char** argv) {
 
   if (argc == 1 || strings_equal(argv[1],"-h")) {
@@ -62,8 +114,20 @@ int main(int argc, char** argv) {
               << " [-org-empty-word] : for IBM 3/4 use empty word as originally published" << std::endl
               << " [-dont-reduce-deficiency] : use non-normalized probabilities for IBM-4 (as in Brown et al.)" << std::endl
               << " [-nonpar-distortion] : use extended set of distortion parameters for IBM-3" << std::endl
-              << " [-dont-print-energy] : do not print the energy (speeds up EM for IBM-1 and HMM)" << std::endl
-              << " [-max-lookup <uint>] : only store lookup tables up to this size. Default: 65535" << std::endl
+              << " [-dont-print-energy] : do not print the energy (the perplexity is still printed)" << std::endl
+              << " [-hmm-scaling] : HMM EM with rescaled double precision forward-backward instead of long double" << std::endl
+              << " [-lookup-mem <uint>] : memory (in MB) for storing lookup tables, the others are computed when needed. Default: 1024" << std::endl
+              << " [-cooc-mem <uint>] : memory (in MB) for finding cooccuring words, beyond that temporary files are used. Default: 2048" << std::endl
+              << " [-ibm4-cache-mem <uint>] : memory (in MB) for the IBM-4 inter distortion tables, the least recently used ones are" << std::endl
+              << "                            recomputed when needed. Default: 64" << std::endl
+              << " [-threads <uint>] : number of threads used in the E-steps. Default: 1" << std::endl
+              << " [-corpus-order] : the E-steps visit the sentence pairs in corpus order instead of grouped by length" << std::endl
+              << " [-stream-chunk <uint>] : for binary corpora that exceed the memory: the E-steps traverse the corpus in chunks" << std::endl
+              << "                          of this many sentence pairs per thread and read the next chunk in advance. Default: 0 (off)" << std::endl
+              << "                          CAUTION: the grouping by length then only takes place within a chunk, so the sums are" << std::endl
+              << "                          collected in a different order and the results depend on the chunk size" << std::endl
+              << " [-checkpoint <prefix>] : after each stage write the model to <prefix>.<stage>.ckpt" << std::endl
+              << " [-resume <file>] : continue the training after the stage stored in the given checkpoint" << std::endl
               << " [-o <file>] : the determined dictionary is written to this file" << std::endl
               << " -oa <file> : the determined alignment is written to this file" << std::endl
               << std::endl;
@@ -73,7 +137,7 @@ int main(int argc, char** argv) {
     exit(0);
   }
 
-  const int nParams = 36;
+  const int nParams = 44;
   ParamDescr  params[nParams] = {{"-s",mandInFilename,0,""},{"-t",mandInFilename,0,""},
                                  {"-ds",optInFilename,0,""},{"-dt",optInFilename,0,""},
                                  {"-o",optOutFilename,0,""},{"-oa",mandOutFilename,0,""},
@@ -92,15 +156,19 @@ int main(int argc, char** argv) {
                                  {"-ibm1-transfer-mode",optWithValue,1,"no"},{"-dict-struct",optWithValue,0,""},
                                  {"-dont-reduce-deficiency",flag,0,""},{"-count-collection",flag,0,""},
 				 {"-sclasses",optInFilename,0,""},{"-tclasses",optInFilename,0,""},
-                                 {"-max-lookup",optWithValue,1,"65535"}};
+                                 {"-lookup-mem",optWithValue,1,"1024"},{"-threads",optWithValue,1,"1"},
+                                 {"-cooc-mem",optWithValue,1,"2048"},{"-checkpoint",optWithValue,0,""},
+                                 {"-resume",optInFilename,0,""},{"-hmm-scaling",flag,0,""},
+                                 {"-corpus-order",flag,0,""},{"-stream-chunk",optWithValue,1,"0"},
+                                 {"-ibm4-cache-mem",optWithValue,1,"64"}};
 
   Application app(argc,argv,params,nParams);
 
-  NamedStorage1D<Storage1D<uint> > source_sentence(MAKENAME(source_sentence));
-  NamedStorage1D<Storage1D<uint> > target_sentence(MAKENAME(target_sentence));
+  Corpus source_sentence;
+  Corpus target_sentence;
 
-  NamedStorage1D<Storage1D<uint> > dev_source_sentence(MAKENAME(dev_source_sentence));
-  NamedStorage1D<Storage1D<uint> > dev_target_sentence(MAKENAME(dev_target_sentence));  
+  Corpus dev_source_sentence;
+  Corpus dev_target_sentence;  
 
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > sure_ref_alignments;
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > possible_ref_alignments;
@@ -136,7 +204,13 @@ int main(int argc, char** argv) {
 
   uint fert_limit = convert<uint>(app.getParam("-fert-limit"));
 
-  const uint max_lookup = convert<uint>(app.getParam("-max-lookup"));
+  const size_t lookup_mem = size_t(convert<uint>(app.getParam("-lookup-mem"))) * 1024 * 1024;
+  const size_t cooc_mem = size_t(convert<uint>(app.getParam("-cooc-mem"))) * 1024 * 1024;
+  const size_t ibm4_cache_mem = size_t(convert<uint>(app.getParam("-ibm4-cache-mem"))) * 1024 * 1024;
+
+  const uint nThreads = std::max<uint>(1,convert<uint>(app.getParam("-threads")));
+  const bool sort_by_length = !app.is_set("-corpus-order");
+  const size_t stream_chunk_size = convert<size_t>(app.getParam("-stream-chunk"));
 
   double postdec_thresh = convert<double>(app.getParam("-postdec-thresh"));
 
@@ -306,19 +380,71 @@ int main(int argc, char** argv) {
   else if (hmm_init_string == "fix2")
     hmm_init_mode = HmmInitFix2;
 
-  std::cerr << "finding cooccuring words" << std::endl;
-  bool read_in = false;
-  if (app.is_set("-dict-struct")) {
+  const bool write_checkpoints = app.is_set("-checkpoint");
+  const std::string checkpoint_prefix = (write_checkpoints) ? app.getParam("-checkpoint") : "";
+
+  Checkpoint* resume = 0;
+  TrainingStage resume_stage = StageNone;
+
+  if (app.is_set("-resume")) {
+
+    resume = new Checkpoint(app.getParam("-resume"));
+    resume_stage = resume->stage();
+
+    Math1D::Vector<size_t> corpus_size;
+    resume->get_vector("corpus_size",corpus_size);
+    if (corpus_size.size() != 3 || corpus_size[0] != source_sentence.size() 
+        || corpus_size[1] != nSourceWords || corpus_size[2] != nTargetWords) {
+      USER_ERROR << "the checkpoint does not match the corpus. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    if ((resume_stage == StageIBM2 && ibm2_iter == 0) || (resume_stage == StageIBM3 && ibm3_iter == 0)
+        || (resume_stage == StageIBM4 && ibm4_iter == 0)) {
+      USER_ERROR << "the stage of the checkpoint is switched off by the given iteration counts. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    std::cerr << "resuming from checkpoint" << std::endl;
+
+    resume->get_nested("wcooc",wcooc);
+    resume->get_nested("dict",dict);
+
+    if (resume->has("ibm2.align_model.dim"))
+      resume->get_matrix_list("ibm2.align_model",reduced_ibm2align_model);
+
+    if (resume_stage >= StageHMM) {
+      resume->get_matrix_list("hmm.align_model",hmmalign_model);
+      resume->get_nested("hmm.initial_prob",initial_prob);
+      resume->get_vector("hmm.dist_params",hmm_dist_params);
+      hmm_dist_grouping_param = resume->get_scalar("hmm.dist_grouping_param");
+      resume->get_vector("hmm.source_fert",source_fert);
+      resume->get_vector("hmm.init_params",hmm_init_params);
 
-    read_in = read_cooccuring_words_structure(app.getParam("-dict-struct"), nSourceWords, nTargetWords, wcooc);
+      if (HmmAlignProbType(resume->get_scalar("hmm.align_type")) != hmm_align_mode
+          || HmmInitProbType(resume->get_scalar("hmm.init_type")) != hmm_init_mode) {
+        USER_ERROR << "the HMM of the checkpoint was trained with different options (-hmm-type, -hmm-init-type, -method)."
+                   << " Exiting..." << std::endl;
+        exit(1);
+      }
+    }
+  }
+  else {
+
+    std::cerr << "finding cooccuring words" << std::endl;
+    bool read_in = false;
+    if (app.is_set("-dict-struct")) {
+      
+      read_in = read_cooccuring_words_structure(app.getParam("-dict-struct"), nSourceWords, nTargetWords, wcooc);
+    }
+    if (!read_in)
+      find_cooccuring_words(source_sentence, target_sentence, dev_source_sentence, dev_target_sentence, 
+                            nSourceWords, nTargetWords, wcooc, nThreads, cooc_mem);
   }
-  if (!read_in)
-    find_cooccuring_words(source_sentence, target_sentence, dev_source_sentence, dev_target_sentence, 
-                          nSourceWords, nTargetWords, wcooc);
   
   std::cerr << "generating lookup table" << std::endl;
   LookupTable slookup;
-  generate_wordlookup(source_sentence, target_sentence, wcooc, nSourceWords, slookup, max_lookup);
+  generate_wordlookup(source_sentence, target_sentence, wcooc, nSourceWords, slookup, lookup_mem);
 
     
   floatSingleWordDictionary prior_weight(nTargetWords, MAKENAME(prior_weight));
@@ -420,26 +546,35 @@ int main(int argc, char** argv) {
   ibm1_options.smoothed_l0_ = em_l0;
   ibm1_options.l0_beta_ = l0_beta;
   ibm1_options.print_energy_ = !app.is_set("-dont-print-energy");
+  ibm1_options.nThreads_ = nThreads;
 
-  if (method == "em") {
+  if (resume_stage < StageIBM1) {
 
-    train_ibm1(source_sentence, slookup, target_sentence, wcooc, dict, 
-               prior_weight, ibm1_options);
-  }
-  else if (method == "gd") {
-
-    train_ibm1_gd_stepcontrol(source_sentence, slookup, target_sentence, wcooc, dict, 
-                              prior_weight, ibm1_options); 
-  }
-  else {
+    if (method == "em") {
+      
+      train_ibm1(source_sentence, slookup, target_sentence, wcooc, dict, 
+                 prior_weight, ibm1_options);
+    }
+    else if (method == "gd") {
+      
+      train_ibm1_gd_stepcontrol(source_sentence, slookup, target_sentence, wcooc, dict, 
+                                prior_weight, ibm1_options); 
+    }
+    else {
+      
+      ibm1_viterbi_training(source_sentence, slookup, target_sentence, wcooc, dict, 
+                            prior_weight, ibm1_options);
+    }
 
-    ibm1_viterbi_training(source_sentence, slookup, target_sentence, wcooc, dict, 
-                          prior_weight, ibm1_options);
+    if (write_checkpoints)
+      write_checkpoint(checkpoint_prefix, StageIBM1, source_sentence, maxJ, maxI, nSourceWords, nTargetWords, wcooc, dict,
+                       reduced_ibm2align_model, hmmalign_model, initial_prob, hmm_dist_params, 
+                       hmm_dist_grouping_param, source_fert, hmm_init_params, hmm_align_mode, hmm_init_mode);
   }
 
   /*** IBM-2 ***/
 
-  if (ibm2_iter > 0) {
+  if (ibm2_iter > 0 && resume_stage < StageIBM2) {
     
     find_cooccuring_lengths(source_sentence, target_sentence, lcooc);
 
@@ -447,21 +582,26 @@ int main(int argc, char** argv) {
 
       train_reduced_ibm2(source_sentence,  slookup, target_sentence, wcooc, lcooc,
                          nSourceWords, nTargetWords, reduced_ibm2align_model, dict, ibm2_iter,
-                         sure_ref_alignments, possible_ref_alignments);
+                         sure_ref_alignments, possible_ref_alignments, sort_by_length, nThreads);
     }
     else if (method == "gd") {
 
       std::cerr << "WARNING: IBM-2 is not available with gradient descent" << std::endl;
       train_reduced_ibm2(source_sentence,  slookup, target_sentence, wcooc, lcooc,
                          nSourceWords, nTargetWords, reduced_ibm2align_model, dict, ibm2_iter,
-                         sure_ref_alignments, possible_ref_alignments);
+                         sure_ref_alignments, possible_ref_alignments, sort_by_length, nThreads);
     }
     else {
 
       ibm2_viterbi_training(source_sentence, slookup, target_sentence, wcooc, lcooc, nSourceWords, nTargetWords, 
                             reduced_ibm2align_model, dict, ibm2_iter, sure_ref_alignments, possible_ref_alignments, 
-                            prior_weight);
+                            prior_weight, sort_by_length, nThreads);
     }
+
+    if (write_checkpoints)
+      write_checkpoint(checkpoint_prefix, StageIBM2, source_sentence, maxJ, maxI, nSourceWords, nTargetWords, wcooc, dict,
+                       reduced_ibm2align_model, hmmalign_model, initial_prob, hmm_dist_params, 
+                       hmm_dist_grouping_param, source_fert, hmm_init_params, hmm_align_mode, hmm_init_mode);
   }
 
   /*** HMM ***/
@@ -473,6 +613,10 @@ int main(int argc, char** argv) {
   hmm_options.smoothed_l0_ = em_l0;
   hmm_options.l0_beta_ = l0_beta;
   hmm_options.print_energy_ = !app.is_set("-dont-print-energy");
+  hmm_options.scaled_forward_backward_ = app.is_set("-hmm-scaling");
+  hmm_options.nThreads_ = nThreads;
+  hmm_options.sort_by_length_ = sort_by_length;
+  hmm_options.stream_chunk_size_ = stream_chunk_size;
 
   std::string ibm1_transfer_mode = downcase(app.getParam("-ibm1-transfer-mode"));
   if (ibm1_transfer_mode != "no" && ibm1_transfer_mode != "viterbi" && ibm1_transfer_mode != "posterior") {
@@ -486,24 +630,32 @@ int main(int argc, char** argv) {
   else if (ibm1_transfer_mode == "viterbi")
     hmm_options.transfer_mode_ = IBM1TransferViterbi;
 
-  if (method == "em") {
+  if (resume_stage < StageHMM) {
 
-    train_extended_hmm(source_sentence, slookup, target_sentence, wcooc, 
-                       hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
-                       initial_prob, hmm_init_params, dict, prior_weight, hmm_options);
-  }
-  else if (method == "gd") {
-
-    train_extended_hmm_gd_stepcontrol(source_sentence, slookup, target_sentence, wcooc, 
-                                      hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
-                                      initial_prob, hmm_init_params, dict, prior_weight, hmm_options); 
-  }
-  else {
+    if (method == "em") {
+      
+      train_extended_hmm(source_sentence, slookup, target_sentence, wcooc, 
+                         hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
+                         initial_prob, hmm_init_params, dict, prior_weight, hmm_options);
+    }
+    else if (method == "gd") {
+      
+      train_extended_hmm_gd_stepcontrol(source_sentence, slookup, target_sentence, wcooc, 
+                                        hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
+                                        initial_prob, hmm_init_params, dict, prior_weight, hmm_options); 
+    }
+    else {
+      
+      viterbi_train_extended_hmm(source_sentence, slookup, target_sentence, wcooc, 
+                                 hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
+                                 initial_prob, hmm_init_params, dict, 
+                                 prior_weight, false, hmm_options);
+    }
 
-    viterbi_train_extended_hmm(source_sentence, slookup, target_sentence, wcooc, 
-                               hmmalign_model, hmm_dist_params, hmm_dist_grouping_param, source_fert,
-                               initial_prob, hmm_init_params, dict, 
-                               prior_weight, false, hmm_options);
+    if (write_checkpoints)
+      write_checkpoint(checkpoint_prefix, StageHMM, source_sentence, maxJ, maxI, nSourceWords, nTargetWords, wcooc, dict,
+                       reduced_ibm2align_model, hmmalign_model, initial_prob, hmm_dist_params, 
+                       hmm_dist_grouping_param, source_fert, hmm_init_params, hmm_align_mode, hmm_init_mode);
   }
   
   /*** IBM-3 ***/
@@ -517,36 +669,50 @@ int main(int argc, char** argv) {
                            false, l0_fertpen, em_l0, l0_beta);
 
   ibm3_trainer.set_fertility_limit(fert_limit);
+  ibm3_trainer.set_nthreads(nThreads);
+  ibm3_trainer.set_sort_by_length(sort_by_length);
+  ibm3_trainer.set_stream_chunk_size(stream_chunk_size);
   if (fert_p0 >= 0.0)
     ibm3_trainer.fix_p0(fert_p0);
 
-  if (ibm3_iter+ibm4_iter > 0)
-    ibm3_trainer.init_from_hmm(hmmalign_model,initial_prob,hmm_options,method == "viterbi");
+  if (resume_stage < StageIBM3) {
 
-  if (ibm3_iter > 0) {
+    if (ibm3_iter+ibm4_iter > 0)
+      ibm3_trainer.init_from_hmm(hmmalign_model,initial_prob,hmm_options,method == "viterbi");
 
-    if (method == "em" || method == "gd") {
+    if (ibm3_iter > 0) {
       
-      std::string constraint_mode = downcase(app.getParam("-constraint-mode"));
-
-      if (constraint_mode == "unconstrained") {
-        ibm3_trainer.train_unconstrained(ibm3_iter);
-      }
-      else if (constraint_mode == "itg") 
-        ibm3_trainer.train_with_itg_constraints(ibm3_iter,true);
-      else if (constraint_mode == "ibm") 
-        ibm3_trainer.train_with_ibm_constraints(ibm3_iter,5,3);
-      else {
-        USER_ERROR << "unknown constraint mode: \"" << constraint_mode << "\". Exiting" << std::endl;
-        exit(1);
+      if (method == "em" || method == "gd") {
+        
+        std::string constraint_mode = downcase(app.getParam("-constraint-mode"));
+        
+        if (constraint_mode == "unconstrained") {
+          ibm3_trainer.train_unconstrained(ibm3_iter);
+        }
+        else if (constraint_mode == "itg") 
+          ibm3_trainer.train_with_itg_constraints(ibm3_iter,true);
+        else if (constraint_mode == "ibm") 
+          ibm3_trainer.train_with_ibm_constraints(ibm3_iter,5,3);
+        else {
+          USER_ERROR << "unknown constraint mode: \"" << constraint_mode << "\". Exiting" << std::endl;
+          exit(1);
+        }
       }
+      else
+        ibm3_trainer.train_viterbi(ibm3_iter,false);
+      
+      if (ibm4_iter == 0 || !app.is_set("-count-collection"))
+        ibm3_trainer.update_alignments_unconstrained();
+
+      if (write_checkpoints)
+        write_checkpoint(checkpoint_prefix, StageIBM3, source_sentence, maxJ, maxI, nSourceWords, nTargetWords, wcooc, dict,
+                         reduced_ibm2align_model, hmmalign_model, initial_prob, hmm_dist_params, 
+                         hmm_dist_grouping_param, source_fert, hmm_init_params, hmm_align_mode, hmm_init_mode,
+                         &ibm3_trainer);
     }
-    else
-      ibm3_trainer.train_viterbi(ibm3_iter,false);
-  
-    if (ibm4_iter == 0 || !app.is_set("-count-collection"))
-      ibm3_trainer.update_alignments_unconstrained();
   }
+  else if (resume_stage == StageIBM3)
+    ibm3_trainer.read_checkpoint(*resume);
 
   /*** IBM-4 ***/
 
@@ -579,14 +745,17 @@ int main(int argc, char** argv) {
                            dict, wcooc, nSourceWords, nTargetWords, prior_weight, 
                            source_class, target_class, !app.is_set("-org-empty-word"), true, true,
                            !app.is_set("-dont-reduce-deficiency"), 
-                           ibm4_cept_mode, em_l0, l0_beta, l0_fertpen);
+                           ibm4_cept_mode, em_l0, l0_beta, l0_fertpen, ibm4_cache_mem);
 
   ibm4_trainer.set_fertility_limit(fert_limit);
+  ibm4_trainer.set_nthreads(nThreads);
+  ibm4_trainer.set_sort_by_length(sort_by_length);
+  ibm4_trainer.set_stream_chunk_size(stream_chunk_size);
   if (fert_p0 >= 0.0)
     ibm4_trainer.fix_p0(fert_p0);
 
 
-  if (ibm4_iter > 0) {
+  if (ibm4_iter > 0 && resume_stage < StageIBM4) {
     bool collect_counts = false;
     
     ibm4_trainer.init_from_ibm3(ibm3_trainer,true,collect_counts,method == "viterbi");
@@ -600,17 +769,23 @@ int main(int argc, char** argv) {
       ibm4_trainer.train_unconstrained(ibm4_iter);
 
     //ibm4_trainer.update_alignments_unconstrained();
-  }
 
-  LookupTable dev_slookup;
-  if (dev_present) {
-    generate_wordlookup(dev_source_sentence, dev_target_sentence, wcooc, nSourceWords, dev_slookup);
+    if (write_checkpoints)
+      write_checkpoint(checkpoint_prefix, StageIBM4, source_sentence, maxJ, maxI, nSourceWords, nTargetWords, wcooc, dict,
+                       reduced_ibm2align_model, hmmalign_model, initial_prob, hmm_dist_params, 
+                       hmm_dist_grouping_param, source_fert, hmm_init_params, hmm_align_mode, hmm_init_mode,
+                       0, &ibm4_trainer);
   }
+  else if (resume_stage == StageIBM4)
+    ibm4_trainer.read_checkpoint(*resume);
 
-  /*** write alignments ***/
+  delete resume;
 
-  int max_devJ = 0;
-  int max_devI = 0;
+  Storage1D<SingleLookupTable> dev_slookup(dev_source_sentence.size());
+  for (size_t s = 0; s < dev_source_sentence.size(); s++)
+    compute_wordlookup(dev_source_sentence[s], dev_target_sentence[s], wcooc, nSourceWords, dev_slookup[s]);
+
+  /*** write alignments ***/
 
   std::set<uint> dev_seenIs;
 
@@ -618,119 +793,17 @@ int main(int argc, char** argv) {
   if (string_ends_with(app.getParam("-oa"),".gz"))
     dev_file += ".gz";
 
-  if (dev_present) {
-    for (size_t s = 0; s < dev_source_sentence.size(); s++) {
-
-      const int curI = dev_target_sentence[s].size();
-      const int curJ = dev_source_sentence[s].size();
-
-      dev_seenIs.insert(curI);
-
-      max_devJ = std::max(max_devJ,curJ);
-      max_devI = std::max(max_devI,curI);	
-    }
-  }
-
-  Math1D::Vector<double> dev_hmm_init_params(max_devI,0.0);
-  Math1D::Vector<double> dev_hmm_dist_params(std::max(2*max_devI-1,0),0.0);
   FullHMMAlignmentModel dev_hmmalign_model(MAKENAME(dev_hmmalign_model));
   InitialAlignmentProbability dev_initial_prob(MAKENAME(dev_initial_prob));
 
-  uint dev_zero_offset = max_devI - 1;
-
   if (dev_present) {
-    
-    uint train_zero_offset = maxI - 1;
-    
-    //handle case where init and/or distance parameters were not estimated above for <emph>train</emph>
-    if (hmm_init_mode == HmmInitNonpar || hmm_init_params.sum() < 1e-5) {
 
-      hmm_init_params.resize(maxI);
-      hmm_init_params.set_constant(0.0);
-
-      for (uint I=1; I <= maxI; I++) {
-        
-        for (uint l=0; l < std::min<uint>(I,initial_prob[I-1].size()); l++) {
-          if (l < hmm_init_params.size()) 
-            hmm_init_params[l] += initial_prob[I-1][l];
-        }
-      }
-      
-      double sum = hmm_init_params.sum();
-      assert(sum > 0.0);
-      hmm_init_params *= 1.0 / sum;
-    }
-    
-    if (hmm_align_mode == HmmAlignProbNonpar || hmm_align_mode == HmmAlignProbNonpar2 || hmm_dist_params.sum() < 1e-5) {
+    for (size_t s = 0; s < dev_source_sentence.size(); s++)
+      dev_seenIs.insert(dev_target_sentence[s].size());
 
-      hmm_dist_grouping_param = -1.0;
-
-      hmm_dist_params.resize(2*maxI-1);
-      hmm_dist_params.set_constant(0.0);
-      
-      for (uint I=1; I <= maxI; I++) {
-        
-        for (uint i1 = 0; i1 < hmmalign_model[I-1].yDim(); i1++) 
-          for (uint i2 = 0; i2 < I; i2++) 
-            hmm_dist_params[train_zero_offset + i2 - i1] += hmmalign_model[I-1](i1,i2);
-      }
-      
-      hmm_dist_params *= 1.0 / hmm_dist_params.sum();
-    }
-
-    if ((hmm_init_mode == HmmInitNonpar && hmm_align_mode == HmmAlignProbNonpar) 
-        || source_fert.sum() < 0.95) {
-      
-      source_fert.resize(2);
-      source_fert[0] = 0.02;
-      source_fert[1] = 0.98;
-    }
-
-    for (uint i=0; i < std::min<uint>(max_devI,hmm_init_params.size()); i++) {
-      dev_hmm_init_params[i] = hmm_init_params[i];	
-      
-      dev_hmm_dist_params[dev_zero_offset - i] = hmm_dist_params[train_zero_offset - i];
-      dev_hmm_dist_params[dev_zero_offset + i] = hmm_dist_params[train_zero_offset + i];
-    }
-
-    dev_hmmalign_model.resize(max_devI+1);
-    dev_initial_prob.resize(max_devI+1);
-
-    for (std::set<uint>::iterator it = dev_seenIs.begin(); it != dev_seenIs.end(); it++) {
-      
-      uint I = *it;
-      
-      dev_hmmalign_model[I-1].resize(I+1,I,0.0); //because of empty words
-      dev_initial_prob[I-1].resize(2*I,0.0);
-    }
-
-    if (hmm_init_mode != HmmInitFix && hmm_init_mode != HmmInitFix2) {
-      par2nonpar_hmm_init_model(dev_hmm_init_params, source_fert, HmmInitPar, dev_initial_prob);
-      if (hmm_init_mode == HmmInitNonpar) {
-        for (uint I=0; I < std::min(dev_initial_prob.size(),initial_prob.size()); I++) {
-          if (dev_initial_prob[I].size() > 0 && initial_prob[I].size() > 0)
-            dev_initial_prob[I] = initial_prob[I];
-        }
-      }
-    }
-    else {
-      par2nonpar_hmm_init_model(dev_hmm_init_params, source_fert, hmm_init_mode, dev_initial_prob);
-    }
-
-    HmmAlignProbType mode = hmm_align_mode;
-    if (mode == HmmAlignProbNonpar || hmm_align_mode == HmmAlignProbNonpar2)
-      mode = HmmAlignProbFullpar;
-    
-    par2nonpar_hmm_alignment_model(dev_hmm_dist_params, dev_zero_offset, hmm_dist_grouping_param, source_fert,
-                                   mode, dev_hmmalign_model);
-    
-    if (hmm_align_mode == HmmAlignProbNonpar || hmm_align_mode == HmmAlignProbNonpar2) {
-      
-      for (uint I=0; I < std::min(dev_hmmalign_model.size(),hmmalign_model.size()); I++) {
-        if (dev_hmmalign_model.size() > 0 && hmmalign_model.size() > 0)
-          dev_hmmalign_model[I] = hmmalign_model[I];
-      }
-    }
+    create_external_hmm_model(dev_seenIs, maxI, hmmalign_model, initial_prob, hmm_init_params, hmm_dist_params,
+                              hmm_dist_grouping_param, source_fert, hmm_align_mode, hmm_init_mode,
+                              dev_hmmalign_model, dev_initial_prob);
 
     for (uint e=0; e < dict.size(); e++) {
       if (dict[e].sum() == 0.0)
@@ -890,7 +963,7 @@ int main(int argc, char** argv) {
 
       const uint curI = target_sentence[s].size();
 
-      SingleLookupTable aux_lookup;
+      WordLookupBuffers aux_lookup;
       const SingleLookupTable& cur_lookup = get_wordlookup(source_sentence[s],target_sentence[s],wcooc,
                                                            nSourceWords,slookup[s],aux_lookup);  
       
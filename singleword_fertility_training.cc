@@ -15,11 +15,13 @@
 #include <set>
 #include "stl_out.hh"
 
+ExternalModelChanges::ExternalModelChanges() : global_(false) {}
+
 /************* implementation of FertilityModelTrainer *******************************/
 
-FertilityModelTrainer::FertilityModelTrainer(const Storage1D<Storage1D<uint> >& source_sentence,
+FertilityModelTrainer::FertilityModelTrainer(const Corpus& source_sentence,
                                              const LookupTable& slookup,
-                                             const Storage1D<Storage1D<uint> >& target_sentence,
+                                             const Corpus& target_sentence,
                                              SingleWordDictionary& dict,
                                              const CooccuringWordsType& wcooc,
                                              uint nSourceWords, uint nTargetWords,
@@ -42,6 +44,10 @@ FertilityModelTrainer::FertilityModelTrainer(const Storage1D<Storage1D<uint> >&
   maxJ_ = 0;
   maxI_ = 0;
   fertility_limit_ = fertility_limit;
+  nThreads_ = 1;
+  sort_by_length_ = true;
+  stream_chunk_size_ = 0;
+  record_changes_ = false;
   
   for (size_t s=0; s < source_sentence.size(); s++) {
 
@@ -65,6 +71,8 @@ FertilityModelTrainer::FertilityModelTrainer(const Storage1D<Storage1D<uint> >&
     }
   }
   
+  combinatorics_.resize(maxJ_);
+
   for (uint i=0; i < nTargetWords; i++) {
     fertility_prob_[i].resize_dirty(max_fertility[i]+1);
     fertility_prob_[i].set_constant(1.0 / (max_fertility[i]+1));
@@ -102,6 +110,95 @@ void FertilityModelTrainer::set_fertility_limit(uint new_limit) {
   fertility_limit_ = new_limit;
 }
 
+void FertilityModelTrainer::set_nthreads(uint nThreads) {
+  nThreads_ = std::max<uint>(1,nThreads);
+}
+
+void FertilityModelTrainer::set_sort_by_length(bool sort_by_length) {
+  sort_by_length_ = sort_by_length;
+}
+
+void FertilityModelTrainer::set_stream_chunk_size(size_t chunk_size) {
+  stream_chunk_size_ = chunk_size;
+}
+
+const ExternalModelChanges& FertilityModelTrainer::recorded_changes() const {
+  return model_changes_;
+}
+
+void FertilityModelTrainer::set_dict_entry(uint t, uint k, double value) {
+
+  if (record_changes_)
+    model_changes_.dict_entry_.push_back(std::make_pair(std::make_pair(t,k),dict_[t][k]));
+
+  dict_[t][k] = value;
+}
+
+void FertilityModelTrainer::save_fertilities(uint t) {
+
+  if (record_changes_ && model_changes_.fertility_.find(t) == model_changes_.fertility_.end())
+    model_changes_.fertility_[t] = fertility_prob_[t];
+}
+
+void FertilityModelTrainer::restore_dict_and_fertilities() {
+
+  //in reverse order, so that an entry that was changed several times gets its first value
+  for (size_t k = model_changes_.dict_entry_.size(); k > 0; k--) {
+    const std::pair<std::pair<uint,uint>,double>& change = model_changes_.dict_entry_[k-1];
+    dict_[change.first.first][change.first.second] = change.second;
+  }
+
+  for (std::map<uint,Math1D::Vector<double> >::const_iterator it = model_changes_.fertility_.begin();
+       it != model_changes_.fertility_.end(); it++)
+    fertility_prob_[it->first] = it->second;
+
+  model_changes_ = ExternalModelChanges();
+  record_changes_ = false;
+}
+
+void FertilityModelTrainer::write_fertility_checkpoint(CheckpointWriter& writer, std::string prefix) const {
+
+  Math1D::Vector<uint> max_lengths(2);
+  max_lengths[0] = maxJ_;
+  max_lengths[1] = maxI_;
+
+  writer.add_nested(prefix + "fertility_prob",fertility_prob_);
+  writer.add_vector(prefix + "max_lengths",max_lengths);
+  writer.add_nested(prefix + "best_known_alignment",best_known_alignment_);
+}
+
+void FertilityModelTrainer::read_fertility_checkpoint(const Checkpoint& checkpoint, std::string prefix, bool model_only) {
+
+  checkpoint.get_nested(prefix + "fertility_prob",fertility_prob_);
+
+  if (model_only) {
+
+    Math1D::Vector<uint> max_lengths;
+    checkpoint.get_vector(prefix + "max_lengths",max_lengths);
+
+    if (max_lengths.size() != 2 || max_lengths[0] == 0 || max_lengths[1] == 0 || fertility_prob_.size() != nTargetWords_) {
+      USER_ERROR << "the checkpoint is corrupt. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    maxJ_ = max_lengths[0];
+    maxI_ = max_lengths[1];
+    combinatorics_.resize(maxJ_);
+    return;
+  }
+
+  checkpoint.get_nested(prefix + "best_known_alignment",best_known_alignment_);
+
+  bool match = (best_known_alignment_.size() == source_sentence_.size());
+  for (size_t s=0; match && s < source_sentence_.size(); s++)
+    match = (best_known_alignment_[s].size() == source_sentence_[s].size());
+
+  if (!match || fertility_prob_.size() != nTargetWords_) {
+    USER_ERROR << "the checkpoint does not match the corpus. Exiting..." << std::endl;
+    exit(1);
+  }
+}
+
 double FertilityModelTrainer::AER() {
 
   double sum_aer = 0.0;
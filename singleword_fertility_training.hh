@@ -8,16 +8,35 @@
 #include "mttypes.hh"
 #include "vector.hh"
 #include "tensor.hh"
+#include "checkpoint.hh"
+#include "combinatoric.hh"
 
 #include <map>
 #include <set>
+#include <vector>
+
+//changes of the model made by prepare_external_alignment() (of IBM3Trainer or IBM4Trainer) while they are recorded.
+// The old values are kept, so that the changes can be taken back
+struct ExternalModelChanges {
+
+  ExternalModelChanges();
+
+  //(target word, index in its list of cooccuring words) and the value before the change, in the order of the changes
+  std::vector<std::pair<std::pair<uint,uint>,double> > dict_entry_;
+
+  //fertility probabilities of the target words before their first change
+  std::map<uint,Math1D::Vector<double> > fertility_;
+
+  //true if the probability of the empty word was changed, which affects all sentence pairs
+  bool global_;
+};
 
 class FertilityModelTrainer {
 public:
 
-  FertilityModelTrainer(const Storage1D<Storage1D<uint> >& source_sentence,
+  FertilityModelTrainer(const Corpus& source_sentence,
                         const LookupTable& slookup,
-                        const Storage1D<Storage1D<uint> >& target_sentence,
+                        const Corpus& target_sentence,
                         SingleWordDictionary& dict,
                         const CooccuringWordsType& wcooc,
                         uint nSourceWords, uint nTargetWords,
@@ -41,10 +60,37 @@ public:
 
   void set_fertility_limit(uint new_limit);
 
+  //number of threads used in the E-steps
+  void set_nthreads(uint nThreads);
+
+  //if true (default), the E-steps visit the sentence pairs grouped by length (see SentenceSchedule)
+  void set_sort_by_length(bool sort_by_length);
+
+  //if nonzero, the E-steps stream through the corpus in chunks of this many sentence pairs per thread
+  void set_stream_chunk_size(size_t chunk_size);
+
   void write_fertilities(std::string filename);
 
+  //the changes of the model recorded since record_model_changes() was called
+  const ExternalModelChanges& recorded_changes() const;
+
 protected:
 
+  //for prepare_external_alignment(): sets an entry of the dictionary, the old value is recorded if requested
+  void set_dict_entry(uint t, uint k, double value);
+
+  //for prepare_external_alignment(): records the fertility probabilities of the target word before they are changed
+  void save_fertilities(uint t);
+
+  //takes back the recorded changes of the dictionary and the fertility probabilities and stops the recording
+  void restore_dict_and_fertilities();
+
+  //fertilities, maximal lengths and best known alignments, the entry names start with the given prefix
+  void write_fertility_checkpoint(CheckpointWriter& writer, std::string prefix) const;
+
+  //with model_only the trainer has no corpus: the alignments are skipped and the maximal lengths are read
+  void read_fertility_checkpoint(const Checkpoint& checkpoint, std::string prefix, bool model_only);
+
   void print_uncovered_set(uint state) const;
 
   uint nUncoveredPositions(uint state) const;
@@ -78,9 +124,9 @@ protected:
   NamedStorage1D<Math2D::Matrix<uint> > predecessor_coverage_states_;
   
 
-  const Storage1D<Storage1D<uint> >& source_sentence_;
+  const Corpus& source_sentence_;
   const LookupTable& slookup_;
-  const Storage1D<Storage1D<uint> >& target_sentence_;
+  const Corpus& target_sentence_;
 
   const CooccuringWordsType& wcooc_;
   SingleWordDictionary& dict_;
@@ -93,12 +139,23 @@ protected:
 
   uint fertility_limit_;
 
+  uint nThreads_;
+
+  bool sort_by_length_;
+  size_t stream_chunk_size_;
+
+  //factorials and binomial coefficients up to maxJ_
+  CombinatoricTable combinatorics_;
+
   NamedStorage1D<Math1D::Vector<double> > fertility_prob_;
 
   NamedStorage1D<Math1D::Vector<AlignBaseType> > best_known_alignment_;
 
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > sure_ref_alignments_;
   std::map<uint,std::set<std::pair<AlignBaseType,AlignBaseType> > > possible_ref_alignments_;
+
+  bool record_changes_;
+  ExternalModelChanges model_changes_;
 };
 
 #endif
@@ -0,0 +1,50 @@
+#!/bin/sh
+# a binary corpus with a truncated or corrupt header has to be rejected with an error
+# instead of being read past the end of the mapping. Run from the main directory after make.
+
+tmp=`mktemp -d`
+trap 'rm -rf "$tmp"' EXIT
+
+printf '3 4 5\n6 7\n8\n' > $tmp/s.idx
+printf '3 4\n5 6 7\n8 9\n' > $tmp/t.idx
+./plain2indices.opt.L64 -i $tmp/s.idx -o $tmp/s.bin -binary > /dev/null || exit 1
+
+failed=0
+
+# expects that the aligner refuses the given source corpus with the given message
+expect_rejected() {
+  ./regaligner_swb.opt.L64 -s $1 -t $tmp/t.idx -ibm1-iter 1 -hmm-iter 0 -oa $tmp/a.txt > $tmp/log.txt 2>&1
+  if [ $? -eq 0 ] || ! grep -q "$2" $tmp/log.txt; then
+    echo "FAILED: $3"
+    failed=1
+  fi
+}
+
+# sets a single byte of the file
+set_byte() {
+  printf "$3" | dd of=$1 bs=1 seek=$2 conv=notrunc 2> /dev/null
+}
+
+./regaligner_swb.opt.L64 -s $tmp/s.bin -t $tmp/t.idx -ibm1-iter 1 -hmm-iter 0 -oa $tmp/a.txt > $tmp/log.txt 2>&1
+if [ $? -ne 0 ]; then
+  echo "FAILED: intact binary corpus"
+  failed=1
+fi
+
+head -c 30 $tmp/s.bin > $tmp/truncated.bin
+expect_rejected $tmp/truncated.bin "truncated or corrupt" "truncated header"
+
+# number of sentences + 2^61: the size of the offsets wraps to the size of the intact file
+cp $tmp/s.bin $tmp/sentences.bin
+set_byte $tmp/sentences.bin 15 '\040'
+expect_rejected $tmp/sentences.bin "truncated or corrupt" "wrapping number of sentences"
+
+# number of words + 2^62: the size of the words wraps to the size of the intact file
+cp $tmp/s.bin $tmp/words.bin
+set_byte $tmp/words.bin 23 '\100'
+expect_rejected $tmp/words.bin "truncated or corrupt" "wrapping number of words"
+
+if [ $failed -eq 0 ]; then
+  echo "binary corpus headers: passed"
+fi
+exit $failed
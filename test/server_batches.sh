@@ -0,0 +1,57 @@
+#!/bin/sh
+# the server has to answer a request with the model of the checkpoint, no matter which requests came before
+# and how they were grouped into batches. Run from the main directory after make.
+
+tmp=`mktemp -d`
+trap 'rm -rf "$tmp"' EXIT
+
+# a small random corpus. The requests contain lengths and word pairs that the training has not seen
+awk 'BEGIN { srand(7);
+             for (n=0; n < 400; n++) {
+               line = ""; J = 1 + int(rand()*9);
+               for (j=0; j < J; j++) line = line " " (1 + int(rand()*60));
+               print substr(line,2) > "'$tmp'/s.idx";
+               line = ""; I = 1 + int(rand()*9);
+               for (i=0; i < I; i++) line = line " " (1 + int(rand()*60));
+               print substr(line,2) > "'$tmp'/t.idx";
+             } }'
+awk 'BEGIN { srand(11);
+             for (n=0; n < 100; n++) {
+               line = ""; J = 1 + int(rand()*16);
+               for (j=0; j < J; j++) line = line " " (1 + int(rand()*60));
+               line = line " |||"; I = 1 + int(rand()*16);
+               for (i=0; i < I; i++) line = line " " (1 + int(rand()*60));
+               print substr(line,2);
+             } }' > $tmp/others.txt
+
+./regaligner_swb.opt.L64 -s $tmp/s.idx -t $tmp/t.idx -ibm1-iter 2 -hmm-iter 2 -ibm3-iter 1 -ibm4-iter 1 \
+  -checkpoint $tmp/ck -oa $tmp/a.txt > $tmp/log.txt 2>&1 || { echo "FAILED: training"; exit 1; }
+
+failed=0
+
+for model in ibm3 ibm4; do
+
+  # every request on its own, with a fresh server
+  rm -f $tmp/alone.txt
+  while read request; do
+    echo "$request" | ./regaligner_server.opt.L64 -model $tmp/ck.$model.ckpt >> $tmp/alone.txt 2> /dev/null
+  done < $tmp/others.txt
+
+  # the first request is aligned again after all others
+  head -n 1 $tmp/others.txt | cat $tmp/others.txt - > $tmp/requests.txt
+  head -n 1 $tmp/alone.txt | cat $tmp/alone.txt - > $tmp/expected.txt
+
+  for batch_size in 1 16 1000; do
+    ./regaligner_server.opt.L64 -model $tmp/ck.$model.ckpt -threads 2 -batch-size $batch_size \
+      < $tmp/requests.txt > $tmp/answers.txt 2> /dev/null
+    if ! cmp -s $tmp/answers.txt $tmp/expected.txt; then
+      echo "FAILED: $model with batch size $batch_size"
+      failed=1
+    fi
+  done
+done
+
+if [ $failed -eq 0 ]; then
+  echo "server batches: passed"
+fi
+exit $failed
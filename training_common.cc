@@ -6,109 +6,317 @@
 #include <set>
 #include <map>
 #include <algorithm>
+#include <queue>
+#include <functional>
+#include <cstdio>
 
 #ifdef HAS_GZSTREAM
 #include "gzstream.h"
 #endif
 
-void find_cooccuring_words(const Storage1D<Storage1D<uint> >& source, 
-                           const Storage1D<Storage1D<uint> >& target,
+void find_cooccuring_words(const Corpus& source, 
+                           const Corpus& target,
                            uint nSourceWords, uint nTargetWords,
-                           CooccuringWordsType& cooc) {
+                           CooccuringWordsType& cooc, uint nThreads, size_t max_bytes) {
   
-  Storage1D<Storage1D<uint> > additional_source;
-  Storage1D<Storage1D<uint> > additional_target;
+  Corpus additional_source;
+  Corpus additional_target;
 
-  find_cooccuring_words(source,target,additional_source,additional_target,nSourceWords,nTargetWords,cooc);
+  find_cooccuring_words(source,target,additional_source,additional_target,nSourceWords,nTargetWords,cooc,
+                        nThreads,max_bytes);
 }
 
+typedef std::pair<uint,uint> CoocPair;
 
-void find_cooccuring_words(const Storage1D<Storage1D<uint> >& source, 
-                           const Storage1D<Storage1D<uint> >& target,
-                           const Storage1D<Storage1D<uint> >& additional_source, 
-                           const Storage1D<Storage1D<uint> >& additional_target,
-                           uint nSourceWords, uint nTargetWords,
-                           CooccuringWordsType& cooc) {
+namespace {
 
-  NamedStorage1D<std::set<uint> > coocset(nTargetWords,MAKENAME(coocset));
+//a sorted sequence of (target word, source word) pairs, held either in memory or in a temporary file
+class CoocRun {
+public:
 
-  const uint nSentences = source.size();
+  CoocRun(const std::vector<CoocPair>& pairs) : pos_(0), end_(pairs.size()), pairs_(&pairs), file_(0) {}
+
+  CoocRun(FILE* file, size_t size) : pos_(0), end_(size), pairs_(0), file_(file) {
+    rewind(file_);
+  }
+
+  //returns false if the run is exhausted
+  bool next(CoocPair& pair) {
+
+    if (pos_ >= end_)
+      return false;
+
+    if (pairs_ != 0)
+      pair = (*pairs_)[pos_];
+    else if (fread(&pair,sizeof(CoocPair),1,file_) != 1) {
+      IO_ERROR << "could not read back temporary cooccurrence file. Exiting..." << std::endl;
+      exit(1);
+    }
+
+    pos_++;
+    return true;
+  }
+
+protected:
+  size_t pos_;
+  size_t end_;
+  const std::vector<CoocPair>* pairs_;
+  FILE* file_;
+};
+
+//sorts the pairs and removes duplicates
+void sort_and_unique(std::vector<CoocPair>& pairs) {
+
+  std::sort(pairs.begin(),pairs.end());
+  pairs.erase(std::unique(pairs.begin(),pairs.end()),pairs.end());
+}
+
+//merges the runs in the temporary files from position first on into a single new temporary file, removing duplicates.
+// The input files are closed and replaced by the merged one
+void merge_cooc_files(std::vector<FILE*>& files, std::vector<size_t>& sizes, size_t first) {
+
+  std::vector<CoocRun> run;
+  for (size_t k=first; k < files.size(); k++)
+    run.push_back(CoocRun(files[k],sizes[k]));
+
+  std::priority_queue<std::pair<CoocPair,uint>,std::vector<std::pair<CoocPair,uint> >,
+                      std::greater<std::pair<CoocPair,uint> > > heads;
+
+  for (uint r=0; r < run.size(); r++) {
+    CoocPair pair;
+    if (run[r].next(pair))
+      heads.push(std::make_pair(pair,r));
+  }
+
+  FILE* merged_file = tmpfile();
+  if (merged_file == 0) {
+    IO_ERROR << "could not write temporary cooccurrence file. Exiting..." << std::endl;
+    exit(1);
+  }
+
+  size_t merged_size = 0;
+  std::vector<CoocPair> buffer;
+  buffer.reserve(4096);
+
+  CoocPair last_pair;
+
+  while (!heads.empty()) {
+
+    const CoocPair pair = heads.top().first;
+    const uint r = heads.top().second;
+    heads.pop();
+
+    CoocPair next_pair;
+    if (run[r].next(next_pair))
+      heads.push(std::make_pair(next_pair,r));
+
+    if (merged_size + buffer.size() > 0 && pair == last_pair)
+      continue;
+
+    last_pair = pair;
+    buffer.push_back(pair);
+
+    if (buffer.size() == 4096) {
+      if (fwrite(&(buffer[0]),sizeof(CoocPair),buffer.size(),merged_file) != buffer.size()) {
+        IO_ERROR << "could not write temporary cooccurrence file. Exiting..." << std::endl;
+        exit(1);
+      }
+      merged_size += buffer.size();
+      buffer.clear();
+    }
+  }
+
+  if (!buffer.empty()) {
+    if (fwrite(&(buffer[0]),sizeof(CoocPair),buffer.size(),merged_file) != buffer.size()) {
+      IO_ERROR << "could not write temporary cooccurrence file. Exiting..." << std::endl;
+      exit(1);
+    }
+    merged_size += buffer.size();
+  }
+
+  for (size_t k=first; k < files.size(); k++)
+    fclose(files[k]);
+
+  files.resize(first);
+  sizes.resize(first);
+  files.push_back(merged_file);
+  sizes.push_back(merged_size);
+}
+
+} //end of anonymous namespace
+
+void find_cooccuring_words(const Corpus& source, 
+                           const Corpus& target,
+                           const Corpus& additional_source, 
+                           const Corpus& additional_target,
+                           uint nSourceWords, uint nTargetWords,
+                           CooccuringWordsType& cooc, uint nThreads, size_t max_bytes) {
+
+  const size_t nSentences = source.size();
   assert(nSentences == target.size());
 
-  cooc.resize_dirty(nTargetWords);
+  const size_t nAddSentences = additional_source.size();
+  assert(nAddSentences == additional_target.size());
 
-  for (uint s=0; s < nSentences; s++) {
+  const size_t nTotalSentences = nSentences + nAddSentences;
 
-    if ((s%10000) == 0)
-      std::cerr << "sentence pair number " << s << std::endl;
-    
-    const uint curJ = source[s].size();
-    const uint curI = target[s].size();
+  nThreads = std::max<uint>(1,nThreads);
+
+  //each thread collects pairs in its own buffer. If a buffer is still large after sorting and removing duplicates,
+  // it is written to a temporary file. The minimal buffer size keeps the number of these files moderate
+  const size_t max_pairs = std::max<size_t>(65536,max_bytes / (sizeof(CoocPair) * nThreads));
+
+  //to bound the number of open files, the files of a thread are merged by level: whenever it has this many files
+  // of the same level, they are merged into one of the next level. Each pair is then rewritten only once per level
+  // and a thread keeps less than this many files open per level
+  const size_t merge_fan_in = std::max<size_t>(4,256 / nThreads);
+
+  Storage1D<std::vector<CoocPair> > pairs(nThreads);
+  Storage1D<std::vector<FILE*> > spill_file(nThreads);
+  Storage1D<std::vector<size_t> > spill_size(nThreads);
+  Storage1D<std::vector<uint> > spill_level(nThreads);
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+#pragma omp parallel for schedule(static,1) num_threads(nThreads)
+  for (int t=0; t < int(nThreads); t++) {
 
-    std::set<uint> source_set;
-    for (uint j=0; j < curJ; j++) {
-      source_set.insert(cur_source[j]);
+    std::vector<CoocPair>& cur_pairs = pairs[t];
+
+    const size_t start_s = nTotalSentences*t/nThreads;
+    const size_t end_s = nTotalSentences*(t+1)/nThreads;
+
+    //the buffer is never grown beyond max_pairs (except for single sentences with more pairs),
+    // so it is reserved right away unless the sentences of the thread have fewer pairs
+    size_t max_thread_pairs = 0;
+    for (size_t s = start_s; s < end_s && max_thread_pairs < max_pairs; s++) {
+      const SentenceView cur_source = (s < nSentences) ? source[s] : additional_source[s-nSentences];
+      const SentenceView cur_target = (s < nSentences) ? target[s] : additional_target[s-nSentences];
+      max_thread_pairs += size_t(cur_source.size()) * cur_target.size();
     }
+    cur_pairs.reserve(std::min(max_pairs,max_thread_pairs));
 
-    //iterating over a vector is faster than iterating over a set -> copy
     std::vector<uint> source_words;
-    for (std::set<uint>::iterator it = source_set.begin(); it != source_set.end(); it++)
-      source_words.push_back(*it);
-    
+    std::vector<uint> target_words;
+
+    for (size_t s = start_s; s < end_s; s++) {
+
+      const SentenceView cur_source = (s < nSentences) ? source[s] : additional_source[s-nSentences];
+      const SentenceView cur_target = (s < nSentences) ? target[s] : additional_target[s-nSentences];
+
+      source_words.assign(cur_source.direct_access(),cur_source.direct_access()+cur_source.size());
+      std::sort(source_words.begin(),source_words.end());
+      source_words.erase(std::unique(source_words.begin(),source_words.end()),source_words.end());
+
+      target_words.assign(cur_target.direct_access(),cur_target.direct_access()+cur_target.size());
+      std::sort(target_words.begin(),target_words.end());
+      target_words.erase(std::unique(target_words.begin(),target_words.end()),target_words.end());
 
-    for (uint i=0; i < curI; i++) {
-      uint t_idx = cur_target[i]; 
-      assert(t_idx < nTargetWords);
+      const size_t nSentencePairs = target_words.size() * source_words.size();
 
-      std::set<uint>& cur_set = coocset[t_idx];
+      if (!cur_pairs.empty() && cur_pairs.size() + nSentencePairs > max_pairs) {
 
-      const uint nWords = source_words.size();
-      for (uint k=0; k < nWords; k++)
-        cur_set.insert(source_words[k]);
+        sort_and_unique(cur_pairs);
+
+        if (cur_pairs.size() >= max_pairs / 2 || cur_pairs.size() + nSentencePairs > max_pairs) {
+
+          FILE* file = tmpfile();
+          if (file == 0 || fwrite(&(cur_pairs[0]),sizeof(CoocPair),cur_pairs.size(),file) != cur_pairs.size()) {
+            IO_ERROR << "could not write temporary cooccurrence file. Exiting..." << std::endl;
+            exit(1);
+          }
+
+          spill_file[t].push_back(file);
+          spill_size[t].push_back(cur_pairs.size());
+          spill_level[t].push_back(0);
+          cur_pairs.clear();
+
+          //the levels are non-increasing along the files, so equal levels are always at the end
+          while (spill_level[t].size() >= merge_fan_in) {
+
+            const size_t first = spill_level[t].size() - merge_fan_in;
+            const uint level = spill_level[t].back();
+            if (spill_level[t][first] != level)
+              break;
+
+            merge_cooc_files(spill_file[t],spill_size[t],first);
+            spill_level[t].resize(first);
+            spill_level[t].push_back(level+1);
+          }
+        }
+      }
+
+      for (uint i=0; i < target_words.size(); i++) {
+        const uint t_idx = target_words[i];
+        assert(t_idx < nTargetWords);
+
+        for (uint k=0; k < source_words.size(); k++) {
+          assert(source_words[k] < nSourceWords);
+          cur_pairs.push_back(CoocPair(t_idx,source_words[k]));
+        }
+      }
     }
+
+    sort_and_unique(cur_pairs);
   }
 
-  const uint nAddSentences = additional_source.size();
-  assert(nAddSentences == additional_target.size());
+  /*** merge the sorted runs ***/
 
-  for (uint s=0; s < nAddSentences; s++) {
+  std::vector<CoocRun> run;
+  for (uint t=0; t < nThreads; t++) {
+    run.push_back(CoocRun(pairs[t]));
+    for (uint k=0; k < spill_file[t].size(); k++)
+      run.push_back(CoocRun(spill_file[t][k],spill_size[t][k]));
+  }
 
-    if ((s%10000) == 0)
-      std::cerr << "sentence pair number " << s << std::endl;
-    
-    const uint nCurSourceWords = additional_source[s].size();
-    const uint nCurTargetWords = additional_target[s].size();
+  //holds the current head of each run
+  std::priority_queue<std::pair<CoocPair,uint>,std::vector<std::pair<CoocPair,uint> >,
+                      std::greater<std::pair<CoocPair,uint> > > heads;
 
-    const Storage1D<uint>& cur_source = additional_source[s];
-    const Storage1D<uint>& cur_target = additional_target[s];
+  for (uint r=0; r < run.size(); r++) {
+    CoocPair pair;
+    if (run[r].next(pair))
+      heads.push(std::make_pair(pair,r));
+  }
 
-    for (uint i=0; i < nCurTargetWords; i++) {
-      uint t_idx = cur_target[i]; 
-      assert(t_idx < nTargetWords);
+  cooc.resize_dirty(nTargetWords);
 
-      std::set<uint>& cur_set = coocset[t_idx];
+  uint next_target = 0;
+  std::vector<uint> cur_cooc;
 
-      for (uint j=0; j < nCurSourceWords; j++) {
-        uint s_idx = cur_source[j]; 
-        assert(s_idx < nSourceWords);
-	
-        cur_set.insert(s_idx);
+  while (!heads.empty()) {
+
+    const CoocPair pair = heads.top().first;
+    const uint r = heads.top().second;
+    heads.pop();
+
+    CoocPair next_pair;
+    if (run[r].next(next_pair))
+      heads.push(std::make_pair(next_pair,r));
+
+    if (pair.first != next_target) {
+
+      //finish the current target word, those in between have no cooccurences
+      for (; next_target < pair.first; next_target++) {
+        cooc[next_target].resize_dirty(cur_cooc.size());
+        for (uint k=0; k < cur_cooc.size(); k++)
+          cooc[next_target][k] = cur_cooc[k];
+        cur_cooc.clear();
       }
     }
+
+    if (cur_cooc.empty() || cur_cooc.back() != pair.second)
+      cur_cooc.push_back(pair.second);
   }
 
-  for (uint i=0; i < nTargetWords; i++) {
-    
-    const uint size = coocset[i].size();
-    cooc[i].resize_dirty(size);
-    uint j=0;
-    for (std::set<uint>::iterator it = coocset[i].begin(); it != coocset[i].end(); it++, j++)
-      cooc[i][j] = *it;
-    
-    coocset[i].clear();
+  for (; next_target < nTargetWords; next_target++) {
+    cooc[next_target].resize_dirty(cur_cooc.size());
+    for (uint k=0; k < cur_cooc.size(); k++)
+      cooc[next_target][k] = cur_cooc[k];
+    cur_cooc.clear();
+  }
+
+  for (uint t=0; t < nThreads; t++) {
+    for (uint k=0; k < spill_file[t].size(); k++)
+      fclose(spill_file[t][k]);
   }
 
   uint max_cooc = 0;
@@ -195,7 +403,7 @@ bool read_cooccuring_words_structure(std::string filename, uint nSourceWords, ui
 }
 
 
-void find_cooc_monolingual_pairs(const Storage1D<Storage1D<uint> >& sentence,
+void find_cooc_monolingual_pairs(const Corpus& sentence,
                                  uint voc_size, Storage1D<Storage1D<uint> >& cooc) {
 
 
@@ -210,7 +418,7 @@ void find_cooc_monolingual_pairs(const Storage1D<Storage1D<uint> >& sentence,
 
   for (uint s=0; s < nSentences; s++) {
 
-    const Storage1D<uint>& cur_sentence = sentence[s];
+    const SentenceView& cur_sentence = sentence[s];
 
     const uint curI = cur_sentence.size();
 
@@ -240,7 +448,7 @@ void find_cooc_monolingual_pairs(const Storage1D<Storage1D<uint> >& sentence,
     std::sort(cooc[k].direct_access(), cooc[k].direct_access() + cooc[k].size());
 }
 
-void monolingual_pairs_cooc_count(const Storage1D<Storage1D<uint> >& sentence,
+void monolingual_pairs_cooc_count(const Corpus& sentence,
                                   const Storage1D<Storage1D<uint> >&t_cooc, Storage1D<Storage1D<uint> >&t_cooc_count) {
 
   t_cooc_count.resize(t_cooc.size());
@@ -251,7 +459,7 @@ void monolingual_pairs_cooc_count(const Storage1D<Storage1D<uint> >& sentence,
 
   for (uint s=0; s < nSentences; s++) {
 
-    const Storage1D<uint>& cur_sentence = sentence[s];
+    const SentenceView& cur_sentence = sentence[s];
 
     const uint curI = cur_sentence.size();
 
@@ -274,8 +482,8 @@ void monolingual_pairs_cooc_count(const Storage1D<Storage1D<uint> >& sentence,
 
 
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              const Storage1D<Storage1D<uint> >& target_cooc,
                                              Storage1D<Storage1D<Storage1D<uint> > >& st_cooc) {
 
@@ -290,8 +498,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
     const uint curJ = source[s].size();
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1=0; i1 < curI; i1++) {
 
@@ -342,8 +550,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
 }
 
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              std::map<std::pair<uint,uint>, std::set<uint> >& cooc) {
 
 
@@ -358,8 +566,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
     const uint curJ = source[s].size();
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1 = 0; i1 <= curI; i1++) {
 
@@ -381,8 +589,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
 }
 
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              uint nSourceWords, uint nTargetWords,
                                              Storage1D<Storage1D<std::pair<uint,Storage1D<uint> > > >& cooc) {
 
@@ -399,8 +607,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
     const uint curJ = source[s].size();
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1 = 0; i1 <= curI; i1++) {
 
@@ -448,8 +656,8 @@ void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
 }
 
 
-void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                              const Storage1D<Storage1D<uint> >& target,
+void count_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                              const Corpus& target,
                                               std::map<std::pair<uint,uint>, std::map<uint,uint> >& cooc_count) {
 
 
@@ -464,8 +672,8 @@ void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
     const uint curJ = source[s].size();
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1 = 0; i1 <= curI; i1++) {
 
@@ -504,8 +712,8 @@ bool operator<(const std::pair<uint,uint>& x1, const std::pair<uint,uint>& x2) {
 }
 
 
-void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                              const Storage1D<Storage1D<uint> >& target,
+void count_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                              const Corpus& target,
                                               uint nSourceWords, uint nTargetWords,
                                               Storage1D<Storage1D<std::pair<uint,Storage1D<std::pair<uint,uint> > > > >& cooc) {
 
@@ -528,7 +736,7 @@ void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
 
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1 = 1; i1 <= curI; i1++) {
 
@@ -573,8 +781,8 @@ void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
     const uint curJ = source[s].size();
     const uint curI = target[s].size();
 
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
+    const SentenceView& cur_source = source[s];
+    const SentenceView& cur_target = target[s];
 
     for (uint i1 = 0; i1 <= curI; i1++) {
 
@@ -641,8 +849,8 @@ void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >&
 }
 
 
-void find_cooccuring_lengths(const Storage1D<Storage1D<uint> >& source, 
-                             const Storage1D<Storage1D<uint> >& target,
+void find_cooccuring_lengths(const Corpus& source, 
+                             const Corpus& target,
                              CooccuringLengthsType& cooc) {
 
   std::map<uint, std::set<uint> > coocvec;
@@ -670,164 +878,71 @@ void find_cooccuring_lengths(const Storage1D<Storage1D<uint> >& source,
   }
 }
 
-void generate_wordlookup(const Storage1D<Storage1D<uint> >& source, 
-                         const Storage1D<Storage1D<uint> >& target,
-                         const CooccuringWordsType& cooc, uint nSourceWords,
-                         LookupTable& slookup, uint max_size) {
+//for each position the first position holding the same word, MAX_UINT if it is the first occurrence itself
+static void find_first_occurrences(const SentenceView& sentence, Math1D::Vector<uint>& first_occ,
+                                   std::vector<std::pair<uint,uint> >& word_pos) {
 
-  const uint nSentences = source.size();
-  slookup.resize_dirty(nSentences);
+  const uint size = sentence.size();
 
-  for (uint s=0; s < nSentences; s++) {
-
-    const Storage1D<uint>& cur_source = source[s];
-    const Storage1D<uint>& cur_target = target[s];
-
-    const uint J = cur_source.size();
-    const uint I = cur_target.size();
+  word_pos.resize(size);
+  for (uint k=0; k < size; k++)
+    word_pos[k] = std::make_pair(sentence[k],k);
 
-    SingleLookupTable& cur_lookup = slookup[s];
+  std::sort(word_pos.begin(),word_pos.end());
 
-    if (J*I <= max_size) {
+  first_occ.resize_dirty(size);
 
-      cur_lookup.resize_dirty(J,I);
-    }
+  uint k=0;
+  while (k < size) {
 
-    //NOTE: even if we don't store the lookup table, we still check for consistency at this point
+    const uint word = word_pos[k].first;
+    const uint first = word_pos[k].second;
+    first_occ[first] = MAX_UINT;
 
-    Math1D::Vector<uint> s_prev_occ(J,MAX_UINT);
-    std::map<uint,uint> s_first_occ;
-    for (uint j=0; j < J; j++) {
-      
-      const uint sidx = cur_source[j];
-      assert(sidx > 0);
-
-      std::map<uint,uint>::iterator it = s_first_occ.find(sidx);
-      
-      if (it != s_first_occ.end())
-        s_prev_occ[j] = it->second;
-      else
-        s_first_occ[sidx] = j;
-    }
-
-    std::map<uint,uint> first_occ;
-
-    for (uint i=0; i < I; i++) {
-      uint tidx = cur_target[i];
-      
-      std::map<uint,uint>::iterator it = first_occ.find(tidx);
-      if (it != first_occ.end()) {
-        uint prev_i = it->second;
-
-        if (cur_lookup.size() > 0) {
-          for (uint j=0; j < J; j++) 
-            cur_lookup(j,i) = cur_lookup(j,prev_i);
-        }
-      }
-      else {
-        
-        first_occ[tidx] = i;
-
-        
-        const Math1D::Vector<uint>& cur_cooc = cooc[tidx];      
-        const size_t cur_size = cur_cooc.size();
-      
-        if (cur_size == nSourceWords-1) {
-          
-          if (cur_lookup.size() > 0) {
-          
-            for (uint j=0; j < J; j++) {
+    k++;
+    for (; k < size && word_pos[k].first == word; k++)
+      first_occ[word_pos[k].second] = first;
+  }
+}
 
-              const uint sidx = cur_source[j]-1;
-              cur_lookup(j,i) = sidx;
-            }
-          }
-        }
-        else {
+void compute_wordlookup(const SentenceView& source, const SentenceView& target,
+                        const CooccuringWordsType& cooc, uint nSourceWords,
+                        SingleLookupTable& table) {
 
-          const uint* start = cur_cooc.direct_access();
-          const uint* end = cur_cooc.direct_access()+cur_size;
-          
-          for (uint j=0; j < J; j++) {
-          
-            const uint sidx = cur_source[j];
-            
-            const uint prev_occ = s_prev_occ[j];
-            
-            if (prev_occ != MAX_UINT) {
-              if (cur_lookup.size() > 0)
-                cur_lookup(j,i) = cur_lookup(prev_occ,i);
-            }
-            else {
-              
-              const uint* ptr = std::lower_bound(start,end,sidx);
-              
-              if (ptr == end || (*ptr) != sidx) {
-                INTERNAL_ERROR << " word not found. Exiting." << std::endl;
-                exit(1);
-              }
-              
-              if (slookup[s].size() > 0) {
-                const uint idx = ptr - start;
-                assert(idx < cooc[tidx].size());
-                cur_lookup(j,i) = idx;
-              }
-            }
-          }
-        }
-      }
-    }
-  }
+  WordLookupBuffers buffers;
+  compute_wordlookup(source,target,cooc,nSourceWords,table,buffers);
 }
 
-const SingleLookupTable& get_wordlookup(const Storage1D<uint>& source, const Storage1D<uint>& target,
-                                        const CooccuringWordsType& cooc, uint nSourceWords,
-                                        const SingleLookupTable& lookup, SingleLookupTable& aux) {
+void compute_wordlookup(const SentenceView& source, const SentenceView& target,
+                        const CooccuringWordsType& cooc, uint nSourceWords,
+                        SingleLookupTable& table, WordLookupBuffers& buffers) {
 
   const uint J = source.size();
   const uint I = target.size();
 
-  if (lookup.xDim() == J && lookup.yDim() == I)
-    return lookup;
+  table.resize_dirty(J,I);
 
-  aux.resize_dirty(J,I);
+  Math1D::Vector<uint>& s_prev_occ = buffers.source_first_occ_;
+  find_first_occurrences(source,s_prev_occ,buffers.word_pos_);
 
-  std::map<uint,uint> first_occ;
+  Math1D::Vector<uint>& t_prev_occ = buffers.target_first_occ_;
+  find_first_occurrences(target,t_prev_occ,buffers.word_pos_);
 
+  for (uint i=0; i < I; i++) {
 
-  Math1D::Vector<uint> s_prev_occ(J,MAX_UINT);
-  std::map<uint,uint> s_first_occ;
-  for (uint j=0; j < J; j++) {
+    const uint prev_i = t_prev_occ[i];
 
-    uint sidx = source[j];
-    assert(sidx > 0);
+    if (prev_i != MAX_UINT) {
 
-    std::map<uint,uint>::iterator it = s_first_occ.find(sidx);
-    
-    if (it != s_first_occ.end())
-      s_prev_occ[j] = it->second;
-    else
-      s_first_occ[sidx] = j;
-  }
-  
-  for (uint i=0; i < I; i++) {
-    uint tidx = target[i];
-    
-    std::map<uint,uint>::iterator it = first_occ.find(tidx);
-    if (it != first_occ.end()) {
-      uint prev_i = it->second;
-      
       for (uint j=0; j < J; j++) 
-        aux(j,i) = aux(j,prev_i);
+        table(j,i) = table(j,prev_i);
     }
     else {
-      
-      first_occ[tidx] = i;
-      
+
+      const uint tidx = target[i];
+
       const Math1D::Vector<uint>& cur_cooc = cooc[tidx];
       const size_t cur_size = cur_cooc.size();
-      
-      double ratio = double(cur_size) / double(nSourceWords);
 
       const uint* start = cur_cooc.direct_access();
       const uint* end = cur_cooc.direct_access()+cur_size;
@@ -835,7 +950,7 @@ const SingleLookupTable& get_wordlookup(const Storage1D<uint>& source, const Sto
       if (cur_size == nSourceWords-1) {
 
         for (uint j=0; j < J; j++)
-          aux(j,i) = source[j]-1;
+          table(j,i) = source[j]-1;
       }
       else {
 
@@ -844,24 +959,24 @@ const SingleLookupTable& get_wordlookup(const Storage1D<uint>& source, const Sto
           const uint prev_occ = s_prev_occ[j];
           
           if (prev_occ != MAX_UINT) {
-            aux(j,i) = aux(prev_occ,i);
+            table(j,i) = table(prev_occ,i);
           }
           else {
 
             const uint sidx = source[j];
+            assert(sidx > 0);
             
             const uint* ptr;
 
             if (sidx-1 < cur_size) {
               
               const uint guess_idx = sidx-1;
-              //const uint guess_idx = floor((sidx-1)*ratio);
 
               const uint* guess = start+guess_idx;
               
               const uint p = *(guess);
               if (p == sidx) {
-                aux(j,i) = guess_idx;
+                table(j,i) = guess_idx;
                 continue;
               }
               else if (p < sidx)
@@ -872,21 +987,156 @@ const SingleLookupTable& get_wordlookup(const Storage1D<uint>& source, const Sto
             else
               ptr = std::lower_bound(start, end, sidx);
            
-#ifdef SAFE_MODE
             if (ptr == end || (*ptr) != sidx) {
               INTERNAL_ERROR << " word not found. Exiting." << std::endl;
               exit(1);
             }
-#endif
         
             const uint idx = ptr - start;
             assert(idx < cur_size);
-            aux(j,i) = idx;
+            table(j,i) = idx;
           }
         }
       }
     }
   }
+}
 
-  return aux;
+void generate_wordlookup(const Corpus& source, 
+                         const Corpus& target,
+                         const CooccuringWordsType& cooc, uint nSourceWords,
+                         LookupTable& slookup, size_t max_bytes) {
+
+  const size_t nSentences = source.size();
+  slookup.resize_dirty(nSentences);
+
+  size_t nBytes = 0;
+  size_t nStored = 0;
+
+  SingleLookupTable cur_lookup;
+  WordLookupBuffers buffers;
+
+  for (size_t s=0; s < nSentences; s++) {
+
+    //NOTE: even if we don't store the lookup table, we still check for consistency at this point
+    compute_wordlookup(source[s],target[s],cooc,nSourceWords,cur_lookup,buffers);
+
+    const size_t cur_bytes = CompactLookupTable::nBytes_needed(cur_lookup);
+    if (nBytes + cur_bytes <= max_bytes) {
+      slookup[s].set(cur_lookup);
+      nBytes += cur_bytes;
+      nStored++;
+    }
+  }
+
+  std::cerr << "stored lookup tables for " << nStored << " of " << nSentences << " sentences ("
+            << (nBytes / (1024.0*1024.0)) << " MB)" << std::endl;
+}
+
+const SingleLookupTable& get_wordlookup(const SentenceView& source, const SentenceView& target,
+                                        const CooccuringWordsType& cooc, uint nSourceWords,
+                                        const CompactLookupTable& lookup, WordLookupBuffers& aux) {
+
+  const uint J = source.size();
+  const uint I = target.size();
+
+  const SingleLookupTable& wide = lookup.wide();
+  if (wide.xDim() == J && wide.yDim() == I)
+    return wide;
+
+  if (lookup.is_narrow(J,I)) {
+
+    const Math2D::Matrix<ushort,ushort>& narrow = lookup.narrow();
+    SingleLookupTable& table = aux.table_;
+    table.resize_dirty(J,I);
+
+    const ushort* narrow_data = narrow.direct_access();
+    uint* table_data = table.direct_access();
+    const size_t size = size_t(J) * size_t(I);
+    for (size_t k=0; k < size; k++)
+      table_data[k] = narrow_data[k];
+
+    return table;
+  }
+
+  compute_wordlookup(source,target,cooc,nSourceWords,aux.table_,aux);
+
+  return aux.table_;
+}
+
+//compares sentence numbers by their (I,J) key, used with a stable sort
+class LengthKeyLess {
+public:
+
+  LengthKeyLess(const Storage1D<size_t>& key) : key_(key) {}
+
+  bool operator()(size_t s1, size_t s2) const {
+    return key_[s1] < key_[s2];
+  }
+
+protected:
+  const Storage1D<size_t>& key_;
+};
+
+SentenceSchedule::SentenceSchedule(const Corpus& source, const Corpus& target, uint nBlocks, bool sort_by_length,
+                                   size_t chunk_size)
+  : source_(source), target_(target), chunk_size_(chunk_size), order_(source.size()),
+    block_start_(std::max<uint>(1,nBlocks)+1) {
+
+  const size_t nSentences = source.size();
+  assert(nSentences == target.size());
+  nBlocks = std::max<uint>(1,nBlocks);
+
+  for (size_t s=0; s < nSentences; s++)
+    order_[s] = s;
+
+  if (!sort_by_length || chunk_size_ > 0) {
+    for (uint b=0; b <= nBlocks; b++)
+      block_start_[b] = (nSentences * b) / nBlocks;
+  }
+
+  if (!sort_by_length)
+    return;
+
+  size_t maxJ = 0;
+  for (size_t s=0; s < nSentences; s++)
+    maxJ = std::max(maxJ,source[s].size());
+
+  Storage1D<size_t> key(nSentences);
+  for (size_t s=0; s < nSentences; s++)
+    key[s] = target[s].size() * (maxJ+1) + source[s].size();
+
+  if (chunk_size_ > 0) {
+
+    //sorting within the chunks keeps the accesses to the corpus local
+    for (uint b=0; b < nBlocks; b++) {
+      for (size_t k=block_start_[b]; k < block_start_[b+1]; k += chunk_size_) {
+        const size_t chunk_end = std::min(k + chunk_size_, block_start_[b+1]);
+        std::stable_sort(order_.direct_access() + k, order_.direct_access() + chunk_end, LengthKeyLess(key));
+      }
+    }
+    return;
+  }
+
+  std::stable_sort(order_.direct_access(), order_.direct_access() + nSentences, LengthKeyLess(key));
+
+  //the cost of a pair is taken as (I+1)*J, the size of the tables in the E-steps
+  double total_cost = 0.0;
+  for (size_t s=0; s < nSentences; s++)
+    total_cost += (target[s].size() + 1.0) * source[s].size();
+
+  block_start_[0] = 0;
+  uint b = 1;
+  double cost = 0.0;
+  for (size_t k=0; k < nSentences && b < nBlocks; k++) {
+
+    const size_t s = order_[k];
+    cost += (target[s].size() + 1.0) * source[s].size();
+    while (b < nBlocks && cost >= (total_cost * b) / nBlocks) {
+      block_start_[b] = k+1;
+      b++;
+    }
+  }
+  for (; b <= nBlocks; b++)
+    block_start_[b] = nSentences;
 }
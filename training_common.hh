@@ -9,67 +9,155 @@
 #include <map>
 #include <set>
 
-void find_cooccuring_words(const Storage1D<Storage1D<uint> >& source, 
-                           const Storage1D<Storage1D<uint> >& target,
+void find_cooccuring_words(const Corpus& source, 
+                           const Corpus& target,
                            uint nSourceWords, uint nTargetWords,
-                           CooccuringWordsType& cooc);
-
-void find_cooccuring_words(const Storage1D<Storage1D<uint> >& source, 
-                           const Storage1D<Storage1D<uint> >& target,
-                           const Storage1D<Storage1D<uint> >& additional_source, 
-                           const Storage1D<Storage1D<uint> >& additional_target,
+                           CooccuringWordsType& cooc, uint nThreads = 1,
+                           size_t max_bytes = std::numeric_limits<size_t>::max());
+
+//the (target word, source word) pairs are collected in sorted buffers of at most max_bytes in total,
+// beyond that they are moved to temporary files
+void find_cooccuring_words(const Corpus& source, 
+                           const Corpus& target,
+                           const Corpus& additional_source, 
+                           const Corpus& additional_target,
                            uint nSourceWords, uint nTargetWords,
-                           CooccuringWordsType& cooc);
+                           CooccuringWordsType& cooc, uint nThreads = 1,
+                           size_t max_bytes = std::numeric_limits<size_t>::max());
 
 bool read_cooccuring_words_structure(std::string filename, uint nSourceWords, uint nTargetWords,
                                      CooccuringWordsType& cooc);
 
 
-void find_cooc_monolingual_pairs(const Storage1D<Storage1D<uint> >& sentence,
+void find_cooc_monolingual_pairs(const Corpus& sentence,
                                  uint voc_size, Storage1D<Storage1D<uint> >& cooc);
 
-void monolingual_pairs_cooc_count(const Storage1D<Storage1D<uint> >& sentence,
+void monolingual_pairs_cooc_count(const Corpus& sentence,
                                   const Storage1D<Storage1D<uint> >&t_cooc, Storage1D<Storage1D<uint> >&t_cooc_count);
 
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              std::map<std::pair<uint,uint>, std::set<uint> >& cooc);
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              uint nSourceWords, uint nTargetWords,
                                              Storage1D<Storage1D<std::pair<uint,Storage1D<uint> > > >& cooc);
 
-void find_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                             const Storage1D<Storage1D<uint> >& target,
+void find_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                             const Corpus& target,
                                              const Storage1D<Storage1D<uint> >& target_cooc,
                                              Storage1D<Storage1D<Storage1D<uint> > >& st_cooc);
 
 
-void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                              const Storage1D<Storage1D<uint> >& target,
+void count_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                              const Corpus& target,
                                               std::map<std::pair<uint,uint>, std::map<uint,uint> >& cooc_count);
 
 
-void count_cooc_target_pairs_and_source_words(const Storage1D<Storage1D<uint> >& source, 
-                                              const Storage1D<Storage1D<uint> >& target,
+void count_cooc_target_pairs_and_source_words(const Corpus& source, 
+                                              const Corpus& target,
                                               uint nSourceWords, uint nTargetWords,
                                               Storage1D<Storage1D<std::pair<uint,Storage1D<std::pair<uint,uint> > > > >& cooc);
 
 
 
-void find_cooccuring_lengths(const Storage1D<Storage1D<uint> >& source, 
-                             const Storage1D<Storage1D<uint> >& target,
+void find_cooccuring_lengths(const Corpus& source, 
+                             const Corpus& target,
                              CooccuringLengthsType& cooc);
 
-void generate_wordlookup(const Storage1D<Storage1D<uint> >& source, 
-                         const Storage1D<Storage1D<uint> >& target,
+//computes the full lookup table of a single sentence pair
+void compute_wordlookup(const SentenceView& source, const SentenceView& target,
+                        const CooccuringWordsType& cooc, uint nSourceWords,
+                        SingleLookupTable& table);
+
+//as above, but with the scratch vectors of the given buffers (their table_ is not touched)
+void compute_wordlookup(const SentenceView& source, const SentenceView& target,
+                        const CooccuringWordsType& cooc, uint nSourceWords,
+                        SingleLookupTable& table, WordLookupBuffers& buffers);
+
+//stores the lookup tables of all sentences, as long as the given memory budget (in bytes) permits
+void generate_wordlookup(const Corpus& source, 
+                         const Corpus& target,
                          const CooccuringWordsType& cooc, uint nSourceWords,
-                         LookupTable& slookup, uint max_size = MAX_UINT);
+                         LookupTable& slookup, size_t max_bytes = std::numeric_limits<size_t>::max());
 
-const SingleLookupTable& get_wordlookup(const Storage1D<uint>& source, const Storage1D<uint>& target,
+//returns the stored table if it is held with 32 bits, otherwise the table is expanded or computed in aux.table_
+const SingleLookupTable& get_wordlookup(const SentenceView& source, const SentenceView& target,
                                         const CooccuringWordsType& cooc, uint nSourceWords,
-                                        const SingleLookupTable& lookup, Math2D::Matrix<uint,ushort>& aux);
+                                        const CompactLookupTable& lookup, WordLookupBuffers& aux);
+
+//order in which the E-steps visit the sentence pairs, split into contiguous blocks for the threads.
+// With length sorting the pairs are grouped by target length and then by source length (ties keep the corpus order),
+// so that consecutive pairs use the same per-length parameters. The blocks then have about equal cost I*J.
+// Without sorting this is the corpus order, split into blocks with equally many pairs.
+// Everything indexed by the sentence number (e.g. the alignments) is unaffected by the order.
+//
+// For corpora that are mapped from disk a chunk size can be given (streaming mode): the blocks are then contiguous
+// ranges of the corpus that are traversed chunk by chunk, and sorting only takes place within a chunk.
+// Since the counts are then summed in a different order, the trained models depend on the chunk size.
+// Calling prefetch() for every position starts reading the next chunk while the current one is processed.
+class SentenceSchedule {
+public:
+
+  SentenceSchedule(const Corpus& source, const Corpus& target, uint nBlocks, bool sort_by_length,
+                   size_t chunk_size = 0);
+
+  uint nBlocks() const;
+
+  //the positions of block b are [block_start(b),block_end(b))
+  size_t block_start(uint b) const;
+
+  size_t block_end(uint b) const;
+
+  //sentence number at position k
+  size_t operator[](size_t k) const;
+
+  //to be called for each position k of block b before the sentence is processed
+  void prefetch(uint b, size_t k) const;
+
+protected:
+
+  const Corpus& source_;
+  const Corpus& target_;
+
+  size_t chunk_size_;
+
+  Storage1D<size_t> order_;
+  Storage1D<size_t> block_start_;
+};
+
+/************************ implementation **************************/
+
+inline uint SentenceSchedule::nBlocks() const {
+  return block_start_.size() - 1;
+}
+
+inline size_t SentenceSchedule::block_start(uint b) const {
+  return block_start_[b];
+}
+
+inline size_t SentenceSchedule::block_end(uint b) const {
+  return block_start_[b+1];
+}
+
+inline size_t SentenceSchedule::operator[](size_t k) const {
+  return order_[k];
+}
+
+inline void SentenceSchedule::prefetch(uint b, size_t k) const {
+
+  //in streaming mode the chunk at positions [k,k+chunk_size_) holds exactly the sentences with these numbers.
+  // At the start of the block the current chunk is requested as well
+  if (chunk_size_ > 0 && ((k - block_start_[b]) % chunk_size_) == 0) {
+    const size_t start = (k == block_start_[b]) ? k : k + chunk_size_;
+    const size_t end = std::min(k + 2*chunk_size_, block_start_[b+1]);
+    if (start < end) {
+      source_.prefetch(start,end);
+      target_.prefetch(start,end);
+    }
+  }
+}
 
 #endif